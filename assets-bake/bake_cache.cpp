@@ -0,0 +1,237 @@
+#include "bake_cache.hpp"
+
+#include <fstream>
+#include <sstream>
+#include <system_error>
+
+#include <cstdio>
+
+// zstd ships xxHash, use it header-only rather than through zstd's prefixed symbols
+#define XXH_INLINE_ALL
+#include "../third-party/zstd/src/common/xxhash.h"
+
+#include "../vkutils/error.hpp"
+
+namespace {
+    /*
+     * First line of every manifest. Manifests with a different header are
+     * ignored, which forces a full bake.
+     */
+    constexpr char kManifestHeader[] = "spicy-bake-manifest 1";
+
+    std::int64_t modification_time(const std::filesystem::path& path, std::error_code& errorCode) {
+        return static_cast<std::int64_t>(
+            std::filesystem::last_write_time(path, errorCode).time_since_epoch().count());
+    }
+
+    // Whether the file still has the recorded content
+    bool is_unchanged(const ManifestInput& input);
+}
+
+ContentHash hash_bytes(const void* data, const std::size_t bytes, const ContentHash seed) {
+    return XXH64(data, bytes, seed);
+}
+
+ContentHash hash_file(const std::filesystem::path& path) {
+    FILE* file = std::fopen(path.string().c_str(), "rb");
+    if (!file) {
+        throw vkutils::Error("hash_file(): unable to open '%s' for reading", path.string().c_str());
+    }
+
+    XXH64_state_t state;
+    XXH64_reset(&state, 0);
+
+    static constexpr std::size_t chunkSize = 1024 * 1024;
+    std::vector<char> chunk(chunkSize);
+    for (std::size_t read; (read = std::fread(chunk.data(), 1, chunk.size(), file)) > 0;) {
+        XXH64_update(&state, chunk.data(), read);
+    }
+
+    const bool failed = std::ferror(file);
+    std::fclose(file);
+
+    if (failed) {
+        throw vkutils::Error("hash_file(): error reading '%s'", path.string().c_str());
+    }
+
+    return XXH64_digest(&state);
+}
+
+BakeManifest::BakeManifest(const ContentHash settings) : mSettings(settings) {
+}
+
+std::optional<BakeManifest> BakeManifest::load(const std::filesystem::path& path) {
+    // Format, one record per line:
+    //   spicy-bake-manifest 1
+    //   settings <hash>
+    //   input <hash> <size> <modification time> <path>
+    //   texture <source hash> <kind> <uncompressed bytes> <compressed bytes> <path>
+    // Hashes are hexadecimal, paths extend to the end of the line.
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return {};
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != kManifestHeader) {
+        return {};
+    }
+
+    BakeManifest manifest;
+    while (std::getline(file, line)) {
+        std::istringstream record(line);
+
+        std::string type;
+        record >> type;
+
+        ManifestInput input;
+        ManifestTexture texture;
+        unsigned kind = 0;
+
+        if ("settings" == type) {
+            record >> std::hex >> manifest.mSettings;
+        } else if ("input" == type) {
+            record >> std::hex >> input.hash >> std::dec >> input.size >> input.modified;
+            std::getline(record >> std::ws, input.path);
+        } else if ("texture" == type) {
+            record >> std::hex >> texture.sourceHash >> std::dec >> kind
+                    >> texture.size.uncompressedBytes >> texture.size.compressedBytes;
+            std::getline(record >> std::ws, texture.path);
+            texture.kind = static_cast<TextureKind>(kind);
+        } else {
+            record.setstate(std::ios::failbit);
+        }
+
+        if (record.fail()) {
+            std::fprintf(stderr, "Note: ignoring malformed manifest '%s'\n", path.string().c_str());
+            return {};
+        }
+
+        if ("input" == type) {
+            manifest.mInputIndex[input.path] = manifest.mInputs.size();
+            manifest.mInputs.emplace_back(std::move(input));
+        } else if ("texture" == type) {
+            manifest.add_texture(std::move(texture));
+        }
+    }
+
+    return manifest;
+}
+
+void BakeManifest::save(const std::filesystem::path& path) const {
+    // Write to a temporary file first, an interrupted bake must not leave a
+    // truncated manifest behind
+    auto temporaryPath = path;
+    temporaryPath += ".tmp";
+
+    {
+        std::ofstream file(temporaryPath, std::ios::trunc);
+        if (!file.is_open()) {
+            throw vkutils::Error("Unable to open '%s' for writing", temporaryPath.string().c_str());
+        }
+
+        file << kManifestHeader << "\n";
+        file << "settings " << std::hex << mSettings << std::dec << "\n";
+
+        for (const auto& input : mInputs) {
+            file << "input " << std::hex << input.hash << std::dec << " " << input.size << " " << input.modified
+                    << " " << input.path << "\n";
+        }
+
+        for (const auto& texture : mTextures) {
+            file << "texture " << std::hex << texture.sourceHash << std::dec << " "
+                    << static_cast<unsigned>(texture.kind) << " " << texture.size.uncompressedBytes << " "
+                    << texture.size.compressedBytes << " " << texture.path << "\n";
+        }
+
+        if (!file.flush()) {
+            throw vkutils::Error("Unable to write '%s'", temporaryPath.string().c_str());
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path);
+}
+
+ContentHash BakeManifest::settings() const {
+    return mSettings;
+}
+
+const ManifestInput& BakeManifest::add_input(const std::filesystem::path& path, const BakeManifest* previous) {
+    ManifestInput input{
+        .path = path.string()
+    };
+
+    if (const auto it = mInputIndex.find(input.path); mInputIndex.end() != it) {
+        return mInputs[it->second];
+    }
+
+    std::error_code errorCode;
+    input.size = std::filesystem::file_size(path, errorCode);
+    input.modified = modification_time(path, errorCode);
+    if (errorCode) {
+        throw vkutils::Error("Unable to stat '%s': %s", input.path.c_str(), errorCode.message().c_str());
+    }
+
+    const ManifestInput* recorded = previous ? previous->find_input(input.path) : nullptr;
+    if (recorded && recorded->size == input.size && recorded->modified == input.modified) {
+        input.hash = recorded->hash;
+    } else {
+        input.hash = hash_file(path);
+    }
+
+    mInputIndex[input.path] = mInputs.size();
+    return mInputs.emplace_back(std::move(input));
+}
+
+void BakeManifest::add_texture(ManifestTexture texture) {
+    mTextureIndex[texture.path] = mTextures.size();
+    mTextures.emplace_back(std::move(texture));
+}
+
+const ManifestTexture* BakeManifest::find_texture(const std::string& path) const {
+    const auto it = mTextureIndex.find(path);
+    return mTextureIndex.end() != it ? &mTextures[it->second] : nullptr;
+}
+
+bool BakeManifest::inputs_unchanged(const std::vector<std::filesystem::path>& expected) const {
+    for (const auto& path : expected) {
+        if (!find_input(path.string())) {
+            return false;
+        }
+    }
+
+    for (const auto& input : mInputs) {
+        if (!is_unchanged(input)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+const std::vector<ManifestTexture>& BakeManifest::textures() const {
+    return mTextures;
+}
+
+const ManifestInput* BakeManifest::find_input(const std::string& path) const {
+    const auto it = mInputIndex.find(path);
+    return mInputIndex.end() != it ? &mInputs[it->second] : nullptr;
+}
+
+namespace {
+    bool is_unchanged(const ManifestInput& input) {
+        std::error_code errorCode;
+        const auto size = std::filesystem::file_size(input.path, errorCode);
+        const auto modified = modification_time(input.path, errorCode);
+        if (errorCode) {
+            return false;
+        }
+
+        if (size == input.size && modified == input.modified) {
+            return true;
+        }
+
+        // Touched (or copied) but possibly identical
+        return size == input.size && hash_file(input.path) == input.hash;
+    }
+}
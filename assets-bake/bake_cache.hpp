@@ -0,0 +1,84 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "texture_bake.hpp"
+
+/*
+ * Incremental baking. Next to every baked scene the baker keeps a manifest
+ * that records a content hash (XXH64) of every input the outputs were derived
+ * from: the compressed and uncompressed OBJ, the MTL files and the source
+ * textures, as well as a hash of the bake settings. A scene whose inputs and
+ * settings are unchanged is skipped, and a texture whose source is unchanged
+ * is not encoded again.
+ *
+ * Like git's index, the manifest also records the size and modification time
+ * of every input. Inputs whose size and time match are not hashed again, so
+ * an up to date scene costs one stat() per input.
+ */
+using ContentHash = std::uint64_t;
+
+ContentHash hash_bytes(const void* data, std::size_t bytes, ContentHash seed = 0);
+
+ContentHash hash_file(const std::filesystem::path&);
+
+struct ManifestInput {
+    std::string path;
+    std::uintmax_t size = 0;
+    std::int64_t modified = 0;
+    ContentHash hash = 0;
+};
+
+struct ManifestTexture {
+    // Baked texture, relative to the directory of the manifest
+    std::string path;
+    TextureKind kind;
+    ContentHash sourceHash = 0;
+    TextureBakeSize size;
+};
+
+class BakeManifest {
+public:
+    BakeManifest() = default;
+
+    explicit BakeManifest(ContentHash settings);
+
+    // Returns an empty optional if the manifest is missing or unreadable
+    static std::optional<BakeManifest> load(const std::filesystem::path&);
+
+    void save(const std::filesystem::path&) const;
+
+    ContentHash settings() const;
+
+    // Records the current state of the file. The hash of the previous
+    // manifest is reused if the file's size and modification time match.
+    const ManifestInput& add_input(const std::filesystem::path&, const BakeManifest* previous);
+
+    void add_texture(ManifestTexture);
+
+    const ManifestTexture* find_texture(const std::string& path) const;
+
+    // True if all of the given inputs and every input recorded in the
+    // manifest are unchanged, and no other inputs are recorded
+    bool inputs_unchanged(const std::vector<std::filesystem::path>& expected) const;
+
+    const std::vector<ManifestTexture>& textures() const;
+
+private:
+    const ManifestInput* find_input(const std::string& path) const;
+
+    ContentHash mSettings = 0;
+    std::vector<ManifestInput> mInputs;
+    std::vector<ManifestTexture> mTextures;
+
+    // Indices into mInputs and mTextures by path
+    std::map<std::string, std::size_t> mInputIndex;
+    std::map<std::string, std::size_t> mTextureIndex;
+};
@@ -0,0 +1,224 @@
+#include "bake_report.hpp"
+
+#include <atomic>
+#include <fstream>
+#include <utility>
+
+#include <cstdio>
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <windows.h>
+#   include <psapi.h>
+#elif defined(__APPLE__)
+#   include <mach/mach.h>
+#   include <sys/resource.h>
+#else
+#   include <sys/resource.h>
+#   include <unistd.h>
+#endif
+
+#include "../vkutils/error.hpp"
+
+namespace {
+    // Version of the report's layout, bump when fields change meaning or are removed
+    constexpr int kReportVersion = 2;
+
+    // Reports alive and ever created, to tell whether scenes overlapped
+    std::atomic<std::size_t> gLiveReports{0};
+    std::atomic<std::size_t> gStartedReports{0};
+
+    void write_string(std::ofstream& out, const std::string& string);
+
+    void write_number(std::ofstream& out, double number);
+
+    void write_cache_stats(std::ofstream& out, const VertexCacheStats& stats);
+}
+
+double MeshReport::vertex_reuse() const {
+    return vertices ? static_cast<double>(triangles * 3) / static_cast<double>(vertices) : 0.0;
+}
+
+BakeReport::BakeReport(std::string scene) : mScene(std::move(scene)), mStart(Clock::now()) {
+    mConcurrent = gLiveReports.fetch_add(1) > 0;
+    mStartedReports = gStartedReports.fetch_add(1) + 1;
+}
+
+BakeReport::~BakeReport() {
+    gLiveReports.fetch_sub(1);
+}
+
+void BakeReport::begin_stage(const char* name) {
+    end_stage();
+
+    mStage = name;
+    mStageStart = Clock::now();
+    mStageStartMemory = current_memory();
+}
+
+void BakeReport::end_stage() {
+    if (mStage.empty()) {
+        return;
+    }
+
+    mStages.emplace_back(StageReport{
+        .name = std::move(mStage),
+        .seconds = std::chrono::duration<double>(Clock::now() - mStageStart).count(),
+        .startMemory = mStageStartMemory,
+        .endMemory = current_memory()
+    });
+    mStage.clear();
+}
+
+void BakeReport::add_stage(const char* name, const double seconds) {
+    mStages.emplace_back(StageReport{
+        .name = name,
+        .seconds = seconds
+    });
+}
+
+void BakeReport::add_mesh(MeshReport mesh) {
+    mMeshes.emplace_back(std::move(mesh));
+}
+
+void BakeReport::save(const std::filesystem::path& path) const {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out.is_open()) {
+        throw vkutils::Error("Unable to open '%s' for writing", path.string().c_str());
+    }
+
+    out << "{\n  \"version\": " << kReportVersion << ",\n  \"scene\": ";
+    write_string(out, mScene);
+    out << ",\n  \"seconds\": ";
+    write_number(out, std::chrono::duration<double>(Clock::now() - mStart).count());
+    out << ",\n  \"peakMemory\": " << peak_memory();
+
+    // Another scene was in flight at some point if one was when this one
+    // started, one started since, or one is still going
+    const bool concurrent = mConcurrent || gStartedReports.load() != mStartedReports || gLiveReports.load() > 1;
+    out << ",\n  \"concurrentScenes\": " << (concurrent ? "true" : "false");
+
+    out << ",\n  \"stages\": [";
+    for (std::size_t i = 0; i < mStages.size(); ++i) {
+        const auto& stage = mStages[i];
+        out << (i ? ",\n    " : "\n    ") << "{\"name\": ";
+        write_string(out, stage.name);
+        out << ", \"seconds\": ";
+        write_number(out, stage.seconds);
+        out << ", \"startMemory\": " << stage.startMemory
+            << ", \"endMemory\": " << stage.endMemory << "}";
+    }
+    out << "\n  ]";
+
+    out << ",\n  \"meshes\": [";
+    for (std::size_t i = 0; i < mMeshes.size(); ++i) {
+        const auto& mesh = mMeshes[i];
+        out << (i ? ",\n    " : "\n    ") << "{\"name\": ";
+        write_string(out, mesh.name);
+        out << ", \"instances\": " << mesh.instances
+            << ", \"triangles\": " << mesh.triangles
+            << ", \"vertices\": " << mesh.vertices
+            << ", \"vertexReuse\": ";
+        write_number(out, mesh.vertex_reuse());
+        out << ", \"cacheBefore\": ";
+        write_cache_stats(out, mesh.cacheBefore);
+        out << ", \"cacheAfter\": ";
+        write_cache_stats(out, mesh.cacheAfter);
+        out << ", \"lods\": " << mesh.lods
+            << ", \"meshlets\": " << mesh.meshlets
+            << ", \"weldSeconds\": ";
+        write_number(out, mesh.weldSeconds);
+        out << ", \"tangentSeconds\": ";
+        write_number(out, mesh.tangentSeconds);
+        out << "}";
+    }
+    out << "\n  ]\n}\n";
+
+    if (!out.flush()) {
+        throw vkutils::Error("Unable to write '%s'", path.string().c_str());
+    }
+}
+
+std::size_t peak_memory() {
+#   if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#   else
+    rusage usage{};
+    if (0 != getrusage(RUSAGE_SELF, &usage)) {
+        return 0;
+    }
+#       if defined(__APPLE__)
+    return static_cast<std::size_t>(usage.ru_maxrss); // bytes
+#       else
+    return static_cast<std::size_t>(usage.ru_maxrss) * 1024; // kilobytes
+#       endif
+#   endif
+}
+
+std::size_t current_memory() {
+#   if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.WorkingSetSize;
+    }
+    return 0;
+#   elif defined(__APPLE__)
+    mach_task_basic_info info{};
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (KERN_SUCCESS != task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                                  reinterpret_cast<task_info_t>(&info), &count)) {
+        return 0;
+    }
+    return static_cast<std::size_t>(info.resident_size);
+#   else
+    // Second field of statm is the resident set size, in pages
+    std::FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (!statm) {
+        return 0;
+    }
+
+    unsigned long long size = 0, resident = 0;
+    const bool parsed = 2 == std::fscanf(statm, "%llu %llu", &size, &resident);
+    std::fclose(statm);
+
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    return parsed && pageSize > 0 ? static_cast<std::size_t>(resident) * static_cast<std::size_t>(pageSize) : 0;
+#   endif
+}
+
+namespace {
+    void write_string(std::ofstream& out, const std::string& string) {
+        out << '"';
+        for (const char c : string) {
+            if ('"' == c || '\\' == c) {
+                out << '\\' << c;
+            } else if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                out << escaped;
+            } else {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+
+    void write_number(std::ofstream& out, const double number) {
+        char formatted[32];
+        std::snprintf(formatted, sizeof(formatted), "%.6g", number);
+        out << formatted;
+    }
+
+    void write_cache_stats(std::ofstream& out, const VertexCacheStats& stats) {
+        out << "{\"acmr\": ";
+        write_number(out, stats.acmr());
+        out << ", \"atvr\": ";
+        write_number(out, stats.atvr());
+        out << "}";
+    }
+}
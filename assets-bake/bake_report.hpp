@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+
+#include "mesh_optimize.hpp"
+
+/*
+ * Machine-readable record of a scene's bake, written as JSON next to the
+ * baked scene (<scene>.bake-report.json) so that bake times and mesh quality
+ * can be tracked across bakes.
+ *
+ * Stages are timed on the wall clock. Their memory is the resident set size
+ * of the whole process when the stage started and ended, so it includes the
+ * other scenes in flight. Reports of scenes that overlapped another scene's
+ * bake are flagged as such ("concurrentScenes"). Scenes are baked one at a
+ * time with --max-memory, for memory figures that only cover their own scene.
+ */
+struct StageReport {
+    std::string name;
+    double seconds = 0.0;
+
+    // Resident set size at the start and end of the stage, 0 if unknown
+    std::size_t startMemory = 0;
+    std::size_t endMemory = 0;
+};
+
+struct MeshReport {
+    std::string name;
+    std::size_t instances = 0;
+
+    // Triangles and welded vertices of the full resolution level
+    std::size_t triangles = 0;
+    std::size_t vertices = 0;
+
+    VertexCacheStats cacheBefore, cacheAfter;
+
+    std::size_t lods = 0;
+    std::size_t meshlets = 0;
+
+    // Worker time spent welding the mesh, see IndexingTimes
+    double weldSeconds = 0.0;
+    double tangentSeconds = 0.0;
+
+    // Triangle soup vertices per welded vertex
+    double vertex_reuse() const;
+};
+
+class BakeReport {
+public:
+    explicit BakeReport(std::string scene);
+
+    ~BakeReport();
+
+    BakeReport(const BakeReport&) = delete;
+
+    BakeReport& operator=(const BakeReport&) = delete;
+
+    // Ends the current stage, if any, and starts timing the next one
+    void begin_stage(const char* name);
+
+    void end_stage();
+
+    // Records a stage timed elsewhere, e.g. on a background thread. Its memory is unknown.
+    void add_stage(const char* name, double seconds);
+
+    void add_mesh(MeshReport);
+
+    void save(const std::filesystem::path&) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::string mScene;
+    Clock::time_point mStart;
+
+    std::string mStage;
+    Clock::time_point mStageStart;
+    std::size_t mStageStartMemory = 0;
+
+    // Whether another scene was baking when this one started, and how many had started by then
+    bool mConcurrent = false;
+    std::size_t mStartedReports = 0;
+
+    std::vector<StageReport> mStages;
+    std::vector<MeshReport> mMeshes;
+};
+
+// Peak resident set size of the process, in bytes. 0 if unknown.
+std::size_t peak_memory();
+
+// Current resident set size of the process, in bytes. 0 if unknown.
+std::size_t current_memory();
@@ -0,0 +1,342 @@
+#include "block_compress.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+namespace {
+    // Picks the nearest palette entry for every value, returns the squared error
+    std::uint32_t fit_bc4_indices(
+        const std::array<std::uint8_t, kBlockTexels>& values,
+        const std::array<std::uint8_t, 8>& palette,
+        std::array<std::uint8_t, kBlockTexels>& indices
+    );
+
+    std::array<std::uint8_t, 8> bc4_palette(std::uint8_t red0, std::uint8_t red1);
+
+    // Mode 6 block before bit packing: 7-bit RGBA endpoints with one p-bit each
+    struct Bc7Mode6 {
+        std::uint32_t error = std::numeric_limits<std::uint32_t>::max();
+        std::array<glm::ivec4, 2> endpoints;
+        std::array<int, 2> pbits;
+        std::array<std::uint8_t, kBlockTexels> indices;
+    };
+
+    // Quantizes both endpoints for every p-bit combination and keeps the
+    // result in block if it beats the current one
+    void fit_bc7_mode6(
+        const std::array<glm::u8vec4, kBlockTexels>& texels,
+        const glm::vec4& endpoint0,
+        const glm::vec4& endpoint1,
+        Bc7Mode6& block
+    );
+
+    // Least squares endpoints for the indices of the block
+    bool refine_bc7_endpoints(
+        const std::array<glm::u8vec4, kBlockTexels>& texels,
+        const Bc7Mode6& block,
+        glm::vec4& endpoint0,
+        glm::vec4& endpoint1
+    );
+
+    class BitWriter {
+    public:
+        explicit BitWriter(std::uint8_t* bytes);
+
+        void write(std::uint32_t value, std::size_t bits);
+
+    private:
+        std::uint8_t* mBytes;
+        std::size_t mPosition = 0;
+    };
+
+    // 4-bit index interpolation weights, out of 64
+    constexpr std::array<int, 16> kBc7Weights{0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+}
+
+Bc4Block encode_bc4_block(const std::array<std::uint8_t, kBlockTexels>& values) {
+    const auto [minIt, maxIt] = std::minmax_element(values.begin(), values.end());
+
+    // 8 interpolated values between the extremes of the block
+    std::uint8_t red0 = *maxIt, red1 = *minIt;
+    std::array<std::uint8_t, kBlockTexels> indices;
+    std::uint32_t error = fit_bc4_indices(values, bc4_palette(red0, red1), indices);
+
+    // 6 interpolated values plus exact 0 and 255, better for blocks that
+    // contain either extreme (e.g. masks)
+    if (error > 0) {
+        std::uint8_t innerMin = 255, innerMax = 0;
+        for (const auto value : values) {
+            if (0 != value && 255 != value) {
+                innerMin = std::min(innerMin, value);
+                innerMax = std::max(innerMax, value);
+            }
+        }
+        if (innerMin > innerMax) {
+            innerMin = innerMax = 0;
+        }
+
+        std::array<std::uint8_t, kBlockTexels> extremeIndices;
+        const auto extremeError = fit_bc4_indices(values, bc4_palette(innerMin, innerMax), extremeIndices);
+        if (extremeError < error) {
+            red0 = innerMin;
+            red1 = innerMax;
+            indices = extremeIndices;
+        }
+    }
+
+    std::uint64_t bits = 0;
+    for (std::size_t i = 0; i < kBlockTexels; ++i) {
+        bits |= static_cast<std::uint64_t>(indices[i]) << (3 * i);
+    }
+
+    Bc4Block block{red0, red1};
+    for (std::size_t byte = 2; byte < block.size(); ++byte) {
+        block[byte] = static_cast<std::uint8_t>(bits >> (8 * (byte - 2)));
+    }
+
+    return block;
+}
+
+Bc5Block encode_bc5_block(const std::array<std::uint8_t, kBlockTexels>& red,
+                          const std::array<std::uint8_t, kBlockTexels>& green) {
+    const auto redBlock = encode_bc4_block(red);
+    const auto greenBlock = encode_bc4_block(green);
+
+    Bc5Block block;
+    std::copy(redBlock.begin(), redBlock.end(), block.begin());
+    std::copy(greenBlock.begin(), greenBlock.end(), block.begin() + redBlock.size());
+    return block;
+}
+
+Bc7Block encode_bc7_block(const std::array<glm::u8vec4, kBlockTexels>& texels) {
+    // Initial endpoints: extremes of the block along its principal axis
+    glm::vec4 mean(0.f), low(255.f), high(0.f);
+    for (const auto& texel : texels) {
+        mean += glm::vec4(texel);
+        low = glm::min(low, glm::vec4(texel));
+        high = glm::max(high, glm::vec4(texel));
+    }
+    mean /= static_cast<float>(kBlockTexels);
+
+    glm::mat4 covariance(0.f);
+    for (const auto& texel : texels) {
+        const auto delta = glm::vec4(texel) - mean;
+        covariance += glm::outerProduct(delta, delta);
+    }
+
+    glm::vec4 axis = high - low;
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        axis = covariance * axis;
+
+        const float scale = glm::max(glm::max(std::abs(axis.x), std::abs(axis.y)),
+                                     glm::max(std::abs(axis.z), std::abs(axis.w)));
+        if (scale <= 0.f) {
+            break;
+        }
+        axis /= scale;
+    }
+
+    glm::vec4 endpoint0 = mean, endpoint1 = mean;
+    if (const float length = glm::length(axis); length > 0.f) {
+        axis /= length;
+
+        float tMin = std::numeric_limits<float>::max(), tMax = std::numeric_limits<float>::lowest();
+        for (const auto& texel : texels) {
+            const float t = glm::dot(glm::vec4(texel) - mean, axis);
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+
+        endpoint0 = glm::clamp(mean + tMin * axis, 0.f, 255.f);
+        endpoint1 = glm::clamp(mean + tMax * axis, 0.f, 255.f);
+    }
+
+    Bc7Mode6 mode6;
+    fit_bc7_mode6(texels, endpoint0, endpoint1, mode6);
+
+    // The quantized endpoints rarely are the best ones for the chosen indices
+    for (int iteration = 0; iteration < 2 && mode6.error > 0; ++iteration) {
+        if (!refine_bc7_endpoints(texels, mode6, endpoint0, endpoint1)) {
+            break;
+        }
+        fit_bc7_mode6(texels, endpoint0, endpoint1, mode6);
+    }
+
+    // The most significant bit of the first (anchor) index is implicitly 0.
+    // Weights are symmetric, so swapping the endpoints and inverting the
+    // indices decodes to the same texels.
+    if (mode6.indices[0] >= 8) {
+        std::swap(mode6.endpoints[0], mode6.endpoints[1]);
+        std::swap(mode6.pbits[0], mode6.pbits[1]);
+        for (auto& index : mode6.indices) {
+            index = static_cast<std::uint8_t>(15 - index);
+        }
+    }
+
+    Bc7Block block{};
+    BitWriter writer(block.data());
+
+    writer.write(1u << 6, 7); // mode 6
+    for (glm::length_t channel = 0; channel < 4; ++channel) {
+        writer.write(static_cast<std::uint32_t>(mode6.endpoints[0][channel]), 7);
+        writer.write(static_cast<std::uint32_t>(mode6.endpoints[1][channel]), 7);
+    }
+    writer.write(static_cast<std::uint32_t>(mode6.pbits[0]), 1);
+    writer.write(static_cast<std::uint32_t>(mode6.pbits[1]), 1);
+
+    writer.write(mode6.indices[0], 3);
+    for (std::size_t i = 1; i < kBlockTexels; ++i) {
+        writer.write(mode6.indices[i], 4);
+    }
+
+    return block;
+}
+
+namespace {
+    std::array<std::uint8_t, 8> bc4_palette(const std::uint8_t red0, const std::uint8_t red1) {
+        std::array<std::uint8_t, 8> palette{red0, red1};
+
+        if (red0 > red1) {
+            for (int i = 2; i < 8; ++i) {
+                palette[i] = static_cast<std::uint8_t>(((8 - i) * red0 + (i - 1) * red1 + 3) / 7);
+            }
+        } else {
+            for (int i = 2; i < 6; ++i) {
+                palette[i] = static_cast<std::uint8_t>(((6 - i) * red0 + (i - 1) * red1 + 2) / 5);
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        return palette;
+    }
+
+    std::uint32_t fit_bc4_indices(const std::array<std::uint8_t, kBlockTexels>& values,
+                                  const std::array<std::uint8_t, 8>& palette,
+                                  std::array<std::uint8_t, kBlockTexels>& indices) {
+        std::uint32_t error = 0;
+
+        for (std::size_t i = 0; i < kBlockTexels; ++i) {
+            std::uint32_t bestError = std::numeric_limits<std::uint32_t>::max();
+            for (std::size_t p = 0; p < palette.size(); ++p) {
+                const int delta = static_cast<int>(values[i]) - static_cast<int>(palette[p]);
+                const auto squared = static_cast<std::uint32_t>(delta * delta);
+                if (squared < bestError) {
+                    bestError = squared;
+                    indices[i] = static_cast<std::uint8_t>(p);
+                }
+            }
+            error += bestError;
+        }
+
+        return error;
+    }
+}
+
+namespace {
+    void fit_bc7_mode6(const std::array<glm::u8vec4, kBlockTexels>& texels,
+                       const glm::vec4& endpoint0,
+                       const glm::vec4& endpoint1,
+                       Bc7Mode6& block) {
+        for (int pbit0 = 0; pbit0 < 2; ++pbit0) {
+            for (int pbit1 = 0; pbit1 < 2; ++pbit1) {
+                Bc7Mode6 candidate{
+                    .error = 0,
+                    .endpoints = {
+                        glm::clamp(glm::ivec4(glm::round((endpoint0 - static_cast<float>(pbit0)) * .5f)), 0, 127),
+                        glm::clamp(glm::ivec4(glm::round((endpoint1 - static_cast<float>(pbit1)) * .5f)), 0, 127)
+                    },
+                    .pbits = {pbit0, pbit1}
+                };
+
+                const glm::ivec4 unquantized0 = (candidate.endpoints[0] << 1) | pbit0;
+                const glm::ivec4 unquantized1 = (candidate.endpoints[1] << 1) | pbit1;
+
+                std::array<glm::ivec4, 16> palette;
+                for (std::size_t i = 0; i < palette.size(); ++i) {
+                    palette[i] = ((64 - kBc7Weights[i]) * unquantized0 + kBc7Weights[i] * unquantized1 + 32) >> 6;
+                }
+
+                // Project onto the endpoint segment for a first guess and
+                // settle on the best of the neighbouring indices
+                const glm::vec4 direction(unquantized1 - unquantized0);
+                const float directionLength2 = glm::dot(direction, direction);
+
+                for (std::size_t t = 0; t < kBlockTexels && candidate.error < block.error; ++t) {
+                    const glm::ivec4 texel(texels[t]);
+
+                    int guess = 0;
+                    if (directionLength2 > 0.f) {
+                        const float projection = glm::dot(glm::vec4(texel - unquantized0), direction) /
+                                                 directionLength2;
+                        guess = std::clamp(static_cast<int>(std::lround(projection * 15.f)), 0, 15);
+                    }
+
+                    std::uint32_t bestError = std::numeric_limits<std::uint32_t>::max();
+                    for (int index = std::max(guess - 1, 0); index <= std::min(guess + 1, 15); ++index) {
+                        const glm::ivec4 delta = texel - palette[index];
+                        const auto error = static_cast<std::uint32_t>(
+                            delta.x * delta.x + delta.y * delta.y + delta.z * delta.z + delta.w * delta.w);
+                        if (error < bestError) {
+                            bestError = error;
+                            candidate.indices[t] = static_cast<std::uint8_t>(index);
+                        }
+                    }
+                    candidate.error += bestError;
+                }
+
+                if (candidate.error < block.error) {
+                    block = candidate;
+                }
+            }
+        }
+    }
+
+    bool refine_bc7_endpoints(const std::array<glm::u8vec4, kBlockTexels>& texels,
+                              const Bc7Mode6& block,
+                              glm::vec4& endpoint0,
+                              glm::vec4& endpoint1) {
+        // Minimizes sum((a_i * e0 + b_i * e1 - texel_i)^2) per channel, with
+        // a_i and b_i the interpolation weights of texel i
+        float aa = 0.f, ab = 0.f, bb = 0.f;
+        glm::vec4 ax(0.f), bx(0.f);
+        for (std::size_t t = 0; t < kBlockTexels; ++t) {
+            const float b = static_cast<float>(kBc7Weights[block.indices[t]]) / 64.f;
+            const float a = 1.f - b;
+
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            ax += a * glm::vec4(texels[t]);
+            bx += b * glm::vec4(texels[t]);
+        }
+
+        const float determinant = aa * bb - ab * ab;
+        if (std::abs(determinant) < 1e-6f) {
+            // All texels share one index
+            return false;
+        }
+
+        endpoint0 = glm::clamp((bb * ax - ab * bx) / determinant, 0.f, 255.f);
+        endpoint1 = glm::clamp((aa * bx - ab * ax) / determinant, 0.f, 255.f);
+        return true;
+    }
+}
+
+namespace {
+    BitWriter::BitWriter(std::uint8_t* bytes) : mBytes(bytes) {
+    }
+
+    void BitWriter::write(const std::uint32_t value, const std::size_t bits) {
+        for (std::size_t bit = 0; bit < bits; ++bit, ++mPosition) {
+            if ((value >> bit) & 1u) {
+                mBytes[mPosition >> 3] |= static_cast<std::uint8_t>(1u << (mPosition & 7));
+            }
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+
+#include <cstdint>
+
+#include <glm/gtc/type_precision.hpp>
+
+/*
+ * CPU encoders for the BCn block compression formats sampled by the runtime.
+ * Every function encodes one 4x4 block of texels, given in row-major order,
+ * into the bit layout expected by the corresponding VK_FORMAT_BCn_*_BLOCK.
+ *
+ *  - BC4: one channel, 8 bytes per block (4 bits per texel)
+ *  - BC5: two channels, two BC4 blocks, 16 bytes per block (8 bits per texel)
+ *  - BC7: RGBA, 16 bytes per block (8 bits per texel). Only mode 6 (a single
+ *         subset with 7.7.7.7 endpoints, p-bits and 4-bit indices) is used,
+ *         which handles smooth gradients well and keeps the encoder simple.
+ *
+ * See the "Block Compressed Image Formats" chapter of the Khronos Data
+ * Format Specification for the layouts.
+ */
+constexpr std::size_t kBlockTexels = 16;
+
+using Bc4Block = std::array<std::uint8_t, 8>;
+using Bc5Block = std::array<std::uint8_t, 16>;
+using Bc7Block = std::array<std::uint8_t, 16>;
+
+Bc4Block encode_bc4_block(const std::array<std::uint8_t, kBlockTexels>& values);
+
+Bc5Block encode_bc5_block(
+    const std::array<std::uint8_t, kBlockTexels>& red,
+    const std::array<std::uint8_t, kBlockTexels>& green
+);
+
+Bc7Block encode_bc7_block(const std::array<glm::u8vec4, kBlockTexels>& texels);
@@ -1,105 +1,96 @@
 #include "indexed_mesh.hpp"
 
 #include <algorithm>
-#include <unordered_map>
+#include <chrono>
+#include <utility>
 
+#include <cassert>
 #include <cstddef>
 #include <tgen.h>
 
 #include <glm/glm.hpp>
 
-namespace {
-    // Tweakables
-    constexpr float kAABBMarginFactor = 10.f;
-    constexpr std::size_t kSparseGridMaxSize = 1024 * 1024;
-
-    // Discretize mesh positions
-    struct DiscretizedPosition {
-        std::int32_t x, y, z;
-    };
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#   define SPICY_WELD_SSE2 1
+#endif
 
-    struct Discretizer {
-        Discretizer(std::uint32_t factor, glm::vec3, float);
+#include "weld_grid.hpp"
 
-        DiscretizedPosition discretize(const glm::vec3& position) const;
+namespace {
+    using weld::DiscretizedPosition;
+    using weld::Discretizer;
 
-        glm::vec3 min;
-        float scale;
-    };
+    // Discretize all positions at once, four at a time where SIMD is available
+    void discretize_positions(
+        std::vector<DiscretizedPosition>&,
+        const Discretizer&,
+        std::span<const glm::vec3>
+    );
 
-    // hash discretized mesh positions
-    using VicinityKey = std::size_t;
+    // Sorted grid: vertices ordered by the packed key of the cell they fall in.
+    // Each axis gets 21 bits, biased by one so that the neighbours of cell 0
+    // remain representable. Z occupies the low bits, hence the three cells
+    // (x, y, z-1), (x, y, z) and (x, y, z+1) form one contiguous key range.
+    using CellKey = std::uint64_t;
 
-    VicinityKey hash_discretized_position(const DiscretizedPosition& position);
+    constexpr unsigned kCellAxisBits = 21;
 
-    // generate vicinity map
-    using VicinityMap = std::unordered_multimap<VicinityKey, std::size_t>;
+    CellKey pack_cell(std::int64_t x, std::int64_t y, std::int64_t z);
 
-    void build_vicinity_map(
-        VicinityMap&,
-        const Discretizer&,
-        const std::vector<glm::vec3>&
-    );
+    struct SortedGrid {
+        std::vector<CellKey> keys; // sorted
+        std::vector<std::uint32_t> vertices; // soup vertex for every key
+    };
 
-    bool is_vertex_mergeable(
-        const TriangleSoup&,
-        std::size_t vertexAIndex, std::size_t vertexBIndex,
-        const glm::vec3& vertexAPos, const glm::vec3& vertexBPos,
-        float);
+    void build_sorted_grid(SortedGrid&, const std::vector<DiscretizedPosition>&);
 
     // collapse vertices
-    using VertexMapping = std::vector<std::size_t>;
-    using IndexBuffer = std::vector<std::uint32_t>;
-
     std::size_t collapse_vertices(
-        IndexBuffer& indices,
-        VertexMapping& vertices,
-        const VicinityMap& vicinityMap,
-        const Discretizer& discretizer,
+        VertexWelding& welding,
+        const SortedGrid& grid,
+        const std::vector<DiscretizedPosition>& cells,
         const TriangleSoup& soup,
         float errorTolerance);
 }
 
 IndexedMesh::IndexedMesh()
     : aabbMin(std::numeric_limits<float>::max()),
-      aabbMax(std::numeric_limits<float>::min()) {
+      aabbMax(std::numeric_limits<float>::lowest()),
+      sphereCenter(0.f),
+      sphereRadius(0.f) {
 }
 
-IndexedMesh make_indexed_mesh(const TriangleSoup& soup, float errorTolerance) {
-    // Compute bounding volume
-    glm::vec3 bmin(std::numeric_limits<float>::max());
-    glm::vec3 bmax(std::numeric_limits<float>::min());
-
-    for (const auto& vertex : soup.vertices) {
-        bmin = min(bmin, vertex);
-        bmax = max(bmax, vertex);
-    }
+VertexWelding weld_vertices(const TriangleSoup& soup, const float errorTolerance) {
+    const auto discretizer = weld::make_discretizer(weld::compute_bounds(soup.vertices), errorTolerance);
 
-    const auto fmin = bmin - glm::vec3(kAABBMarginFactor * errorTolerance);
-    const auto fmax = bmax + glm::vec3(kAABBMarginFactor * errorTolerance);
+    // Quantize positions into grid cells and sort vertices by cell
+    std::vector<DiscretizedPosition> cells;
+    discretize_positions(cells, discretizer, soup.vertices);
 
-    // Compute grid size
-    const auto side = fmax - fmin;
-    float const maxSide = std::max(side.x, std::max(side.y, side.z));
+    SortedGrid grid;
+    build_sorted_grid(grid, cells);
 
-    float const numCells = maxSide / (2.f * errorTolerance);
-    std::size_t subdiv = std::min(kSparseGridMaxSize, static_cast<std::size_t>(numCells + .5f));
+    // collapse vertices
+    VertexWelding welding;
+    [[maybe_unused]] const std::size_t verts = collapse_vertices(welding, grid, cells, soup, errorTolerance);
 
-    // parameters for discretization
-    Discretizer discretizer(static_cast<std::uint32_t>(subdiv), fmin, maxSide);
+    assert(welding.indices.size() == soup.vertices.size());
+    assert(verts == welding.vertexMapping.size());
 
-    // build the vincinity map
-    VicinityMap vincinityMap;
-    build_vicinity_map(vincinityMap, discretizer, soup.vertices);
+    return welding;
+}
 
-    // collapse vertices
-    IndexBuffer indices;
-    VertexMapping vertexMapping;
+IndexedMesh make_indexed_mesh(const TriangleSoup& soup, float errorTolerance, IndexingTimes* times) {
+    using Clock = std::chrono::steady_clock;
+    const auto weldStart = Clock::now();
 
-    size_t verts = collapse_vertices(indices, vertexMapping, vincinityMap, discretizer, soup, errorTolerance);
+    // Compute bounding volume
+    const auto [bmin, bmax] = weld::compute_bounds(soup.vertices);
 
-    assert(indices.size() == soup.vertices.size());
-    assert(verts == vertexMapping.size());
+    // Weld vertices
+    auto [vertexMapping, indices] = weld_vertices(soup, errorTolerance);
+    const std::size_t verts = vertexMapping.size();
 
     // shuffle vertex data
     IndexedMesh indexedMesh;
@@ -127,6 +118,7 @@ IndexedMesh make_indexed_mesh(const TriangleSoup& soup, float errorTolerance) {
     indexedMesh.indices = std::move(indices);
 
     // Compute tangents
+    const auto tangentStart = Clock::now();
     const std::vector<tgen::VIndexT> triIndicesPos(indexedMesh.indices.begin(), indexedMesh.indices.end());
     const std::vector<tgen::VIndexT> triIndicesUV(indexedMesh.indices.begin(), indexedMesh.indices.end());
     std::vector<tgen::RealT> positions3D;
@@ -173,121 +165,139 @@ IndexedMesh make_indexed_mesh(const TriangleSoup& soup, float errorTolerance) {
         );
     }
 
+    if (times) {
+        times->weld = std::chrono::duration<double>(tangentStart - weldStart).count();
+        times->tangents = std::chrono::duration<double>(Clock::now() - tangentStart).count();
+    }
+
     // meta-data & return
     indexedMesh.aabbMin = bmin;
     indexedMesh.aabbMax = bmax;
 
+    if (!indexedMesh.vertices.empty()) {
+        compute_bounding_sphere(indexedMesh.vertices, bmin, bmax, indexedMesh.sphereCenter, indexedMesh.sphereRadius);
+    }
+
     return indexedMesh;
 }
 
 namespace {
-    Discretizer::Discretizer(const std::uint32_t factor,
-                             const glm::vec3 min,
-                             const float side): min(min), scale(factor / side) {
-    }
+    void discretize_positions(std::vector<DiscretizedPosition>& cells,
+                              const Discretizer& discretizer,
+                              const std::span<const glm::vec3> positions) {
+        static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+        static_assert(sizeof(DiscretizedPosition) == 3 * sizeof(std::int32_t));
+
+        cells.resize(positions.size());
+
+        std::size_t i = 0;
+#       if SPICY_WELD_SSE2
+        // Four tightly packed vec3 are three SSE registers. The min vector is
+        // rotated to line up with the x/y/z pattern of each register. The math
+        // is exactly that of Discretizer::discretize() (subtract, multiply,
+        // truncate), so results are bit-identical to the scalar path.
+        const auto& min = discretizer.min;
+        const __m128 min0 = _mm_setr_ps(min.x, min.y, min.z, min.x);
+        const __m128 min1 = _mm_setr_ps(min.y, min.z, min.x, min.y);
+        const __m128 min2 = _mm_setr_ps(min.z, min.x, min.y, min.z);
+        const __m128 scale = _mm_set1_ps(discretizer.scale);
+
+        const float* src = reinterpret_cast<const float*>(positions.data());
+        auto* dst = reinterpret_cast<std::int32_t*>(cells.data());
+
+        for (; i + 4 <= positions.size(); i += 4, src += 12, dst += 12) {
+            const __m128 p0 = _mm_loadu_ps(src + 0);
+            const __m128 p1 = _mm_loadu_ps(src + 4);
+            const __m128 p2 = _mm_loadu_ps(src + 8);
+
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 0),
+                             _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(p0, min0), scale)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 4),
+                             _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(p1, min1), scale)));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8),
+                             _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(p2, min2), scale)));
+        }
+#       endif
 
-    DiscretizedPosition Discretizer::discretize(const glm::vec3& position) const {
-        return {
-            .x = static_cast<std::int32_t>((position[0] - min[0]) * scale),
-            .y = static_cast<std::int32_t>((position[1] - min[1]) * scale),
-            .z = static_cast<std::int32_t>((position[2] - min[2]) * scale)
-        };
+        for (; i < positions.size(); ++i) {
+            cells[i] = discretizer.discretize(positions[i]);
+        }
     }
 }
 
 namespace {
-    std::hash<VicinityKey> scopedHash;
-
-    VicinityKey hash_discretized_position(const DiscretizedPosition& position) {
-        // Based on boost::hash_combine
-        std::size_t hash = scopedHash(position.x);
-        hash ^= scopedHash(position.y) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
-        hash ^= scopedHash(position.z) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
-        return hash;
+    CellKey pack_cell(const std::int64_t x, const std::int64_t y, const std::int64_t z) {
+        constexpr CellKey mask = (CellKey(1) << kCellAxisBits) - 1;
+        return (static_cast<CellKey>(x + 1) & mask) << (2 * kCellAxisBits)
+               | (static_cast<CellKey>(y + 1) & mask) << kCellAxisBits
+               | (static_cast<CellKey>(z + 1) & mask);
     }
-}
 
-namespace {
-    void build_vicinity_map(VicinityMap& map, const Discretizer& discretizer, const std::vector<glm::vec3>& positions) {
-        for (std::size_t index = 0; index < positions.size(); ++index) {
-            DiscretizedPosition dp = discretizer.discretize(positions[index]);
-            VicinityKey vk = hash_discretized_position(dp);
+    void build_sorted_grid(SortedGrid& grid, const std::vector<DiscretizedPosition>& cells) {
+        const std::size_t count = cells.size();
 
-            map.insert(std::make_pair(vk, index));
+        std::vector<CellKey> keys(count);
+        std::vector<std::uint32_t> vertices(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            keys[i] = pack_cell(cells[i].x, cells[i].y, cells[i].z);
+            vertices[i] = static_cast<std::uint32_t>(i);
         }
-    }
-}
 
-namespace {
-    bool is_vertex_mergeable(const TriangleSoup& soup,
-                             const size_t vertexAIndex, const size_t vertexBIndex,
-                             const glm::vec3& vertexAPos, const glm::vec3& vertexBPos,
-                             const float errorTolerance) {
-        // Compare all elements component-wise.
-        // start with positions, since we've already got those
-        for (std::size_t i = 0; i < 3; ++i) {
-            if (std::abs(vertexAPos[i] - vertexBPos[i]) > errorTolerance) {
-                return false;
+        // LSD radix sort, 11 bits per pass. Stable, so vertices within a cell
+        // stay in soup order. All histograms are gathered in a single sweep and
+        // passes in which every key has the same digit are skipped (common for
+        // flat or small meshes).
+        constexpr unsigned kRadixBits = 11;
+        constexpr std::size_t kRadixSize = std::size_t(1) << kRadixBits;
+        constexpr unsigned kPassCount = (3 * kCellAxisBits + kRadixBits - 1) / kRadixBits;
+
+        std::vector<std::size_t> histograms(kPassCount * kRadixSize, 0);
+        for (const auto key : keys) {
+            for (unsigned pass = 0; pass < kPassCount; ++pass) {
+                ++histograms[pass * kRadixSize + ((key >> (pass * kRadixBits)) & (kRadixSize - 1))];
             }
         }
 
-        // Compare normals
-        if (!soup.normals.empty()) {
-            const auto nI = soup.normals[vertexAIndex];
-            const auto nJ = soup.normals[vertexBIndex];
-            for (size_t i = 0; i < 3; ++i) {
-                if (std::abs(nI[i] - nJ[i]) > errorTolerance) {
-                    return false;
-                }
+        std::vector<CellKey> keysTmp(count);
+        std::vector<std::uint32_t> verticesTmp(count);
+
+        for (unsigned pass = 0; pass < kPassCount && count > 0; ++pass) {
+            const unsigned shift = pass * kRadixBits;
+            const auto histogram = histograms.begin() + pass * kRadixSize;
+
+            if (histogram[(keys[0] >> shift) & (kRadixSize - 1)] == count) {
+                continue;
             }
-        }
 
-        // Compare tex coord
-        const auto tI = soup.texcoords[vertexAIndex];
-        const auto tJ = soup.texcoords[vertexBIndex];
-        for (std::size_t i = 0; i < 2; ++i) {
-            if (std::abs(tI[i] - tJ[i]) > errorTolerance) {
-                return false;
+            std::size_t offset = 0;
+            for (auto bucket = histogram; bucket != histogram + kRadixSize; ++bucket) {
+                offset += std::exchange(*bucket, offset);
             }
+
+            for (std::size_t i = 0; i < count; ++i) {
+                const auto slot = histogram[(keys[i] >> shift) & (kRadixSize - 1)]++;
+                keysTmp[slot] = keys[i];
+                verticesTmp[slot] = vertices[i];
+            }
+
+            keys.swap(keysTmp);
+            vertices.swap(verticesTmp);
         }
 
-        return true;
+        grid.keys = std::move(keys);
+        grid.vertices = std::move(vertices);
     }
 }
 
 namespace {
-    constexpr size_t kNeighbourCount = 27;
-
-    DiscretizedPosition neighbour(DiscretizedPosition const& position, std::size_t index) {
-        static constexpr std::int32_t offset[kNeighbourCount][3]{
-            {0, 0, 0}, {0, 0, 1}, {0, 0, -1},
-            {0, 1, 0}, {0, 1, 1}, {0, 1, -1},
-            {0, -1, 0}, {0, -1, 1}, {0, -1, -1},
-
-            {1, 0, 0}, {1, 0, 1}, {1, 0, -1},
-            {1, 1, 0}, {1, 1, 1}, {1, 1, -1},
-            {1, -1, 0}, {1, -1, 1}, {1, -1, -1},
-
-            {-1, 0, 0}, {-1, 0, 1}, {-1, 0, -1},
-            {-1, 1, 0}, {-1, 1, 1}, {-1, 1, -1},
-            {-1, -1, 0}, {-1, -1, 1}, {-1, -1, -1},
-        };
-
-        assert(index < kNeighbourCount);
-
-        return {
-            .x = position.x + offset[index][0],
-            .y = position.y + offset[index][1],
-            .z = position.z + offset[index][2]
-        };
-    }
+    std::size_t collapse_vertices(VertexWelding& welding,
+                                  const SortedGrid& grid,
+                                  const std::vector<DiscretizedPosition>& cells,
+                                  const TriangleSoup& soup,
+                                  const float errorTolerance) {
+        auto& vertices = welding.vertexMapping;
+        auto& indices = welding.indices;
 
-    size_t collapse_vertices(IndexBuffer& indices,
-                             VertexMapping& vertices,
-                             const VicinityMap& vicinityMap,
-                             const Discretizer& discretizer,
-                             const TriangleSoup& soup,
-                             const float errorTolerance) {
         vertices.clear();
         vertices.reserve(soup.vertices.size());
 
@@ -295,63 +305,61 @@ namespace {
         indices.reserve(soup.vertices.size());
 
         // initialize collapse map
-        VertexMapping collapseMap(soup.vertices.size());
-        std::fill(collapseMap.begin(), collapseMap.end(), ~static_cast<std::size_t>(0));
+        std::vector<std::size_t> collapseMap(soup.vertices.size(), ~static_cast<std::size_t>(0));
 
         // process vertices
         std::size_t nextVertex = 0;
         for (std::size_t i = 0; i < soup.vertices.size(); ++i) {
             // check if this vertex already was merged somewhere
-            if (~static_cast<size_t>(0) != collapseMap[i]) {
+            if (~static_cast<std::size_t>(0) != collapseMap[i]) {
                 assert(collapseMap[i] < vertices.size());
                 indices.push_back(static_cast<std::uint32_t>(collapseMap[i]));
                 continue;
             }
 
-            // get position and look for possible neighbours
-            const auto self = soup.vertices[i];
-            DiscretizedPosition const dp = discretizer.discretize(self);
+            // look for possible neighbours in the surrounding 3x3x3 cells
+            const DiscretizedPosition dp = cells[i];
 
             bool merged = false;
             std::size_t target = ~static_cast<std::size_t>(0);
 
-            for (std::size_t j = 0; j < kNeighbourCount; ++j) {
-                DiscretizedPosition const dq = neighbour(dp, j);
-                VicinityKey const vk = hash_discretized_position(dq);
-
-                // get vertices in this bucket
-                for (auto [it, jt] = vicinityMap.equal_range(vk); it != jt; ++it) {
-                    std::size_t const idx = it->second;
-
-                    if (idx == i) {
-                        // don't try to merge with self
-                        continue;
-                    }
+            // the nine rows are visited in increasing key order, so each search
+            // can start where the previous row ended
+            auto rowBegin = grid.keys.begin();
+            for (std::int32_t dx = -1; dx <= 1; ++dx) {
+                for (std::int32_t dy = -1; dy <= 1; ++dy) {
+                    const CellKey first = pack_cell(dp.x + dx, dp.y + dy, dp.z - 1);
+                    const CellKey last = pack_cell(dp.x + dx, dp.y + dy, dp.z + 1);
+
+                    auto it = std::lower_bound(rowBegin, grid.keys.end(), first);
+                    for (; it != grid.keys.end() && *it <= last; ++it) {
+                        const std::size_t idx = grid.vertices[it - grid.keys.begin()];
+
+                        if (idx == i) {
+                            // don't try to merge with self
+                            continue;
+                        }
 
-                    if (~static_cast<std::size_t>(0) != collapseMap[idx]) {
-                        // don't remerge
-                        continue;
-                    }
+                        if (~static_cast<std::size_t>(0) != collapseMap[idx]) {
+                            // don't remerge
+                            continue;
+                        }
 
-                    if (const auto other = soup.vertices[idx];
-                        is_vertex_mergeable(soup, i, idx, self, other, errorTolerance)) {
-                        std::size_t toWhere;
+                        if (weld::is_vertex_mergeable(soup, i, idx, errorTolerance)) {
+                            if (!merged) {
+                                target = nextVertex++;
+                                vertices.push_back(i);
 
-                        if (merged) {
-                            toWhere = target;
-                        } else {
-                            toWhere = nextVertex++;
-                            vertices.push_back(i);
+                                collapseMap[i] = target;
+                                indices.push_back(static_cast<std::uint32_t>(target));
+                                merged = true;
+                            }
 
-                            collapseMap[i] = toWhere;
-                            indices.push_back(static_cast<std::uint32_t>(toWhere));
+                            collapseMap[idx] = target;
                         }
-
-                        collapseMap[idx] = toWhere;
-
-                        target = toWhere;
-                        merged = true;
                     }
+
+                    rowBegin = it;
                 }
             }
 
@@ -367,3 +375,64 @@ namespace {
         return nextVertex;
     }
 }
+
+void compute_bounding_sphere(const std::vector<glm::vec3>& positions,
+                             const glm::vec3& aabbMin,
+                             const glm::vec3& aabbMax,
+                             glm::vec3& center,
+                             float& radius) {
+    assert(!positions.empty());
+
+    // Ritter: start from the most distant pair of axis-extreme points...
+    std::size_t extremes[3][2] = {};
+    for (std::size_t i = 0; i < positions.size(); ++i) {
+        for (glm::length_t axis = 0; axis < 3; ++axis) {
+            if (positions[i][axis] < positions[extremes[axis][0]][axis]) {
+                extremes[axis][0] = i;
+            }
+            if (positions[i][axis] > positions[extremes[axis][1]][axis]) {
+                extremes[axis][1] = i;
+            }
+        }
+    }
+
+    glm::vec3 ritterCenter(0.f);
+    float ritterRadius = -1.f;
+    for (const auto& [lo, hi] : extremes) {
+        const float candidate = 0.5f * glm::distance(positions[lo], positions[hi]);
+        if (candidate > ritterRadius) {
+            ritterCenter = 0.5f * (positions[lo] + positions[hi]);
+            ritterRadius = candidate;
+        }
+    }
+
+    // ...and grow the sphere towards every point left outside
+    for (const auto& position : positions) {
+        const float distance = glm::distance(ritterCenter, position);
+        if (distance > ritterRadius) {
+            const float grownRadius = 0.5f * (ritterRadius + distance);
+            ritterCenter += (grownRadius - ritterRadius) / distance * (position - ritterCenter);
+            ritterRadius = grownRadius;
+        }
+    }
+
+    // The sphere around the AABB centre is tighter for some box-like meshes
+    const glm::vec3 boxCenter = 0.5f * (aabbMin + aabbMax);
+    float boxRadius = 0.f;
+    for (const auto& position : positions) {
+        boxRadius = std::max(boxRadius, glm::distance(boxCenter, position));
+    }
+
+    if (boxRadius < ritterRadius) {
+        center = boxCenter;
+        radius = boxRadius;
+        return;
+    }
+
+    // Measure the final radius exactly, the incremental updates round
+    center = ritterCenter;
+    radius = 0.f;
+    for (const auto& position : positions) {
+        radius = std::max(radius, glm::distance(center, position));
+    }
+}
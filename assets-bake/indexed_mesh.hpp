@@ -1,17 +1,20 @@
 #pragma once
 
+#include <span>
 #include <vector>
 
+#include <cstddef>
 #include <cstdint>
 
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
 
+// Views of a mesh's vertices in the loaded model, which must outlive the soup
 struct TriangleSoup {
-    std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> texcoords;
+    std::span<const glm::vec3> vertices;
+    std::span<const glm::vec3> normals;
+    std::span<const glm::vec2> texcoords;
 };
 
 struct IndexedMesh {
@@ -24,10 +27,41 @@ struct IndexedMesh {
 
     glm::vec3 aabbMin, aabbMax;
 
+    glm::vec3 sphereCenter;
+    float sphereRadius;
+
     IndexedMesh();
 };
 
+// Result of welding a triangle soup. Output vertex i is soup vertex
+// vertexMapping[i]; indices has one entry per soup vertex.
+struct VertexWelding {
+    std::vector<std::size_t> vertexMapping;
+    std::vector<std::uint32_t> indices;
+};
+
+VertexWelding weld_vertices(
+    const TriangleSoup& soup,
+    float errorTolerance
+);
+
+// Time spent in the two halves of make_indexed_mesh(), in seconds
+struct IndexingTimes {
+    double weld = 0.0;
+    double tangents = 0.0;
+};
+
 IndexedMesh make_indexed_mesh(
     const TriangleSoup& soup,
-    float errorTolerance = 1e-6f
+    float errorTolerance = 1e-6f,
+    IndexingTimes* times = nullptr
+);
+
+// Bounding sphere, the smaller of Ritter's sphere and the one around the AABB centre
+void compute_bounding_sphere(
+    const std::vector<glm::vec3>& positions,
+    const glm::vec3& aabbMin,
+    const glm::vec3& aabbMax,
+    glm::vec3& center,
+    float& radius
 );
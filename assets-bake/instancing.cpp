@@ -0,0 +1,189 @@
+#include "instancing.hpp"
+
+#include <algorithm>
+#include <bit>
+
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "bake_cache.hpp"
+
+namespace {
+    // Normals of an instance may deviate by ~2.5 degrees (cos = 0.999)
+    constexpr float kNormalTolerance = 0.999f;
+
+    // Mantissa bits of the vertex spread ignored by the signature, so that
+    // rounding in transformed copies does not change it
+    constexpr std::uint32_t kSpreadMask = ~static_cast<std::uint32_t>(0xFFF);
+
+    struct Spread {
+        glm::vec3 centroid;
+        // Root mean square distance of the vertices to the centroid
+        float radius;
+    };
+
+    Spread compute_spread(const IndexedMesh& mesh);
+
+    // Rigid transform that maps mesh from onto mesh to, if any
+    std::optional<glm::mat4x3> find_transform(const IndexedMesh& from, const IndexedMesh& to, float tolerance);
+}
+
+InstanceFinder::InstanceFinder(std::filesystem::path spillPath, const float tolerance)
+    : mTolerance(tolerance),
+      mSpill(std::move(spillPath)) {
+}
+
+std::optional<InstanceFinder::Instance> InstanceFinder::add(const IndexedMesh& mesh,
+                                                            const std::size_t material,
+                                                            const ContentHash signature) {
+    auto& bucket = mCandidates[signature];
+
+    for (const auto unique : bucket) {
+        const auto& candidate = mUniques[unique];
+        if (candidate.material != material || candidate.vertexCount != mesh.vertices.size() ||
+            candidate.indexCount != mesh.indices.size()) {
+            continue;
+        }
+
+        if (const auto transform = find_transform(read_unique(candidate), mesh, mTolerance)) {
+            return Instance{unique, *transform};
+        }
+    }
+
+    bucket.push_back(mUniques.size());
+    mUniques.push_back(Unique{
+        .material = material,
+        .vertexCount = mesh.vertices.size(),
+        .indexCount = mesh.indices.size(),
+        .sphereRadius = mesh.sphereRadius,
+        .spillOffset = mSpill.append(mesh.vertices.data(), sizeof(glm::vec3) * mesh.vertices.size())
+    });
+    mSpill.append(mesh.normals.data(), sizeof(glm::vec3) * mesh.normals.size());
+    mSpill.append(mesh.texcoords.data(), sizeof(glm::vec2) * mesh.texcoords.size());
+    mSpill.append(mesh.indices.data(), sizeof(std::uint32_t) * mesh.indices.size());
+
+    return std::nullopt;
+}
+
+std::size_t InstanceFinder::unique_count() const {
+    return mUniques.size();
+}
+
+IndexedMesh InstanceFinder::read_unique(const Unique& unique) {
+    IndexedMesh mesh;
+    mesh.vertices.resize(unique.vertexCount);
+    mesh.normals.resize(unique.vertexCount);
+    mesh.texcoords.resize(unique.vertexCount);
+    mesh.indices.resize(unique.indexCount);
+    mesh.sphereRadius = unique.sphereRadius;
+
+    std::uint64_t offset = unique.spillOffset;
+    const auto read = [this, &offset](void* data, const std::size_t bytes) {
+        mSpill.read(offset, bytes, data);
+        offset += bytes;
+    };
+
+    read(mesh.vertices.data(), sizeof(glm::vec3) * mesh.vertices.size());
+    read(mesh.normals.data(), sizeof(glm::vec3) * mesh.normals.size());
+    read(mesh.texcoords.data(), sizeof(glm::vec2) * mesh.texcoords.size());
+    read(mesh.indices.data(), sizeof(std::uint32_t) * mesh.indices.size());
+
+    return mesh;
+}
+
+ContentHash instance_signature(const IndexedMesh& mesh, const std::size_t material) {
+    const std::uint64_t counts[] = {mesh.vertices.size(), mesh.indices.size(), material};
+    ContentHash hash = hash_bytes(counts, sizeof(counts));
+    hash = hash_bytes(mesh.indices.data(), sizeof(std::uint32_t) * mesh.indices.size(), hash);
+    hash = hash_bytes(mesh.texcoords.data(), sizeof(glm::vec2) * mesh.texcoords.size(), hash);
+
+    const std::uint32_t spread = std::bit_cast<std::uint32_t>(compute_spread(mesh).radius) & kSpreadMask;
+    return hash_bytes(&spread, sizeof(spread), hash);
+}
+
+namespace {
+    Spread compute_spread(const IndexedMesh& mesh) {
+        glm::dvec3 sum(0.0);
+        for (const auto& position : mesh.vertices) {
+            sum += glm::dvec3(position);
+        }
+        const glm::dvec3 centroid = sum / static_cast<double>(std::max<std::size_t>(mesh.vertices.size(), 1));
+
+        double squares = 0.0;
+        for (const auto& position : mesh.vertices) {
+            const glm::dvec3 offset = glm::dvec3(position) - centroid;
+            squares += glm::dot(offset, offset);
+        }
+
+        return Spread{
+            .centroid = glm::vec3(centroid),
+            .radius = static_cast<float>(std::sqrt(squares / static_cast<double>(
+                std::max<std::size_t>(mesh.vertices.size(), 1))))
+        };
+    }
+
+    std::optional<glm::mat4x3> find_transform(const IndexedMesh& from, const IndexedMesh& to, const float tolerance) {
+        if (from.vertices.empty() ||
+            from.vertices.size() != to.vertices.size() ||
+            from.indices != to.indices ||
+            from.texcoords != to.texcoords) {
+            return std::nullopt;
+        }
+
+        const auto fromSpread = compute_spread(from);
+        const auto toSpread = compute_spread(to);
+
+        // Reference vertices: the one farthest from the centroid, and the one
+        // farthest from the line through it
+        std::size_t first = 0;
+        float firstDistance = 0.f;
+        for (std::size_t v = 0; v < from.vertices.size(); ++v) {
+            const float distance = glm::length(from.vertices[v] - fromSpread.centroid);
+            if (distance > firstDistance) {
+                first = v;
+                firstDistance = distance;
+            }
+        }
+
+        const glm::vec3 firstAxis = from.vertices[first] - fromSpread.centroid;
+        std::size_t second = 0;
+        float secondDistance = 0.f;
+        for (std::size_t v = 0; v < from.vertices.size(); ++v) {
+            const float distance = glm::length(glm::cross(firstAxis, from.vertices[v] - fromSpread.centroid));
+            if (distance > secondDistance) {
+                second = v;
+                secondDistance = distance;
+            }
+        }
+
+        // Flat lines and points have no unique rotation
+        if (secondDistance <= 1e-6f * firstDistance * firstDistance) {
+            return std::nullopt;
+        }
+
+        // Orthonormal frames spanned by the reference vertices
+        const auto frame = [first, second](const IndexedMesh& mesh, const glm::vec3& centroid) {
+            const glm::vec3 x = glm::normalize(mesh.vertices[first] - centroid);
+            const glm::vec3 z = glm::normalize(glm::cross(x, mesh.vertices[second] - centroid));
+            return glm::mat3(x, glm::cross(z, x), z);
+        };
+
+        const glm::mat3 rotation = frame(to, toSpread.centroid) * glm::transpose(frame(from, fromSpread.centroid));
+        const glm::vec3 translation = toSpread.centroid - rotation * fromSpread.centroid;
+
+        const float maxDistance = tolerance * std::max(from.sphereRadius, 1e-6f);
+        for (std::size_t v = 0; v < from.vertices.size(); ++v) {
+            if (glm::length(rotation * from.vertices[v] + translation - to.vertices[v]) > maxDistance) {
+                return std::nullopt;
+            }
+
+            if (glm::dot(rotation * from.normals[v], to.normals[v]) < kNormalTolerance) {
+                return std::nullopt;
+            }
+        }
+
+        return glm::mat4x3(rotation[0], rotation[1], rotation[2], translation);
+    }
+}
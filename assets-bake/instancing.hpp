@@ -0,0 +1,82 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/mat4x3.hpp>
+
+#include "bake_cache.hpp"
+#include "indexed_mesh.hpp"
+#include "spill_file.hpp"
+
+/*
+ * Largest distance between a vertex of a mesh and the transformed vertex of
+ * its instance, relative to the mesh's bounding sphere radius
+ */
+constexpr float kInstanceTolerance = 1e-4f;
+
+/*
+ * Finds meshes that are copies of each other up to a rigid transform, for
+ * example the same chair placed at several positions of a scene.
+ *
+ * Candidates are found by hashing what a rigid transform keeps unchanged: the
+ * material, the index buffer, the texture coordinates and the (quantized)
+ * spread of the vertices around their centroid, see instance_signature().
+ * Welding is deterministic, so copies of the same geometry have the same
+ * vertex order. A candidate is an instance if the rotation and translation
+ * that map three reference vertices onto each other also map every other
+ * vertex and normal.
+ *
+ * Meshes are added one at a time, as they are welded. Only the signatures of
+ * the unique meshes are kept in memory. Their geometry is spilled to a file
+ * and read back when a later mesh has the same signature.
+ */
+class InstanceFinder {
+public:
+    // The spill file is created at spillPath, and removed with the finder
+    explicit InstanceFinder(std::filesystem::path spillPath, float tolerance = kInstanceTolerance);
+
+    struct Instance {
+        // Unique mesh, in order of first occurrence
+        std::size_t unique;
+
+        // Model to world transform, rotation and translation only
+        glm::mat4x3 transform;
+    };
+
+    // The unique mesh that mesh is an instance of. Otherwise mesh becomes the
+    // next unique mesh, whose first instance is the mesh itself with an
+    // identity transform.
+    std::optional<Instance> add(const IndexedMesh& mesh, std::size_t material, ContentHash signature);
+
+    std::size_t unique_count() const;
+
+private:
+    struct Unique {
+        std::size_t material;
+        std::size_t vertexCount;
+        std::size_t indexCount;
+        float sphereRadius;
+
+        // Of the vertices, normals, texture coordinates and indices
+        std::uint64_t spillOffset;
+    };
+
+    IndexedMesh read_unique(const Unique&);
+
+    float mTolerance;
+    SpillFile mSpill;
+
+    std::vector<Unique> mUniques;
+
+    // Unique meshes with the same signature
+    std::unordered_map<ContentHash, std::vector<std::size_t>> mCandidates;
+};
+
+// Hash of what a rigid transform keeps unchanged, see InstanceFinder
+ContentHash instance_signature(const IndexedMesh& mesh, std::size_t material);
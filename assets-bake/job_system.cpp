@@ -0,0 +1,163 @@
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+namespace {
+    // Identifies the queue owned by the current thread, if it is a worker
+    thread_local const JobSystem* tOwner = nullptr;
+    thread_local std::size_t tQueueIndex = 0;
+}
+
+bool JobGroup::done() const {
+    return 0 == mPending.load(std::memory_order_acquire);
+}
+
+JobSystem::JobSystem(const std::size_t workerCount) {
+    const std::size_t workers = std::max<std::size_t>(1, workerCount);
+
+    mQueues.reserve(workers + 1);
+    for (std::size_t i = 0; i < workers + 1; ++i) {
+        mQueues.emplace_back(std::make_unique<Queue>());
+    }
+
+    mWorkers.reserve(workers);
+    for (std::size_t i = 0; i < workers; ++i) {
+        mWorkers.emplace_back([this, i] {
+            worker_loop(i);
+        });
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard lock(mSleepMutex);
+        mStopping = true;
+    }
+    mWake.notify_all();
+
+    for (auto& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+std::size_t JobSystem::worker_count() const {
+    return mWorkers.size();
+}
+
+void JobSystem::submit(JobGroup& group, std::function<void()> function) {
+    group.mPending.fetch_add(1, std::memory_order_relaxed);
+
+    auto& queue = *mQueues[queue_index()];
+    {
+        std::lock_guard lock(queue.mutex);
+        queue.jobs.emplace_back(Job{std::move(function), &group});
+    }
+
+    // Increment under the sleep mutex so that sleeping threads cannot miss it
+    {
+        std::lock_guard lock(mSleepMutex);
+        mQueued.fetch_add(1, std::memory_order_release);
+    }
+    mWake.notify_one();
+}
+
+void JobSystem::wait(JobGroup& group) {
+    const auto self = queue_index();
+
+    while (!group.done()) {
+        if (try_run_one(self)) {
+            continue;
+        }
+
+        // Nothing to help with: sleep until new work arrives or the group completes
+        std::unique_lock lock(mSleepMutex);
+        mWake.wait(lock, [this, &group] {
+            return group.done() || mQueued.load(std::memory_order_acquire) > 0;
+        });
+    }
+
+    if (group.mError) {
+        std::rethrow_exception(std::exchange(group.mError, nullptr));
+    }
+}
+
+std::size_t JobSystem::queue_index() const {
+    return tOwner == this ? tQueueIndex : mQueues.size() - 1;
+}
+
+bool JobSystem::try_pop(const std::size_t queueIndex, Job& job) {
+    // Own queue first, newest job first
+    {
+        auto& own = *mQueues[queueIndex];
+        std::lock_guard lock(own.mutex);
+        if (!own.jobs.empty()) {
+            job = std::move(own.jobs.back());
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+
+    // Then steal the oldest job from any other queue
+    for (std::size_t offset = 1; offset < mQueues.size(); ++offset) {
+        auto& victim = *mQueues[(queueIndex + offset) % mQueues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.jobs.empty()) {
+            job = std::move(victim.jobs.front());
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool JobSystem::try_run_one(const std::size_t queueIndex) {
+    Job job;
+    if (!try_pop(queueIndex, job)) {
+        return false;
+    }
+
+    mQueued.fetch_sub(1, std::memory_order_acq_rel);
+
+    assert(job.group);
+    try {
+        job.function();
+    } catch (...) {
+        std::lock_guard lock(job.group->mErrorMutex);
+        if (!job.group->mError) {
+            job.group->mError = std::current_exception();
+        }
+    }
+
+    if (1 == job.group->mPending.fetch_sub(1, std::memory_order_acq_rel)) {
+        // Last job of the group: wake up whoever is waiting on it
+        {
+            std::lock_guard lock(mSleepMutex);
+        }
+        mWake.notify_all();
+    }
+
+    return true;
+}
+
+void JobSystem::worker_loop(const std::size_t queueIndex) {
+    tOwner = this;
+    tQueueIndex = queueIndex;
+
+    for (;;) {
+        if (try_run_one(queueIndex)) {
+            continue;
+        }
+
+        std::unique_lock lock(mSleepMutex);
+        mWake.wait(lock, [this] {
+            return mStopping || mQueued.load(std::memory_order_acquire) > 0;
+        });
+
+        if (mStopping) {
+            return;
+        }
+    }
+}
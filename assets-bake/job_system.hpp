@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+ * Small work-stealing job system used by the baker.
+ *
+ * Every worker thread owns a deque of jobs. Workers push and pop at the back
+ * of their own deque (LIFO, which keeps recently spawned work hot in cache)
+ * and steal from the front of the other deques when they run dry. Threads that
+ * are not workers (e.g. main()) share one additional deque.
+ *
+ * Jobs are submitted into a JobGroup. Waiting on a group does not block the
+ * calling thread: it keeps executing queued jobs until the group completes.
+ * This makes nested parallelism (a scene job spawning per-mesh jobs) safe.
+ */
+class JobGroup {
+public:
+    JobGroup() = default;
+
+    JobGroup(const JobGroup&) = delete;
+
+    JobGroup& operator=(const JobGroup&) = delete;
+
+    bool done() const;
+
+private:
+    friend class JobSystem;
+
+    std::atomic<std::size_t> mPending{0};
+
+    std::mutex mErrorMutex;
+    std::exception_ptr mError;
+};
+
+class JobSystem {
+public:
+    explicit JobSystem(std::size_t workerCount = std::thread::hardware_concurrency());
+
+    ~JobSystem();
+
+    JobSystem(const JobSystem&) = delete;
+
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    std::size_t worker_count() const;
+
+    void submit(JobGroup&, std::function<void()>);
+
+    // Runs queued jobs until all jobs of the group have finished. Rethrows the
+    // first exception raised by any of the group's jobs.
+    void wait(JobGroup&);
+
+private:
+    struct Job {
+        std::function<void()> function;
+        JobGroup* group;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::size_t queue_index() const;
+
+    bool try_pop(std::size_t queueIndex, Job&);
+
+    bool try_run_one(std::size_t queueIndex);
+
+    void worker_loop(std::size_t queueIndex);
+
+    // One queue per worker, plus one shared by all external threads (last)
+    std::vector<std::unique_ptr<Queue>> mQueues;
+    std::vector<std::thread> mWorkers;
+
+    std::atomic<std::size_t> mQueued{0};
+    bool mStopping = false;
+
+    std::mutex mSleepMutex;
+    std::condition_variable mWake;
+};
+
+/*
+ * Invokes function(i) for i in [0, count) across the job system and waits for
+ * all invocations to complete.
+ */
+template<typename tFunction>
+void parallel_for(JobSystem& jobs, const std::size_t count, tFunction&& function) {
+    JobGroup group;
+    for (std::size_t i = 0; i < count; ++i) {
+        jobs.submit(group, [&function, i] {
+            function(i);
+        });
+    }
+    jobs.wait(group);
+}
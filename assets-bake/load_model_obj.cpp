@@ -1,23 +1,32 @@
 #include "load_model_obj.hpp"
 
-#include <unordered_set>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <thread>
 
 #include <cassert>
 #include <cstring>
+
+// For ZSTD_estimateCCtxSize(), fine since zstd is linked statically
+#define ZSTD_STATIC_LINKING_ONLY
 #include <zstd.h>
 
+#include <glm/glm.hpp>
+
 #include <rapidobj/rapidobj.hpp>
 
+#include "bake_report.hpp"
 #include "input_model.hpp"
-#include "zstdistream.hpp"
+#include "zstdbuffer.hpp"
 
 #include "../vkutils/error.hpp"
 
 /*
  * Validates aPath is a .obj-zstd path and a corresponding file exists.
- * Otherwise, it attempts to create it from its .obj file.
+ * Otherwise, or if its .obj file is newer, it (re)creates it from the .obj.
  */
-void ensure_compressed_obj(char const* rawPath) {
+void ensure_compressed_obj(char const* rawPath, const int compressionLevel) {
     const std::filesystem::path compressedObjPath(rawPath);
     assert(compressedObjPath.extension() == ".obj-zstd");
     std::filesystem::path objPath(compressedObjPath);
@@ -29,7 +38,14 @@ void ensure_compressed_obj(char const* rawPath) {
         return;
     }
 
-    std::printf("'%s' does not exist, attempting to create from '%s'\n", compressedObjPath.string().c_str(),
+    // Likewise if the .obj-zstd was created from the current .obj already
+    if (exists(compressedObjPath) && last_write_time(compressedObjPath) >= last_write_time(objPath)) {
+        std::printf("Using %s, it is newer than %s\n", compressedObjPath.string().c_str(),
+                    objPath.string().c_str());
+        return;
+    }
+
+    std::printf("'%s' is missing or out of date, attempting to create from '%s'\n", compressedObjPath.string().c_str(),
                 objPath.string().c_str());
 
     if (!exists(objPath)) {
@@ -51,12 +67,35 @@ void ensure_compressed_obj(char const* rawPath) {
         throw vkutils::Error("Unable to read file: '%s'", objPath.string().c_str());
     }
 
-    // Compress .obj buffer
+    // Compress .obj buffer. Large OBJs take a while to compress, especially at
+    // higher levels, so split the work across threads (ZSTDMT). The output is
+    // a regular zstd frame that records the decompressed size.
+    ZSTD_CCtx* ctx = ZSTD_createCCtx();
+    if (!ctx) {
+        throw vkutils::Error("ZSTD_createCCtx(): returned error");
+    }
+
+    if (const auto ret = ZSTD_CCtx_setParameter(ctx, ZSTD_c_compressionLevel, compressionLevel);
+        ZSTD_isError(ret)) {
+        ZSTD_freeCCtx(ctx);
+        throw vkutils::Error("Invalid compression level %d: %s", compressionLevel, ZSTD_getErrorName(ret));
+    }
+
+    // Fails if zstd was built without ZSTD_MULTITHREAD, in which case it simply
+    // compresses on this thread
+    const int workers = static_cast<int>(std::thread::hardware_concurrency());
+    if (const auto ret = ZSTD_CCtx_setParameter(ctx, ZSTD_c_nbWorkers, workers); ZSTD_isError(ret)) {
+        std::printf("Note: compressing '%s' single-threaded: %s\n", objPath.string().c_str(),
+                    ZSTD_getErrorName(ret));
+    }
+
     const size_t compressedSize = ZSTD_compressBound(buffer.size());
     std::vector<char> compressedData(compressedSize);
 
-    const size_t actualCompressedSize = ZSTD_compress(compressedData.data(), compressedSize, buffer.data(),
-                                                      buffer.size(), ZSTD_CLEVEL_DEFAULT);
+    const size_t actualCompressedSize = ZSTD_compress2(ctx, compressedData.data(), compressedSize, buffer.data(),
+                                                       buffer.size());
+    ZSTD_freeCCtx(ctx);
+
     if (ZSTD_isError(actualCompressedSize)) {
         throw vkutils::Error("Compression failed: '%s'", std::string(ZSTD_getErrorName(actualCompressedSize)).c_str());
     }
@@ -75,21 +114,104 @@ void ensure_compressed_obj(char const* rawPath) {
     }
 }
 
-InputModel load_compressed_obj(char const* rawPath) {
-    assert(rawPath);
-
-    // Ask rapidobj to load requested file
+/*
+ * Parses the .obj-zstd. The OBJ is decompressed on a separate thread, while
+ * rapidobj parses the parts decompressed so far on multiple threads. The
+ * decompressed text is released on return, before the triangle soup is built.
+ */
+rapidobj::Result parse_compressed_obj(char const* rawPath, BakeReport* report) {
     rapidobj::MaterialLibrary const mlib = rapidobj::MaterialLibrary::SearchPath(
         std::filesystem::absolute(std::filesystem::path(rawPath).remove_filename()));
 
-    // Load compressed obj
-    ensure_compressed_obj(rawPath);
-    ZStdIStream ins = ZStdIStream(rawPath);
-    auto result = rapidobj::ParseStream(ins, mlib);
+    ZStdBuffer obj(rawPath);
+    const rapidobj::ObjBuffer source{
+        .data = obj.data(),
+        .size = obj.size(),
+        .wait_until_available = [&obj](const std::size_t count) {
+            return obj.wait_until_available(count);
+        }
+    };
+
+    if (report) {
+        report->begin_stage("parse");
+    }
+
+    auto result = rapidobj::ParseBuffer(source, mlib);
+    obj.rethrow_error();
     if (result.error) {
         throw vkutils::Error("Unable to load OBJ file '%s': %s", rawPath, result.error.code.message().c_str());
     }
 
+    // Decompression overlaps parsing, see ZStdBuffer
+    if (report) {
+        report->end_stage();
+        report->add_stage("decompress", obj.decompress_seconds());
+    }
+
+    return result;
+}
+
+std::size_t obj_size(char const* rawPath) {
+    const std::filesystem::path compressedObjPath(rawPath);
+    std::filesystem::path objPath(compressedObjPath);
+    objPath.replace_extension(".obj");
+
+    std::error_code error;
+    if (const auto size = std::filesystem::file_size(objPath, error); !error) {
+        return size;
+    }
+
+    // Without the .obj, use the decompressed size recorded in the frame header
+    std::ifstream compressedObjFile(compressedObjPath, std::ios::binary);
+    std::array<char, 18> header{}; // ZSTD_FRAMEHEADERSIZE_MAX
+    compressedObjFile.read(header.data(), header.size());
+
+    const auto size = ZSTD_getFrameContentSize(header.data(), compressedObjFile.gcount());
+    if (ZSTD_CONTENTSIZE_UNKNOWN == size || ZSTD_CONTENTSIZE_ERROR == size) {
+        return 0;
+    }
+
+    return size;
+}
+
+std::size_t parse_memory(char const* rawPath, const int compressionLevel) {
+    // The decompressed text, and rapidobj's attributes and faces, measured at
+    // 2.2 to 2.6 bytes per byte of text. Each of rapidobj's threads holds its
+    // own blocks of text on top.
+    constexpr std::size_t kParseMemoryPerObjByte = 3;
+    constexpr std::size_t kParseMemoryPerThread = std::size_t(1) << 20;
+
+    const std::size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    // Recreating the .obj-zstd holds the text and its compressed copy
+    return obj_size(rawPath) * kParseMemoryPerObjByte + kParseMemoryPerThread * threads +
+           ZSTD_estimateCCtxSize(compressionLevel);
+}
+
+struct ParsedObj::Parsed {
+    rapidobj::Result result;
+
+    // Face of every soup triangle, by shape. A mesh's triangles are those from
+    // vertexStartIndex / 3 on, see meshes().
+    std::vector<std::uint32_t> faces;
+    // Shape of every mesh
+    std::vector<std::uint32_t> meshShapes;
+};
+
+ParsedObj::ParsedObj(char const* rawPath, const int compressionLevel, BakeReport* report)
+    : mSourcePath(rawPath),
+      mParsed(std::make_unique<Parsed>()) {
+    assert(rawPath);
+
+    // Ask rapidobj to load requested file
+    ensure_compressed_obj(rawPath, compressionLevel);
+    auto& result = mParsed->result;
+    result = parse_compressed_obj(rawPath, report);
+
+    if (report) {
+        report->begin_stage("bucket");
+    }
+
     // OBJ files can define faces that are not triangles. However, Vulkan will
     // only render triangles (or lines and points), so we must triangulate any
     // faces that are not already triangles. Fortunately, rapidobj can do this
@@ -102,12 +224,8 @@ InputModel load_compressed_obj(char const* rawPath) {
 
     std::string const prefix = pathEnd ? std::string(pathBeg, pathEnd + 1) : "";
 
-    // Convert the OBJ data into a InputModel structure.
+    // Convert the OBJ data into InputMaterialInfo and InputMeshInfo records.
     // First, extract material data.
-    InputModel loadedModel;
-
-    loadedModel.modelSourcePath = rawPath;
-
     for (const auto& material : result.materials) {
         InputMaterialInfo materialInfo;
 
@@ -137,12 +255,13 @@ InputModel load_compressed_obj(char const* rawPath) {
             materialInfo.alphaMaskTexturePath = prefix + material.alpha_texname;
         }
 
-        loadedModel.materials.emplace_back(std::move(materialInfo));
+        mMaterials.emplace_back(std::move(materialInfo));
     }
 
-    // Next, extract the actual mesh data. There are some complications:
+    // Next, bucket the faces into meshes. There are some complications:
     // - OBJ use separate indices to positions, normals and texture coords. To
-    //   deal with this, the mesh is turned into an unindexed triangle soup.
+    //   deal with this, meshes are turned into an unindexed triangle soup, see
+    //   load_meshes().
     // - OBJ uses three methods of grouping faces:
     //   - 'o' = object
     //   - 'g' = group
@@ -151,82 +270,224 @@ InputModel load_compressed_obj(char const* rawPath) {
     //  materials. We want to primarily group faces by material (and possibly
     //  secondarily by other logical groupings).
     //
-    // RapidOBJ exposes a per-face material index.
-    std::unordered_set<std::size_t> activeMaterials;
+    // RapidOBJ exposes a per-face material index. Faces are bucketed by
+    // material with a counting sort: one pass over a shape counts the faces
+    // of each material, which determines where each material's faces go, and
+    // a second pass writes every face to its final place.
+    std::size_t totalFaces = 0;
     for (const auto& shape : result.shapes) {
+        totalFaces += shape.mesh.indices.size() / 3;
+    }
+
+    if (totalFaces > std::numeric_limits<std::uint32_t>::max()) {
+        throw vkutils::Error("'%s' has too many faces (%zu)", rawPath, totalFaces);
+    }
+
+    auto& faces = mParsed->faces;
+    faces.resize(totalFaces);
+
+    // Per material: number of faces in the current shape, then the next face
+    // to write. Only the entries of the shape's materials are reset.
+    std::vector<std::size_t> materialFaces(mMaterials.size(), 0);
+    std::vector<std::size_t> activeMaterials;
+
+    std::size_t firstShapeFace = 0;
+    for (std::size_t shapeIndex = 0; shapeIndex < result.shapes.size(); ++shapeIndex) {
+        auto& shape = result.shapes[shapeIndex];
         const auto& shapeName = shape.name;
 
-        // Scan shape for materials
+        // Count faces per material. Always triangles; see Triangulate() above.
         activeMaterials.clear();
 
-        for (std::size_t i = 0; i < shape.mesh.indices.size(); ++i) {
-            // Always triangles; see Triangulate() above
-            const auto faceId = i / 3;
-
-            assert(faceId < shape.mesh.material_ids.size());
+        const auto faceCount = shape.mesh.indices.size() / 3;
+        assert(faceCount <= shape.mesh.material_ids.size());
+        for (std::size_t faceId = 0; faceId < faceCount; ++faceId) {
             const auto matId = shape.mesh.material_ids[faceId];
 
-            assert(matId < static_cast<int>(loadedModel.materials.size()));
-            activeMaterials.emplace(matId);
+            assert(matId >= 0 && matId < static_cast<int>(mMaterials.size()));
+            if (0 == materialFaces[matId]) {
+                activeMaterials.emplace_back(matId);
+            }
+            materialFaces[matId] += 1;
         }
 
-        // Process vertices for active material
-        // This does multiple passes over the vertex data, which is less than
-        // optimal...
+        // Meshes are emitted in order of material within the shape.
         //
         // Note: we still keep different "shapes" separate. For static meshes,
         // one could merge all vertices with the same material for a bit more
         // efficient rendering.
+        std::sort(activeMaterials.begin(), activeMaterials.end());
+
+        std::size_t firstFace = firstShapeFace;
         for (const auto materialId : activeMaterials) {
             // Keep track of mesh names; this can be useful for debugging.
             std::string meshName;
             if (1 == activeMaterials.size()) {
                 meshName = shapeName;
             } else {
-                meshName = shapeName + "::" + loadedModel.materials[materialId].materialName;
+                meshName = shapeName + "::" + mMaterials[materialId].materialName;
             }
 
-            // Extract this material's vertices.
-            const auto firstVertex = loadedModel.positions.size();
+            const auto meshFaces = materialFaces[materialId];
+
+            mMeshes.emplace_back(InputMeshInfo{
+                std::move(meshName),
+                materialId,
+                3 * firstFace,
+                3 * meshFaces
+            });
+            mParsed->meshShapes.push_back(static_cast<std::uint32_t>(shapeIndex));
 
-            for (std::size_t i = 0; i < shape.mesh.indices.size(); ++i) {
-                const auto faceId = i / 3; // Always triangles; see Triangulate() above
-                const auto faceMaterial = static_cast<std::size_t>(shape.mesh.material_ids[faceId]);
+            materialFaces[materialId] = firstFace;
+            firstFace += meshFaces;
+        }
 
-                if (faceMaterial != materialId) {
-                    continue;
-                }
+        // Scatter each face into its material's range
+        for (std::size_t faceId = 0; faceId < faceCount; ++faceId) {
+            faces[materialFaces[shape.mesh.material_ids[faceId]]++] = static_cast<std::uint32_t>(faceId);
+        }
 
-                const auto& index = shape.mesh.indices[i];
+        for (const auto materialId : activeMaterials) {
+            materialFaces[materialId] = 0;
+        }
 
-                loadedModel.positions.emplace_back(
-                    result.attributes.positions[index.position_index * 3 + 0],
-                    result.attributes.positions[index.position_index * 3 + 1],
-                    result.attributes.positions[index.position_index * 3 + 2]
+        // Only the corners of the faces are needed from here on
+        shape.mesh.num_face_vertices = {};
+        shape.mesh.material_ids = {};
+        shape.mesh.smoothing_group_ids = {};
+        shape.lines = {};
+        shape.points = {};
+
+        firstShapeFace = firstFace;
+    }
+
+    result.attributes.colors = {};
+
+    if (report) {
+        report->end_stage();
+    }
+}
+
+ParsedObj::~ParsedObj() = default;
+
+const std::string& ParsedObj::source_path() const {
+    return mSourcePath;
+}
+
+std::vector<InputMaterialInfo>& ParsedObj::materials() {
+    return mMaterials;
+}
+
+const std::vector<InputMaterialInfo>& ParsedObj::materials() const {
+    return mMaterials;
+}
+
+const std::vector<InputMeshInfo>& ParsedObj::meshes() const {
+    return mMeshes;
+}
+
+glm::vec3 ParsedObj::mesh_centre(const std::size_t mesh) const {
+    const auto& info = mMeshes[mesh];
+    const auto& shape = mParsed->result.shapes[mParsed->meshShapes[mesh]];
+    const auto& positions = mParsed->result.attributes.positions;
+
+    glm::vec3 aabbMin(0.f), aabbMax(0.f);
+    for (std::size_t t = info.vertexStartIndex / 3; t < (info.vertexStartIndex + info.vertexCount) / 3; ++t) {
+        for (std::size_t corner = 0; corner < 3; ++corner) {
+            const auto& index = shape.mesh.indices[mParsed->faces[t] * std::size_t(3) + corner];
+            const glm::vec3 position(
+                positions[index.position_index * 3 + 0],
+                positions[index.position_index * 3 + 1],
+                positions[index.position_index * 3 + 2]
+            );
+
+            if (t == info.vertexStartIndex / 3 && 0 == corner) {
+                aabbMin = aabbMax = position;
+            }
+            aabbMin = glm::min(aabbMin, position);
+            aabbMax = glm::max(aabbMax, position);
+        }
+    }
+
+    return 0.5f * (aabbMin + aabbMax);
+}
+
+InputModel ParsedObj::load_meshes(const std::span<const std::size_t> meshes) const {
+    const auto& attributes = mParsed->result.attributes;
+
+    InputModel model{
+        .modelSourcePath = mSourcePath,
+        .materials = mMaterials
+    };
+
+    std::size_t totalVertices = 0;
+    for (const auto mesh : meshes) {
+        totalVertices += mMeshes[mesh].vertexCount;
+    }
+
+    model.positions.resize(totalVertices);
+    model.texcoords.resize(totalVertices);
+    model.normals.resize(totalVertices);
+
+    // Every triangle soup vertex is written exactly once into the presized
+    // vertex arrays
+    std::size_t nextVertex = 0;
+    for (const auto mesh : meshes) {
+        const auto& info = mMeshes[mesh];
+        const auto& shape = mParsed->result.shapes[mParsed->meshShapes[mesh]];
+
+        model.meshes.emplace_back(InputMeshInfo{
+            info.meshName,
+            info.materialIndex,
+            nextVertex,
+            info.vertexCount
+        });
+
+        for (std::size_t t = info.vertexStartIndex / 3; t < (info.vertexStartIndex + info.vertexCount) / 3; ++t) {
+            for (std::size_t corner = 0; corner < 3; ++corner) {
+                const auto& index = shape.mesh.indices[mParsed->faces[t] * std::size_t(3) + corner];
+
+                model.positions[nextVertex] = glm::vec3(
+                    attributes.positions[index.position_index * 3 + 0],
+                    attributes.positions[index.position_index * 3 + 1],
+                    attributes.positions[index.position_index * 3 + 2]
                 );
 
-                loadedModel.texcoords.emplace_back(
-                    result.attributes.texcoords[index.texcoord_index * 2 + 0],
-                    result.attributes.texcoords[index.texcoord_index * 2 + 1]
+                model.texcoords[nextVertex] = glm::vec2(
+                    attributes.texcoords[index.texcoord_index * 2 + 0],
+                    attributes.texcoords[index.texcoord_index * 2 + 1]
                 );
 
-                loadedModel.normals.emplace_back(
-                    result.attributes.normals[index.normal_index * 3 + 0],
-                    result.attributes.normals[index.normal_index * 3 + 1],
-                    result.attributes.normals[index.normal_index * 3 + 2]
+                model.normals[nextVertex] = glm::vec3(
+                    attributes.normals[index.normal_index * 3 + 0],
+                    attributes.normals[index.normal_index * 3 + 1],
+                    attributes.normals[index.normal_index * 3 + 2]
                 );
+
+                ++nextVertex;
             }
+        }
+    }
 
-            const auto vertexCount = loadedModel.positions.size() - firstVertex;
+    return model;
+}
 
-            loadedModel.meshes.emplace_back(InputMeshInfo{
-                std::move(meshName),
-                materialId,
-                firstVertex,
-                vertexCount
-            });
-        }
+std::size_t ParsedObj::memory() const {
+    const auto& result = mParsed->result;
+
+    std::size_t bytes = sizeof(float) * (result.attributes.positions.size() + result.attributes.texcoords.size() +
+                                         result.attributes.normals.size());
+    for (const auto& shape : result.shapes) {
+        bytes += sizeof(shape) + shape.name.capacity() + sizeof(rapidobj::Index) * shape.mesh.indices.size();
+    }
+    bytes += sizeof(std::uint32_t) * (mParsed->faces.capacity() + mParsed->meshShapes.capacity());
+
+    for (const auto& mesh : mMeshes) {
+        bytes += sizeof(mesh) + mesh.meshName.capacity();
+    }
+    for (const auto& material : mMaterials) {
+        bytes += sizeof(material) + material.materialName.capacity();
     }
 
-    return loadedModel;
+    return bytes;
 }
@@ -1,5 +1,82 @@
 #pragma once
 
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <cstddef>
+
+#include <glm/vec3.hpp>
+
 #include "input_model.hpp"
 
-InputModel load_compressed_obj(const char* rawPath);
+/*
+ * zstd level used to create .obj-zstd files from .obj files. Only affects the
+ * bake when the .obj-zstd is missing or older than the .obj.
+ */
+constexpr int kDefaultObjCompressionLevel = 3; // ZSTD_CLEVEL_DEFAULT
+
+class BakeReport;
+
+/*
+ * A parsed .obj-zstd file, whose triangle soup is built on demand a few meshes
+ * at a time, see load_meshes(). The soup of every mesh at once takes several
+ * times the memory of the parsed OBJ, so it is never built for a whole scene.
+ *
+ * Meshes are the faces of one material within one OBJ shape. The faces of
+ * every shape are bucketed by material with a counting sort when the OBJ is
+ * loaded, so that building a mesh's soup only reads its own faces.
+ */
+class ParsedObj {
+public:
+    // Records the decompress, parse and bucket stages in the report, if given
+    explicit ParsedObj(
+        const char* rawPath,
+        int compressionLevel = kDefaultObjCompressionLevel,
+        BakeReport* report = nullptr
+    );
+
+    ~ParsedObj();
+
+    ParsedObj(const ParsedObj&) = delete;
+
+    ParsedObj& operator=(const ParsedObj&) = delete;
+
+    const std::string& source_path() const;
+
+    // Texture paths are relative to the working directory
+    std::vector<InputMaterialInfo>& materials();
+
+    const std::vector<InputMaterialInfo>& materials() const;
+
+    // In order of shape, then material. vertexStartIndex is where the mesh
+    // would start in the soup of the whole OBJ.
+    const std::vector<InputMeshInfo>& meshes() const;
+
+    // Centre of the mesh's bounding box
+    glm::vec3 mesh_centre(std::size_t mesh) const;
+
+    // Triangle soup of the meshes, one after the other in the given order.
+    // Safe to call from several threads at once.
+    InputModel load_meshes(std::span<const std::size_t> meshes) const;
+
+    // Bytes held by the parsed attributes, faces and records of the OBJ
+    std::size_t memory() const;
+
+private:
+    struct Parsed;
+
+    std::string mSourcePath;
+    std::vector<InputMaterialInfo> mMaterials;
+    std::vector<InputMeshInfo> mMeshes;
+
+    std::unique_ptr<Parsed> mParsed;
+};
+
+// Size in bytes of the OBJ text of a .obj-zstd path, 0 if unknown
+std::size_t obj_size(const char* rawPath);
+
+// Upper bound of the memory that loading a .obj-zstd path into a ParsedObj
+// takes, see ParsedObj::memory() for what is kept once it is loaded
+std::size_t parse_memory(const char* rawPath, int compressionLevel = kDefaultObjCompressionLevel);
@@ -1,23 +1,50 @@
+#include <array>
+#include <deque>
 #include <iterator>
+#include <map>
+#include <memory>
+#include <set>
+#include <optional>
+#include <span>
+#include <utility>
 #include <vector>
 #include <typeinfo>
 #include <exception>
 #include <filesystem>
-#include <system_error>
-#include <unordered_map>
 
+#include <algorithm>
+#include <numeric>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <string_view>
 
 #include <glm/glm.hpp>
 #include <glm/ext/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "bake_cache.hpp"
+#include "bake_report.hpp"
 #include "indexed_mesh.hpp"
+#include "instancing.hpp"
 #include "input_model.hpp"
+#include "job_system.hpp"
 #include "load_model_obj.hpp"
+#include "mesh_blob.hpp"
+#include "mesh_chunk.hpp"
+#include "mesh_compress.hpp"
+#include "mesh_merge.hpp"
+#include "mesh_optimize.hpp"
+#include "mesh_simplify.hpp"
+#include "scene_bvh.hpp"
+#include "memory_budget.hpp"
+#include "meshlet.hpp"
+#include "packed_mesh.hpp"
+#include "texture_bake.hpp"
+#include "weld_benchmark.hpp"
 
 #include "../vkutils/error.hpp"
+#include "../vkutils/vertex_packing.hpp"
 
 namespace {
     /*
@@ -34,6 +61,28 @@ namespace {
     constexpr char kFileMagic[16] = "\0\0SPICYMESH";
     constexpr char kFileVariant[16] = "spicy";
 
+    /*
+     * Variant with packed vertex streams: mesh-relative 16-bit positions,
+     * octahedral normals and tangents, and half-float texture coordinates
+     * (20 instead of 48 bytes per vertex). This is what the baker writes
+     * unless --float-vertices is given.
+     */
+    constexpr char kFileVariantPacked[16] = "spicy-packed";
+
+    /*
+     * Variant with the packed vertex streams and the indices compressed into
+     * independently decodable zstd blocks, see compress_mesh(). Written with
+     * --compress-meshes.
+     */
+    constexpr char kFileVariantCompressed[16] = "spicy-zstd";
+
+    /*
+     * Variant with the packed vertex streams and the indices of every mesh in
+     * one aligned blob after the last mesh, so that the runtime uploads them
+     * with a single copy, see MeshBlob. Written with --mesh-blob.
+     */
+    constexpr char kFileVariantBlob[16] = "spicy-blob";
+
     /*
      * Fallback textures
      */
@@ -41,42 +90,335 @@ namespace {
     constexpr char kTextureFallbackRGBA1111[] = ASSETS_SRC_PATH_"/rgba1111.png";
     constexpr char kTextureFallbackRRGGB05051[] = ASSETS_SRC_PATH_"/rrggb05051.png";
 
+    /*
+     * Tolerance under which two soup vertices are considered identical
+     */
+    constexpr float kWeldErrorTolerance = 1e-5f;
+
+    /*
+     * Upper bounds of the memory that the meshes take on their way through
+     * the baker, per triangle soup vertex of a batch and per welded vertex
+     * and index of a mesh, see batch_memory() and mesh_memory(). Measured on
+     * the scenes below, with some headroom.
+     */
+    constexpr std::size_t kWeldMemoryPerSoupVertex = 256;
+    constexpr std::size_t kWeldMemoryPerBatch = 256 * 1024;
+    constexpr std::size_t kBakeMemoryPerVertex = 192;
+    constexpr std::size_t kBakeMemoryPerIndex = 96;
+
+    // Packed streams of the kFileVariantCompressed and kFileVariantBlob variants
+    constexpr std::size_t kPackedMemoryPerVertex = 64;
+    constexpr std::size_t kPackedMemoryPerIndex = 16;
+    constexpr std::size_t kPackedMemoryPerMesh = 8 * kMeshBlobAlignment;
+
+    // Bounds, transforms and reports kept for the whole scene, per mesh
+    constexpr std::size_t kSceneMemoryPerMesh = 1024;
+
+    /*
+     * Versions of the baked outputs, part of the hashes in the bake manifests.
+     * Bump these whenever the baker's output changes for identical inputs, so
+     * that existing outputs are baked again.
+     */
+    constexpr std::uint32_t kMeshBakeVersion = 9;
+    constexpr std::uint32_t kTextureBakeVersion = 3;
+
+    // A source image is baked once for every kind of texture it is used as.
+    // Surface textures are packed from several images, see bake_texture().
+    struct TextureSource {
+        std::vector<std::string> paths;
+        TextureKind kind;
+
+        auto operator<=>(const TextureSource&) const = default;
+    };
+
+    // Sources with identical content share their info, see deduplicate_textures()
     struct TextureInfo {
         std::uint32_t uniqueId;
         std::uint8_t channels;
         std::string newPath;
     };
 
+    using TextureMap = std::map<TextureSource, TextureInfo>;
+
+    struct SceneInfo {
+        const char* inputObj;
+        const char* output;
+    };
+
+    struct BakeOptions {
+        // Write the kFileVariant float vertex streams instead of packed ones
+        bool floatVertices = false;
+        // Ignore the bake manifests and bake every scene and texture again
+        bool force = false;
+        // zstd level of .obj-zstd files created from .obj files
+        int objCompressionLevel = kDefaultObjCompressionLevel;
+        // Merge meshes sharing a material into batches, see merge_meshes()
+        bool mergeMeshes = false;
+        // Split meshes larger than this many world units, see chunk_meshes(). 0 disables chunking.
+        float maxChunkExtent = kMaxChunkExtent;
+        // Write the kFileVariantCompressed blocks instead of raw packed streams. Only loads faster
+        // than them on storage slower than a few hundred MB/s, see decodeCompressedMeshes() in ssr/baked_model.cpp.
+        bool compressMeshes = false;
+        // Write the kFileVariantBlob instead of raw packed streams
+        bool meshBlob = false;
+        /*
+         * Bound on the memory of the meshes and textures in flight, in bytes.
+         * 0 is unlimited. With a bound, scenes are baked one at a time, see
+         * MemoryBudget.
+         */
+        std::size_t maxMemory = 0;
+    };
+
     void process_model(
+        JobSystem& jobs,
+        MemoryBudget* budget,
         const char* inputObj,
         const char* output,
+        const BakeOptions& options,
         const glm::mat4& transform = glm::identity<glm::mat4>()
     );
 
-    InputModel normalize(InputModel);
+    std::vector<InputMaterialInfo> normalize(std::vector<InputMaterialInfo>);
+
+    // Hash of everything other than the inputs that affects the baked mesh
+    ContentHash settings_hash(const BakeOptions&, const glm::mat4& transform);
+
+    // The scene's OBJ files (compressed and uncompressed, if present) and the
+    // MTL files next to them. Textures are recorded separately once known.
+    std::vector<std::filesystem::path> scene_inputs(const char* inputObj);
+
+    // Whether the manifest's scene is up to date and all of its outputs exist
+    bool is_up_to_date(
+        const BakeManifest& manifest,
+        ContentHash settings,
+        const std::vector<std::filesystem::path>& inputs,
+        const std::filesystem::path& meshPath,
+        const std::filesystem::path& rootdir
+    );
+
+    /*
+     * Bytes reserved from a memory budget, released on destruction. Without a
+     * budget nothing is reserved, and every reservation succeeds.
+     */
+    class Reservation {
+    public:
+        explicit Reservation(MemoryBudget* budget = nullptr);
+
+        ~Reservation();
+
+        Reservation(Reservation&&) noexcept;
+
+        Reservation& operator=(Reservation&&) noexcept;
+
+        // See MemoryBudget::acquire() and MemoryBudget::try_acquire()
+        void acquire(std::size_t bytes);
+
+        bool try_acquire(std::size_t bytes);
+
+        // Moves bytes of this reservation into a reservation of their own
+        Reservation split(std::size_t bytes);
+
+        // Takes over the bytes of a reservation from the same budget
+        void merge(Reservation&& other);
+
+        // Releases all but bytes of the reservation
+        void shrink(std::size_t bytes);
+
+    private:
+        MemoryBudget* mBudget;
+        std::size_t mBytes = 0;
+    };
+
+    struct OptimizationReport {
+        VertexCacheStats before, after;
+    };
+
+    // A chunk of a batch, welded, see weld_batch()
+    struct WeldedMesh {
+        std::string name;
+        std::size_t materialIndex;
+
+        IndexedMesh mesh;
+        IndexingTimes times;
+        ContentHash signature;
+    };
+
+    // A unique mesh, ready to be written, see bake_mesh()
+    struct BakedMesh {
+        std::string name;
+        std::size_t materialIndex;
+
+        // Reordered, with the indices of every level of detail
+        IndexedMesh mesh;
+        std::vector<MeshLod> lods;
+        // Of every level, in index order
+        std::vector<Meshlet> meshlets;
+
+        OptimizationReport optimization;
+        IndexingTimes times;
+
+        // The streams of the kFileVariantCompressed and kFileVariantBlob variants
+        std::optional<CompressedMesh> compressed;
+        std::optional<BlobMesh> blob;
+    };
+
+    // Totals over the meshes of a scene, for its summary
+    struct MeshSummary {
+        std::size_t chunks = 0, unique = 0;
+        std::size_t inputVerts = 0;
+        std::size_t outputVerts = 0, outputIndices = 0, outputIndexBytes = 0, narrowMeshes = 0;
+        VertexCacheStats cacheBefore, cacheAfter;
+        std::size_t lodCount = 0, lodTriangles = 0, meshletCount = 0;
+        std::size_t bvhNodes = 0, bvhPrimitives = 0;
+        std::size_t compressedBlocks = 0, compressedBytes = 0, blobBytes = 0;
+    };
+
+    /*
+     * Bakes the batches' meshes and writes them to out, see write_mesh()
+     * for the layout. Every batch is welded, instanced and baked on its own
+     * and written as soon as it is done, with only a few batches in flight, so
+     * that no more than their bounds, transforms and signatures are kept for
+     * the whole scene. Spill files are created next to spillPath.
+     */
+    MeshSummary bake_meshes(
+        JobSystem& jobs,
+        MemoryBudget* budget,
+        const ParsedObj& obj,
+        const std::vector<MeshBatch>& batches,
+        FILE* out,
+        const std::filesystem::path& spillPath,
+        const BakeOptions& options,
+        BakeReport& report
+    );
+
+    // Upper bound of the memory that welding a batch of this many triangle
+    // soup vertices takes, including the memory of baking its meshes later
+    std::size_t batch_memory(std::size_t soupVertices, const BakeOptions&);
+
+    // Upper bound of the memory that baking a welded mesh takes
+    std::size_t mesh_memory(std::size_t vertices, std::size_t indices, const BakeOptions&);
+
+    // Chunks and welds the soup of the batch
+    std::vector<WeldedMesh> weld_batch(
+        JobSystem& jobs,
+        const ParsedObj& obj,
+        const MeshBatch& batch,
+        const BakeOptions& options,
+        float errorTolerance = kWeldErrorTolerance
+    );
 
-    void write_model_data(
+    // Reorders the mesh for the GPU, appends its levels of detail, and splits
+    // every level into meshlets for cluster culling
+    void bake_mesh(
+        JobSystem& jobs,
+        BakedMesh& baked,
+        const BakeOptions& options
+    );
+
+    // Header, textures and materials, up to the meshes
+    void write_model_header(
         FILE* out,
-        const InputModel& model,
-        const std::vector<IndexedMesh>& indexedMeshes,
-        const std::unordered_map<std::string, TextureInfo>& textures);
+        const std::vector<InputMaterialInfo>& materials,
+        const TextureMap& textures,
+        const BakeOptions& options
+    );
 
-    std::vector<IndexedMesh> index_meshes(
-        const InputModel& model,
-        float errorTolerance = 1e-5f
+    // One mesh record
+    void write_mesh(
+        FILE* out,
+        const BakedMesh& baked,
+        MeshBlob* blob,
+        const BakeOptions& options
     );
 
-    std::unordered_map<std::string, TextureInfo> find_unique_textures(
-        const InputModel&);
+    // Everything after the last mesh
+    void write_model_trailer(
+        FILE* out,
+        MeshBlob* blob,
+        const std::vector<std::vector<glm::mat4x3>>& instances,
+        const SceneBvh& bvh
+    );
+
+    TextureMap find_unique_textures(
+        const std::vector<InputMaterialInfo>&);
 
-    std::unordered_map<std::string, TextureInfo> populate_paths(
-        std::unordered_map<std::string, TextureInfo>,
+    // Roughness and metalness
+    TextureSource surface_source(const InputMaterialInfo&);
+
+    // Gives sources whose images have identical content the same unique ID.
+    // Hashes every image into the manifest, see BakeManifest::add_input().
+    TextureMap deduplicate_textures(
+        TextureMap,
+        const BakeManifest* previous,
+        BakeManifest& manifest
+    );
+
+    // Number of distinct unique IDs
+    std::size_t unique_texture_count(const TextureMap&);
+
+    TextureMap populate_paths(
+        TextureMap,
         const std::filesystem::path& textureDir
     );
+
+    struct TextureBakeReport {
+        TextureBakeSize size;
+        std::size_t upToDate = 0;
+    };
+
+    // Bakes the textures whose source or encoder changed since the previous
+    // manifest, and records all of them in the manifest
+    TextureBakeReport bake_textures(
+        JobSystem& jobs,
+        MemoryBudget* budget,
+        const TextureMap& textures,
+        const std::filesystem::path& rootdir,
+        const BakeManifest* previous,
+        BakeManifest& manifest
+    );
 }
 
 
-int main() try {
+int main(int argc, char* argv[]) try {
+    // --benchmark-weld: compare the welder against the reference implementation
+    // instead of baking. See weld_benchmark.hpp.
+    bool benchmarkWeld = false;
+    BakeOptions options;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string_view(argv[i]) == "--benchmark-weld") {
+            benchmarkWeld = true;
+        } else if (std::string_view(argv[i]) == "--float-vertices") {
+            options.floatVertices = true;
+        } else if (std::string_view(argv[i]) == "--force") {
+            options.force = true;
+        } else if (std::string_view(argv[i]) == "--obj-compression-level" && i + 1 < argc) {
+            options.objCompressionLevel = std::atoi(argv[++i]);
+        } else if (std::string_view(argv[i]) == "--merge-meshes") {
+            options.mergeMeshes = true;
+        } else if (std::string_view(argv[i]) == "--max-chunk-extent" && i + 1 < argc) {
+            options.maxChunkExtent = static_cast<float>(std::atof(argv[++i]));
+        } else if (std::string_view(argv[i]) == "--compress-meshes") {
+            options.compressMeshes = true;
+        } else if (std::string_view(argv[i]) == "--mesh-blob") {
+            options.meshBlob = true;
+        } else if (std::string_view(argv[i]) == "--max-memory" && i + 1 < argc) {
+            options.maxMemory = std::strtoull(argv[++i], nullptr, 10) * 1024 * 1024;
+        } else {
+            std::fprintf(stderr, "Usage: %s [--benchmark-weld] [--float-vertices | --compress-meshes | --mesh-blob] "
+                                 "[--force] "
+                                 "[--obj-compression-level <zstd level>] [--merge-meshes] "
+                                 "[--max-chunk-extent <world units>] [--max-memory <MiB>]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // Compressed meshes and the mesh blob are made of the packed vertex streams
+    if (int(options.floatVertices) + int(options.compressMeshes) + int(options.meshBlob) > 1) {
+        std::fprintf(stderr, "--float-vertices, --compress-meshes and --mesh-blob are mutually exclusive\n");
+        return 1;
+    }
+
+
 #   ifndef NDEBUG
     std::printf("Suggest running this in release mode (it appears to be running in debug)\n");
     std::printf("Especially under VisualStudio/MSVC, the debug build seems very slow.\n");
@@ -110,35 +452,68 @@ int main() try {
      * even while debugging the main program.
      */
 #	endif
-    process_model(
-        ASSETS_SRC_PATH_"/suntemple/suntemple.obj-zstd",
-        ASSETS_PATH_"/suntemple/suntemple.spicymesh"
-    );
-
-    process_model(
-        ASSETS_SRC_PATH_"/box/box.obj-zstd",
-        ASSETS_PATH_"/box/box.spicymesh"
-    );
+    constexpr std::array scenes{
+        SceneInfo{
+            ASSETS_SRC_PATH_"/suntemple/suntemple.obj-zstd",
+            ASSETS_PATH_"/suntemple/suntemple.spicymesh"
+        },
+        SceneInfo{
+            ASSETS_SRC_PATH_"/box/box.obj-zstd",
+            ASSETS_PATH_"/box/box.spicymesh"
+        },
+        SceneInfo{
+            ASSETS_SRC_PATH_"/shapes/shapes.obj-zstd",
+            ASSETS_PATH_"/shapes/shapes.spicymesh"
+        },
+        SceneInfo{
+            ASSETS_SRC_PATH_"/sponza/sponza_with_ship.obj-zstd",
+            ASSETS_PATH_"/sponza/sponza.spicymesh"
+        },
+        SceneInfo{
+            ASSETS_SRC_PATH_"/sphere/sphere.obj-zstd",
+            ASSETS_PATH_"/sphere/sphere.spicymesh"
+        },
+        SceneInfo{
+            ASSETS_SRC_PATH_"/bistro/bistro.obj-zstd",
+            ASSETS_PATH_"/bistro/bistro.spicymesh"
+        }
+    };
 
-    process_model(
-        ASSETS_SRC_PATH_"/shapes/shapes.obj-zstd",
-        ASSETS_PATH_"/shapes/shapes.spicymesh"
-    );
+    if (benchmarkWeld) {
+        for (const auto& scene : scenes) {
+            const ParsedObj obj(scene.inputObj, options.objCompressionLevel);
 
-    process_model(
-        ASSETS_SRC_PATH_"/sponza/sponza_with_ship.obj-zstd",
-        ASSETS_PATH_"/sponza/sponza.spicymesh"
-    );
+            std::vector<std::size_t> meshes(obj.meshes().size());
+            std::iota(meshes.begin(), meshes.end(), std::size_t(0));
+            benchmark_welders(obj.load_meshes(meshes), kWeldErrorTolerance);
+        }
+        return 0;
+    }
 
-    process_model(
-        ASSETS_SRC_PATH_"/sphere/sphere.obj-zstd",
-        ASSETS_PATH_"/sphere/sphere.spicymesh"
-    );
+    JobSystem jobs;
+    std::printf("Baking %zu scenes with %zu worker threads\n", scenes.size(), jobs.worker_count());
+
+    // With a memory budget, scenes are baked one after the other. Each scene
+    // reserves memory for its meshes and textures on this thread and fans them
+    // out onto the job system, see MemoryBudget. Concurrent scenes would hold
+    // parts of the budget while waiting for each other.
+    if (options.maxMemory > 0) {
+        MemoryBudget budget(options.maxMemory);
+        for (const auto& scene : scenes) {
+            process_model(jobs, &budget, scene.inputObj, scene.output, options);
+        }
+        return 0;
+    }
 
-    process_model(
-        ASSETS_SRC_PATH_"/bistro/bistro.obj-zstd",
-        ASSETS_PATH_"/bistro/bistro.spicymesh"
-    );
+    // Scenes are independent of each other, so bake them concurrently. Each
+    // scene additionally fans out its per-mesh work onto the same job system.
+    JobGroup sceneJobs;
+    for (const auto& scene : scenes) {
+        jobs.submit(sceneJobs, [&jobs, &scene, &options] {
+            process_model(jobs, nullptr, scene.inputObj, scene.output, options);
+        });
+    }
+    jobs.wait(sceneJobs);
 
     return 0;
 } catch (std::exception const& eErr) {
@@ -147,7 +522,12 @@ int main() try {
 }
 
 namespace {
-    void process_model(const char* inputObj, const char* output, const glm::mat4& transform) {
+    void process_model(JobSystem& jobs,
+                       MemoryBudget* budget,
+                       const char* inputObj,
+                       const char* output,
+                       const BakeOptions& options,
+                       const glm::mat4& transform) {
         static constexpr std::size_t vertexSize = sizeof(float) * (3 + 3 + 2);
 
         // Figure out output paths
@@ -156,90 +536,203 @@ namespace {
         const std::filesystem::path basename = outname.stem();
         const std::filesystem::path textureDir = basename.string() + "-tex";
 
-        // Load input model
-        const auto model = normalize(load_compressed_obj(inputObj));
+        auto mainpath = rootdir / basename;
+        mainpath.replace_extension("spicymesh");
 
-        std::size_t inputVerts = 0;
-        for (const auto& mesh : model.meshes) {
-            inputVerts += mesh.vertexCount;
+        // Skip the scene if nothing it is baked from changed since the last bake
+        const auto manifestPath = rootdir / (basename.string() + ".bake-manifest");
+        const auto settings = settings_hash(options, transform);
+
+        const auto previous = options.force ? std::nullopt : BakeManifest::load(manifestPath);
+        if (previous && is_up_to_date(*previous, settings, scene_inputs(inputObj), mainpath, rootdir)) {
+            std::printf("%s: up to date\n", inputObj);
+            return;
         }
 
-        std::printf("%s: %zu meshes, %zu materials\n", inputObj, model.meshes.size(), model.materials.size());
-        std::printf(" - triangle soup vertices: %zu => %zu kB\n", inputVerts, inputVerts * vertexSize / 1024);
+        // The outputs are about to change, don't let an interrupted bake leave
+        // a manifest that claims they are up to date
+        std::filesystem::remove(manifestPath);
 
-        // Index meshes
-        const auto indexed = index_meshes(model);
+        BakeReport report(inputObj);
 
-        std::size_t outputVerts = 0, outputIndices = 0;
-        for (const auto& mesh : indexed) {
-            outputVerts += mesh.vertices.size();
-            outputIndices += mesh.indices.size();
-        }
+        // Load input model. Parsing takes a few times the memory of what is
+        // kept of the OBJ, which is held until the meshes are written.
+        Reservation objMemory(budget);
+        objMemory.acquire(parse_memory(inputObj, options.objCompressionLevel));
+
+        auto obj = std::make_unique<ParsedObj>(inputObj, options.objCompressionLevel, &report);
+        objMemory.shrink(obj->memory());
 
-        std::printf(" - indexed vertices: %zu with %zu indices => %zu kB\n", outputVerts, outputIndices,
-                    (outputVerts * vertexSize + outputIndices * sizeof(std::uint32_t)) / 1024);
+        report.begin_stage("normalize");
+        obj->materials() = normalize(std::move(obj->materials()));
 
-        // Find list of unique textures
-        const auto textures = populate_paths(find_unique_textures(model), textureDir);
+        // Merge meshes into fewer draw calls, before indexing so that batches are welded as a whole
+        const auto& meshes = obj->meshes();
+        const std::size_t inputMeshes = meshes.size();
+        std::vector<MeshBatch> batches;
+        if (options.mergeMeshes) {
+            report.begin_stage("merge");
+
+            std::vector<glm::vec3> centres;
+            for (std::size_t i = 0; i < meshes.size(); ++i) {
+                centres.push_back(obj->mesh_centre(i));
+            }
 
-        std::printf(" - unique textures: %zu\n", textures.size());
+            batches = merge_meshes(obj->materials(), meshes, centres);
+        } else {
+            for (std::size_t i = 0; i < meshes.size(); ++i) {
+                batches.emplace_back(MeshBatch{meshes[i].meshName, meshes[i].materialIndex, {i}});
+            }
+        }
+
+        // Inputs are recorded after loading, which may have created the .obj-zstd
+        BakeManifest manifest(settings);
+        for (const auto& input : scene_inputs(inputObj)) {
+            manifest.add_input(input, previous ? &*previous : nullptr);
+        }
+
+        // Find list of unique textures, baking identical images only once.
+        // Materials refer to them by their unique IDs, which are written before the meshes.
+        const auto materials = obj->materials();
+        const auto textures = populate_paths(
+            deduplicate_textures(find_unique_textures(materials), previous ? &*previous : nullptr, manifest),
+            textureDir);
+        const std::size_t textureCount = unique_texture_count(textures);
 
         // Ensure output directory exists
         std::filesystem::create_directories(rootdir);
 
-        // Output mesh data
-        auto mainpath = rootdir / basename;
-        mainpath.replace_extension("spicymesh");
-
+        // Output mesh data. Meshes are written as they are baked.
+        report.begin_stage("meshes");
         FILE* fof = std::fopen(mainpath.string().c_str(), "wb");
         if (!fof)
             throw vkutils::Error("Unable to open '%s' for writing", mainpath.string().c_str());
 
+        MeshSummary summary;
         try {
-            write_model_data(fof, model, indexed, textures);
+            write_model_header(fof, materials, textures, options);
+            summary = bake_meshes(jobs, budget, *obj, batches, fof, mainpath, options, report);
         } catch (...) {
+            // Meshes are written as they are baked, don't leave half of them behind
             std::fclose(fof);
+            std::filesystem::remove(mainpath);
             throw;
         }
 
         std::fclose(fof);
-
-        // Copy textures
+        report.end_stage();
+
+        // The meshes are baked, only the textures are left
+        obj.reset();
+        objMemory.shrink(0);
+
+        // Scenes are baked concurrently, so emit the summary with a single call
+        // to keep it from interleaving with the output of other scenes
+        std::printf("%s: %zu meshes, %zu materials\n"
+                    " - spatial chunks: %zu meshes => %zu\n"
+                    " - drawn meshes: %zu, %zu unique\n"
+                    " - triangle soup vertices: %zu => %zu kB\n"
+                    " - indexed vertices: %zu with %zu indices => %zu kB\n"
+                    " - 16-bit indices: %zu out of %zu meshes\n"
+                    " - vertex cache: ACMR %.3f => %.3f, ATVR %.3f => %.3f\n"
+                    " - levels of detail: %zu with %zu triangles\n"
+                    " - meshlets: %zu, %.1f triangles on average\n"
+                    " - scene BVH: %zu nodes over %zu instances\n"
+                    " - compressed meshes: %zu blocks, %zu kB\n"
+                    " - mesh blob: %zu kB\n"
+                    " - unique textures: %zu from %zu sources\n",
+                    inputObj, inputMeshes, materials.size(),
+                    batches.size(), summary.chunks,
+                    summary.chunks, summary.unique,
+                    summary.inputVerts, summary.inputVerts * vertexSize / 1024,
+                    summary.outputVerts, summary.outputIndices,
+                    (summary.outputVerts * vertexSize + summary.outputIndexBytes) / 1024,
+                    summary.narrowMeshes, summary.unique,
+                    summary.cacheBefore.acmr(), summary.cacheAfter.acmr(),
+                    summary.cacheBefore.atvr(), summary.cacheAfter.atvr(),
+                    summary.lodCount, summary.lodTriangles,
+                    summary.meshletCount,
+                    summary.meshletCount
+                        ? static_cast<double>(summary.outputIndices / 3 + summary.lodTriangles) / summary.meshletCount
+                        : 0.0,
+                    summary.bvhNodes, summary.bvhPrimitives,
+                    summary.compressedBlocks, summary.compressedBytes / 1024,
+                    summary.blobBytes / 1024,
+                    textureCount, textures.size());
+
+        // Bake textures
         std::filesystem::create_directories(rootdir / textureDir);
 
-        std::size_t errors = 0;
-        for (const auto& textureEntry : textures) {
-            const auto dest = rootdir / textureEntry.second.newPath;
+        report.begin_stage("textures");
+        const auto [textureSize, texturesUpToDate] =
+                bake_textures(jobs, budget, textures, rootdir, previous ? &*previous : nullptr, manifest);
+        report.end_stage();
+        std::printf("%s: baked %zu textures (%zu up to date), %zu kB as RGBA8 => %zu kB block compressed\n",
+                    inputObj, textureCount, texturesUpToDate,
+                    textureSize.uncompressedBytes / 1024, textureSize.compressedBytes / 1024);
 
-            std::error_code errorCode;
-            bool ret = std::filesystem::copy_file(
-                textureEntry.first,
-                dest,
-                std::filesystem::copy_options::none,
-                errorCode
-            );
+        manifest.save(manifestPath);
+        report.save(rootdir / (basename.string() + ".bake-report.json"));
+    }
+
+    ContentHash settings_hash(const BakeOptions& options, const glm::mat4& transform) {
+        ContentHash hash = hash_bytes(&kMeshBakeVersion, sizeof(kMeshBakeVersion));
+        hash = hash_bytes(&options.floatVertices, sizeof(options.floatVertices), hash);
+        hash = hash_bytes(&options.mergeMeshes, sizeof(options.mergeMeshes), hash);
+        hash = hash_bytes(&options.maxChunkExtent, sizeof(options.maxChunkExtent), hash);
+        hash = hash_bytes(&options.compressMeshes, sizeof(options.compressMeshes), hash);
+        hash = hash_bytes(&options.meshBlob, sizeof(options.meshBlob), hash);
+        hash = hash_bytes(glm::value_ptr(transform), sizeof(float) * 16, hash);
+        return hash_bytes(&kWeldErrorTolerance, sizeof(kWeldErrorTolerance), hash);
+    }
 
-            if (!ret) {
-                ++errors;
-                std::fprintf(stderr, "copy_file(): '%s' failed: %s (%s)\n", dest.string().c_str(),
-                             errorCode.message().c_str(),
-                             errorCode.category().name());
+    std::vector<std::filesystem::path> scene_inputs(const char* inputObj) {
+        const std::filesystem::path compressedObjPath(inputObj);
+        std::filesystem::path objPath(compressedObjPath);
+        objPath.replace_extension(".obj");
+
+        std::vector<std::filesystem::path> inputs;
+        for (const auto& path : {compressedObjPath, objPath}) {
+            if (std::filesystem::exists(path)) {
+                inputs.emplace_back(path);
             }
         }
 
-        const auto total = textures.size();
-        std::printf("Copied %zu textures out of %zu.\n", total - errors, total);
-        if (errors) {
-            std::fprintf(
-                stderr,
-                "Some copies reported an error. Currently, the code will never overwrite existing files. The errors likely just indicate that the file was copied previously. Remove old files manually, if necessary.\n");
+        // Any material library in the directory may be referenced by the OBJ.
+        // Sort them, directory iteration order is unspecified.
+        const auto firstLibrary = inputs.size();
+        for (const auto& entry : std::filesystem::directory_iterator(compressedObjPath.parent_path())) {
+            if (entry.is_regular_file() && entry.path().extension() == ".mtl") {
+                inputs.emplace_back(entry.path());
+            }
         }
+        std::sort(inputs.begin() + static_cast<std::ptrdiff_t>(firstLibrary), inputs.end());
+
+        return inputs;
+    }
+
+    bool is_up_to_date(const BakeManifest& manifest,
+                       const ContentHash settings,
+                       const std::vector<std::filesystem::path>& inputs,
+                       const std::filesystem::path& meshPath,
+                       const std::filesystem::path& rootdir) {
+        if (manifest.settings() != settings || !std::filesystem::exists(meshPath)) {
+            return false;
+        }
+
+        for (const auto& texture : manifest.textures()) {
+            if (!std::filesystem::exists(rootdir / texture.path)) {
+                return false;
+            }
+        }
+
+        return manifest.inputs_unchanged(inputs);
     }
 }
 
 namespace {
-    InputModel normalize(InputModel model) {
-        for (auto& material : model.materials) {
+    std::vector<InputMaterialInfo> normalize(std::vector<InputMaterialInfo> materials) {
+        for (auto& material : materials) {
             if (material.baseColorTexturePath.empty()) {
                 material.baseColorTexturePath = kTextureFallbackRGBA1111;
             }
@@ -259,7 +752,7 @@ namespace {
         }
 
         // This should use the move constructor implicitly
-        return model;
+        return materials;
     }
 }
 
@@ -282,16 +775,57 @@ namespace {
         checked_write(out, length, string);
     }
 
-    void write_model_data(FILE* out,
-                          const InputModel& model,
-                          const std::vector<IndexedMesh>& indexedMeshes,
-                          const std::unordered_map<std::string, TextureInfo>& textures) {
+    void write_float_vertices(FILE* out, const IndexedMesh& mesh) {
+        // Format:
+        //  - repeat V times: vec3 position
+        //  - repeat V times: vec3 normal
+        //  - repeat V times: vec2 texture coordinate
+        //  - repeat V times: vec4 tangent
+        const std::size_t vertexCount = mesh.vertices.size();
+
+        checked_write(out, sizeof(glm::vec3) * vertexCount, mesh.vertices.data());
+        checked_write(out, sizeof(glm::vec3) * vertexCount, mesh.normals.data());
+        checked_write(out, sizeof(glm::vec2) * vertexCount, mesh.texcoords.data());
+        checked_write(out, sizeof(glm::vec4) * vertexCount, mesh.tangent.data());
+    }
+
+    void write_packed_vertices(FILE* out, const IndexedMesh& mesh) {
+        // Format:
+        //  - vec3 : position origin
+        //  - vec3 : position extent
+        //  - repeat V times: u16vec4 position, (x, y, z) as UNORM16 relative to
+        //                    origin and extent, w = tangent handedness
+        //                    (0 => -1, 0xFFFF => +1)
+        //  - repeat V times: i16vec2 octahedral normal, SNORM16
+        //  - repeat V times: u16vec2 texture coordinate, half floats
+        //  - repeat V times: i16vec2 octahedral tangent, SNORM16
+        const std::size_t vertexCount = mesh.vertices.size();
+        const auto packed = pack_vertices(mesh);
+
+        checked_write(out, sizeof(glm::vec3), glm::value_ptr(packed.origin));
+        checked_write(out, sizeof(glm::vec3), glm::value_ptr(packed.extent));
+        checked_write(out, sizeof(glm::u16vec4) * vertexCount, packed.positions.data());
+        checked_write(out, sizeof(glm::i16vec2) * vertexCount, packed.normals.data());
+        checked_write(out, sizeof(glm::u16vec2) * vertexCount, packed.texcoords.data());
+        checked_write(out, sizeof(glm::i16vec2) * vertexCount, packed.tangents.data());
+    }
+
+    void write_model_header(FILE* out,
+                            const std::vector<InputMaterialInfo>& materials,
+                            const TextureMap& textures,
+                            const BakeOptions& options) {
         // Write header
         // Format:
         //   - char[16] : file magic
         //   - char[16] : file variant ID
         checked_write(out, sizeof(char) * 16, kFileMagic);
-        checked_write(out, sizeof(char) * 16, kFileVariant);
+        const char* variant = options.floatVertices ? kFileVariant : kFileVariantPacked;
+        if (options.compressMeshes) {
+            variant = kFileVariantCompressed;
+        } else if (options.meshBlob) {
+            variant = kFileVariantBlob;
+        }
+        checked_write(out, sizeof(char) * 16, variant);
 
         // Write list of unique textures
         // Format:
@@ -299,9 +833,11 @@ namespace {
         //  - repeat U times:
         //    - string : path to texture
         //    - uint8_t : number of channels in texture
-        std::vector<const TextureInfo*> orderedUnique(textures.size());
+        // Deduplicated sources share their unique ID
+        std::vector<const TextureInfo*> orderedUnique(unique_texture_count(textures));
         for (const auto& texture : textures) {
-            assert(!orderedUnique[texture.second.uniqueId]);
+            assert(!orderedUnique[texture.second.uniqueId] ||
+                   orderedUnique[texture.second.uniqueId]->newPath == texture.second.newPath);
             orderedUnique[texture.second.uniqueId] = &texture.second;
         }
 
@@ -327,159 +863,782 @@ namespace {
         //    - float : base metalness
         //    - uint32_t : base color texture index
         //    - uint32_t : emissive texture index
-        //    - uint32_t : roughness texture index
-        //    - uint32_t : metalness texture index
+        //    - uint32_t : surface texture index (roughness, metalness)
         //    - uint32_t : normalMap texture index
-        //    - uint32_t : alphaMask texture index, or 0xFFFFFFFF if none is provided
-        const std::uint32_t materialCount = static_cast<std::uint32_t>(model.materials.size());
+        //    - uint32_t : alphaMask texture index, or 0xFFFFFFFF if none
+        const std::uint32_t materialCount = static_cast<std::uint32_t>(materials.size());
         checked_write(out, sizeof(materialCount), &materialCount);
 
-        for (const auto& material : model.materials) {
+        for (const auto& material : materials) {
             write_string(out, material.materialName.c_str());
             checked_write(out, sizeof(glm::vec3), glm::value_ptr(material.baseColor));
             checked_write(out, sizeof(glm::vec3), glm::value_ptr(material.baseEmission));
             checked_write(out, sizeof(float), &material.baseRoughness);
             checked_write(out, sizeof(float), &material.baseMetalness);
 
-            const auto writeTex = [&textures, &out](const std::string& rawTexturePath) {
-                if (rawTexturePath.empty()) {
-                    static constexpr std::uint32_t sentinel = ~static_cast<std::uint32_t>(0);
-                    checked_write(out, sizeof(std::uint32_t), &sentinel);
-                    return;
-                }
-
-                const auto it = textures.find(rawTexturePath);
+            const auto writeTex = [&textures, &out](const TextureSource& source) {
+                const auto it = textures.find(source);
                 assert(textures.end() != it);
 
                 checked_write(out, sizeof(std::uint32_t), &it->second.uniqueId);
             };
 
-            writeTex(material.baseColorTexturePath);
-            writeTex(material.emissiveTexturePath);
-            writeTex(material.roughnessTexturePath);
-            writeTex(material.metalnessTexturePath);
-            writeTex(material.normalMapTexturePath);
-            writeTex(material.alphaMaskTexturePath);
+            writeTex(TextureSource{{material.baseColorTexturePath}, TextureKind::baseColor});
+            writeTex(TextureSource{{material.emissiveTexturePath}, TextureKind::emissive});
+            writeTex(surface_source(material));
+            writeTex(TextureSource{{material.normalMapTexturePath}, TextureKind::normalMap});
+
+            if (material.has_alpha_mask()) {
+                writeTex(TextureSource{{material.alphaMaskTexturePath}, TextureKind::alphaMask});
+            } else {
+                constexpr std::uint32_t noTexture = 0xFFFFFFFF;
+                checked_write(out, sizeof(noTexture), &noTexture);
+            }
         }
+    }
 
-        // Write mesh data
+    void write_mesh(FILE* out, const BakedMesh& baked, MeshBlob* blob, const BakeOptions& options) {
+        // Write a mesh record. Records follow the number of meshes, see
+        // bake_meshes(), and are written in the order meshes are baked.
         // Format:
-        //  - uint32_t : M = number of meshes
-        //  - repeat M times:
-        //    - uint32_t : material index
-        //    - uint32_t : V = number of vertices
-        //    - uint32_t : I = number of indices
-        //    - repeat V times: vec3 position
-        //    - repeat V times: vec3 normal
-        //    - repeat V times: vec2 texture coordinate
-        //    - repeat I times: uint32_t index
-        const std::uint32_t meshCount = static_cast<std::uint32_t>(model.meshes.size());
-        checked_write(out, sizeof(meshCount), &meshCount);
+        //  - string : name
+        //  - uint32_t : material index
+        //  - uint32_t : V = number of vertices
+        //  - uint32_t : I = number of indices
+        //  - uint8_t : S = size of an index in bytes, 2 if V <= 65536, else 4
+        //  - vec3 : bounding box min
+        //  - vec3 : bounding box max
+        //  - vec3 : bounding sphere center
+        //  - float : bounding sphere radius
+        //  - uint32_t : L = number of levels of detail, at least 1
+        //  - repeat L times:
+        //    - uint32_t : first index
+        //    - uint32_t : number of indices
+        //    - float : simplification error in model space units
+        //  - vertex data, see write_float_vertices() and write_packed_vertices()
+        //  - repeat I times: uint16_t or uint32_t index, depending on S
+        //  - uint32_t : C = number of meshlets
+        //  - repeat C times:
+        //    - uint32_t : first index
+        //    - uint32_t : number of indices
+        //    - vec3 : bounding sphere center
+        //    - float : bounding sphere radius
+        //    - vec3 : normal cone axis
+        //    - float : normal cone cutoff, see Meshlet
+        //  In the kFileVariantCompressed variant, the vertex data is only the
+        //  position origin and extent, and the indices are replaced by the
+        //  mesh's compressed blocks, see compress_mesh():
+        //  - uint32_t : K = number of blocks
+        //  - repeat K times, ordered by stream and first element:
+        //    - uint32_t : stream, 0 to 4 = positions, normals, texture coordinates, tangents, indices
+        //    - uint32_t : first element
+        //    - uint32_t : number of elements
+        //    - uint32_t : Z = compressed size in bytes
+        //  - repeat K times: Z bytes, a zstd frame of the block's byte shuffled elements
+        //  In the kFileVariantBlob variant, the vertex data is the position
+        //  origin and extent followed by the offsets of the streams in the
+        //  blob after the last mesh, and there are no indices:
+        //  - uint64_t : positions, normals, texture coordinates, tangents and indices offsets
+        const auto& indexedMesh = baked.mesh;
+
+        write_string(out, baked.name.c_str());
+
+        std::uint32_t materialIndex = static_cast<std::uint32_t>(baked.materialIndex);
+        checked_write(out, sizeof(materialIndex), &materialIndex);
+
+        std::uint32_t vertexCount = static_cast<std::uint32_t>(indexedMesh.vertices.size());
+        checked_write(out, sizeof(vertexCount), &vertexCount);
+        std::uint32_t indexCount = static_cast<std::uint32_t>(indexedMesh.indices.size());
+        checked_write(out, sizeof(indexCount), &indexCount);
+        std::uint8_t indexSize = index_size(indexedMesh);
+        checked_write(out, sizeof(indexSize), &indexSize);
+
+        checked_write(out, sizeof(glm::vec3), glm::value_ptr(indexedMesh.aabbMin));
+        checked_write(out, sizeof(glm::vec3), glm::value_ptr(indexedMesh.aabbMax));
+        checked_write(out, sizeof(glm::vec3), glm::value_ptr(indexedMesh.sphereCenter));
+        checked_write(out, sizeof(float), &indexedMesh.sphereRadius);
+
+        const std::uint32_t lodCount = static_cast<std::uint32_t>(baked.lods.size());
+        checked_write(out, sizeof(lodCount), &lodCount);
+
+        for (const auto& lod : baked.lods) {
+            checked_write(out, sizeof(std::uint32_t), &lod.firstIndex);
+            checked_write(out, sizeof(std::uint32_t), &lod.indexCount);
+            checked_write(out, sizeof(float), &lod.error);
+        }
+
+        if (baked.compressed) {
+            const auto& compressed = *baked.compressed;
+            checked_write(out, sizeof(glm::vec3), glm::value_ptr(compressed.positionOrigin));
+            checked_write(out, sizeof(glm::vec3), glm::value_ptr(compressed.positionExtent));
+
+            const std::uint32_t blockCount = static_cast<std::uint32_t>(compressed.blocks.size());
+            checked_write(out, sizeof(blockCount), &blockCount);
+
+            for (const auto& block : compressed.blocks) {
+                const std::uint32_t compressedSize = static_cast<std::uint32_t>(block.data.size());
+                checked_write(out, sizeof(std::uint32_t), &block.stream);
+                checked_write(out, sizeof(std::uint32_t), &block.firstElement);
+                checked_write(out, sizeof(std::uint32_t), &block.elementCount);
+                checked_write(out, sizeof(compressedSize), &compressedSize);
+            }
 
-        assert(model.meshes.size() == indexedMeshes.size());
-        for (std::size_t i = 0; i < model.meshes.size(); ++i) {
-            const auto& modelMesh = model.meshes[i];
+            for (const auto& block : compressed.blocks) {
+                checked_write(out, block.data.size(), block.data.data());
+            }
+        } else if (baked.blob) {
+            assert(blob);
+            const auto streams = blob->append(*baked.blob);
+            checked_write(out, sizeof(glm::vec3), glm::value_ptr(baked.blob->positionOrigin));
+            checked_write(out, sizeof(glm::vec3), glm::value_ptr(baked.blob->positionExtent));
+            for (const std::uint64_t offset : {streams.positions, streams.normals, streams.texcoords,
+                                               streams.tangents, streams.indices}) {
+                checked_write(out, sizeof(offset), &offset);
+            }
+        } else {
+            if (options.floatVertices) {
+                write_float_vertices(out, indexedMesh);
+            } else {
+                write_packed_vertices(out, indexedMesh);
+            }
+
+            if (sizeof(std::uint16_t) == indexSize) {
+                const std::vector<std::uint16_t> narrowIndices(indexedMesh.indices.begin(), indexedMesh.indices.end());
+                checked_write(out, sizeof(std::uint16_t) * indexCount, narrowIndices.data());
+            } else {
+                checked_write(out, sizeof(std::uint32_t) * indexCount, indexedMesh.indices.data());
+            }
+        }
+
+        const std::uint32_t meshletCount = static_cast<std::uint32_t>(baked.meshlets.size());
+        checked_write(out, sizeof(meshletCount), &meshletCount);
+
+        for (const auto& meshlet : baked.meshlets) {
+            checked_write(out, sizeof(std::uint32_t), &meshlet.firstIndex);
+            checked_write(out, sizeof(std::uint32_t), &meshlet.indexCount);
+            checked_write(out, sizeof(glm::vec3), glm::value_ptr(meshlet.sphereCenter));
+            checked_write(out, sizeof(float), &meshlet.sphereRadius);
+            checked_write(out, sizeof(glm::vec3), glm::value_ptr(meshlet.coneAxis));
+            checked_write(out, sizeof(float), &meshlet.coneCutoff);
+        }
+    }
+
+    void write_model_trailer(FILE* out,
+                             MeshBlob* blob,
+                             const std::vector<std::vector<glm::mat4x3>>& instances,
+                             const SceneBvh& bvh) {
+        // Write the blob of the kFileVariantBlob variant, see MeshBlob
+        // Format:
+        //  - uint64_t : B = size of the blob in bytes
+        //  - zero padding up to the next multiple of kMeshBlobAlignment bytes in the file
+        //  - B bytes : the blob
+        if (blob) {
+            const std::uint64_t blobSize = blob->size();
+            checked_write(out, sizeof(blobSize), &blobSize);
+
+            const long position = std::ftell(out);
+            if (position < 0) {
+                throw vkutils::Error("Unable to query the position in the output file");
+            }
+
+            static constexpr std::uint8_t padding[kMeshBlobAlignment] = {};
+            checked_write(out, (kMeshBlobAlignment - std::size_t(position) % kMeshBlobAlignment) % kMeshBlobAlignment,
+                          padding);
+            blob->write(out);
+        }
+
+        // Write the instances of every mesh, only known once every mesh is baked
+        // Format:
+        //  - repeat M times, once per mesh in the order of the records:
+        //    - uint32_t : N = number of instances, at least 1
+        //    - repeat N times: mat4x3 model to world transform, column-major
+        for (const auto& transforms : instances) {
+            const std::uint32_t instanceCount = static_cast<std::uint32_t>(transforms.size());
+            checked_write(out, sizeof(instanceCount), &instanceCount);
+            checked_write(out, sizeof(glm::mat4x3) * instanceCount, transforms.data());
+        }
+
+        // Write the scene BVH, see build_scene_bvh()
+        // Format:
+        //  - uint32_t : B = number of nodes
+        //  - repeat B times, depth-first:
+        //    - vec3 : bounding box min
+        //    - uint32_t : right child of inner nodes, first primitive of leaves
+        //    - vec3 : bounding box max
+        //    - uint32_t : number of primitives, 0 for inner nodes
+        //  - uint32_t : P = number of primitives
+        //  - repeat P times:
+        //    - uint32_t : mesh index
+        //    - uint32_t : instance index
+        const std::uint32_t nodeCount = static_cast<std::uint32_t>(bvh.nodes.size());
+        checked_write(out, sizeof(nodeCount), &nodeCount);
+        checked_write(out, sizeof(BvhNode) * nodeCount, bvh.nodes.data());
+
+        const std::uint32_t primitiveCount = static_cast<std::uint32_t>(bvh.primitives.size());
+        checked_write(out, sizeof(primitiveCount), &primitiveCount);
+        checked_write(out, sizeof(BvhPrimitive) * primitiveCount, bvh.primitives.data());
+    }
+
+}
+
+namespace {
+    Reservation::Reservation(MemoryBudget* budget)
+        : mBudget(budget) {
+    }
 
-            write_string(out, modelMesh.meshName.c_str());
+    Reservation::~Reservation() {
+        shrink(0);
+    }
+
+    Reservation::Reservation(Reservation&& other) noexcept
+        : mBudget(other.mBudget), mBytes(std::exchange(other.mBytes, 0)) {
+    }
 
-            std::uint32_t materialIndex = static_cast<std::uint32_t>(modelMesh.materialIndex);
-            checked_write(out, sizeof(materialIndex), &materialIndex);
+    Reservation& Reservation::operator=(Reservation&& other) noexcept {
+        if (this != &other) {
+            shrink(0);
+            mBudget = other.mBudget;
+            mBytes = std::exchange(other.mBytes, 0);
+        }
+        return *this;
+    }
+
+    void Reservation::acquire(const std::size_t bytes) {
+        if (mBudget) {
+            mBudget->acquire(bytes);
+            mBytes += bytes;
+        }
+    }
+
+    bool Reservation::try_acquire(const std::size_t bytes) {
+        if (!mBudget) {
+            return true;
+        }
+
+        if (!mBudget->try_acquire(bytes)) {
+            return false;
+        }
 
-            const auto& indexedMesh = indexedMeshes[i];
+        mBytes += bytes;
+        return true;
+    }
 
-            std::uint32_t vertexCount = static_cast<std::uint32_t>(indexedMesh.vertices.size());
-            checked_write(out, sizeof(vertexCount), &vertexCount);
-            std::uint32_t indexCount = static_cast<std::uint32_t>(indexedMesh.indices.size());
-            checked_write(out, sizeof(indexCount), &indexCount);
+    Reservation Reservation::split(const std::size_t bytes) {
+        Reservation part(mBudget);
+        if (mBudget) {
+            assert(bytes <= mBytes);
+            mBytes -= bytes;
+            part.mBytes = bytes;
+        }
+        return part;
+    }
 
-            checked_write(out, sizeof(glm::vec3) * vertexCount, indexedMesh.vertices.data());
-            checked_write(out, sizeof(glm::vec3) * vertexCount, indexedMesh.normals.data());
-            checked_write(out, sizeof(glm::vec2) * vertexCount, indexedMesh.texcoords.data());
-            checked_write(out, sizeof(glm::vec4) * vertexCount, indexedMesh.tangent.data());
+    void Reservation::merge(Reservation&& other) {
+        assert(mBudget == other.mBudget);
+        mBytes += std::exchange(other.mBytes, 0);
+    }
 
-            checked_write(out, sizeof(std::uint32_t) * indexCount, indexedMesh.indices.data());
+    void Reservation::shrink(const std::size_t bytes) {
+        if (mBudget && bytes < mBytes) {
+            mBudget->release(mBytes - bytes);
+            mBytes = bytes;
         }
     }
 }
 
 namespace {
-    std::vector<IndexedMesh> index_meshes(const InputModel& model, float errorTolerance) {
-        std::vector<IndexedMesh> indexed;
+    MeshSummary bake_meshes(JobSystem& jobs,
+                            MemoryBudget* budget,
+                            const ParsedObj& obj,
+                            const std::vector<MeshBatch>& batches,
+                            FILE* out,
+                            const std::filesystem::path& spillPath,
+                            const BakeOptions& options,
+                            BakeReport& report) {
+        // A batch is welded as a whole, then every unique mesh of it is baked
+        // on its own. Welded meshes wait for the instance finder, baked meshes
+        // for the file, in the order of the batches, so that the file is
+        // identical to a bake of the whole scene at once.
+        struct PendingBatch {
+            JobGroup group;
+            std::vector<WeldedMesh> meshes;
+            Reservation memory;
+        };
+
+        struct PendingMesh {
+            JobGroup group;
+            BakedMesh baked;
+            Reservation memory;
+        };
+
+        MeshSummary summary;
+
+        InstanceFinder finder(spillPath.string() + ".instances.tmp");
+
+        std::optional<MeshBlob> blob;
+        if (options.meshBlob) {
+            blob.emplace(spillPath.string() + ".blob.tmp");
+        }
+
+        // The number of meshes is only known once every batch is instanced
+        const long meshCountPosition = std::ftell(out);
+        if (meshCountPosition < 0) {
+            throw vkutils::Error("Unable to query the position in the output file");
+        }
+
+        std::uint32_t meshCount = 0;
+        checked_write(out, sizeof(meshCount), &meshCount);
+
+        // Only the bounds, transforms and reports of the meshes are kept for the scene
+        std::vector<MeshBounds> bounds;
+        std::vector<std::vector<glm::mat4x3>> instances;
+        std::vector<MeshReport> meshReports;
+        Reservation sceneMemory(budget);
+
+        std::deque<std::unique_ptr<PendingBatch>> pendingBatches;
+        std::deque<std::unique_ptr<PendingMesh>> pendingMeshes;
+
+        const auto commitBatch = [&] {
+            auto batch = std::move(pendingBatches.front());
+            pendingBatches.pop_front();
+            jobs.wait(batch->group);
+
+            // Candidates read back by the finder fit into the memory of the
+            // meshes that are instances and never baked
+            for (auto& welded : batch->meshes) {
+                // One index per triangle soup vertex, before simplification
+                ++summary.chunks;
+                summary.inputVerts += welded.mesh.indices.size();
+                sceneMemory.merge(batch->memory.split(kSceneMemoryPerMesh));
+
+                const auto instance = finder.add(welded.mesh, welded.materialIndex, welded.signature);
+                if (instance) {
+                    instances[instance->unique].push_back(instance->transform);
+                    continue;
+                }
+
+                instances.push_back({glm::mat4x3(1.f)});
+
+                auto pending = std::make_unique<PendingMesh>();
+                pending->memory = batch->memory.split(
+                    mesh_memory(welded.mesh.vertices.size(), welded.mesh.indices.size(), options));
+                pending->baked = BakedMesh{
+                    .name = std::move(welded.name),
+                    .materialIndex = welded.materialIndex,
+                    .mesh = std::move(welded.mesh),
+                    .times = welded.times
+                };
+
+                auto& baked = pending->baked;
+                jobs.submit(pending->group, [&jobs, &baked, &options] {
+                    bake_mesh(jobs, baked, options);
+                });
+                pendingMeshes.emplace_back(std::move(pending));
+            }
+        };
 
-        for (const auto& mesh : model.meshes) {
-            const auto endIndex = mesh.vertexStartIndex + mesh.vertexCount;
+        const auto writeMesh = [&] {
+            auto pending = std::move(pendingMeshes.front());
+            pendingMeshes.pop_front();
+            jobs.wait(pending->group);
+
+            const auto& baked = pending->baked;
+            write_mesh(out, baked, blob ? &*blob : nullptr, options);
+
+            const auto& mesh = baked.mesh;
+            const auto& lods = baked.lods;
+            summary.outputVerts += mesh.vertices.size();
+            summary.outputIndices += lods.front().indexCount;
+            summary.outputIndexBytes += mesh.indices.size() * index_size(mesh);
+            summary.narrowMeshes += sizeof(std::uint16_t) == index_size(mesh) ? 1 : 0;
+            summary.cacheBefore += baked.optimization.before;
+            summary.cacheAfter += baked.optimization.after;
+            summary.lodCount += lods.size() - 1;
+            summary.lodTriangles += (mesh.indices.size() - lods.front().indexCount) / 3;
+            summary.meshletCount += baked.meshlets.size();
+            if (baked.compressed) {
+                summary.compressedBlocks += baked.compressed->blocks.size();
+                for (const auto& block : baked.compressed->blocks) {
+                    summary.compressedBytes += block.data.size();
+                }
+            }
+
+            bounds.push_back(MeshBounds{mesh.aabbMin, mesh.aabbMax});
+            meshReports.push_back(MeshReport{
+                .name = baked.name,
+                .triangles = lods.front().indexCount / 3,
+                .vertices = mesh.vertices.size(),
+                .cacheBefore = baked.optimization.before,
+                .cacheAfter = baked.optimization.after,
+                .lods = lods.size(),
+                .meshlets = baked.meshlets.size(),
+                .weldSeconds = baked.times.weld,
+                .tangentSeconds = baked.times.tangents
+            });
+        };
 
-            TriangleSoup soup;
+        // Commits the oldest batch once it is welded, or else writes the
+        // oldest mesh, freeing its memory. False if nothing is in flight.
+        const auto retireOne = [&] {
+            if (!pendingBatches.empty() && (pendingMeshes.empty() || pendingBatches.front()->group.done())) {
+                commitBatch();
+                return true;
+            }
 
-            soup.vertices.reserve(mesh.vertexCount);
-            for (std::size_t i = mesh.vertexStartIndex; i < endIndex; ++i) {
-                soup.vertices.emplace_back(model.positions[i]);
+            if (!pendingMeshes.empty()) {
+                writeMesh();
+                return true;
             }
 
-            soup.texcoords.reserve(mesh.vertexCount);
-            for (std::size_t i = mesh.vertexStartIndex; i < endIndex; ++i) {
-                soup.texcoords.emplace_back(model.texcoords[i]);
+            return false;
+        };
+
+        const auto reserve = [&](Reservation& reservation, const std::size_t bytes) {
+            while (!reservation.try_acquire(bytes)) {
+                if (!retireOne()) {
+                    throw vkutils::Error("%s: %zu MiB more do not fit into --max-memory, try a larger one",
+                                         obj.source_path().c_str(), (bytes + 1024 * 1024 - 1) / (1024 * 1024));
+                }
             }
+        };
 
-            soup.normals.reserve(mesh.vertexCount);
-            for (std::size_t i = mesh.vertexStartIndex; i < endIndex; ++i) {
-                soup.normals.emplace_back(model.normals[i]);
+        // Keep every worker busy, but no more than that in flight
+        const std::size_t maxInFlight = 2 * jobs.worker_count() + 2;
+
+        try {
+            // The compression contexts of every thread, whichever meshes they work on
+            if (options.compressMeshes) {
+                reserve(sceneMemory, compress_memory(jobs.worker_count() + 1));
+            }
+
+            for (const auto& batch : batches) {
+                std::size_t soupVertices = 0;
+                for (const auto mesh : batch.meshes) {
+                    soupVertices += obj.meshes()[mesh].vertexCount;
+                }
+
+                auto pending = std::make_unique<PendingBatch>();
+                pending->memory = Reservation(budget);
+                reserve(pending->memory, batch_memory(soupVertices, options));
+
+                auto& meshes = pending->meshes;
+                jobs.submit(pending->group, [&jobs, &obj, &batch, &meshes, &options] {
+                    meshes = weld_batch(jobs, obj, batch, options);
+                });
+                pendingBatches.emplace_back(std::move(pending));
+
+                while (pendingBatches.size() + pendingMeshes.size() > maxInFlight) {
+                    retireOne();
+                }
             }
 
-            indexed.emplace_back(make_indexed_mesh(soup, errorTolerance));
+            while (retireOne()) {
+            }
+
+            // Index the bounds of every instance for visibility queries at runtime
+            report.begin_stage("bvh");
+            const auto bvh = build_scene_bvh(bounds, instances);
+            summary.bvhNodes = bvh.nodes.size();
+            summary.bvhPrimitives = bvh.primitives.size();
+
+            write_model_trailer(out, blob ? &*blob : nullptr, instances, bvh);
+            if (blob) {
+                summary.blobBytes = blob->size();
+            }
+
+            meshCount = static_cast<std::uint32_t>(bounds.size());
+            if (0 != std::fseek(out, meshCountPosition, SEEK_SET)) {
+                throw vkutils::Error("Unable to seek in the output file");
+            }
+            checked_write(out, sizeof(meshCount), &meshCount);
+            if (0 != std::fseek(out, 0, SEEK_END)) {
+                throw vkutils::Error("Unable to seek in the output file");
+            }
+        } catch (...) {
+            // Jobs in flight refer to the pending batches and meshes
+            for (auto& pending : pendingBatches) {
+                try {
+                    jobs.wait(pending->group);
+                } catch (...) {
+                }
+            }
+            for (auto& pending : pendingMeshes) {
+                try {
+                    jobs.wait(pending->group);
+                } catch (...) {
+                }
+            }
+            throw;
+        }
+
+        summary.unique = finder.unique_count();
+        for (std::size_t i = 0; i < meshReports.size(); ++i) {
+            meshReports[i].instances = instances[i].size();
+            report.add_mesh(std::move(meshReports[i]));
+        }
+
+        return summary;
+    }
+
+    std::size_t batch_memory(const std::size_t soupVertices, const BakeOptions& options) {
+        // Welding holds the soup, its chunks and the welded meshes at once.
+        // Once welded, every chunk is baked within the memory of the batch,
+        // see mesh_memory(). Chunks have at least kMinChunkTriangles.
+        const std::size_t chunks = 1 + soupVertices / (3 * kMinChunkTriangles);
+        const std::size_t weld = kWeldMemoryPerBatch + kWeldMemoryPerSoupVertex * soupVertices;
+        const std::size_t bake = mesh_memory(soupVertices, soupVertices, options) +
+                                 chunks * mesh_memory(0, 0, options);
+        return std::max(weld, bake) + kSceneMemoryPerMesh * chunks;
+    }
+
+    std::size_t mesh_memory(const std::size_t vertices, const std::size_t indices, const BakeOptions& options) {
+        std::size_t bytes = kBakeMemoryPerVertex * vertices + kBakeMemoryPerIndex * indices;
+        if (options.compressMeshes || options.meshBlob) {
+            bytes += kPackedMemoryPerVertex * vertices + kPackedMemoryPerIndex * indices + kPackedMemoryPerMesh;
+        }
+        return bytes;
+    }
+
+    std::vector<WeldedMesh> weld_batch(JobSystem& jobs,
+                                       const ParsedObj& obj,
+                                       const MeshBatch& batch,
+                                       const BakeOptions& options,
+                                       const float errorTolerance) {
+        auto model = obj.load_meshes(batch.meshes);
+        model.meshes = {InputMeshInfo{batch.name, batch.materialIndex, 0, model.positions.size()}};
+
+        // Split meshes spanning large parts of the scene, so that they can be culled piecewise
+        if (options.maxChunkExtent > 0.f) {
+            model = chunk_meshes(std::move(model), options.maxChunkExtent);
         }
 
-        return indexed;
+        // Chunks are welded (and their tangents generated) independently.
+        // Every job writes only its own slot, so the output order, and hence
+        // the baked file, is identical to a serial bake.
+        std::vector<WeldedMesh> welded(model.meshes.size());
+
+        parallel_for(jobs, model.meshes.size(), [&](const std::size_t meshIndex) {
+            const auto& mesh = model.meshes[meshIndex];
+
+            // Weld straight from the model's arrays, the soup is only held once
+            const TriangleSoup soup{
+                .vertices = std::span(model.positions).subspan(mesh.vertexStartIndex, mesh.vertexCount),
+                .normals = std::span(model.normals).subspan(mesh.vertexStartIndex, mesh.vertexCount),
+                .texcoords = std::span(model.texcoords).subspan(mesh.vertexStartIndex, mesh.vertexCount)
+            };
+
+            auto& out = welded[meshIndex];
+            out.name = mesh.meshName;
+            out.materialIndex = mesh.materialIndex;
+            out.mesh = make_indexed_mesh(soup, errorTolerance, &out.times);
+            out.signature = instance_signature(out.mesh, out.materialIndex);
+        });
+
+        return welded;
+    }
+
+    void bake_mesh(JobSystem& jobs, BakedMesh& baked, const BakeOptions& options) {
+        auto& mesh = baked.mesh;
+
+        // Reorder triangles and vertices for the GPU
+        baked.optimization.before = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+        optimize_mesh(mesh);
+        baked.optimization.after = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+
+        // Append simplified levels of detail, sharing the reordered vertices
+        baked.lods = generate_lods(mesh);
+
+        // Meshlets never straddle two levels, so that every level is drawn as
+        // a range of meshlets
+        for (const auto& lod : baked.lods) {
+            const auto lodMeshlets = build_meshlets(mesh, lod.firstIndex, lod.indexCount);
+            baked.meshlets.insert(baked.meshlets.end(), lodMeshlets.begin(), lodMeshlets.end());
+        }
+
+        // Compress the vertex streams and indices into blocks that load in
+        // parallel, or lay them out for a single upload
+        if (options.compressMeshes) {
+            baked.compressed = compress_mesh(jobs, mesh);
+        } else if (options.meshBlob) {
+            baked.blob = pack_blob_mesh(mesh);
+        }
     }
 }
 
 namespace {
-    std::unordered_map<std::string, TextureInfo> find_unique_textures(const InputModel& model) {
-        std::unordered_map<std::string, TextureInfo> unique;
+    TextureMap find_unique_textures(const std::vector<InputMaterialInfo>& materials) {
+        TextureMap unique;
 
         std::uint32_t textureId = 0;
-        const auto addUnique = [&](const std::string& path, const std::uint8_t channels) {
-            if (path.empty()) {
-                return;
-            }
-
+        const auto addUnique = [&](TextureSource source, const std::uint8_t channels) {
             const TextureInfo info{
                 .uniqueId = textureId,
                 .channels = channels
             };
 
-            const auto [_, isNew] = unique.emplace(path, info);
+            const auto [_, isNew] = unique.emplace(std::move(source), info);
 
             if (isNew) {
                 ++textureId;
             }
         };
 
-        for (const auto& mat : model.materials) {
-            addUnique(mat.baseColorTexturePath, 4); // rgba
-            addUnique(mat.emissiveTexturePath, 3); // rgb
-            addUnique(mat.roughnessTexturePath, 1); // r
-            addUnique(mat.metalnessTexturePath, 1); // M
-            addUnique(mat.normalMapTexturePath, 3); // xyz
+        for (const auto& mat : materials) {
+            addUnique(TextureSource{{mat.baseColorTexturePath}, TextureKind::baseColor}, 4); // rgba
+            addUnique(TextureSource{{mat.emissiveTexturePath}, TextureKind::emissive}, 3); // rgb
+            addUnique(surface_source(mat), 2); // r, M
+            addUnique(TextureSource{{mat.normalMapTexturePath}, TextureKind::normalMap}, 2); // xy
             if (mat.has_alpha_mask()) {
-                addUnique(mat.alphaMaskTexturePath, 3); // rgb
+                addUnique(TextureSource{{mat.alphaMaskTexturePath}, TextureKind::alphaMask}, 1); // transparency
             }
         }
 
         return unique;
     }
 
-    std::unordered_map<std::string, TextureInfo> populate_paths(std::unordered_map<std::string, TextureInfo> textures,
-                                                                const std::filesystem::path& textureDir) {
+    TextureSource surface_source(const InputMaterialInfo& material) {
+        return TextureSource{
+            .paths = {material.roughnessTexturePath, material.metalnessTexturePath},
+            .kind = TextureKind::surface
+        };
+    }
+
+    TextureMap deduplicate_textures(TextureMap textures,
+                                    const BakeManifest* previous,
+                                    BakeManifest& manifest) {
+        // Visit sources in the order they were found so that IDs stay stable
+        std::vector<TextureMap::iterator> ordered(textures.size());
+        for (auto it = textures.begin(); it != textures.end(); ++it) {
+            ordered[it->second.uniqueId] = it;
+        }
+
+        // Images are keyed on their kind and the content of every source,
+        // such that e.g. copies of a fallback texture are baked once
+        std::map<std::pair<TextureKind, std::vector<ContentHash>>, std::uint32_t> contentIds;
+        for (const auto& it : ordered) {
+            const auto& source = it->first;
+
+            std::vector<ContentHash> hashes;
+            for (const auto& path : source.paths) {
+                hashes.push_back(manifest.add_input(path, previous).hash);
+            }
+
+            const auto nextId = static_cast<std::uint32_t>(contentIds.size());
+            const auto [content, _] = contentIds.emplace(std::pair{source.kind, std::move(hashes)}, nextId);
+            it->second.uniqueId = content->second;
+        }
+
+        return textures;
+    }
+
+    std::size_t unique_texture_count(const TextureMap& textures) {
+        std::size_t count = 0;
+        for (const auto& entry : textures) {
+            count = std::max(count, std::size_t(entry.second.uniqueId) + 1);
+        }
+
+        return count;
+    }
+
+    TextureMap populate_paths(TextureMap textures, const std::filesystem::path& textureDir) {
+        // Name every unique texture after its first source, in ID order
+        std::vector<std::vector<TextureInfo*>> byId(unique_texture_count(textures));
+        std::vector<const TextureSource*> firstSource(byId.size());
         for (auto& entry : textures) {
-            const std::filesystem::path originalPath(entry.first);
-            const auto filename = originalPath.filename();
-            const auto newPath = textureDir / filename;
+            auto& shared = byId[entry.second.uniqueId];
+            if (shared.empty()) {
+                firstSource[entry.second.uniqueId] = &entry.first;
+            }
+            shared.push_back(&entry.second);
+        }
+
+        std::set<std::string> taken;
+        for (std::size_t id = 0; id < byId.size(); ++id) {
+            const auto& source = *firstSource[id];
+            const std::filesystem::path originalPath(source.paths.front());
+            const auto name = originalPath.stem().string() + "-" + texture_kind_name(source.kind);
+
+            // Images of the same name may live in different directories
+            auto newPath = (textureDir / (name + ".spicytex")).string();
+            if (!taken.insert(newPath).second) {
+                newPath = (textureDir / (name + "-" + std::to_string(id) + ".spicytex")).string();
+                taken.insert(newPath);
+            }
 
-            auto& textureInfo = entry.second;
-            textureInfo.newPath = newPath.string();
+            for (auto* textureInfo : byId[id]) {
+                textureInfo->newPath = newPath;
+            }
         }
 
         return textures;
     }
+
+    TextureBakeReport bake_textures(JobSystem& jobs,
+                                    MemoryBudget* budget,
+                                    const TextureMap& textures,
+                                    const std::filesystem::path& rootdir,
+                                    const BakeManifest* previous,
+                                    BakeManifest& manifest) {
+        TextureBakeReport report;
+
+        // A texture is baked again unless the previous bake encoded the same
+        // sources with the same encoder into the same output
+        std::vector<TextureMap::const_iterator> entries;
+        std::vector<ManifestTexture> baked;
+        std::set<std::uint32_t> seen;
+        for (auto it = textures.begin(); it != textures.end(); ++it) {
+            const auto& [source, info] = *it;
+            if (!seen.insert(info.uniqueId).second) {
+                continue; // Deduplicated
+            }
+
+            ManifestTexture texture{
+                .path = info.newPath,
+                .kind = source.kind,
+                .sourceHash = hash_bytes(&kTextureBakeVersion, sizeof(kTextureBakeVersion))
+            };
+            for (const auto& path : source.paths) {
+                const ContentHash inputHash = manifest.add_input(path, previous).hash;
+                texture.sourceHash = hash_bytes(&inputHash, sizeof(inputHash), texture.sourceHash);
+            }
+
+            const auto* recorded = previous ? previous->find_texture(info.newPath) : nullptr;
+            if (recorded && recorded->kind == texture.kind && recorded->sourceHash == texture.sourceHash &&
+                std::filesystem::exists(rootdir / info.newPath)) {
+                texture.size = recorded->size;
+                report.size += texture.size;
+                ++report.upToDate;
+                manifest.add_texture(std::move(texture));
+            } else {
+                entries.push_back(it);
+                baked.emplace_back(std::move(texture));
+            }
+        }
+
+        // Textures are independent, and encoding them dominates the bake time.
+        // Each reserves the memory of its sources and mip chain before it is
+        // submitted, and releases it once encoded.
+        JobGroup group;
+        for (std::size_t i = 0; i < entries.size(); ++i) {
+            const auto& sourcePaths = entries[i]->first.paths;
+            std::vector<std::filesystem::path> paths(sourcePaths.begin(), sourcePaths.end());
+
+            auto memory = std::make_shared<Reservation>(budget);
+            memory->acquire(budget ? texture_memory(paths) : 0);
+
+            jobs.submit(group, [&, i, paths = std::move(paths), memory] {
+                const auto& [source, info] = *entries[i];
+                baked[i].size = bake_texture(paths, source.kind, rootdir / info.newPath);
+                memory->shrink(0);
+            });
+        }
+        jobs.wait(group);
+
+        for (auto& texture : baked) {
+            report.size += texture.size;
+            manifest.add_texture(std::move(texture));
+        }
+
+        return report;
+    }
 }
@@ -0,0 +1,48 @@
+#include "memory_budget.hpp"
+
+#include <cassert>
+
+#include "../vkutils/error.hpp"
+
+MemoryBudget::MemoryBudget(const std::size_t bytes)
+    : mLimit(bytes) {
+}
+
+void MemoryBudget::acquire(const std::size_t bytes) {
+    check_limit(bytes);
+
+    std::unique_lock lock(mMutex);
+    mReleased.wait(lock, [&] {
+        return bytes <= mLimit - mReserved;
+    });
+
+    mReserved += bytes;
+}
+
+bool MemoryBudget::try_acquire(const std::size_t bytes) {
+    check_limit(bytes);
+
+    std::lock_guard lock(mMutex);
+    if (bytes > mLimit - mReserved) {
+        return false;
+    }
+
+    mReserved += bytes;
+    return true;
+}
+
+void MemoryBudget::release(const std::size_t bytes) {
+    {
+        std::lock_guard lock(mMutex);
+        assert(bytes <= mReserved);
+        mReserved -= bytes;
+    }
+    mReleased.notify_all();
+}
+
+void MemoryBudget::check_limit(const std::size_t bytes) const {
+    if (bytes > mLimit) {
+        throw vkutils::Error("Work needs up to %zu MiB, more than the whole --max-memory of %zu MiB",
+                             (bytes + 1024 * 1024 - 1) / (1024 * 1024), mLimit / (1024 * 1024));
+    }
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+#include <cstddef>
+
+/*
+ * Bounds the memory of work in flight, in bytes.
+ *
+ * Work reserves an upper bound of what it allocates before it starts, and
+ * releases the reservation as it frees its memory. Bounds are computed from
+ * the sizes the work actually handles (vertices and indices of a mesh, texels
+ * of a texture) rather than estimated per scene, so that the reserved memory
+ * bounds the memory in use. Work whose bound exceeds the whole budget throws,
+ * it could never run within it.
+ *
+ * Never block on a reservation from within a job of the JobSystem: a
+ * reservation that waits for work in flight would keep the worker from
+ * helping to finish it. Reserve on the thread that submits the work, and
+ * retire work in flight whenever try_acquire() fails.
+ */
+class MemoryBudget {
+public:
+    explicit MemoryBudget(std::size_t bytes);
+
+    MemoryBudget(const MemoryBudget&) = delete;
+
+    MemoryBudget& operator=(const MemoryBudget&) = delete;
+
+    // Blocks until the bytes fit into the budget
+    void acquire(std::size_t bytes);
+
+    // Reserves the bytes if they fit into the budget right away
+    bool try_acquire(std::size_t bytes);
+
+    void release(std::size_t bytes);
+
+private:
+    // Throws if the bytes can never fit
+    void check_limit(std::size_t bytes) const;
+
+    const std::size_t mLimit;
+
+    std::mutex mMutex;
+    std::condition_variable mReleased;
+    std::size_t mReserved = 0;
+};
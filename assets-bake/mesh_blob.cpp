@@ -0,0 +1,85 @@
+#include "mesh_blob.hpp"
+
+#include <cstring>
+
+#include "packed_mesh.hpp"
+
+namespace {
+    std::uint64_t align_up(std::uint64_t offset);
+
+    void copy_stream(std::vector<std::uint8_t>& blob, std::uint64_t offset, const void* data, std::size_t bytes);
+}
+
+BlobMesh pack_blob_mesh(const IndexedMesh& mesh) {
+    const std::uint64_t vertexCount = mesh.vertices.size();
+
+    BlobMesh blob{};
+    auto& streams = blob.streams;
+    streams.positions = 0;
+    streams.normals = align_up(streams.positions + vertexCount * sizeof(glm::u16vec4));
+    streams.texcoords = align_up(streams.normals + vertexCount * sizeof(glm::i16vec2));
+    streams.tangents = align_up(streams.texcoords + vertexCount * sizeof(glm::u16vec2));
+    streams.indices = align_up(streams.tangents + vertexCount * sizeof(glm::i16vec2));
+
+    blob.data.resize(streams.indices + std::uint64_t(mesh.indices.size()) * index_size(mesh));
+
+    const auto packed = pack_vertices(mesh);
+    blob.positionOrigin = packed.origin;
+    blob.positionExtent = packed.extent;
+
+    copy_stream(blob.data, streams.positions, packed.positions.data(), vertexCount * sizeof(glm::u16vec4));
+    copy_stream(blob.data, streams.normals, packed.normals.data(), vertexCount * sizeof(glm::i16vec2));
+    copy_stream(blob.data, streams.texcoords, packed.texcoords.data(), vertexCount * sizeof(glm::u16vec2));
+    copy_stream(blob.data, streams.tangents, packed.tangents.data(), vertexCount * sizeof(glm::i16vec2));
+
+    if (sizeof(std::uint16_t) == index_size(mesh)) {
+        const std::vector<std::uint16_t> narrowIndices(mesh.indices.begin(), mesh.indices.end());
+        copy_stream(blob.data, streams.indices, narrowIndices.data(), sizeof(std::uint16_t) * mesh.indices.size());
+    } else {
+        copy_stream(blob.data, streams.indices, mesh.indices.data(), sizeof(std::uint32_t) * mesh.indices.size());
+    }
+
+    return blob;
+}
+
+MeshBlob::MeshBlob(std::filesystem::path spillPath)
+    : mData(std::move(spillPath)) {
+}
+
+MeshBlobStreams MeshBlob::append(const BlobMesh& mesh) {
+    // Streams are aligned relative to the mesh, which starts aligned in the blob
+    static constexpr std::uint8_t padding[kMeshBlobAlignment] = {};
+    mData.append(padding, align_up(mData.size()) - mData.size());
+    const std::uint64_t first = mData.append(mesh.data.data(), mesh.data.size());
+
+    return MeshBlobStreams{
+        .positions = first + mesh.streams.positions,
+        .normals = first + mesh.streams.normals,
+        .texcoords = first + mesh.streams.texcoords,
+        .tangents = first + mesh.streams.tangents,
+        .indices = first + mesh.streams.indices
+    };
+}
+
+std::uint64_t MeshBlob::size() const {
+    return mData.size();
+}
+
+void MeshBlob::write(FILE* out) {
+    mData.copy_to(out);
+}
+
+namespace {
+    std::uint64_t align_up(const std::uint64_t offset) {
+        return (offset + kMeshBlobAlignment - 1) / kMeshBlobAlignment * kMeshBlobAlignment;
+    }
+
+    void copy_stream(std::vector<std::uint8_t>& blob,
+                     const std::uint64_t offset,
+                     const void* data,
+                     const std::size_t bytes) {
+        if (bytes > 0) {
+            std::memcpy(blob.data() + offset, data, bytes);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <glm/vec3.hpp>
+
+#include "indexed_mesh.hpp"
+#include "spill_file.hpp"
+
+/*
+ * Streams start at multiples of this many bytes in the blob, measured from the
+ * start of the blob. The blob itself starts at a multiple of it in the file.
+ * 256 covers every VkBuffer offset alignment, so the runtime binds the streams
+ * at their offsets in the blob as they are. Must match ssr/baked_model.cpp.
+ */
+constexpr std::size_t kMeshBlobAlignment = 256;
+
+// Offsets of a mesh's streams in the blob, in bytes
+struct MeshBlobStreams {
+    std::uint64_t positions;
+    std::uint64_t normals;
+    std::uint64_t texcoords;
+    std::uint64_t tangents;
+    std::uint64_t indices;
+};
+
+// A mesh's packed streams, laid out as they are in the blob
+struct BlobMesh {
+    // Position dequantization, see PackedVertices
+    glm::vec3 positionOrigin;
+    glm::vec3 positionExtent;
+
+    // Relative to the start of data
+    MeshBlobStreams streams;
+
+    // Zero between the streams
+    std::vector<std::uint8_t> data;
+};
+
+BlobMesh pack_blob_mesh(const IndexedMesh& mesh);
+
+/*
+ * The packed vertex streams and the indices of every mesh in a single blob,
+ * in the order the meshes are appended, that the runtime uploads with one
+ * copy. The blob is spilled to a file until it is written.
+ */
+class MeshBlob {
+public:
+    explicit MeshBlob(std::filesystem::path spillPath);
+
+    // Returns the offsets of the mesh's streams in the blob
+    MeshBlobStreams append(const BlobMesh& mesh);
+
+    std::uint64_t size() const;
+
+    // Writes the blob to out, at out's current position
+    void write(FILE* out);
+
+private:
+    SpillFile mData;
+};
@@ -0,0 +1,157 @@
+#include "mesh_chunk.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace {
+    struct Bounds {
+        glm::vec3 min;
+        glm::vec3 max;
+
+        float largest_extent() const {
+            const glm::vec3 extent = max - min;
+            return std::max({extent.x, extent.y, extent.z, 0.f});
+        }
+    };
+
+    struct TriangleCentroid {
+        // Index of the triangle's first vertex in InputModel::positions
+        std::size_t firstVertex;
+        glm::vec3 centroid;
+    };
+
+    using TriangleCentroidIt = std::vector<TriangleCentroid>::iterator;
+
+    Bounds compute_bounds(const std::vector<glm::vec3>& positions, std::size_t first, std::size_t count);
+
+    // Splits the triangles in [begin, end) into chunks, see chunk_meshes()
+    void split_chunks(
+        const InputModel& model,
+        TriangleCentroidIt begin,
+        TriangleCentroidIt end,
+        float maxExtent,
+        std::vector<std::vector<std::size_t>>& chunks
+    );
+}
+
+InputModel chunk_meshes(InputModel model, const float maxExtent) {
+    // Most meshes are small enough, leave the model untouched if all are
+    const bool needsChunking = std::any_of(model.meshes.begin(), model.meshes.end(), [&](const InputMeshInfo& mesh) {
+        return mesh.vertexCount / 3 >= 2 * kMinChunkTriangles &&
+               compute_bounds(model.positions, mesh.vertexStartIndex, mesh.vertexCount).largest_extent() > maxExtent;
+    });
+    if (!needsChunking) {
+        return model;
+    }
+
+    InputModel chunked{
+        .modelSourcePath = model.modelSourcePath,
+        .materials = model.materials
+    };
+    chunked.positions.reserve(model.positions.size());
+    chunked.normals.reserve(model.normals.size());
+    chunked.texcoords.reserve(model.texcoords.size());
+
+    std::vector<TriangleCentroid> triangles;
+    std::vector<std::vector<std::size_t>> chunks;
+    for (const auto& mesh : model.meshes) {
+        assert(mesh.vertexCount % 3 == 0);
+
+        triangles.clear();
+        for (std::size_t v = mesh.vertexStartIndex; v < mesh.vertexStartIndex + mesh.vertexCount; v += 3) {
+            const glm::vec3 centroid = (model.positions[v] + model.positions[v + 1] + model.positions[v + 2]) / 3.f;
+            triangles.push_back(TriangleCentroid{v, centroid});
+        }
+
+        chunks.clear();
+        if (!triangles.empty()) {
+            split_chunks(model, triangles.begin(), triangles.end(), maxExtent, chunks);
+        }
+
+        for (std::size_t c = 0; c < chunks.size(); ++c) {
+            // Keep mesh names where nothing was split; this can be useful for debugging.
+            InputMeshInfo info{
+                .meshName = 1 == chunks.size() ? mesh.meshName : mesh.meshName + "::chunk" + std::to_string(c),
+                .materialIndex = mesh.materialIndex,
+                .vertexStartIndex = chunked.positions.size(),
+                .vertexCount = 3 * chunks[c].size()
+            };
+
+            for (const auto firstVertex : chunks[c]) {
+                for (std::size_t v = firstVertex; v < firstVertex + 3; ++v) {
+                    chunked.positions.push_back(model.positions[v]);
+                    chunked.normals.push_back(model.normals[v]);
+                    chunked.texcoords.push_back(model.texcoords[v]);
+                }
+            }
+
+            chunked.meshes.emplace_back(std::move(info));
+        }
+    }
+
+    return chunked;
+}
+
+namespace {
+    Bounds compute_bounds(const std::vector<glm::vec3>& positions, const std::size_t first, const std::size_t count) {
+        Bounds bounds{glm::vec3(0.f), glm::vec3(0.f)};
+        if (count > 0) {
+            bounds.min = bounds.max = positions[first];
+        }
+        for (std::size_t v = first; v < first + count; ++v) {
+            bounds.min = glm::min(bounds.min, positions[v]);
+            bounds.max = glm::max(bounds.max, positions[v]);
+        }
+        return bounds;
+    }
+
+    void split_chunks(const InputModel& model,
+                      const TriangleCentroidIt begin,
+                      const TriangleCentroidIt end,
+                      const float maxExtent,
+                      std::vector<std::vector<std::size_t>>& chunks) {
+        assert(begin != end);
+
+        Bounds bounds{model.positions[begin->firstVertex], model.positions[begin->firstVertex]};
+        glm::vec3 centroidMin = begin->centroid, centroidMax = begin->centroid;
+        for (auto it = begin; it != end; ++it) {
+            for (std::size_t v = it->firstVertex; v < it->firstVertex + 3; ++v) {
+                bounds.min = glm::min(bounds.min, model.positions[v]);
+                bounds.max = glm::max(bounds.max, model.positions[v]);
+            }
+            centroidMin = glm::min(centroidMin, it->centroid);
+            centroidMax = glm::max(centroidMax, it->centroid);
+        }
+
+        // Triangles larger than maxExtent can't be split, stop once the centroids coincide
+        const glm::vec3 extent = centroidMax - centroidMin;
+        const auto triangleCount = static_cast<std::size_t>(end - begin);
+        if (bounds.largest_extent() <= maxExtent ||
+            triangleCount < 2 * kMinChunkTriangles ||
+            std::max({extent.x, extent.y, extent.z}) <= 0.f) {
+            auto& chunk = chunks.emplace_back();
+            for (auto it = begin; it != end; ++it) {
+                chunk.push_back(it->firstVertex);
+            }
+
+            // Keep the original triangle order within a chunk
+            std::sort(chunk.begin(), chunk.end());
+            return;
+        }
+
+        const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+        const auto middle = begin + (end - begin) / 2;
+        std::nth_element(begin, middle, end, [axis](const TriangleCentroid& lhs, const TriangleCentroid& rhs) {
+            return lhs.centroid[axis] < rhs.centroid[axis];
+        });
+
+        split_chunks(model, begin, middle, maxExtent, chunks);
+        split_chunks(model, middle, end, maxExtent, chunks);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+
+#include "input_model.hpp"
+
+/*
+ * Meshes are split until no chunk is larger than this along any axis, in
+ * world units. A sixth of the camera's far distance leaves chunks that the
+ * frustum can reject, while small scenes and props are left alone.
+ */
+constexpr float kMaxChunkExtent = 16.0f;
+
+// Chunks are not split into chunks of fewer triangles, whatever their size
+constexpr std::size_t kMinChunkTriangles = 256;
+
+/*
+ * Splits meshes that span a large part of the scene, such as the ground or
+ * building facades, into spatially compact chunks. Every chunk is a mesh with
+ * its own bounds, so that culling can skip the parts out of view.
+ *
+ * Triangles are split at the median of their centroids along the widest axis
+ * of the chunk, until the bounds of every chunk are at most maxExtent world
+ * units along every axis, or splitting would leave fewer than
+ * kMinChunkTriangles triangles in a chunk. Triangles keep their relative
+ * order within a chunk to preserve the locality of the source's vertices.
+ *
+ * Chunks of a mesh replace it in place. Meshes that need no splitting are
+ * kept as they are.
+ */
+InputModel chunk_meshes(
+    InputModel model,
+    float maxExtent = kMaxChunkExtent
+);
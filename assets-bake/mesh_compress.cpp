@@ -0,0 +1,142 @@
+#include "mesh_compress.hpp"
+
+#include <algorithm>
+
+#include <cstring>
+
+// For ZSTD_estimateCCtxSize_usingCParams(), fine since zstd is linked statically
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+#include "../vkutils/error.hpp"
+#include "../vkutils/mesh_codec.hpp"
+
+#include "packed_mesh.hpp"
+
+namespace {
+    // A mesh's streams in the layout of the baked file
+    struct MeshStreams {
+        PackedVertices vertices;
+        std::vector<std::uint8_t> indices;
+        std::uint8_t indexSize;
+    };
+
+    MeshStreams pack_streams(const IndexedMesh& mesh);
+
+    // Raw bytes and element size of a stream
+    std::pair<const std::uint8_t*, std::size_t> stream_data(const MeshStreams& streams, MeshStream stream);
+
+    std::vector<std::uint8_t> compress_block(const MeshStreams& streams, const MeshBlock& block, int compressionLevel);
+}
+
+CompressedMesh compress_mesh(JobSystem& jobs, const IndexedMesh& mesh, const int compressionLevel) {
+    const auto streams = pack_streams(mesh);
+
+    CompressedMesh compressed{
+        .positionOrigin = streams.vertices.origin,
+        .positionExtent = streams.vertices.extent
+    };
+
+    const std::size_t vertexCount = mesh.vertices.size();
+    const std::size_t indexCount = mesh.indices.size();
+    for (const auto stream : {MeshStream::positions, MeshStream::normals, MeshStream::texcoords,
+                              MeshStream::tangents, MeshStream::indices}) {
+        const std::size_t count = MeshStream::indices == stream ? indexCount : vertexCount;
+        for (std::size_t first = 0; first < count; first += kMeshBlockElements) {
+            compressed.blocks.push_back(MeshBlock{
+                .stream = stream,
+                .firstElement = static_cast<std::uint32_t>(first),
+                .elementCount = static_cast<std::uint32_t>(std::min(count - first, kMeshBlockElements))
+            });
+        }
+    }
+
+    parallel_for(jobs, compressed.blocks.size(), [&](const std::size_t blockIndex) {
+        auto& block = compressed.blocks[blockIndex];
+        block.data = compress_block(streams, block, compressionLevel);
+    });
+
+    return compressed;
+}
+
+std::size_t compress_memory(const std::size_t threadCount, const int compressionLevel) {
+    // The largest block is one of positions. compress_block() copies it, shuffles
+    // it, and compresses it with a context sized for it.
+    const std::size_t blockBytes = kMeshBlockElements * sizeof(glm::u16vec4);
+    const std::size_t context = ZSTD_estimateCCtxSize_usingCParams(
+        ZSTD_getCParams(compressionLevel, blockBytes, 0));
+
+    return threadCount * (2 * blockBytes + ZSTD_compressBound(blockBytes) + context);
+}
+
+namespace {
+    MeshStreams pack_streams(const IndexedMesh& mesh) {
+        MeshStreams streams{
+            .vertices = pack_vertices(mesh),
+            .indexSize = index_size(mesh)
+        };
+
+        streams.indices.resize(mesh.indices.size() * streams.indexSize);
+        if (sizeof(std::uint16_t) == streams.indexSize) {
+            const std::vector<std::uint16_t> narrowIndices(mesh.indices.begin(), mesh.indices.end());
+            std::memcpy(streams.indices.data(), narrowIndices.data(), streams.indices.size());
+        } else {
+            std::memcpy(streams.indices.data(), mesh.indices.data(), streams.indices.size());
+        }
+
+        return streams;
+    }
+
+    std::pair<const std::uint8_t*, std::size_t> stream_data(const MeshStreams& streams, const MeshStream stream) {
+        const auto bytes = [](const auto& vector) {
+            return std::pair{reinterpret_cast<const std::uint8_t*>(vector.data()), sizeof(vector[0])};
+        };
+
+        switch (stream) {
+            case MeshStream::positions:
+                return bytes(streams.vertices.positions);
+            case MeshStream::normals:
+                return bytes(streams.vertices.normals);
+            case MeshStream::texcoords:
+                return bytes(streams.vertices.texcoords);
+            case MeshStream::tangents:
+                return bytes(streams.vertices.tangents);
+            case MeshStream::indices:
+                return {streams.indices.data(), streams.indexSize};
+        }
+
+        throw vkutils::Error("Unknown mesh stream %u", static_cast<std::uint32_t>(stream));
+    }
+
+    std::vector<std::uint8_t> compress_block(const MeshStreams& streams,
+                                             const MeshBlock& block,
+                                             const int compressionLevel) {
+        const auto [data, elementSize] = stream_data(streams, block.stream);
+        const std::uint8_t* first = data + std::size_t(block.firstElement) * elementSize;
+        const std::size_t size = std::size_t(block.elementCount) * elementSize;
+
+        // Delta code indices, restarting at the block so that it decodes on its own
+        std::vector<std::uint8_t> elements(first, first + size);
+        if (MeshStream::indices == block.stream) {
+            if (sizeof(std::uint16_t) == elementSize) {
+                vkutils::encode_index_deltas(reinterpret_cast<std::uint16_t*>(elements.data()), block.elementCount);
+            } else {
+                vkutils::encode_index_deltas(reinterpret_cast<std::uint32_t*>(elements.data()), block.elementCount);
+            }
+        }
+
+        std::vector<std::uint8_t> shuffled(size);
+        vkutils::shuffle_bytes(elements.data(), block.elementCount, elementSize, shuffled.data());
+
+        std::vector<std::uint8_t> compressed(ZSTD_compressBound(size));
+        const std::size_t compressedSize = ZSTD_compress(compressed.data(), compressed.size(),
+                                                         shuffled.data(), shuffled.size(), compressionLevel);
+        if (ZSTD_isError(compressedSize)) {
+            throw vkutils::Error("Compressing mesh stream %u: %s", static_cast<std::uint32_t>(block.stream),
+                                 ZSTD_getErrorName(compressedSize));
+        }
+
+        compressed.resize(compressedSize);
+        return compressed;
+    }
+}
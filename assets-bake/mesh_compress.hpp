@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+#include "indexed_mesh.hpp"
+#include "job_system.hpp"
+
+/*
+ * Streams are split into blocks of at most this many elements, so that the
+ * loader can decode the blocks of a single large mesh on several threads.
+ * 64 Ki positions are 512 kB before compression.
+ */
+constexpr std::size_t kMeshBlockElements = std::size_t(1) << 16;
+
+// zstd level of compressed mesh blocks. Blocks are small and compressed in parallel, so this is cheap.
+constexpr int kMeshCompressionLevel = 12;
+
+// Must match baked::MeshStream
+enum class MeshStream : std::uint32_t {
+    positions = 0,
+    normals = 1,
+    texcoords = 2,
+    tangents = 3,
+    indices = 4
+};
+
+struct MeshBlock {
+    MeshStream stream;
+    std::uint32_t firstElement;
+    std::uint32_t elementCount;
+
+    // One zstd frame
+    std::vector<std::uint8_t> data;
+};
+
+struct CompressedMesh {
+    // Position dequantization, see PackedVertices
+    glm::vec3 positionOrigin;
+    glm::vec3 positionExtent;
+
+    // In order of stream and first element
+    std::vector<MeshBlock> blocks;
+};
+
+/*
+ * Compresses the packed vertex streams and the indices of a mesh into
+ * independently decodable blocks, in parallel.
+ *
+ * Every block's elements are byte shuffled (see vkutils::shuffle_bytes())
+ * and compressed with zstd. Indices are delta and zigzag coded before (see
+ * vkutils::encode_index_deltas()), restarting at every block.
+ */
+CompressedMesh compress_mesh(
+    JobSystem& jobs,
+    const IndexedMesh& mesh,
+    int compressionLevel = kMeshCompressionLevel
+);
+
+/*
+ * Upper bound of the memory that compressing blocks on threadCount threads at
+ * once takes, besides the packed streams and the compressed blocks
+ */
+std::size_t compress_memory(
+    std::size_t threadCount,
+    int compressionLevel = kMeshCompressionLevel
+);
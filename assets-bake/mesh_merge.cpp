@@ -0,0 +1,107 @@
+#include "mesh_merge.hpp"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace {
+    struct MeshCentre {
+        std::size_t mesh;
+        glm::vec3 centre;
+    };
+
+    using MeshCentreIt = std::vector<MeshCentre>::iterator;
+
+    // Splits the meshes in [begin, end) into batches, see merge_meshes()
+    void split_batches(
+        const std::vector<InputMeshInfo>& meshes,
+        MeshCentreIt begin,
+        MeshCentreIt end,
+        std::size_t maxBatchVertices,
+        std::vector<std::vector<std::size_t>>& batches
+    );
+}
+
+std::vector<MeshBatch> merge_meshes(const std::vector<InputMaterialInfo>& materials,
+                                    const std::vector<InputMeshInfo>& meshes,
+                                    const std::vector<glm::vec3>& centres,
+                                    const std::size_t maxBatchVertices) {
+    assert(centres.size() == meshes.size());
+
+    // Centre of every mesh's bounding box, by material
+    std::vector<std::vector<MeshCentre>> materialMeshes(materials.size());
+    for (std::size_t i = 0; i < meshes.size(); ++i) {
+        assert(meshes[i].materialIndex < materials.size());
+        materialMeshes[meshes[i].materialIndex].push_back(MeshCentre{i, centres[i]});
+    }
+
+    std::vector<MeshBatch> merged;
+
+    std::vector<std::vector<std::size_t>> batches;
+    for (std::size_t materialIndex = 0; materialIndex < materialMeshes.size(); ++materialIndex) {
+        auto& materialCentres = materialMeshes[materialIndex];
+        if (materialCentres.empty()) {
+            continue;
+        }
+
+        batches.clear();
+        split_batches(meshes, materialCentres.begin(), materialCentres.end(), maxBatchVertices, batches);
+
+        for (std::size_t b = 0; b < batches.size(); ++b) {
+            // Keep mesh names where nothing was merged; this can be useful for debugging.
+            merged.emplace_back(MeshBatch{
+                .name = 1 == batches[b].size()
+                            ? meshes[batches[b].front()].meshName
+                            : materials[materialIndex].materialName + "::batch" + std::to_string(b),
+                .materialIndex = materialIndex,
+                .meshes = std::move(batches[b])
+            });
+        }
+    }
+
+    return merged;
+}
+
+namespace {
+    void split_batches(const std::vector<InputMeshInfo>& meshes,
+                       const MeshCentreIt begin,
+                       const MeshCentreIt end,
+                       const std::size_t maxBatchVertices,
+                       std::vector<std::vector<std::size_t>>& batches) {
+        assert(begin != end);
+
+        std::size_t vertexCount = 0;
+        glm::vec3 centreMin = begin->centre, centreMax = begin->centre;
+        for (auto it = begin; it != end; ++it) {
+            vertexCount += meshes[it->mesh].vertexCount;
+            centreMin = glm::min(centreMin, it->centre);
+            centreMax = glm::max(centreMax, it->centre);
+        }
+
+        if (vertexCount <= maxBatchVertices || 1 == end - begin) {
+            auto& batch = batches.emplace_back();
+            for (auto it = begin; it != end; ++it) {
+                batch.push_back(it->mesh);
+            }
+
+            // Keep the original mesh order within a batch
+            std::sort(batch.begin(), batch.end());
+            return;
+        }
+
+        const glm::vec3 extent = centreMax - centreMin;
+        const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+
+        const auto middle = begin + (end - begin) / 2;
+        std::nth_element(begin, middle, end, [axis](const MeshCentre& lhs, const MeshCentre& rhs) {
+            return lhs.centre[axis] < rhs.centre[axis];
+        });
+
+        split_batches(meshes, begin, middle, maxBatchVertices, batches);
+        split_batches(meshes, middle, end, maxBatchVertices, batches);
+    }
+}
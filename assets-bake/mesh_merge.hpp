@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <cstddef>
+
+#include <glm/vec3.hpp>
+
+#include "input_model.hpp"
+
+/*
+ * Batches of at most this many triangle soup vertices always weld into at most
+ * 2^16 vertices, so merging never costs 16-bit indices.
+ */
+constexpr std::size_t kMaxBatchVertices = std::size_t(1) << 16;
+
+// Meshes baked as one, their soups one after the other
+struct MeshBatch {
+    std::string name;
+    std::size_t materialIndex;
+
+    // In their original order
+    std::vector<std::size_t> meshes;
+};
+
+/*
+ * Merges meshes that share a material into batches, each drawn with a single
+ * set of buffers and descriptors instead of one per mesh.
+ *
+ * The meshes of every material are split at the median of their centres (of
+ * their bounding boxes) along the widest axis until each batch has at most
+ * maxBatchVertices vertices, so that batches stay spatially compact and
+ * culling keeps some granularity. Meshes that exceed maxBatchVertices on their
+ * own are kept as they are.
+ *
+ * Batches are ordered by material. Only the mesh records are needed, so that
+ * the soup of a batch is built once it is baked.
+ */
+std::vector<MeshBatch> merge_meshes(
+    const std::vector<InputMaterialInfo>& materials,
+    const std::vector<InputMeshInfo>& meshes,
+    const std::vector<glm::vec3>& centres,
+    std::size_t maxBatchVertices = kMaxBatchVertices
+);
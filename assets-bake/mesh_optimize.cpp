@@ -0,0 +1,411 @@
+#include "mesh_optimize.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace {
+    constexpr std::uint32_t kInvalidIndex = ~static_cast<std::uint32_t>(0);
+
+    // Tipsify. Returns the first triangle of every hard cluster, that is,
+    // the triangles after which the algorithm ran into a dead end.
+    std::vector<std::size_t> optimize_vertex_cache(
+        std::vector<std::uint32_t>& indices,
+        std::size_t vertexCount,
+        std::size_t cacheSize
+    );
+
+    void optimize_overdraw(
+        std::vector<std::uint32_t>& indices,
+        const std::vector<glm::vec3>& positions,
+        const std::vector<std::size_t>& hardClusters,
+        std::size_t cacheSize,
+        float threshold
+    );
+
+    void optimize_vertex_fetch(IndexedMesh& mesh);
+
+    // FIFO cache simulation: a vertex is resident if fewer than cacheSize
+    // misses happened since it was last loaded
+    class FifoCache {
+    public:
+        FifoCache(std::size_t vertexCount, std::size_t cacheSize);
+
+        // Returns true on a cache miss
+        bool access(std::uint32_t vertex);
+
+        void reset();
+
+    private:
+        std::vector<std::size_t> mTimestamps;
+        std::size_t mTime;
+        std::size_t mCacheSize;
+    };
+}
+
+float VertexCacheStats::acmr() const {
+    return triangles ? static_cast<float>(transforms) / static_cast<float>(triangles) : 0.f;
+}
+
+float VertexCacheStats::atvr() const {
+    return vertices ? static_cast<float>(transforms) / static_cast<float>(vertices) : 0.f;
+}
+
+VertexCacheStats& VertexCacheStats::operator+=(const VertexCacheStats& other) {
+    triangles += other.triangles;
+    vertices += other.vertices;
+    transforms += other.transforms;
+    return *this;
+}
+
+VertexCacheStats analyze_vertex_cache(const std::vector<std::uint32_t>& indices,
+                                      const std::size_t vertexCount,
+                                      const std::size_t cacheSize) {
+    assert(indices.size() % 3 == 0);
+
+    VertexCacheStats stats;
+    stats.triangles = indices.size() / 3;
+
+    FifoCache cache(vertexCount, cacheSize);
+    std::vector<bool> referenced(vertexCount, false);
+
+    for (const auto index : indices) {
+        assert(index < vertexCount);
+
+        if (cache.access(index)) {
+            ++stats.transforms;
+        }
+
+        if (!referenced[index]) {
+            referenced[index] = true;
+            ++stats.vertices;
+        }
+    }
+
+    return stats;
+}
+
+void optimize_mesh(IndexedMesh& mesh, const float overdrawThreshold) {
+    assert(mesh.indices.size() % 3 == 0);
+
+    if (mesh.indices.empty()) {
+        return;
+    }
+
+    const auto inputIndices = mesh.indices;
+    auto hardClusters = optimize_vertex_cache(mesh.indices, mesh.vertices.size(), kVertexCacheSize);
+
+    // Tipsify is a greedy heuristic. Inputs that are already in a good order
+    // (e.g. generated strips) can come out slightly worse, keep those as is.
+    const auto inputStats = analyze_vertex_cache(inputIndices, mesh.vertices.size());
+    const auto tipsifyStats = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+    if (tipsifyStats.transforms > inputStats.transforms) {
+        mesh.indices = inputIndices;
+        hardClusters.assign(1, 0);
+    }
+
+    optimize_overdraw(mesh.indices, mesh.vertices, hardClusters, kVertexCacheSize, overdrawThreshold);
+    optimize_vertex_fetch(mesh);
+}
+
+namespace {
+    FifoCache::FifoCache(const std::size_t vertexCount, const std::size_t cacheSize)
+        : mTimestamps(vertexCount, 0),
+          mTime(cacheSize + 1),
+          mCacheSize(cacheSize) {
+    }
+
+    bool FifoCache::access(const std::uint32_t vertex) {
+        if (mTime - mTimestamps[vertex] > mCacheSize) {
+            mTimestamps[vertex] = mTime++;
+            return true;
+        }
+
+        return false;
+    }
+
+    void FifoCache::reset() {
+        // Moving time forward past every timestamp evicts all vertices
+        mTime += mCacheSize + 1;
+    }
+}
+
+namespace {
+    std::vector<std::size_t> optimize_vertex_cache(std::vector<std::uint32_t>& indices,
+                                                   const std::size_t vertexCount,
+                                                   const std::size_t cacheSize) {
+        const std::size_t triangleCount = indices.size() / 3;
+
+        // Vertex-triangle adjacency, stored as offsets into one flat array
+        std::vector<std::uint32_t> liveTriangles(vertexCount, 0);
+        for (const auto index : indices) {
+            ++liveTriangles[index];
+        }
+
+        std::vector<std::size_t> adjacencyOffsets(vertexCount + 1, 0);
+        std::partial_sum(liveTriangles.begin(), liveTriangles.end(), adjacencyOffsets.begin() + 1);
+
+        std::vector<std::uint32_t> adjacency(indices.size());
+        {
+            std::vector<std::size_t> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (std::size_t i = 0; i < indices.size(); ++i) {
+                adjacency[cursor[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+            }
+        }
+
+        std::vector<std::size_t> timestamps(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<std::uint32_t> deadEnds;
+        std::vector<std::uint32_t> candidates;
+
+        std::vector<std::uint32_t> output;
+        output.reserve(indices.size());
+
+        std::vector<std::size_t> hardClusters;
+
+        std::size_t time = cacheSize + 1;
+        std::size_t inputCursor = 0;
+
+        const auto skipDeadEnd = [&]() -> std::uint32_t {
+            // Recently referenced vertices first, they are likely still cached
+            while (!deadEnds.empty()) {
+                const auto vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[vertex] > 0) {
+                    return vertex;
+                }
+            }
+
+            // Then the next vertex in input order with live triangles
+            for (; inputCursor < vertexCount; ++inputCursor) {
+                if (liveTriangles[inputCursor] > 0) {
+                    return static_cast<std::uint32_t>(inputCursor);
+                }
+            }
+
+            return kInvalidIndex;
+        };
+
+        std::uint32_t fanning = skipDeadEnd();
+        hardClusters.push_back(0);
+
+        while (kInvalidIndex != fanning) {
+            candidates.clear();
+
+            // Emit all live triangles around the fanning vertex
+            for (std::size_t a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a) {
+                const auto triangle = adjacency[a];
+                if (emitted[triangle]) {
+                    continue;
+                }
+
+                for (std::size_t corner = 0; corner < 3; ++corner) {
+                    const auto vertex = indices[3 * triangle + corner];
+
+                    output.push_back(vertex);
+                    deadEnds.push_back(vertex);
+                    candidates.push_back(vertex);
+                    --liveTriangles[vertex];
+
+                    if (time - timestamps[vertex] > cacheSize) {
+                        timestamps[vertex] = time++;
+                    }
+                }
+
+                emitted[triangle] = true;
+            }
+
+            // Pick the candidate that will still be in cache after emitting all
+            // of its live triangles, preferring the oldest one
+            std::uint32_t next = kInvalidIndex;
+            std::size_t bestPriority = 0;
+            for (const auto vertex : candidates) {
+                if (0 == liveTriangles[vertex]) {
+                    continue;
+                }
+
+                std::size_t priority = 0;
+                if (time - timestamps[vertex] + 2 * liveTriangles[vertex] <= cacheSize) {
+                    priority = time - timestamps[vertex];
+                }
+
+                if (kInvalidIndex == next || priority > bestPriority) {
+                    next = vertex;
+                    bestPriority = priority;
+                }
+            }
+
+            if (kInvalidIndex == next) {
+                next = skipDeadEnd();
+
+                if (kInvalidIndex != next && output.size() < indices.size()) {
+                    hardClusters.push_back(output.size() / 3);
+                }
+            }
+
+            fanning = next;
+        }
+
+        assert(output.size() == indices.size());
+        indices = std::move(output);
+
+        return hardClusters;
+    }
+}
+
+namespace {
+    void optimize_overdraw(std::vector<std::uint32_t>& indices,
+                           const std::vector<glm::vec3>& positions,
+                           const std::vector<std::size_t>& hardClusters,
+                           const std::size_t cacheSize,
+                           const float threshold) {
+        const std::size_t triangleCount = indices.size() / 3;
+        const float targetAcmr = threshold * analyze_vertex_cache(indices, positions.size(), cacheSize).acmr();
+
+        // Split hard clusters further wherever the miss ratio accumulated since
+        // the previous split is within the threshold. Reordering clusters then
+        // costs at most a cache flush at each split.
+        std::vector<std::size_t> clusters;
+        FifoCache cache(positions.size(), cacheSize);
+
+        for (std::size_t h = 0; h < hardClusters.size(); ++h) {
+            const std::size_t end = h + 1 < hardClusters.size() ? hardClusters[h + 1] : triangleCount;
+
+            cache.reset();
+            clusters.push_back(hardClusters[h]);
+
+            std::size_t clusterStart = hardClusters[h], misses = 0;
+            for (std::size_t t = hardClusters[h]; t < end; ++t) {
+                for (std::size_t corner = 0; corner < 3; ++corner) {
+                    misses += cache.access(indices[3 * t + corner]) ? 1 : 0;
+                }
+
+                const auto clusterTriangles = static_cast<float>(t + 1 - clusterStart);
+                if (t + 1 < end && static_cast<float>(misses) <= targetAcmr * clusterTriangles) {
+                    cache.reset();
+                    clusterStart = t + 1;
+                    misses = 0;
+                    clusters.push_back(clusterStart);
+                }
+            }
+
+            // The tail of the hard cluster never reached the target, fold it
+            // into the preceding soft cluster where it is served by a warm cache
+            const auto tailTriangles = static_cast<float>(end - clusterStart);
+            if (clusterStart != hardClusters[h] && static_cast<float>(misses) > targetAcmr * tailTriangles) {
+                clusters.pop_back();
+            }
+        }
+
+        // Sort clusters by how much they face away from the mesh centroid, so
+        // that the outer ones are drawn first and occlude the inner ones
+        glm::vec3 meshCentroid(0.f);
+        float meshArea = 0.f;
+
+        std::vector<glm::vec3> clusterCentroids(clusters.size(), glm::vec3(0.f));
+        std::vector<glm::vec3> clusterNormals(clusters.size(), glm::vec3(0.f));
+
+        for (std::size_t c = 0; c < clusters.size(); ++c) {
+            const std::size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+            float clusterArea = 0.f;
+            for (std::size_t t = clusters[c]; t < end; ++t) {
+                const auto& p0 = positions[indices[3 * t + 0]];
+                const auto& p1 = positions[indices[3 * t + 1]];
+                const auto& p2 = positions[indices[3 * t + 2]];
+
+                const auto normal = glm::cross(p1 - p0, p2 - p0);
+                const float area = glm::length(normal);
+                const auto centroid = (p0 + p1 + p2) / 3.f;
+
+                clusterCentroids[c] += centroid * area;
+                clusterNormals[c] += normal;
+                clusterArea += area;
+            }
+
+            meshCentroid += clusterCentroids[c];
+            meshArea += clusterArea;
+
+            clusterCentroids[c] = clusterArea > 0.f
+                                      ? clusterCentroids[c] / clusterArea
+                                      : positions[indices[3 * clusters[c]]];
+        }
+
+        if (meshArea > 0.f) {
+            meshCentroid /= meshArea;
+        }
+
+        std::vector<float> sortKeys(clusters.size());
+        for (std::size_t c = 0; c < clusters.size(); ++c) {
+            const float length = glm::length(clusterNormals[c]);
+            const auto normal = length > 0.f ? clusterNormals[c] / length : glm::vec3(0.f);
+            sortKeys[c] = glm::dot(clusterCentroids[c] - meshCentroid, normal);
+        }
+
+        std::vector<std::size_t> order(clusters.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&sortKeys](const std::size_t a, const std::size_t b) {
+            return sortKeys[a] > sortKeys[b];
+        });
+
+        std::vector<std::uint32_t> output;
+        output.reserve(indices.size());
+        for (const auto c : order) {
+            const std::size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            output.insert(output.end(),
+                          indices.begin() + static_cast<std::ptrdiff_t>(3 * clusters[c]),
+                          indices.begin() + static_cast<std::ptrdiff_t>(3 * end));
+        }
+
+        indices = std::move(output);
+    }
+}
+
+namespace {
+    template<typename tAttribute>
+    void remap_attribute(std::vector<tAttribute>& attribute, const std::vector<std::uint32_t>& remap) {
+        if (attribute.empty()) {
+            return;
+        }
+
+        std::vector<tAttribute> remapped(attribute.size());
+        for (std::size_t i = 0; i < attribute.size(); ++i) {
+            remapped[remap[i]] = attribute[i];
+        }
+
+        attribute = std::move(remapped);
+    }
+
+    void optimize_vertex_fetch(IndexedMesh& mesh) {
+        const std::size_t vertexCount = mesh.vertices.size();
+
+        std::vector<std::uint32_t> remap(vertexCount, kInvalidIndex);
+        std::uint32_t nextVertex = 0;
+
+        for (auto& index : mesh.indices) {
+            if (kInvalidIndex == remap[index]) {
+                remap[index] = nextVertex++;
+            }
+
+            index = remap[index];
+        }
+
+        // Unreferenced vertices, if any, keep their relative order at the end
+        for (auto& target : remap) {
+            if (kInvalidIndex == target) {
+                target = nextVertex++;
+            }
+        }
+
+        assert(nextVertex == vertexCount);
+
+        remap_attribute(mesh.vertices, remap);
+        remap_attribute(mesh.normals, remap);
+        remap_attribute(mesh.texcoords, remap);
+        remap_attribute(mesh.tangent, remap);
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "indexed_mesh.hpp"
+
+/*
+ * Post-transform vertex cache statistics, measured by simulating a FIFO cache
+ * of kVertexCacheSize entries. Counts are additive, so the statistics of
+ * several meshes can be summed before computing the ratios.
+ *
+ *  - ACMR: average cache miss ratio, vertex shader invocations per triangle
+ *          (0.5 is the optimum for large regular meshes, 3 is the worst case)
+ *  - ATVR: average transform to vertex ratio, vertex shader invocations per
+ *          referenced vertex (1 is the optimum)
+ */
+constexpr std::size_t kVertexCacheSize = 16;
+
+struct VertexCacheStats {
+    std::size_t triangles = 0;
+    std::size_t vertices = 0;
+    std::size_t transforms = 0;
+
+    float acmr() const;
+
+    float atvr() const;
+
+    VertexCacheStats& operator+=(const VertexCacheStats&);
+};
+
+VertexCacheStats analyze_vertex_cache(
+    const std::vector<std::uint32_t>& indices,
+    std::size_t vertexCount,
+    std::size_t cacheSize = kVertexCacheSize
+);
+
+/*
+ * Reorders triangles and vertices of an indexed mesh for rendering:
+ *
+ *  1. Triangles are reordered for post-transform cache locality (Tipsify,
+ *     Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and
+ *     Reduced Overdraw").
+ *  2. The resulting triangle clusters are reordered to reduce overdraw, as in
+ *     the same paper. Clusters facing away from the mesh centre are drawn
+ *     first. Clusters are only split where the cache miss ratio stays within
+ *     overdrawThreshold of the ratio after step 1.
+ *  3. Vertices are renumbered in order of first use, so that vertex fetches
+ *     walk the vertex buffers linearly.
+ *
+ * Triangle winding and the rendered result are unchanged.
+ */
+void optimize_mesh(
+    IndexedMesh& mesh,
+    float overdrawThreshold = 1.05f
+);
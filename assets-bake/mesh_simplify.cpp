@@ -0,0 +1,388 @@
+#include "mesh_simplify.hpp"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <utility>
+
+#include <cassert>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+namespace {
+    // A level is only kept if it has at most this fraction of the triangles
+    // of the previous one, otherwise it costs memory for little benefit
+    constexpr float kMinLodReduction = 0.9f;
+
+    // A collapse is rejected if it rotates a triangle's normal by more than
+    // ~75 degrees (cos = 0.25), which also rules out needle-thin triangles
+    constexpr float kMaxNormalDeviation = 0.25f;
+
+    // Sum of squared distances to a set of planes, weighted by triangle area:
+    //   Q(p) = sum(area * (dot(n, p) + d)^2)
+    // Stored as the upper triangle of the symmetric 4x4 matrix.
+    struct Quadric {
+        double a00 = 0.0, a01 = 0.0, a02 = 0.0, a03 = 0.0;
+        double a11 = 0.0, a12 = 0.0, a13 = 0.0;
+        double a22 = 0.0, a23 = 0.0;
+        double a33 = 0.0;
+
+        // Total area of the planes
+        double weight = 0.0;
+
+        Quadric& operator+=(const Quadric& other);
+
+        double evaluate(const glm::vec3& position) const;
+    };
+
+    struct Collapse {
+        std::uint32_t from;
+        std::uint32_t to;
+        double cost;
+    };
+
+    Quadric make_triangle_quadric(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+    // Vertices that must not move: seams, borders and non-manifold edges
+    std::vector<bool> find_locked_vertices(
+        const std::vector<glm::vec3>& positions,
+        const std::vector<std::uint32_t>& indices
+    );
+
+    // Does moving vertex from onto to turn any triangle around from (nearly) over?
+    bool flips_triangle(
+        const std::vector<glm::vec3>& positions,
+        const std::vector<std::uint32_t>& indices,
+        const std::vector<std::uint32_t>& triangleOffsets,
+        const std::vector<std::uint32_t>& vertexTriangles,
+        std::uint32_t from,
+        std::uint32_t to
+    );
+}
+
+std::vector<std::uint32_t> simplify(const std::vector<glm::vec3>& positions,
+                                    const std::vector<std::uint32_t>& indices,
+                                    const std::size_t targetIndexCount,
+                                    float& error) {
+    assert(indices.size() % 3 == 0);
+
+    const std::size_t vertexCount = positions.size();
+    const auto locked = find_locked_vertices(positions, indices);
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (std::size_t i = 0; i < indices.size(); i += 3) {
+        const auto quadric = make_triangle_quadric(positions[indices[i + 0]],
+                                                   positions[indices[i + 1]],
+                                                   positions[indices[i + 2]]);
+        for (std::size_t k = 0; k < 3; ++k) {
+            quadrics[indices[i + k]] += quadric;
+        }
+    }
+
+    std::vector<std::uint32_t> result = indices;
+    std::vector<std::uint32_t> triangleOffsets(vertexCount + 1);
+    std::vector<std::uint32_t> vertexTriangles;
+    std::vector<std::uint32_t> remap(vertexCount);
+    std::vector<bool> touched(vertexCount);
+    std::vector<Collapse> collapses;
+
+    double maxError = 0.0;
+
+    // Collapses are applied in passes. Every pass performs the cheapest
+    // collapses whose neighbourhoods do not overlap, so that the costs and
+    // flip checks of one pass stay valid while it is applied.
+    while (result.size() > targetIndexCount) {
+        // Triangles around every vertex
+        std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+        for (const auto index : result) {
+            ++triangleOffsets[index + 1];
+        }
+        std::partial_sum(triangleOffsets.begin(), triangleOffsets.end(), triangleOffsets.begin());
+
+        vertexTriangles.resize(result.size());
+        std::vector<std::uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            vertexTriangles[fill[result[i]]++] = static_cast<std::uint32_t>(i / 3);
+        }
+
+        // Candidate collapses along every edge, in both directions
+        collapses.clear();
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            for (std::size_t k = 0; k < 3; ++k) {
+                const auto a = result[i + k];
+                const auto b = result[i + (k + 1) % 3];
+
+                for (const auto& [from, to] : {std::pair{a, b}, std::pair{b, a}}) {
+                    if (locked[from]) {
+                        continue;
+                    }
+
+                    Quadric quadric = quadrics[from];
+                    quadric += quadrics[to];
+                    collapses.push_back(Collapse{from, to, quadric.evaluate(positions[to])});
+                }
+            }
+        }
+
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& lhs, const Collapse& rhs) {
+            return lhs.cost < rhs.cost;
+        });
+
+        // A collapse of an interior edge removes two triangles
+        const std::size_t excessTriangles = (result.size() - targetIndexCount + 2) / 3;
+        const std::size_t collapseGoal = std::max<std::size_t>(1, excessTriangles / 2);
+
+        std::iota(remap.begin(), remap.end(), 0);
+        std::fill(touched.begin(), touched.end(), false);
+
+        std::size_t collapseCount = 0;
+        for (const auto& collapse : collapses) {
+            if (collapseCount >= collapseGoal) {
+                break;
+            }
+
+            if (touched[collapse.from] || touched[collapse.to]) {
+                continue;
+            }
+
+            if (flips_triangle(positions, result, triangleOffsets, vertexTriangles, collapse.from, collapse.to)) {
+                continue;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to] += quadrics[collapse.from];
+
+            const double weight = quadrics[collapse.to].weight;
+            if (weight > 0.0) {
+                maxError = std::max(maxError, std::sqrt(std::max(collapse.cost, 0.0) / weight));
+            }
+
+            // Every triangle around from changes shape, keep their vertices
+            // out of the rest of the pass
+            for (auto t = triangleOffsets[collapse.from]; t < triangleOffsets[collapse.from + 1]; ++t) {
+                const std::size_t triangle = vertexTriangles[t];
+                for (std::size_t k = 0; k < 3; ++k) {
+                    touched[result[3 * triangle + k]] = true;
+                }
+            }
+
+            ++collapseCount;
+        }
+
+        if (0 == collapseCount) {
+            break;
+        }
+
+        // Apply the pass and drop the triangles that collapsed to a line
+        std::size_t write = 0;
+        for (std::size_t i = 0; i < result.size(); i += 3) {
+            const auto a = remap[result[i + 0]];
+            const auto b = remap[result[i + 1]];
+            const auto c = remap[result[i + 2]];
+
+            if (a != b && b != c && c != a) {
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+        }
+        result.resize(write);
+    }
+
+    error += static_cast<float>(maxError);
+
+    return result;
+}
+
+std::vector<MeshLod> generate_lods(IndexedMesh& mesh, const std::size_t maxLods, const float reduction) {
+    assert(mesh.indices.size() % 3 == 0);
+    assert(reduction > 0.f && reduction < 1.f);
+
+    std::vector<MeshLod> lods{
+        MeshLod{
+            .firstIndex = 0,
+            .indexCount = static_cast<std::uint32_t>(mesh.indices.size()),
+            .error = 0.f
+        }
+    };
+
+    // Every level is simplified from the previous one, so the errors add up
+    std::vector<std::uint32_t> source = mesh.indices;
+    float error = 0.f;
+
+    while (lods.size() < maxLods) {
+        const auto targetTriangles = static_cast<std::size_t>(static_cast<float>(source.size() / 3) * reduction);
+        if (0 == targetTriangles) {
+            break;
+        }
+
+        auto simplified = simplify(mesh.vertices, source, 3 * targetTriangles, error);
+        if (simplified.empty() ||
+            static_cast<float>(simplified.size()) > kMinLodReduction * static_cast<float>(source.size())) {
+            break;
+        }
+
+        lods.push_back(MeshLod{
+            .firstIndex = static_cast<std::uint32_t>(mesh.indices.size()),
+            .indexCount = static_cast<std::uint32_t>(simplified.size()),
+            .error = error
+        });
+
+        mesh.indices.insert(mesh.indices.end(), simplified.begin(), simplified.end());
+        source = std::move(simplified);
+    }
+
+    return lods;
+}
+
+namespace {
+    Quadric& Quadric::operator+=(const Quadric& other) {
+        a00 += other.a00;
+        a01 += other.a01;
+        a02 += other.a02;
+        a03 += other.a03;
+        a11 += other.a11;
+        a12 += other.a12;
+        a13 += other.a13;
+        a22 += other.a22;
+        a23 += other.a23;
+        a33 += other.a33;
+        weight += other.weight;
+        return *this;
+    }
+
+    double Quadric::evaluate(const glm::vec3& position) const {
+        const double x = position.x, y = position.y, z = position.z;
+
+        // p^T A p with p = (x, y, z, 1)
+        return a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x
+             + a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y
+             + a22 * z * z + 2.0 * a23 * z
+             + a33;
+    }
+
+    Quadric make_triangle_quadric(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        const glm::dvec3 cross = glm::cross(glm::dvec3(b - a), glm::dvec3(c - a));
+        const double length = glm::length(cross);
+        if (length <= 0.0) {
+            return Quadric{};
+        }
+
+        const glm::dvec3 n = cross / length;
+        const double d = -glm::dot(n, glm::dvec3(a));
+        const double area = 0.5 * length;
+
+        return Quadric{
+            .a00 = area * n.x * n.x,
+            .a01 = area * n.x * n.y,
+            .a02 = area * n.x * n.z,
+            .a03 = area * n.x * d,
+            .a11 = area * n.y * n.y,
+            .a12 = area * n.y * n.z,
+            .a13 = area * n.y * d,
+            .a22 = area * n.z * n.z,
+            .a23 = area * n.z * d,
+            .a33 = area * d * d,
+            .weight = area
+        };
+    }
+
+    std::vector<bool> find_locked_vertices(const std::vector<glm::vec3>& positions,
+                                           const std::vector<std::uint32_t>& indices) {
+        const std::size_t vertexCount = positions.size();
+        std::vector<bool> locked(vertexCount, false);
+
+        // Number the distinct positions. Vertices sharing a position differ
+        // in their other attributes, that is, they lie on a seam.
+        std::vector<std::uint32_t> order(vertexCount);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](const std::uint32_t lhs, const std::uint32_t rhs) {
+            const auto& a = positions[lhs];
+            const auto& b = positions[rhs];
+            return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+        });
+
+        std::vector<std::uint32_t> positionIds(vertexCount);
+        std::uint32_t positionId = 0;
+        for (std::size_t i = 0; i < vertexCount;) {
+            std::size_t end = i + 1;
+            while (end < vertexCount && positions[order[end]] == positions[order[i]]) {
+                ++end;
+            }
+
+            for (std::size_t j = i; j < end; ++j) {
+                positionIds[order[j]] = positionId;
+                locked[order[j]] = end - i > 1;
+            }
+
+            ++positionId;
+            i = end;
+        }
+
+        // Edges that do not have exactly two triangles are borders or
+        // non-manifold, across seams too
+        std::vector<std::uint64_t> edges;
+        edges.reserve(indices.size());
+        for (std::size_t i = 0; i < indices.size(); i += 3) {
+            for (std::size_t k = 0; k < 3; ++k) {
+                const auto a = positionIds[indices[i + k]];
+                const auto b = positionIds[indices[i + (k + 1) % 3]];
+                edges.push_back(std::uint64_t(std::min(a, b)) << 32 | std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        std::vector<bool> lockedPositions(positionId, false);
+        for (std::size_t i = 0; i < edges.size();) {
+            std::size_t end = i + 1;
+            while (end < edges.size() && edges[end] == edges[i]) {
+                ++end;
+            }
+
+            if (end - i != 2) {
+                lockedPositions[edges[i] >> 32] = true;
+                lockedPositions[edges[i] & 0xFFFFFFFFu] = true;
+            }
+
+            i = end;
+        }
+
+        for (std::size_t v = 0; v < vertexCount; ++v) {
+            locked[v] = locked[v] || lockedPositions[positionIds[v]];
+        }
+
+        return locked;
+    }
+
+    bool flips_triangle(const std::vector<glm::vec3>& positions,
+                        const std::vector<std::uint32_t>& indices,
+                        const std::vector<std::uint32_t>& triangleOffsets,
+                        const std::vector<std::uint32_t>& vertexTriangles,
+                        const std::uint32_t from,
+                        const std::uint32_t to) {
+        for (auto t = triangleOffsets[from]; t < triangleOffsets[from + 1]; ++t) {
+            const std::uint32_t* triangle = &indices[3 * std::size_t(vertexTriangles[t])];
+
+            // Triangles on the collapsed edge disappear
+            if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+                continue;
+            }
+
+            std::array<glm::vec3, 3> corners;
+            std::array<glm::vec3, 3> moved;
+            for (std::size_t k = 0; k < 3; ++k) {
+                corners[k] = positions[triangle[k]];
+                moved[k] = triangle[k] == from ? positions[to] : corners[k];
+            }
+
+            const glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+            const glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+            if (glm::dot(before, after) <= kMaxNormalDeviation * glm::length(before) * glm::length(after)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
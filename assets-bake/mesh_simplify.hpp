@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+#include "indexed_mesh.hpp"
+
+/*
+ * Levels of detail by edge collapse with quadric error metrics (Garland and
+ * Heckbert 1997, "Surface Simplification Using Quadric Error Metrics").
+ *
+ * Vertices are only ever collapsed onto other existing vertices, so every
+ * level of detail is just another index list into the mesh's vertices. The
+ * levels share one vertex buffer and differ in their index ranges.
+ *
+ * Vertices on open borders, on non-manifold edges and on attribute seams
+ * (several vertices at the same position, e.g. UV or hard normal seams) never
+ * move. This keeps meshes watertight against each other and textures intact,
+ * at the cost of simplifying heavily seamed meshes less.
+ */
+constexpr std::size_t kMaxLods = 4;
+
+struct MeshLod {
+    // Range in the mesh's index buffer
+    std::uint32_t firstIndex;
+    std::uint32_t indexCount;
+
+    // Estimated distance between the level and the full resolution surface,
+    // in model space units. 0 for the full resolution level.
+    float error;
+};
+
+/*
+ * Simplifies the triangles in indices towards targetIndexCount indices.
+ * Stops early when no more edges can be collapsed without flipping
+ * triangles or moving locked vertices. Adds the error of the simplification
+ * to error.
+ */
+std::vector<std::uint32_t> simplify(
+    const std::vector<glm::vec3>& positions,
+    const std::vector<std::uint32_t>& indices,
+    std::size_t targetIndexCount,
+    float& error
+);
+
+/*
+ * Appends up to maxLods - 1 simplified levels to mesh.indices, each with
+ * about reduction times the triangles of the previous one. Returns all
+ * levels, starting with the full resolution mesh. The chain ends early once
+ * a level would not drop at least a tenth of the triangles.
+ */
+std::vector<MeshLod> generate_lods(
+    IndexedMesh& mesh,
+    std::size_t maxLods = kMaxLods,
+    float reduction = 0.5f
+);
@@ -0,0 +1,157 @@
+#include "meshlet.hpp"
+
+#include <algorithm>
+
+#include <cassert>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+namespace {
+    constexpr std::uint32_t kNoMeshlet = ~static_cast<std::uint32_t>(0);
+
+    /*
+     * Normal cones whose normals deviate from the axis by more than ~84
+     * degrees (cos = 0.1) are not worth testing: they would only be culled
+     * from a very narrow range of directions.
+     */
+    constexpr float kMinConeSpread = 0.1f;
+
+    // Bounds of the triangles [firstTriangle, endTriangle) referencing vertices
+    Meshlet make_meshlet(
+        const IndexedMesh& mesh,
+        std::size_t firstTriangle,
+        std::size_t endTriangle,
+        const std::vector<std::uint32_t>& vertices
+    );
+
+    void compute_normal_cone(const IndexedMesh& mesh, Meshlet& meshlet);
+}
+
+std::vector<Meshlet> build_meshlets(const IndexedMesh& mesh,
+                                    const std::size_t firstIndex,
+                                    const std::size_t indexCount,
+                                    const std::size_t maxVertices,
+                                    const std::size_t maxTriangles) {
+    assert(maxVertices >= 3 && maxTriangles >= 1);
+    assert(firstIndex % 3 == 0 && indexCount % 3 == 0 && firstIndex + indexCount <= mesh.indices.size());
+
+    std::vector<Meshlet> meshlets;
+
+    // Meshlet that most recently referenced every vertex, and the distinct
+    // vertices of the meshlet being built
+    std::vector<std::uint32_t> vertexMeshlet(mesh.vertices.size(), kNoMeshlet);
+    std::vector<std::uint32_t> vertices;
+    vertices.reserve(maxVertices);
+
+    const std::size_t triangleCount = (firstIndex + indexCount) / 3;
+    std::size_t firstTriangle = firstIndex / 3;
+
+    for (std::size_t t = firstTriangle; t < triangleCount; ++t) {
+        const std::uint32_t* triangle = &mesh.indices[3 * t];
+
+        const auto newVertices = [&] {
+            const auto current = static_cast<std::uint32_t>(meshlets.size());
+            std::size_t count = 0;
+            for (std::size_t k = 0; k < 3; ++k) {
+                const bool repeated = std::find(triangle, triangle + k, triangle[k]) != triangle + k;
+                count += !repeated && vertexMeshlet[triangle[k]] != current ? 1 : 0;
+            }
+            return count;
+        };
+
+        if (vertices.size() + newVertices() > maxVertices || t - firstTriangle >= maxTriangles) {
+            meshlets.emplace_back(make_meshlet(mesh, firstTriangle, t, vertices));
+            vertices.clear();
+            firstTriangle = t;
+        }
+
+        const auto current = static_cast<std::uint32_t>(meshlets.size());
+        for (std::size_t k = 0; k < 3; ++k) {
+            if (vertexMeshlet[triangle[k]] != current) {
+                vertexMeshlet[triangle[k]] = current;
+                vertices.push_back(triangle[k]);
+            }
+        }
+    }
+
+    if (firstTriangle < triangleCount) {
+        meshlets.emplace_back(make_meshlet(mesh, firstTriangle, triangleCount, vertices));
+    }
+
+    return meshlets;
+}
+
+namespace {
+    Meshlet make_meshlet(const IndexedMesh& mesh,
+                         const std::size_t firstTriangle,
+                         const std::size_t endTriangle,
+                         const std::vector<std::uint32_t>& vertices) {
+        Meshlet meshlet{
+            .firstIndex = static_cast<std::uint32_t>(3 * firstTriangle),
+            .indexCount = static_cast<std::uint32_t>(3 * (endTriangle - firstTriangle))
+        };
+
+        std::vector<glm::vec3> positions;
+        positions.reserve(vertices.size());
+        for (const auto vertex : vertices) {
+            positions.push_back(mesh.vertices[vertex]);
+        }
+
+        glm::vec3 aabbMin = positions[0], aabbMax = positions[0];
+        for (const auto& position : positions) {
+            aabbMin = glm::min(aabbMin, position);
+            aabbMax = glm::max(aabbMax, position);
+        }
+
+        compute_bounding_sphere(positions, aabbMin, aabbMax, meshlet.sphereCenter, meshlet.sphereRadius);
+        compute_normal_cone(mesh, meshlet);
+
+        return meshlet;
+    }
+
+    void compute_normal_cone(const IndexedMesh& mesh, Meshlet& meshlet) {
+        // Disabled unless shown otherwise
+        meshlet.coneAxis = glm::vec3(0.f, 0.f, 1.f);
+        meshlet.coneCutoff = 1.f;
+
+        // Backface culling depends on the winding, not on the vertex normals
+        std::vector<glm::vec3> normals;
+        normals.reserve(meshlet.indexCount / 3);
+
+        glm::vec3 sum(0.f);
+        for (std::uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+            const auto& a = mesh.vertices[mesh.indices[i + 0]];
+            const auto& b = mesh.vertices[mesh.indices[i + 1]];
+            const auto& c = mesh.vertices[mesh.indices[i + 2]];
+
+            const glm::vec3 normal = glm::cross(b - a, c - a);
+            const float length = glm::length(normal);
+            if (length > 0.f) {
+                normals.push_back(normal / length);
+                sum += normals.back();
+            }
+        }
+
+        const float sumLength = glm::length(sum);
+        if (normals.empty() || sumLength <= 0.f) {
+            return;
+        }
+
+        const glm::vec3 axis = sum / sumLength;
+
+        float minDot = 1.f;
+        for (const auto& normal : normals) {
+            minDot = std::min(minDot, glm::dot(normal, axis));
+        }
+
+        if (minDot <= kMinConeSpread) {
+            return;
+        }
+
+        // The cone of back-facing view directions is the normal cone widened
+        // to a half-space: sin of the widest normal angle
+        meshlet.coneAxis = axis;
+        meshlet.coneCutoff = std::sqrt(1.f - minDot * minDot);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+
+#include "indexed_mesh.hpp"
+
+/*
+ * Meshlets (clusters) for culling on the GPU. A meshlet is a run of
+ * consecutive triangles in the mesh's index buffer, so that it is drawn from
+ * the mesh's own vertex and index buffers with a single indexed draw. Runs
+ * are cut whenever they would reference more than kMaxMeshletVertices
+ * distinct vertices or contain more than kMaxMeshletTriangles triangles.
+ *
+ * This relies on optimize_mesh() having ordered the triangles for vertex
+ * locality: consecutive triangles share most of their vertices, so runs stay
+ * compact in space.
+ *
+ * The limits match the usual mesh shader limits (64 vertices, 124 triangles
+ * fit the 128 byte primitive index blocks of common hardware).
+ */
+constexpr std::size_t kMaxMeshletVertices = 64;
+constexpr std::size_t kMaxMeshletTriangles = 124;
+
+struct Meshlet {
+    // Range in the mesh's index buffer
+    std::uint32_t firstIndex;
+    std::uint32_t indexCount;
+
+    glm::vec3 sphereCenter;
+    float sphereRadius;
+
+    // Normal cone. Every triangle faces away from a camera at position p if
+    //   dot(sphereCenter - p, coneAxis) >= coneCutoff * length(sphereCenter - p) + sphereRadius
+    // coneCutoff is 1 if the normals are spread too widely for the test to
+    // ever succeed.
+    glm::vec3 coneAxis;
+    float coneCutoff;
+};
+
+// Meshlets of the triangles in mesh.indices[firstIndex, firstIndex + indexCount)
+std::vector<Meshlet> build_meshlets(
+    const IndexedMesh& mesh,
+    std::size_t firstIndex,
+    std::size_t indexCount,
+    std::size_t maxVertices = kMaxMeshletVertices,
+    std::size_t maxTriangles = kMaxMeshletTriangles
+);
@@ -0,0 +1,49 @@
+#include "packed_mesh.hpp"
+
+#include <glm/glm.hpp>
+
+#include "../vkutils/vertex_packing.hpp"
+
+PackedVertices pack_vertices(const IndexedMesh& mesh) {
+    const std::size_t vertexCount = mesh.vertices.size();
+
+    PackedVertices packed{
+        .origin = glm::vec3(0.f),
+        .extent = glm::vec3(0.f),
+        .positions = std::vector<glm::u16vec4>(vertexCount),
+        .normals = std::vector<glm::i16vec2>(vertexCount),
+        .texcoords = std::vector<glm::u16vec2>(vertexCount),
+        .tangents = std::vector<glm::i16vec2>(vertexCount)
+    };
+
+    if (vertexCount > 0) {
+        glm::vec3 pmax = mesh.vertices[0];
+        packed.origin = mesh.vertices[0];
+        for (const auto& position : mesh.vertices) {
+            packed.origin = glm::min(packed.origin, position);
+            pmax = glm::max(pmax, position);
+        }
+        packed.extent = pmax - packed.origin;
+    }
+
+    for (std::size_t v = 0; v < vertexCount; ++v) {
+        const auto& position = mesh.vertices[v];
+        for (glm::length_t axis = 0; axis < 3; ++axis) {
+            packed.positions[v][axis] = vkutils::pack_unorm16(
+                packed.extent[axis] > 0.f ? (position[axis] - packed.origin[axis]) / packed.extent[axis] : 0.f);
+        }
+        packed.positions[v].w = mesh.tangent[v].w < 0.f ? 0 : 0xFFFF;
+
+        packed.normals[v] = vkutils::pack_octahedral(mesh.normals[v]);
+        packed.texcoords[v] = {vkutils::pack_half(mesh.texcoords[v].x), vkutils::pack_half(mesh.texcoords[v].y)};
+        packed.tangents[v] = vkutils::pack_octahedral(glm::vec3(mesh.tangent[v]));
+    }
+
+    return packed;
+}
+
+std::uint8_t index_size(const IndexedMesh& mesh) {
+    // Every index of a mesh with at most 2^16 vertices fits into 16 bits
+    constexpr std::size_t maxNarrowVertices = std::size_t(1) << 16;
+    return mesh.vertices.size() <= maxNarrowVertices ? sizeof(std::uint16_t) : sizeof(std::uint32_t);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "indexed_mesh.hpp"
+
+/*
+ * Vertex streams of the "spicy-packed" variant, see ssr/baked_model.hpp:
+ *  - positions: (x, y, z) as UNORM16 relative to origin and extent, w = tangent
+ *    handedness (0 => -1, 0xFFFF => +1)
+ *  - normals and tangents: octahedral, SNORM16
+ *  - texture coordinates: half floats
+ */
+struct PackedVertices {
+    glm::vec3 origin;
+    glm::vec3 extent;
+
+    std::vector<glm::u16vec4> positions;
+    std::vector<glm::i16vec2> normals;
+    std::vector<glm::u16vec2> texcoords;
+    std::vector<glm::i16vec2> tangents;
+};
+
+PackedVertices pack_vertices(const IndexedMesh& mesh);
+
+// Size in bytes of the mesh's indices in the baked file (2 or 4)
+std::uint8_t index_size(const IndexedMesh& mesh);
@@ -0,0 +1,202 @@
+#include "scene_bvh.hpp"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+#include <cassert>
+
+#include <glm/glm.hpp>
+
+namespace {
+    // Cost of visiting an inner node, relative to testing one primitive
+    constexpr float kTraversalCost = 1.0f;
+
+    struct Bounds {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+        void grow(const Bounds& other) {
+            min = glm::min(min, other.min);
+            max = glm::max(max, other.max);
+        }
+
+        void grow(const glm::vec3& point) {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+
+        // Half the surface area, the SAH only compares ratios
+        float half_area() const {
+            if (min.x > max.x) {
+                return 0.f;
+            }
+            const glm::vec3 extent = max - min;
+            return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+        }
+    };
+
+    struct PrimitiveBounds {
+        Bounds bounds;
+        glm::vec3 centre;
+        BvhPrimitive primitive;
+    };
+
+    using PrimitiveIt = std::vector<PrimitiveBounds>::iterator;
+
+    // World space bounds of a model space box under a rigid transform
+    Bounds transform_bounds(const glm::mat4x3& transform, const glm::vec3& aabbMin, const glm::vec3& aabbMax);
+
+    // Appends the subtree over [begin, end) to nodes and primitives, depth-first
+    void build_node(
+        PrimitiveIt begin,
+        PrimitiveIt end,
+        std::size_t maxLeafPrimitives,
+        SceneBvh& bvh
+    );
+}
+
+SceneBvh build_scene_bvh(const std::vector<MeshBounds>& meshes,
+                         const std::vector<std::vector<glm::mat4x3>>& instances,
+                         const std::size_t maxLeafPrimitives) {
+    assert(meshes.size() == instances.size());
+    assert(maxLeafPrimitives > 0);
+
+    std::vector<PrimitiveBounds> primitives;
+    for (std::size_t m = 0; m < meshes.size(); ++m) {
+        for (std::size_t i = 0; i < instances[m].size(); ++i) {
+            const Bounds bounds = transform_bounds(instances[m][i], meshes[m].aabbMin, meshes[m].aabbMax);
+            primitives.push_back(PrimitiveBounds{
+                .bounds = bounds,
+                .centre = 0.5f * (bounds.min + bounds.max),
+                .primitive = BvhPrimitive{static_cast<std::uint32_t>(m), static_cast<std::uint32_t>(i)}
+            });
+        }
+    }
+
+    SceneBvh bvh;
+    if (!primitives.empty()) {
+        // A binary tree with at least one primitive per leaf has at most 2n - 1 nodes
+        bvh.nodes.reserve(2 * primitives.size() - 1);
+        bvh.primitives.reserve(primitives.size());
+        build_node(primitives.begin(), primitives.end(), maxLeafPrimitives, bvh);
+    }
+
+    return bvh;
+}
+
+namespace {
+    Bounds transform_bounds(const glm::mat4x3& transform, const glm::vec3& aabbMin, const glm::vec3& aabbMax) {
+        // Arvo, "Transforming Axis-Aligned Bounding Boxes", Graphics Gems, 1990
+        const glm::vec3 centre = transform * glm::vec4(0.5f * (aabbMin + aabbMax), 1.0f);
+        const glm::vec3 halfExtent = 0.5f * (aabbMax - aabbMin);
+
+        glm::vec3 worldHalfExtent(0.f);
+        for (int c = 0; c < 3; ++c) {
+            worldHalfExtent += glm::abs(transform[c]) * halfExtent[c];
+        }
+
+        return Bounds{centre - worldHalfExtent, centre + worldHalfExtent};
+    }
+
+    void build_node(const PrimitiveIt begin,
+                    const PrimitiveIt end,
+                    const std::size_t maxLeafPrimitives,
+                    SceneBvh& bvh) {
+        assert(begin != end);
+
+        Bounds bounds, centreBounds;
+        for (auto it = begin; it != end; ++it) {
+            bounds.grow(it->bounds);
+            centreBounds.grow(it->centre);
+        }
+
+        const std::size_t nodeIndex = bvh.nodes.size();
+        bvh.nodes.push_back(BvhNode{
+            .aabbMin = bounds.min,
+            .offset = 0,
+            .aabbMax = bounds.max,
+            .count = 0
+        });
+
+        // Find the cheapest split at a bin boundary. Costs are scaled by the
+        // node's area, so a side costs its area times its primitive count.
+        const auto count = static_cast<std::size_t>(end - begin);
+        float bestCost = std::numeric_limits<float>::max();
+        int bestAxis = -1;
+        std::size_t bestBin = 0;
+
+        const glm::vec3 centreExtent = centreBounds.max - centreBounds.min;
+        for (int axis = 0; axis < 3; ++axis) {
+            if (centreExtent[axis] <= 0.f) {
+                continue;
+            }
+
+            std::array<Bounds, kBvhBinCount> bins;
+            std::array<std::size_t, kBvhBinCount> binCounts{};
+            const float scale = static_cast<float>(kBvhBinCount) / centreExtent[axis];
+            for (auto it = begin; it != end; ++it) {
+                const auto bin = std::min(static_cast<std::size_t>((it->centre[axis] - centreBounds.min[axis]) * scale),
+                                          kBvhBinCount - 1);
+                bins[bin].grow(it->bounds);
+                ++binCounts[bin];
+            }
+
+            // Sweep from the right to get the area of every right side, then from the left
+            std::array<float, kBvhBinCount> rightCosts{};
+            Bounds right;
+            std::size_t rightCount = 0;
+            for (std::size_t bin = kBvhBinCount - 1; bin > 0; --bin) {
+                right.grow(bins[bin]);
+                rightCount += binCounts[bin];
+                rightCosts[bin] = right.half_area() * static_cast<float>(rightCount);
+            }
+
+            Bounds left;
+            std::size_t leftCount = 0;
+            for (std::size_t bin = 0; bin + 1 < kBvhBinCount; ++bin) {
+                left.grow(bins[bin]);
+                leftCount += binCounts[bin];
+                if (0 == leftCount || count == leftCount) {
+                    continue;
+                }
+
+                const float cost = left.half_area() * static_cast<float>(leftCount) + rightCosts[bin + 1];
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = bin;
+                }
+            }
+        }
+
+        const float leafCost = bounds.half_area() * static_cast<float>(count);
+        if (count <= maxLeafPrimitives &&
+            (bestAxis < 0 || leafCost <= bestCost + kTraversalCost * bounds.half_area())) {
+            bvh.nodes[nodeIndex].offset = static_cast<std::uint32_t>(bvh.primitives.size());
+            bvh.nodes[nodeIndex].count = static_cast<std::uint32_t>(count);
+            for (auto it = begin; it != end; ++it) {
+                bvh.primitives.push_back(it->primitive);
+            }
+            return;
+        }
+
+        PrimitiveIt middle;
+        if (bestAxis >= 0) {
+            const float scale = static_cast<float>(kBvhBinCount) / centreExtent[bestAxis];
+            middle = std::partition(begin, end, [&](const PrimitiveBounds& primitive) {
+                const auto bin = std::min(
+                    static_cast<std::size_t>((primitive.centre[bestAxis] - centreBounds.min[bestAxis]) * scale),
+                    kBvhBinCount - 1);
+                return bin <= bestBin;
+            });
+        } else {
+            // All centres coincide, any split is as good as another
+            middle = begin + static_cast<std::ptrdiff_t>(count / 2);
+        }
+
+        build_node(begin, middle, maxLeafPrimitives, bvh);
+        bvh.nodes[nodeIndex].offset = static_cast<std::uint32_t>(bvh.nodes.size());
+        build_node(middle, end, maxLeafPrimitives, bvh);
+    }
+}
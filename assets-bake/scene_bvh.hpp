@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x3.hpp>
+
+// Leaves hold at most this many primitives, so that a query tests few bounds it could have skipped
+constexpr std::size_t kMaxBvhLeafPrimitives = 4;
+
+// Number of bins along each axis that split candidates are taken from
+constexpr std::size_t kBvhBinCount = 16;
+
+// Model space bounds of a mesh
+struct MeshBounds {
+    glm::vec3 aabbMin;
+    glm::vec3 aabbMax;
+};
+
+// One instance of one mesh
+struct BvhPrimitive {
+    std::uint32_t mesh;
+    std::uint32_t instance;
+};
+
+static_assert(sizeof(BvhPrimitive) == 8, "BvhPrimitive is written as is, see write_model_trailer()");
+
+/*
+ * Nodes are stored depth-first: the left child of an inner node directly
+ * follows it, its right child is at offset. Leaves have count > 0 primitives
+ * starting at offset.
+ */
+struct BvhNode {
+    glm::vec3 aabbMin;
+    std::uint32_t offset;
+    glm::vec3 aabbMax;
+    std::uint32_t count;
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode is written as is, see write_model_trailer()");
+
+struct SceneBvh {
+    std::vector<BvhNode> nodes;
+    std::vector<BvhPrimitive> primitives;
+};
+
+/*
+ * Builds a bounding volume hierarchy over the world space bounds of every
+ * instance of every mesh. Only the bounds of the meshes are needed, so that
+ * their geometry may be gone by the time the hierarchy is built.
+ *
+ * Nodes are split where the surface area heuristic (SAH) estimates the lowest
+ * cost of a query, evaluated at kBvhBinCount bin boundaries of the primitive
+ * centres along each axis. A node becomes a leaf if no split is cheaper than
+ * testing all of its primitives and it has at most maxLeafPrimitives of them.
+ *
+ * Returns no nodes if there are no meshes.
+ */
+SceneBvh build_scene_bvh(
+    const std::vector<MeshBounds>& meshes,
+    const std::vector<std::vector<glm::mat4x3>>& instances,
+    std::size_t maxLeafPrimitives = kMaxBvhLeafPrimitives
+);
@@ -0,0 +1,71 @@
+#include "spill_file.hpp"
+
+#include <vector>
+
+#include "../vkutils/error.hpp"
+
+SpillFile::SpillFile(std::filesystem::path path)
+    : mPath(std::move(path)) {
+    mFile = std::fopen(mPath.string().c_str(), "w+b");
+    if (!mFile) {
+        throw vkutils::Error("Unable to create temporary file '%s'", mPath.string().c_str());
+    }
+}
+
+SpillFile::~SpillFile() {
+    // Windows does not remove files that are still open
+    std::fclose(mFile);
+
+    std::error_code error;
+    std::filesystem::remove(mPath, error);
+}
+
+std::uint64_t SpillFile::append(const void* data, const std::size_t bytes) {
+    const std::uint64_t offset = mSize;
+    seek(offset);
+
+    if (const auto ret = std::fwrite(data, 1, bytes, mFile); ret != bytes) {
+        throw vkutils::Error("Writing '%s' failed: %zu instead of %zu bytes", mPath.string().c_str(), ret, bytes);
+    }
+
+    mSize += bytes;
+    return offset;
+}
+
+void SpillFile::read(const std::uint64_t offset, const std::size_t bytes, void* buffer) {
+    seek(offset);
+
+    if (const auto ret = std::fread(buffer, 1, bytes, mFile); ret != bytes) {
+        throw vkutils::Error("Reading '%s' failed: %zu instead of %zu bytes", mPath.string().c_str(), ret, bytes);
+    }
+}
+
+std::uint64_t SpillFile::size() const {
+    return mSize;
+}
+
+void SpillFile::copy_to(FILE* out) {
+    seek(0);
+
+    std::vector<char> chunk(1024 * 1024);
+    for (std::uint64_t left = mSize; left > 0;) {
+        const std::size_t bytes = left < chunk.size() ? static_cast<std::size_t>(left) : chunk.size();
+        if (std::fread(chunk.data(), 1, bytes, mFile) != bytes || std::fwrite(chunk.data(), 1, bytes, out) != bytes) {
+            throw vkutils::Error("Copying '%s' failed", mPath.string().c_str());
+        }
+
+        left -= bytes;
+    }
+}
+
+void SpillFile::seek(const std::uint64_t offset) {
+    // Switching between reading and writing requires a seek in any case
+#   if defined(_WIN32)
+    const int ret = _fseeki64(mFile, static_cast<long long>(offset), SEEK_SET);
+#   else
+    const int ret = fseeko(mFile, static_cast<off_t>(offset), SEEK_SET);
+#   endif
+    if (0 != ret) {
+        throw vkutils::Error("Seeking in '%s' failed", mPath.string().c_str());
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <filesystem>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+/*
+ * Temporary file for data that the baker reads back later, so that it does
+ * not have to stay in memory until then. The file is removed when the
+ * SpillFile is destroyed.
+ *
+ * Offsets are 64-bit, a spill may exceed the 2 GiB that a long addresses on
+ * Windows.
+ */
+class SpillFile {
+public:
+    explicit SpillFile(std::filesystem::path);
+
+    ~SpillFile();
+
+    SpillFile(const SpillFile&) = delete;
+
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    // Appends the bytes to the end of the file, returns the offset they start at
+    std::uint64_t append(const void* data, std::size_t bytes);
+
+    void read(std::uint64_t offset, std::size_t bytes, void* buffer);
+
+    std::uint64_t size() const;
+
+    // Writes the whole file to out, at out's current position
+    void copy_to(FILE* out);
+
+private:
+    void seek(std::uint64_t offset);
+
+    std::filesystem::path mPath;
+    FILE* mFile = nullptr;
+    std::uint64_t mSize = 0;
+};
@@ -0,0 +1,430 @@
+#include "texture_bake.hpp"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+
+#include <stb_image.h>
+
+#include <glm/glm.hpp>
+
+#include "block_compress.hpp"
+
+#include "../vkutils/error.hpp"
+
+namespace {
+    /*
+     * File "magic" of baked textures, see kFileMagic in main.cpp
+     */
+    constexpr char kFileMagic[16] = "\0\0SPICYTEX";
+
+    // Matches baked::TextureEncoding in ssr/baked_model.hpp
+    enum class TextureEncoding : std::uint8_t {
+        bc7Srgb = 1,
+        bc7Unorm = 2,
+        bc5Unorm = 3,
+        bc4Unorm = 4
+    };
+
+    TextureEncoding texture_encoding(TextureKind);
+
+    // One mip level, rows bottom to top as Vulkan expects them. Base colors
+    // are stored in linear space so that they are filtered correctly, every
+    // other kind as it is sampled (e.g. transparency in x for alpha masks).
+    struct MipLevel {
+        std::uint32_t width = 0;
+        std::uint32_t height = 0;
+        std::vector<glm::vec4> texels;
+    };
+
+    // How the texels of a source image are interpreted
+    enum class ImageContent {
+        raw,
+        // sRGB colours, converted to linear space
+        srgb,
+        // Alpha mask, converted to transparency in x, see alpha_mask_transparency()
+        transparency
+    };
+
+    MipLevel load_image(const std::filesystem::path&, ImageContent);
+
+    MipLevel load_base_level(const std::vector<std::filesystem::path>& sources, TextureKind);
+
+    // Nearest neighbour texel of the level at texture coordinate (u, v)
+    const glm::vec4& sample_nearest(const MipLevel&, float u, float v);
+
+    // Box filters the level down to half its size, rounding down
+    MipLevel downsample(const MipLevel&, TextureKind);
+
+    std::vector<std::uint8_t> compress_level(const MipLevel&, TextureKind);
+
+    float srgb_to_linear(std::uint8_t);
+
+    float linear_to_srgb(float);
+
+    // The transparency the alpha masked shaders used to derive from RGBA
+    // textures sampled as sRGB: linear RGB brightness, or alpha if the texel
+    // is translucent
+    float alpha_mask_transparency(const glm::vec4&);
+
+    void checked_write(FILE* out, std::size_t bytes, const void* data);
+}
+
+const char* texture_kind_name(const TextureKind kind) {
+    switch (kind) {
+        case TextureKind::baseColor:
+            return "color";
+        case TextureKind::emissive:
+            return "emissive";
+        case TextureKind::normalMap:
+            return "normal";
+        case TextureKind::surface:
+            return "surface";
+        case TextureKind::alphaMask:
+            return "mask";
+    }
+
+    throw vkutils::Error("texture_kind_name(): unknown kind %u", static_cast<unsigned>(kind));
+}
+
+TextureBakeSize& TextureBakeSize::operator+=(const TextureBakeSize& other) {
+    uncompressedBytes += other.uncompressedBytes;
+    compressedBytes += other.compressedBytes;
+    return *this;
+}
+
+TextureBakeSize bake_texture(const std::vector<std::filesystem::path>& sources,
+                             const TextureKind kind,
+                             const std::filesystem::path& destination) {
+    // Compress each level before generating the next one, so that at most two
+    // uncompressed levels are alive at a time
+    auto level = load_base_level(sources, kind);
+    const std::uint32_t width = level.width, height = level.height;
+
+    TextureBakeSize size;
+    std::vector<std::vector<std::uint8_t>> compressedLevels;
+    for (;;) {
+        size.uncompressedBytes += std::size_t(level.width) * level.height * 4;
+        const auto& compressed = compressedLevels.emplace_back(compress_level(level, kind));
+        size.compressedBytes += compressed.size();
+
+        if (1 == level.width && 1 == level.height) {
+            break;
+        }
+        level = downsample(level, kind);
+    }
+
+    FILE* out = std::fopen(destination.string().c_str(), "wb");
+    if (!out) {
+        throw vkutils::Error("Unable to open '%s' for writing", destination.string().c_str());
+    }
+
+    try {
+        // Format:
+        //  - char[16] : file magic
+        //  - uint8_t : encoding
+        //  - uint32_t : width
+        //  - uint32_t : height
+        //  - uint32_t : L = number of mip levels
+        //  - repeat L times: uint32_t size of the level in bytes
+        //  - repeat L times: level data, 4x4 blocks in row-major order
+        checked_write(out, sizeof(char) * 16, kFileMagic);
+
+        const auto encoding = static_cast<std::uint8_t>(texture_encoding(kind));
+        checked_write(out, sizeof(encoding), &encoding);
+        checked_write(out, sizeof(width), &width);
+        checked_write(out, sizeof(height), &height);
+
+        const auto levelCount = static_cast<std::uint32_t>(compressedLevels.size());
+        checked_write(out, sizeof(levelCount), &levelCount);
+
+        for (const auto& compressed : compressedLevels) {
+            const auto levelSize = static_cast<std::uint32_t>(compressed.size());
+            checked_write(out, sizeof(levelSize), &levelSize);
+        }
+        for (const auto& compressed : compressedLevels) {
+            checked_write(out, compressed.size(), compressed.data());
+        }
+    } catch (...) {
+        std::fclose(out);
+        throw;
+    }
+
+    std::fclose(out);
+
+    return size;
+}
+
+std::size_t texture_memory(const std::vector<std::filesystem::path>& sources) {
+    // Every source, decoded by stb_image (4 bytes per texel) into a MipLevel,
+    // and the base level they are combined into. The downsampled and the
+    // compressed levels take less than the sources once those are released.
+    std::size_t sourceTexels = 0;
+    std::uint32_t width = 0, height = 0;
+    for (const auto& source : sources) {
+        int widthi, heighti, channelsi;
+        if (!stbi_info(source.string().c_str(), &widthi, &heighti, &channelsi)) {
+            throw vkutils::Error("%s: unable to load texture (%s)", source.string().c_str(), stbi_failure_reason());
+        }
+
+        sourceTexels += std::size_t(widthi) * heighti;
+        width = std::max(width, static_cast<std::uint32_t>(widthi));
+        height = std::max(height, static_cast<std::uint32_t>(heighti));
+    }
+
+    const std::size_t levelTexels = std::size_t(width) * height;
+    return (4 + sizeof(glm::vec4)) * sourceTexels + 2 * sizeof(glm::vec4) * levelTexels;
+}
+
+namespace {
+    TextureEncoding texture_encoding(const TextureKind kind) {
+        switch (kind) {
+            case TextureKind::baseColor:
+                return TextureEncoding::bc7Srgb;
+            case TextureKind::emissive:
+                return TextureEncoding::bc7Unorm;
+            case TextureKind::normalMap:
+            case TextureKind::surface:
+                return TextureEncoding::bc5Unorm;
+            case TextureKind::alphaMask:
+                return TextureEncoding::bc4Unorm;
+        }
+
+        throw vkutils::Error("texture_encoding(): unknown kind %u", static_cast<unsigned>(kind));
+    }
+
+    MipLevel load_base_level(const std::vector<std::filesystem::path>& sources, const TextureKind kind) {
+        if (TextureKind::surface != kind) {
+            assert(1 == sources.size());
+            const auto content = TextureKind::baseColor == kind ? ImageContent::srgb
+                               : TextureKind::alphaMask == kind ? ImageContent::transparency
+                               : ImageContent::raw;
+            return load_image(sources[0], content);
+        }
+
+        assert(2 == sources.size());
+        const auto roughness = load_image(sources[0], ImageContent::raw);
+        const auto metalness = load_image(sources[1], ImageContent::raw);
+
+        // Fallbacks are single texels, so channels are mostly either of the
+        // same size or constant
+        MipLevel level{
+            .width = std::max(roughness.width, metalness.width),
+            .height = std::max(roughness.height, metalness.height)
+        };
+        level.texels.resize(std::size_t(level.width) * level.height);
+
+        for (std::uint32_t y = 0; y < level.height; ++y) {
+            const float v = (static_cast<float>(y) + .5f) / static_cast<float>(level.height);
+
+            for (std::uint32_t x = 0; x < level.width; ++x) {
+                const float u = (static_cast<float>(x) + .5f) / static_cast<float>(level.width);
+
+                level.texels[std::size_t(y) * level.width + x] = glm::vec4(
+                    sample_nearest(roughness, u, v).r,
+                    sample_nearest(metalness, u, v).r,
+                    0.f,
+                    1.f
+                );
+            }
+        }
+
+        return level;
+    }
+
+    const glm::vec4& sample_nearest(const MipLevel& level, const float u, const float v) {
+        const auto x = std::min(static_cast<std::uint32_t>(u * static_cast<float>(level.width)), level.width - 1);
+        const auto y = std::min(static_cast<std::uint32_t>(v * static_cast<float>(level.height)), level.height - 1);
+        return level.texels[std::size_t(y) * level.width + x];
+    }
+
+    MipLevel load_image(const std::filesystem::path& path, const ImageContent content) {
+        const auto rawPath = path.string();
+
+        int widthi, heighti, channelsi;
+        stbi_uc* data = stbi_load(rawPath.c_str(), &widthi, &heighti, &channelsi, 4 /* want 4 channels = RGBA */);
+        if (data == nullptr) {
+            throw vkutils::Error("%s: unable to load texture (%s)", rawPath.c_str(), stbi_failure_reason());
+        }
+
+        MipLevel level{
+            .width = static_cast<std::uint32_t>(widthi),
+            .height = static_cast<std::uint32_t>(heighti)
+        };
+        level.texels.resize(std::size_t(level.width) * level.height);
+
+        for (std::size_t y = 0; y < level.height; ++y) {
+            // Vulkan expects the first scanline to be the bottom-most one, PNG
+            // et al. store the top-most one first
+            const stbi_uc* row = data + (level.height - 1 - y) * level.width * 4;
+
+            for (std::size_t x = 0; x < level.width; ++x) {
+                const stbi_uc* rgba = row + 4 * x;
+                const glm::vec4 texel = glm::vec4(rgba[0], rgba[1], rgba[2], rgba[3]) / 255.f;
+                const glm::vec4 linear(srgb_to_linear(rgba[0]), srgb_to_linear(rgba[1]),
+                                       srgb_to_linear(rgba[2]), texel.a);
+
+                auto& output = level.texels[y * level.width + x];
+                switch (content) {
+                    case ImageContent::srgb:
+                        output = linear;
+                        break;
+                    case ImageContent::transparency:
+                        output = glm::vec4(alpha_mask_transparency(linear), 0.f, 0.f, 1.f);
+                        break;
+                    case ImageContent::raw:
+                        output = texel;
+                        break;
+                }
+            }
+        }
+
+        stbi_image_free(data);
+
+        return level;
+    }
+
+    MipLevel downsample(const MipLevel& level, const TextureKind kind) {
+        MipLevel half{
+            .width = std::max(level.width / 2, 1u),
+            .height = std::max(level.height / 2, 1u)
+        };
+        half.texels.resize(std::size_t(half.width) * half.height);
+
+        for (std::uint32_t y = 0; y < half.height; ++y) {
+            const std::uint32_t y0 = std::min(2 * y, level.height - 1), y1 = std::min(2 * y + 1, level.height - 1);
+
+            for (std::uint32_t x = 0; x < half.width; ++x) {
+                const std::uint32_t x0 = std::min(2 * x, level.width - 1), x1 = std::min(2 * x + 1, level.width - 1);
+
+                const std::array quad{
+                    level.texels[std::size_t(y0) * level.width + x0],
+                    level.texels[std::size_t(y0) * level.width + x1],
+                    level.texels[std::size_t(y1) * level.width + x0],
+                    level.texels[std::size_t(y1) * level.width + x1]
+                };
+
+                auto& output = half.texels[std::size_t(y) * half.width + x];
+                if (TextureKind::normalMap == kind) {
+                    // Average the directions, not their encodings
+                    glm::vec3 normal(0.f);
+                    for (const auto& texel : quad) {
+                        normal += glm::vec3(texel) * 2.f - 1.f;
+                    }
+
+                    const float length = glm::length(normal);
+                    normal = length > 0.f ? normal / length : glm::vec3(0.f, 0.f, 1.f);
+                    output = glm::vec4(normal * .5f + .5f, 1.f);
+                } else {
+                    output = (quad[0] + quad[1] + quad[2] + quad[3]) * .25f;
+                }
+            }
+        }
+
+        return half;
+    }
+
+    std::vector<std::uint8_t> compress_level(const MipLevel& level, const TextureKind kind) {
+        const auto toUnorm8 = [](const float value) {
+            return static_cast<std::uint8_t>(std::lround(std::clamp(value, 0.f, 1.f) * 255.f));
+        };
+
+        const std::uint32_t blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+        const auto encoding = texture_encoding(kind);
+        const std::size_t blockSize = TextureEncoding::bc4Unorm == encoding ? sizeof(Bc4Block) : sizeof(Bc7Block);
+
+        std::vector<std::uint8_t> compressed;
+        compressed.reserve(std::size_t(blocksX) * blocksY * blockSize);
+
+        std::array<glm::vec4, kBlockTexels> texels;
+        for (std::uint32_t by = 0; by < blocksY; ++by) {
+            for (std::uint32_t bx = 0; bx < blocksX; ++bx) {
+                // Blocks that extend past the edges of small levels repeat the
+                // edge texels
+                for (std::uint32_t t = 0; t < kBlockTexels; ++t) {
+                    const std::uint32_t x = std::min(4 * bx + t % 4, level.width - 1);
+                    const std::uint32_t y = std::min(4 * by + t / 4, level.height - 1);
+                    texels[t] = level.texels[std::size_t(y) * level.width + x];
+                }
+
+                switch (encoding) {
+                    case TextureEncoding::bc7Srgb:
+                    case TextureEncoding::bc7Unorm: {
+                        std::array<glm::u8vec4, kBlockTexels> colors;
+                        for (std::size_t t = 0; t < kBlockTexels; ++t) {
+                            auto color = texels[t];
+                            if (TextureKind::baseColor == kind) {
+                                color = glm::vec4(linear_to_srgb(color.r), linear_to_srgb(color.g),
+                                                  linear_to_srgb(color.b), color.a);
+                            } else {
+                                // Emissive textures ignore alpha, spend all bits on RGB
+                                color.a = 1.f;
+                            }
+                            colors[t] = {toUnorm8(color.r), toUnorm8(color.g), toUnorm8(color.b), toUnorm8(color.a)};
+                        }
+
+                        const auto block = encode_bc7_block(colors);
+                        compressed.insert(compressed.end(), block.begin(), block.end());
+                        break;
+                    }
+                    case TextureEncoding::bc5Unorm: {
+                        std::array<std::uint8_t, kBlockTexels> red, green;
+                        for (std::size_t t = 0; t < kBlockTexels; ++t) {
+                            red[t] = toUnorm8(texels[t].x);
+                            green[t] = toUnorm8(texels[t].y);
+                        }
+
+                        const auto block = encode_bc5_block(red, green);
+                        compressed.insert(compressed.end(), block.begin(), block.end());
+                        break;
+                    }
+                    case TextureEncoding::bc4Unorm: {
+                        std::array<std::uint8_t, kBlockTexels> red;
+                        for (std::size_t t = 0; t < kBlockTexels; ++t) {
+                            red[t] = toUnorm8(texels[t].x);
+                        }
+
+                        const auto block = encode_bc4_block(red);
+                        compressed.insert(compressed.end(), block.begin(), block.end());
+                        break;
+                    }
+                }
+            }
+        }
+
+        return compressed;
+    }
+
+    float srgb_to_linear(const std::uint8_t value) {
+        static const auto table = [] {
+            std::array<float, 256> linear;
+            for (std::size_t i = 0; i < linear.size(); ++i) {
+                const float srgb = static_cast<float>(i) / 255.f;
+                linear[i] = srgb <= 0.04045f ? srgb / 12.92f : std::pow((srgb + 0.055f) / 1.055f, 2.4f);
+            }
+            return linear;
+        }();
+
+        return table[value];
+    }
+
+    float linear_to_srgb(const float value) {
+        return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.f / 2.4f) - 0.055f;
+    }
+
+    float alpha_mask_transparency(const glm::vec4& rgba) {
+        const float brightness = glm::dot(glm::vec3(rgba), glm::vec3(0.333f));
+        return rgba.a < 1.f ? std::max(rgba.a, brightness) : brightness;
+    }
+
+    void checked_write(FILE* out, const std::size_t bytes, const void* data) {
+        if (const auto ret = std::fwrite(data, 1, bytes, out);
+            ret != bytes) {
+            throw vkutils::Error("fwrite() failed: %zu instead of %zu", ret, bytes);
+        }
+    }
+}
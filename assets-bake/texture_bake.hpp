@@ -0,0 +1,65 @@
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * How a texture is sampled at runtime, which determines its encoding:
+ *
+ *  - baseColor: RGBA, BC7, sampled as sRGB
+ *  - emissive: RGB, BC7, sampled as UNORM
+ *  - normalMap: tangent space XY, BC5. Z is reconstructed in the shaders.
+ *  - surface: roughness (R) and metalness (G), BC5, sampled as UNORM. Packed
+ *             from the red channels of the roughness and metalness images,
+ *             which BC5 encodes independently of each other.
+ *  - alphaMask: transparency, BC4, sampled as UNORM, see
+ *               alpha_mask_transparency(). Kept apart from the surface so
+ *               that the alpha-tested edges keep their own endpoints.
+ *
+ * The same source image may be baked once per kind it is used as.
+ */
+enum class TextureKind : std::uint8_t {
+    baseColor,
+    emissive,
+    normalMap,
+    surface,
+    alphaMask
+};
+
+// Short name of the kind, used to derive baked texture file names
+const char* texture_kind_name(TextureKind);
+
+struct TextureBakeSize {
+    // Size of the full mip chain as RGBA8, as uploaded before texture baking
+    std::size_t uncompressedBytes = 0;
+    // Size of the baked mip chain
+    std::size_t compressedBytes = 0;
+
+    TextureBakeSize& operator+=(const TextureBakeSize&);
+};
+
+/*
+ * Loads the image at source, generates its full mip chain and writes it block
+ * compressed to destination. See ssr/baked_model.hpp for the file format.
+ *
+ * Every kind is baked from one source image, except for surface textures:
+ * roughness and metalness, in this order. Their images may differ in size,
+ * the smaller one is scaled up to the larger.
+ */
+TextureBakeSize bake_texture(
+    const std::vector<std::filesystem::path>& sources,
+    TextureKind kind,
+    const std::filesystem::path& destination
+);
+
+/*
+ * Upper bound of the memory that bake_texture() takes for the sources, from
+ * the size of their images. Texels are decoded to floats, and the surface
+ * textures combine two sources at the size of the larger one.
+ */
+std::size_t texture_memory(
+    const std::vector<std::filesystem::path>& sources
+);
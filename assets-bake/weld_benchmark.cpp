@@ -0,0 +1,175 @@
+#include "weld_benchmark.hpp"
+
+#include <chrono>
+#include <span>
+#include <unordered_map>
+
+#include <cassert>
+#include <cstdio>
+
+#include "weld_grid.hpp"
+
+#include "../vkutils/error.hpp"
+
+namespace {
+    using weld::DiscretizedPosition;
+    using weld::Discretizer;
+
+    // hash discretized mesh positions
+    using VicinityKey = std::size_t;
+
+    VicinityKey hash_discretized_position(const DiscretizedPosition& position) {
+        // Based on boost::hash_combine
+        const std::hash<VicinityKey> scopedHash;
+        std::size_t hash = scopedHash(position.x);
+        hash ^= scopedHash(position.y) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        hash ^= scopedHash(position.z) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+
+    // generate vicinity map
+    using VicinityMap = std::unordered_multimap<VicinityKey, std::size_t>;
+
+    void build_vicinity_map(VicinityMap& map, const Discretizer& discretizer, const std::span<const glm::vec3> positions) {
+        for (std::size_t index = 0; index < positions.size(); ++index) {
+            DiscretizedPosition dp = discretizer.discretize(positions[index]);
+            VicinityKey vk = hash_discretized_position(dp);
+
+            map.insert(std::make_pair(vk, index));
+        }
+    }
+
+    constexpr std::size_t kNeighbourCount = 27;
+
+    DiscretizedPosition neighbour(DiscretizedPosition const& position, std::size_t index) {
+        static constexpr std::int32_t offset[kNeighbourCount][3]{
+            {0, 0, 0}, {0, 0, 1}, {0, 0, -1},
+            {0, 1, 0}, {0, 1, 1}, {0, 1, -1},
+            {0, -1, 0}, {0, -1, 1}, {0, -1, -1},
+
+            {1, 0, 0}, {1, 0, 1}, {1, 0, -1},
+            {1, 1, 0}, {1, 1, 1}, {1, 1, -1},
+            {1, -1, 0}, {1, -1, 1}, {1, -1, -1},
+
+            {-1, 0, 0}, {-1, 0, 1}, {-1, 0, -1},
+            {-1, 1, 0}, {-1, 1, 1}, {-1, 1, -1},
+            {-1, -1, 0}, {-1, -1, 1}, {-1, -1, -1},
+        };
+
+        assert(index < kNeighbourCount);
+
+        return {
+            .x = position.x + offset[index][0],
+            .y = position.y + offset[index][1],
+            .z = position.z + offset[index][2]
+        };
+    }
+}
+
+VertexWelding weld_vertices_reference(const TriangleSoup& soup, const float errorTolerance) {
+    const auto discretizer = weld::make_discretizer(weld::compute_bounds(soup.vertices), errorTolerance);
+
+    // build the vincinity map
+    VicinityMap vicinityMap;
+    build_vicinity_map(vicinityMap, discretizer, soup.vertices);
+
+    // collapse vertices
+    VertexWelding welding;
+    auto& vertices = welding.vertexMapping;
+    auto& indices = welding.indices;
+
+    vertices.reserve(soup.vertices.size());
+    indices.reserve(soup.vertices.size());
+
+    std::vector<std::size_t> collapseMap(soup.vertices.size(), ~static_cast<std::size_t>(0));
+
+    std::size_t nextVertex = 0;
+    for (std::size_t i = 0; i < soup.vertices.size(); ++i) {
+        if (~static_cast<std::size_t>(0) != collapseMap[i]) {
+            indices.push_back(static_cast<std::uint32_t>(collapseMap[i]));
+            continue;
+        }
+
+        DiscretizedPosition const dp = discretizer.discretize(soup.vertices[i]);
+
+        bool merged = false;
+        std::size_t target = ~static_cast<std::size_t>(0);
+
+        for (std::size_t j = 0; j < kNeighbourCount; ++j) {
+            const VicinityKey vk = hash_discretized_position(neighbour(dp, j));
+
+            for (auto [it, jt] = vicinityMap.equal_range(vk); it != jt; ++it) {
+                std::size_t const idx = it->second;
+
+                if (idx == i || ~static_cast<std::size_t>(0) != collapseMap[idx]) {
+                    continue;
+                }
+
+                if (weld::is_vertex_mergeable(soup, i, idx, errorTolerance)) {
+                    if (!merged) {
+                        target = nextVertex++;
+                        vertices.push_back(i);
+
+                        collapseMap[i] = target;
+                        indices.push_back(static_cast<std::uint32_t>(target));
+                        merged = true;
+                    }
+
+                    collapseMap[idx] = target;
+                }
+            }
+        }
+
+        if (!merged) {
+            const std::size_t toWhere = nextVertex++;
+
+            collapseMap[i] = toWhere;
+            vertices.push_back(i);
+            indices.push_back(static_cast<std::uint32_t>(toWhere));
+        }
+    }
+
+    return welding;
+}
+
+void benchmark_welders(const InputModel& model, const float errorTolerance) {
+    using Clock = std::chrono::steady_clock;
+    using Milliseconds = std::chrono::duration<double, std::milli>;
+
+    Milliseconds sortedTime{0}, referenceTime{0};
+    std::size_t soupVertices = 0, weldedVertices = 0;
+
+    for (const auto& mesh : model.meshes) {
+        const TriangleSoup soup{
+            .vertices = std::span(model.positions).subspan(mesh.vertexStartIndex, mesh.vertexCount),
+            .normals = std::span(model.normals).subspan(mesh.vertexStartIndex, mesh.vertexCount),
+            .texcoords = std::span(model.texcoords).subspan(mesh.vertexStartIndex, mesh.vertexCount)
+        };
+
+        const auto t0 = Clock::now();
+        const auto sorted = weld_vertices(soup, errorTolerance);
+        const auto t1 = Clock::now();
+        const auto reference = weld_vertices_reference(soup, errorTolerance);
+        const auto t2 = Clock::now();
+
+        sortedTime += t1 - t0;
+        referenceTime += t2 - t1;
+
+        if (sorted.vertexMapping != reference.vertexMapping || sorted.indices != reference.indices) {
+            throw vkutils::Error("benchmark_welders(): '%s' welds differently (%zu vs %zu vertices)",
+                                 mesh.meshName.c_str(), sorted.vertexMapping.size(),
+                                 reference.vertexMapping.size());
+        }
+
+        soupVertices += mesh.vertexCount;
+        weldedVertices += sorted.vertexMapping.size();
+    }
+
+    std::printf("%s: welded %zu => %zu vertices in %zu meshes\n"
+                " - sorted grid:   %10.2f ms\n"
+                " - hash multimap: %10.2f ms (%.2fx)\n",
+                model.modelSourcePath.c_str(), soupVertices, weldedVertices, model.meshes.size(),
+                sortedTime.count(),
+                referenceTime.count(),
+                sortedTime.count() > 0.0 ? referenceTime.count() / sortedTime.count() : 0.0);
+}
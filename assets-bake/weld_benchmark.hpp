@@ -0,0 +1,25 @@
+#pragma once
+
+#include "indexed_mesh.hpp"
+#include "input_model.hpp"
+
+/*
+ * Reference implementation of the vertex welder, based on a
+ * std::unordered_multimap keyed by hashed grid cells. This was the welder
+ * used by the baker before weld_vertices() switched to a radix-sorted grid.
+ * It is kept for benchmarking and validating the latter only.
+ */
+VertexWelding weld_vertices_reference(
+    const TriangleSoup& soup,
+    float errorTolerance
+);
+
+/*
+ * Welds every mesh of the model with both weld_vertices() and
+ * weld_vertices_reference(), verifies that both produce identical results and
+ * prints the timings. Throws if the results differ.
+ */
+void benchmark_welders(
+    const InputModel& model,
+    float errorTolerance
+);
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "indexed_mesh.hpp"
+
+/*
+ * Uniform grid used to find vertex welding candidates. Shared between the
+ * production welder (indexed_mesh.cpp) and the reference welder used by the
+ * welding benchmark (weld_benchmark.cpp), so both see identical cells.
+ */
+namespace weld {
+    // Tweakables
+    constexpr float kAABBMarginFactor = 10.f;
+    constexpr std::size_t kSparseGridMaxSize = 1024 * 1024;
+
+    // Discretize mesh positions
+    struct DiscretizedPosition {
+        std::int32_t x, y, z;
+    };
+
+    struct Discretizer {
+        Discretizer(const std::uint32_t factor, const glm::vec3 min, const float side)
+            : min(min), scale(factor / side) {
+        }
+
+        DiscretizedPosition discretize(const glm::vec3& position) const {
+            return {
+                .x = static_cast<std::int32_t>((position[0] - min[0]) * scale),
+                .y = static_cast<std::int32_t>((position[1] - min[1]) * scale),
+                .z = static_cast<std::int32_t>((position[2] - min[2]) * scale)
+            };
+        }
+
+        glm::vec3 min;
+        float scale;
+    };
+
+    struct Bounds {
+        glm::vec3 min, max;
+    };
+
+    inline Bounds compute_bounds(const std::span<const glm::vec3> positions) {
+        glm::vec3 bmin(std::numeric_limits<float>::max());
+        glm::vec3 bmax(std::numeric_limits<float>::lowest());
+
+        for (const auto& vertex : positions) {
+            bmin = glm::min(bmin, vertex);
+            bmax = glm::max(bmax, vertex);
+        }
+
+        return {bmin, bmax};
+    }
+
+    inline Discretizer make_discretizer(const Bounds& bounds, const float errorTolerance) {
+        const auto fmin = bounds.min - glm::vec3(kAABBMarginFactor * errorTolerance);
+        const auto fmax = bounds.max + glm::vec3(kAABBMarginFactor * errorTolerance);
+
+        // Compute grid size
+        const auto side = fmax - fmin;
+        float const maxSide = std::max(side.x, std::max(side.y, side.z));
+
+        float const numCells = maxSide / (2.f * errorTolerance);
+        std::size_t subdiv = std::min(kSparseGridMaxSize, static_cast<std::size_t>(numCells + .5f));
+
+        return Discretizer(static_cast<std::uint32_t>(subdiv), fmin, maxSide);
+    }
+
+    inline bool is_vertex_mergeable(const TriangleSoup& soup,
+                                    const std::size_t vertexAIndex, const std::size_t vertexBIndex,
+                                    const float errorTolerance) {
+        // Compare all elements component-wise, starting with positions
+        const auto pI = soup.vertices[vertexAIndex];
+        const auto pJ = soup.vertices[vertexBIndex];
+        for (std::size_t i = 0; i < 3; ++i) {
+            if (std::abs(pI[i] - pJ[i]) > errorTolerance) {
+                return false;
+            }
+        }
+
+        // Compare normals
+        if (!soup.normals.empty()) {
+            const auto nI = soup.normals[vertexAIndex];
+            const auto nJ = soup.normals[vertexBIndex];
+            for (std::size_t i = 0; i < 3; ++i) {
+                if (std::abs(nI[i] - nJ[i]) > errorTolerance) {
+                    return false;
+                }
+            }
+        }
+
+        // Compare tex coord
+        const auto tI = soup.texcoords[vertexAIndex];
+        const auto tJ = soup.texcoords[vertexBIndex];
+        for (std::size_t i = 0; i < 2; ++i) {
+            if (std::abs(tI[i] - tJ[i]) > errorTolerance) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+}
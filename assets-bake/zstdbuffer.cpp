@@ -0,0 +1,183 @@
+#include "zstdbuffer.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+// For ZSTD_findDecompressedSize(), fine since zstd is linked statically
+#define ZSTD_STATIC_LINKING_ONLY
+#include <zstd.h>
+
+#include "../vkutils/error.hpp"
+
+namespace {
+    /*
+     * Amount of data decompressed between wake-ups of waiting readers. Much
+     * larger than rapidobj's blocks (256 kB) so that the decompression thread
+     * isn't slowed down by notifications.
+     */
+    constexpr std::size_t kChunkSize = 4 * 1024 * 1024;
+
+    std::vector<char> read_file(const char* path);
+
+    // Decompresses data of unknown size, growing the output as needed
+    std::vector<char> decompress_unsized(const std::vector<char>& compressed, const char* path);
+}
+
+ZStdBuffer::ZStdBuffer(const char* path) : mPath(path), mStart(std::chrono::steady_clock::now()) {
+    auto compressed = read_file(path);
+
+    const auto size = ZSTD_findDecompressedSize(compressed.data(), compressed.size());
+    if (ZSTD_CONTENTSIZE_ERROR == size) {
+        throw vkutils::Error("'%s' is not a valid zstd file", path);
+    }
+
+    if (ZSTD_CONTENTSIZE_UNKNOWN == size) {
+        mData = decompress_unsized(compressed, path);
+        mAvailable = mData.size();
+        mFinish = std::chrono::steady_clock::now();
+        return;
+    }
+
+    mData.resize(size);
+    mThread = std::thread(&ZStdBuffer::decompress, this, std::move(compressed));
+}
+
+ZStdBuffer::~ZStdBuffer() {
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+const char* ZStdBuffer::data() const {
+    return mData.data();
+}
+
+std::size_t ZStdBuffer::size() const {
+    return mData.size();
+}
+
+bool ZStdBuffer::wait_until_available(const std::size_t count) {
+    std::unique_lock lock(mMutex);
+    mProgress.wait(lock, [&] {
+        return mAvailable >= count || !mError.empty();
+    });
+
+    return mAvailable >= count;
+}
+
+double ZStdBuffer::decompress_seconds() {
+    wait_until_available(mData.size());
+
+    std::lock_guard lock(mMutex);
+    return std::chrono::duration<double>(mFinish - mStart).count();
+}
+
+void ZStdBuffer::rethrow_error() {
+    std::lock_guard lock(mMutex);
+    if (!mError.empty()) {
+        throw vkutils::Error("Decompressing '%s' failed: %s", mPath.c_str(), mError.c_str());
+    }
+}
+
+void ZStdBuffer::decompress(const std::vector<char> compressed) {
+    const auto fail = [this](const char* error) {
+        std::lock_guard lock(mMutex);
+        mError = error;
+        mProgress.notify_all();
+    };
+
+    ZSTD_DCtx* ctx = ZSTD_createDCtx();
+    if (!ctx) {
+        fail("ZSTD_createDCtx() returned error");
+        return;
+    }
+
+    ZSTD_inBuffer input{compressed.data(), compressed.size(), 0};
+    ZSTD_outBuffer output{mData.data(), 0, 0};
+
+    while (output.pos < mData.size()) {
+        const auto previousInput = input.pos;
+        const auto previousOutput = output.pos;
+
+        output.size = std::min(output.pos + kChunkSize, mData.size());
+        if (const auto ret = ZSTD_decompressStream(ctx, &output, &input); ZSTD_isError(ret)) {
+            fail(ZSTD_getErrorName(ret));
+            break;
+        }
+
+        if (previousInput == input.pos && previousOutput == output.pos) {
+            fail("data is truncated");
+            break;
+        }
+
+        std::lock_guard lock(mMutex);
+        mAvailable = output.pos;
+        if (mAvailable == mData.size()) {
+            mFinish = std::chrono::steady_clock::now();
+        }
+        mProgress.notify_all();
+    }
+
+    ZSTD_freeDCtx(ctx);
+}
+
+namespace {
+    std::vector<char> read_file(const char* path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            throw vkutils::Error("Unable to open '%s'", path);
+        }
+
+        const std::streamsize size = file.tellg();
+        file.seekg(0, std::ios::beg);
+
+        std::vector<char> data(size);
+        if (!file.read(data.data(), size)) {
+            throw vkutils::Error("Unable to read '%s'", path);
+        }
+
+        return data;
+    }
+
+    std::vector<char> decompress_unsized(const std::vector<char>& compressed, const char* path) {
+        ZSTD_DCtx* ctx = ZSTD_createDCtx();
+        if (!ctx) {
+            throw vkutils::Error("ZSTD_createDCtx(): returned error");
+        }
+
+        std::vector<char> data(std::max(compressed.size() * 4, kChunkSize));
+
+        ZSTD_inBuffer input{compressed.data(), compressed.size(), 0};
+        ZSTD_outBuffer output{data.data(), data.size(), 0};
+
+        // A non-zero return value means that the current frame is incomplete
+        std::size_t ret = 0;
+        do {
+            const auto previousInput = input.pos;
+            const auto previousOutput = output.pos;
+
+            ret = ZSTD_decompressStream(ctx, &output, &input);
+            if (ZSTD_isError(ret)) {
+                ZSTD_freeDCtx(ctx);
+                throw vkutils::Error("Decompressing '%s' failed: %s", path, ZSTD_getErrorName(ret));
+            }
+
+            if (output.pos == output.size) {
+                data.resize(data.size() * 2);
+                output.dst = data.data();
+                output.size = data.size();
+            } else if (previousInput == input.pos && previousOutput == output.pos) {
+                break;
+            }
+        } while (input.pos < input.size || 0 != ret);
+
+        ZSTD_freeDCtx(ctx);
+
+        if (0 != ret) {
+            throw vkutils::Error("Decompressing '%s' failed: data is truncated", path);
+        }
+
+        data.resize(output.pos);
+        return data;
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <cstddef>
+
+/*
+ * Decompresses a .obj-zstd file into memory on a background thread.
+ *
+ * The data is decompressed front to back in large chunks, and readers may
+ * wait for any prefix of it to become available. This lets rapidobj parse the
+ * beginning of the OBJ (on multiple threads, see rapidobj::ParseBuffer())
+ * while the rest is still being decompressed, instead of decompressing and
+ * parsing on one thread through a std::istream.
+ *
+ * zstd records the decompressed size in the frame header unless the data was
+ * compressed as a stream. Files without it are decompressed completely before
+ * any of the data becomes available.
+ */
+class ZStdBuffer {
+public:
+    explicit ZStdBuffer(const char* path);
+
+    ~ZStdBuffer();
+
+    ZStdBuffer(const ZStdBuffer&) = delete;
+
+    ZStdBuffer& operator=(const ZStdBuffer&) = delete;
+
+    const char* data() const;
+
+    std::size_t size() const;
+
+    // Blocks until the first count bytes are decompressed. Returns false if
+    // decompression failed before that, see rethrow_error().
+    bool wait_until_available(std::size_t count);
+
+    // Throws if decompression failed
+    void rethrow_error();
+
+    // Wall-clock time from construction until all of the data was available,
+    // in seconds. Blocks until then.
+    double decompress_seconds();
+
+private:
+    void decompress(std::vector<char> compressed);
+
+    std::string mPath;
+    std::vector<char> mData;
+
+    std::chrono::steady_clock::time_point mStart;
+    std::chrono::steady_clock::time_point mFinish;
+
+    std::mutex mMutex;
+    std::condition_variable mProgress;
+    std::size_t mAvailable = 0;
+    std::string mError;
+
+    std::thread mThread;
+};
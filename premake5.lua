@@ -109,6 +109,7 @@ project "ssr"
     links "x-stb"
     links "x-glfw"
     links "x-vma"
+    links "x-zstd"
     filter "options:enable-diagnostics=true"
         defines { "ENABLE_DIAGNOSTICS" }
         links { "x-imgui", "x-nfd" }
@@ -150,6 +151,7 @@ project "assets-bake"
     links "vkutils" -- for vkutils::Error
     links "x-tgen"
     links "x-zstd"
+    links "x-stb"
 
     dependson "x-glm"
     dependson "x-rapidobj"
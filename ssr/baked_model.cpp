@@ -1,19 +1,63 @@
 #include "baked_model.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <exception>
+#include <numeric>
+#include <thread>
+
 #include <cstdio>
 #include <cstring>
 #include <glm/gtc/type_ptr.hpp>
+#include <zstd.h>
 
 #include "../vkutils/error.hpp"
+#include "../vkutils/mesh_codec.hpp"
+#include "../vkutils/vertex_packing.hpp"
 
 // TODO: Rename methods to snake_case
 namespace baked {
     // See asset3-bake/main.cpp for more info
     constexpr char kFileMagic[16] = "\0\0SPICYMESH";
     constexpr char kFileVariant[16] = "spicy";
+    constexpr char kFileVariantPacked[16] = "spicy-packed";
+    constexpr char kFileVariantCompressed[16] = "spicy-zstd";
+    constexpr char kFileVariantBlob[16] = "spicy-blob";
+
+    // Alignment of the "spicy-blob" variant's streams, see assets-bake/mesh_blob.hpp
+    constexpr std::size_t kMeshBlobAlignment = 256;
+
+    // See assets-bake/texture_bake.cpp
+    constexpr char kTextureFileMagic[16] = "\0\0SPICYTEX";
+
+    // Enough levels for a 2^31 texels wide texture
+    constexpr std::uint32_t kMaxMipLevels = 32;
 
     constexpr std::uint32_t kMaxString = 32 * 1024;
 
+    // Read position in a mapped file
+    struct MappedInput {
+        std::span<const std::uint8_t> bytes;
+        std::size_t offset = 0;
+    };
+
+    // Returns the next bytes of the mapping without copying them
+    std::span<const std::uint8_t> readBytes(MappedInput& input, const std::size_t bytes) {
+        const std::size_t available = input.bytes.size() - input.offset;
+        if (bytes > available) {
+            throw vkutils::Error("readBytes(): expected %zu bytes, got %zu", bytes, available);
+        }
+
+        const auto ret = input.bytes.subspan(input.offset, bytes);
+        input.offset += bytes;
+        return ret;
+    }
+
+    void checkedRead(MappedInput& input, const std::size_t bytes, void* buffer) {
+        std::memcpy(buffer, readBytes(input, bytes).data(), bytes);
+    }
+
     void checkedRead(FILE* input, const std::size_t bytes, void* buffer) {
         auto ret = std::fread(buffer, 1, bytes, input);
 
@@ -22,26 +66,35 @@ namespace baked {
         }
     }
 
-    std::uint32_t readUint32(FILE* input) {
+    template<typename Input>
+    std::uint32_t readUint32(Input& input) {
         std::uint32_t ret;
         checkedRead(input, sizeof(std::uint32_t), &ret);
         return ret;
     }
 
-    float readFloat(FILE* input) {
+    std::uint64_t readUint64(MappedInput& input) {
+        std::uint64_t ret;
+        checkedRead(input, sizeof(std::uint64_t), &ret);
+        return ret;
+    }
+
+    template<typename Input>
+    float readFloat(Input& input) {
         float ret;
         checkedRead(input, sizeof(float), &ret);
         return ret;
     }
 
-    template<glm::length_t L>
-    glm::vec<L, float> readVec(FILE* input) {
+    template<glm::length_t L, typename Input>
+    glm::vec<L, float> readVec(Input& input) {
         glm::vec<L, float> ret;
         checkedRead(input, sizeof(float) * L, &ret);
         return ret;
     }
 
-    std::string readString(FILE* aFin) {
+    template<typename Input>
+    std::string readString(Input& aFin) {
         const auto length = readUint32(aFin);
 
         if (length >= kMaxString) {
@@ -55,8 +108,371 @@ namespace baked {
         return ret;
     }
 
-    BakedModel loadBakedModelFromFile(FILE* input, char const* inputName) {
+    // Points the vertex streams, and the indices if requested, into data.decoded
+    void allocateDecodedStreams(BakedMeshData& data, const bool withIndices) {
+        const std::size_t V = data.vertexCount;
+        const std::array sizes{
+            V * sizeof(glm::u16vec4),
+            V * sizeof(glm::i16vec2),
+            V * sizeof(glm::u16vec2),
+            V * sizeof(glm::i16vec2),
+            withIndices ? std::size_t(data.indexCount) * data.indexSize : 0
+        };
+
+        data.decoded.resize(std::accumulate(sizes.begin(), sizes.end(), std::size_t(0)));
+
+        const std::uint8_t* next = data.decoded.data();
+        const auto stream = [&next](const std::size_t size) {
+            const std::span<const std::uint8_t> ret(next, size);
+            next += size;
+            return ret;
+        };
+
+        data.positions = stream(sizes[0]);
+        data.normals = stream(sizes[1]);
+        data.uvs = stream(sizes[2]);
+        data.tangents = stream(sizes[3]);
+        if (withIndices) {
+            data.indices = stream(sizes[4]);
+        }
+    }
+
+    // Writable bytes of a stream in data.decoded
+    std::uint8_t* decodedStream(BakedMeshData& data, const std::span<const std::uint8_t> stream) {
+        assert(stream.data() >= data.decoded.data() &&
+               stream.data() + stream.size() <= data.decoded.data() + data.decoded.size());
+        return data.decoded.data() + (stream.data() - data.decoded.data());
+    }
+
+    void readPackedVertices(MappedInput& input, BakedMeshData& data) {
+        const std::size_t V = data.vertexCount;
+
+        data.positionOrigin = readVec<3>(input);
+        data.positionExtent = readVec<3>(input);
+
+        data.positions = readBytes(input, V * sizeof(glm::u16vec4));
+        data.normals = readBytes(input, V * sizeof(glm::i16vec2));
+        data.uvs = readBytes(input, V * sizeof(glm::u16vec2));
+        data.tangents = readBytes(input, V * sizeof(glm::i16vec2));
+    }
+
+    void readFloatVertices(MappedInput& input, BakedMeshData& data) {
+        const std::uint32_t V = data.vertexCount;
+
+        std::vector<glm::vec3> positions(V);
+        checkedRead(input, V * sizeof(glm::vec3), positions.data());
+
+        std::vector<glm::vec3> normals(V);
+        checkedRead(input, V * sizeof(glm::vec3), normals.data());
+
+        std::vector<glm::vec2> uvs(V);
+        checkedRead(input, V * sizeof(glm::vec2), uvs.data());
+
+        std::vector<glm::vec4> tangents(V);
+        checkedRead(input, V * sizeof(glm::vec4), tangents.data());
+
+        // Pack exactly as the baker does for the "spicy-packed" variant
+        glm::vec3 pmin(0.f), pmax(0.f);
+        if (V > 0) {
+            pmin = pmax = positions[0];
+            for (const auto& position : positions) {
+                pmin = glm::min(pmin, position);
+                pmax = glm::max(pmax, position);
+            }
+        }
+
+        data.positionOrigin = pmin;
+        data.positionExtent = pmax - pmin;
+
+        std::vector<glm::u16vec4> packedPositions(V);
+        std::vector<glm::i16vec2> packedNormals(V);
+        std::vector<glm::u16vec2> packedUvs(V);
+        std::vector<glm::i16vec2> packedTangents(V);
+
+        for (std::uint32_t v = 0; v < V; ++v) {
+            for (glm::length_t axis = 0; axis < 3; ++axis) {
+                const float extent = data.positionExtent[axis];
+                packedPositions[v][axis] = vkutils::pack_unorm16(
+                    extent > 0.f ? (positions[v][axis] - pmin[axis]) / extent : 0.f);
+            }
+            packedPositions[v].w = tangents[v].w < 0.f ? 0 : 0xFFFF;
+
+            packedNormals[v] = vkutils::pack_octahedral(normals[v]);
+            packedUvs[v] = {vkutils::pack_half(uvs[v].x), vkutils::pack_half(uvs[v].y)};
+            packedTangents[v] = vkutils::pack_octahedral(glm::vec3(tangents[v]));
+        }
+
+        allocateDecodedStreams(data, false);
+        std::memcpy(decodedStream(data, data.positions), packedPositions.data(), data.positions.size());
+        std::memcpy(decodedStream(data, data.normals), packedNormals.data(), data.normals.size());
+        std::memcpy(decodedStream(data, data.uvs), packedUvs.data(), data.uvs.size());
+        std::memcpy(decodedStream(data, data.tangents), packedTangents.data(), data.tangents.size());
+    }
+
+    // Entry of the "spicy-zstd" variant's block table
+    struct CompressedBlock {
+        std::uint32_t mesh;
+        MeshStream stream;
+        std::uint32_t firstElement;
+        std::uint32_t elementCount;
+
+        // The zstd frame, in the mapping
+        std::span<const std::uint8_t> payload;
+    };
+
+    // Destination of a stream, and the size of its elements
+    std::pair<std::uint8_t*, std::size_t> streamData(BakedMeshData& data, const MeshStream stream) {
+        switch (stream) {
+            case MeshStream::positions:
+                return {decodedStream(data, data.positions), sizeof(glm::u16vec4)};
+            case MeshStream::normals:
+                return {decodedStream(data, data.normals), sizeof(glm::i16vec2)};
+            case MeshStream::uvs:
+                return {decodedStream(data, data.uvs), sizeof(glm::u16vec2)};
+            case MeshStream::tangents:
+                return {decodedStream(data, data.tangents), sizeof(glm::i16vec2)};
+            case MeshStream::indices:
+                return {decodedStream(data, data.indices), data.indexSize};
+        }
+
+        return {nullptr, 0};
+    }
+
+    // Appends the compressed blocks of a mesh's record to blocks
+    void readCompressedBlocks(MappedInput& input,
+                              const BakedMeshData& data,
+                              const std::uint32_t mesh,
+                              std::vector<CompressedBlock>& blocks,
+                              char const* inputName) {
+        const auto K = readUint32(input);
+
+        const std::size_t first = blocks.size();
+        std::vector<std::uint32_t> sizes;
+        sizes.reserve(K);
+        for (std::uint32_t i = 0; i < K; ++i) {
+            blocks.emplace_back(CompressedBlock{
+                .mesh = mesh,
+                .stream = static_cast<MeshStream>(readUint32(input)),
+                .firstElement = readUint32(input),
+                .elementCount = readUint32(input)
+            });
+            sizes.emplace_back(readUint32(input));
+        }
+
+        // Blocks are decoded straight from the mapping
+        for (std::uint32_t i = 0; i < K; ++i) {
+            blocks[first + i].payload = readBytes(input, sizes[i]);
+        }
+
+        // Blocks must cover every stream of the mesh exactly once, in order,
+        // so that no two blocks are decoded into the same elements
+        std::size_t next = first;
+        for (const auto stream : {MeshStream::positions, MeshStream::normals, MeshStream::uvs,
+                                  MeshStream::tangents, MeshStream::indices}) {
+            const std::size_t count = MeshStream::indices == stream ? data.indexCount : data.vertexCount;
+
+            std::size_t covered = 0;
+            for (; covered < count; ++next) {
+                if (next >= blocks.size() || blocks[next].stream != stream ||
+                    blocks[next].firstElement != covered || 0 == blocks[next].elementCount ||
+                    blocks[next].elementCount > count - covered) {
+                    throw vkutils::Error("loadBakedModelFromFile(): %s: invalid compressed block for mesh '%s'",
+                                         inputName, data.name.c_str());
+                }
+
+                covered += blocks[next].elementCount;
+            }
+        }
+
+        if (next != blocks.size()) {
+            throw vkutils::Error("loadBakedModelFromFile(): %s: %zu unexpected compressed blocks in mesh '%s'",
+                                 inputName, blocks.size() - next, data.name.c_str());
+        }
+    }
+
+    void decodeCompressedBlock(ZSTD_DCtx* context,
+                               const CompressedBlock& block,
+                               std::vector<std::uint8_t>& scratch,
+                               BakedModel& model,
+                               char const* inputName) {
+        auto& data = model.meshes[block.mesh];
+        const auto [destination, elementSize] = streamData(data, block.stream);
+        const std::size_t size = std::size_t(block.elementCount) * elementSize;
+
+        scratch.resize(size);
+        const std::size_t decoded = ZSTD_decompressDCtx(context, scratch.data(), scratch.size(),
+                                                        block.payload.data(), block.payload.size());
+        if (ZSTD_isError(decoded) || decoded != size) {
+            throw vkutils::Error("loadBakedModelFromFile(): %s: corrupt compressed block in mesh '%s': %s",
+                                 inputName, data.name.c_str(),
+                                 ZSTD_isError(decoded) ? ZSTD_getErrorName(decoded) : "size mismatch");
+        }
+
+        std::uint8_t* first = destination + std::size_t(block.firstElement) * elementSize;
+        vkutils::unshuffle_bytes(scratch.data(), block.elementCount, elementSize, first);
+
+        if (MeshStream::indices == block.stream) {
+            if (sizeof(std::uint16_t) == elementSize) {
+                vkutils::decode_index_deltas(reinterpret_cast<std::uint16_t*>(first), block.elementCount);
+            } else {
+                vkutils::decode_index_deltas(reinterpret_cast<std::uint32_t*>(first), block.elementCount);
+            }
+        }
+    }
+
+    // Offsets of a mesh's streams in the "spicy-blob" variant's blob
+    struct BlobStreams {
+        std::uint64_t positions;
+        std::uint64_t normals;
+        std::uint64_t uvs;
+        std::uint64_t tangents;
+        std::uint64_t indices;
+    };
+
+    BlobStreams readBlobStreams(MappedInput& input) {
+        return BlobStreams{
+            .positions = readUint64(input),
+            .normals = readUint64(input),
+            .uvs = readUint64(input),
+            .tangents = readUint64(input),
+            .indices = readUint64(input)
+        };
+    }
+
+    void readMeshBlob(MappedInput& input,
+                      const std::vector<BlobStreams>& offsets,
+                      BakedModel& model,
+                      char const* inputName) {
+        const std::uint64_t B = readUint64(input);
+
+        // The blob starts at an aligned position in the file, and therefore in the mapping
+        const std::size_t padding = (kMeshBlobAlignment - input.offset % kMeshBlobAlignment) % kMeshBlobAlignment;
+        readBytes(input, padding);
+        model.meshBlob = readBytes(input, B);
+
+        const auto stream = [&](const BakedMeshData& data, const std::uint64_t offset, const std::size_t size) {
+            if (0 != offset % kMeshBlobAlignment || offset > B || size > B - offset) {
+                throw vkutils::Error("loadBakedModelFromFile(): %s: mesh '%s' has an invalid stream offset %llu",
+                                     inputName, data.name.c_str(), static_cast<unsigned long long>(offset));
+            }
+
+            return model.meshBlob.subspan(offset, size);
+        };
+
+        for (std::size_t m = 0; m < model.meshes.size(); ++m) {
+            auto& data = model.meshes[m];
+            const std::size_t V = data.vertexCount;
+
+            data.positions = stream(data, offsets[m].positions, V * sizeof(glm::u16vec4));
+            data.normals = stream(data, offsets[m].normals, V * sizeof(glm::i16vec2));
+            data.uvs = stream(data, offsets[m].uvs, V * sizeof(glm::u16vec2));
+            data.tangents = stream(data, offsets[m].tangents, V * sizeof(glm::i16vec2));
+            data.indices = stream(data, offsets[m].indices, std::size_t(data.indexCount) * data.indexSize);
+        }
+    }
+
+    /*
+     * Trades CPU for I/O: a worker decodes roughly 650 MB/s of streams from
+     * 260 MB/s of blocks, so on a single worker this only loads faster than
+     * the packed streams while the storage reads slower than about 400 MB/s.
+     */
+    void decodeCompressedMeshes(const std::vector<CompressedBlock>& blocks, BakedModel& model, char const* inputName) {
+        // Blocks write disjoint elements, so workers take the next block until
+        // none are left. The first error is rethrown once all workers are done.
+        const std::size_t workerCount = std::min<std::size_t>(
+            std::max(std::thread::hardware_concurrency(), 1u), blocks.size());
+
+        std::atomic<std::size_t> nextBlock = 0;
+        std::exception_ptr error;
+        std::atomic_flag failed;
+
+        const auto work = [&] {
+            ZSTD_DCtx* context = ZSTD_createDCtx();
+            std::vector<std::uint8_t> scratch;
+
+            try {
+                if (!context) {
+                    throw vkutils::Error("loadBakedModelFromFile(): %s: unable to create zstd context", inputName);
+                }
+
+                for (std::size_t b = nextBlock++; b < blocks.size() && !failed.test(); b = nextBlock++) {
+                    decodeCompressedBlock(context, blocks[b], scratch, model, inputName);
+                }
+            } catch (...) {
+                if (!failed.test_and_set()) {
+                    error = std::current_exception();
+                }
+            }
+
+            ZSTD_freeDCtx(context);
+        };
+
+        std::vector<std::thread> workers;
+        for (std::size_t w = 1; w < workerCount; ++w) {
+            workers.emplace_back(work);
+        }
+
+        work();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // Meshlets must cover the mesh's indices in order, within its levels of detail
+    void readMeshlets(MappedInput& input, BakedMeshData& data, char const* inputName) {
+        const auto C = readUint32(input);
+
+        std::uint32_t nextIndex = 0;
+        std::size_t lodIndex = 0;
+        for (std::uint32_t i = 0; i < C; ++i) {
+            const BakedMeshlet meshlet{
+                .firstIndex = readUint32(input),
+                .indexCount = readUint32(input),
+                .sphereCentre = readVec<3>(input),
+                .sphereRadius = readFloat(input),
+                .coneAxis = readVec<3>(input),
+                .coneCutoff = readFloat(input)
+            };
+
+            if (meshlet.firstIndex != nextIndex || meshlet.indexCount > data.indexCount - nextIndex) {
+                throw vkutils::Error("loadBakedModelFromFile(): %s: mesh '%s' has invalid meshlet %u",
+                                     inputName, data.name.c_str(), i);
+            }
+
+            // Assign the meshlet to the level of detail containing it
+            while (meshlet.firstIndex >= data.lods[lodIndex].firstIndex + data.lods[lodIndex].indexCount &&
+                   lodIndex + 1 < data.lods.size()) {
+                ++lodIndex;
+            }
+
+            auto& lod = data.lods[lodIndex];
+            if (meshlet.firstIndex + meshlet.indexCount > lod.firstIndex + lod.indexCount) {
+                throw vkutils::Error("loadBakedModelFromFile(): %s: meshlet %u of mesh '%s' spans two levels of detail",
+                                     inputName, i, data.name.c_str());
+            }
+
+            if (0 == lod.meshletCount) {
+                lod.firstMeshlet = i;
+            }
+            ++lod.meshletCount;
+
+            nextIndex += meshlet.indexCount;
+            data.meshlets.emplace_back(meshlet);
+        }
+
+        if (nextIndex != data.indexCount) {
+            throw vkutils::Error("loadBakedModelFromFile(): %s: meshlets of mesh '%s' cover %u of %u indices",
+                                 inputName, data.name.c_str(), nextIndex, data.indexCount);
+        }
+    }
+
+    BakedModel loadBakedModelFromFile(vkutils::MappedFile file, char const* inputName) {
         BakedModel bakedModel;
+        MappedInput input{.bytes = file.bytes()};
 
         // Figure out base path
         char const* pathBeg = inputName;
@@ -75,10 +491,18 @@ namespace baked {
         char variant[16];
         checkedRead(input, 16, variant);
 
-        if (0 != std::memcmp(variant, kFileVariant, 16)) {
-            throw vkutils::Error("loadBakedModelFromFile(): %s: file variant is '%s', expected '%s'", inputName,
+        const bool packedVertices = 0 == std::memcmp(variant, kFileVariantPacked, 16);
+        const bool compressedMeshes = 0 == std::memcmp(variant, kFileVariantCompressed, 16);
+        const bool meshBlob = 0 == std::memcmp(variant, kFileVariantBlob, 16);
+        if (!packedVertices && !compressedMeshes && !meshBlob && 0 != std::memcmp(variant, kFileVariant, 16)) {
+            variant[15] = '\0';
+            throw vkutils::Error("loadBakedModelFromFile(): %s: file variant is '%s', expected '%s', '%s', '%s' or '%s'",
+                                 inputName,
                                  variant,
-                                 kFileVariant);
+                                 kFileVariant,
+                                 kFileVariantPacked,
+                                 kFileVariantCompressed,
+                                 kFileVariantBlob);
         }
 
         // Read texture info
@@ -107,16 +531,14 @@ namespace baked {
                 .metalness = readFloat(input),
                 .baseColourTextureId = readUint32(input),
                 .emissiveTextureId = readUint32(input),
-                .roughnessTextureId = readUint32(input),
-                .metalnessTextureId = readUint32(input),
+                .surfaceTextureId = readUint32(input),
                 .normalMapTextureId = readUint32(input),
                 .alphaMaskTextureId = readUint32(input)
             };
 
             assert(info.baseColourTextureId < bakedModel.textures.size());
             assert(info.emissiveTextureId < bakedModel.textures.size());
-            assert(info.roughnessTextureId < bakedModel.textures.size());
-            assert(info.metalnessTextureId < bakedModel.textures.size());
+            assert(info.surfaceTextureId < bakedModel.textures.size());
             assert(info.normalMapTextureId < bakedModel.textures.size());
             assert(info.alphaMaskTextureId < bakedModel.textures.size() || info.alphaMaskTextureId == NO_ID);
 
@@ -125,6 +547,8 @@ namespace baked {
 
         // Read mesh data
         const auto meshCount = readUint32(input);
+        std::vector<BlobStreams> blobStreams;
+        std::vector<CompressedBlock> compressedBlocks;
         for (std::uint32_t i = 0; i < meshCount; ++i) {
             BakedMeshData data;
             data.name = readString(input);
@@ -134,46 +558,205 @@ namespace baked {
             const auto V = readUint32(input);
             const auto I = readUint32(input);
 
-            data.positions.resize(V);
-            checkedRead(input, V * sizeof(glm::vec3), data.positions.data());
+            checkedRead(input, sizeof(std::uint8_t), &data.indexSize);
+            if (sizeof(std::uint16_t) != data.indexSize && sizeof(std::uint32_t) != data.indexSize) {
+                throw vkutils::Error("loadBakedModelFromFile(): %s: mesh '%s' has invalid index size %u",
+                                     inputName, data.name.c_str(), static_cast<unsigned>(data.indexSize));
+            }
+
+            data.aabbMin = readVec<3>(input);
+            data.aabbMax = readVec<3>(input);
+            data.sphereCentre = readVec<3>(input);
+            data.sphereRadius = readFloat(input);
+
+            const auto L = readUint32(input);
+            std::uint32_t nextLodIndex = 0;
+            for (std::uint32_t l = 0; l < L; ++l) {
+                BakedMeshLod lod{
+                    .firstIndex = readUint32(input),
+                    .indexCount = readUint32(input),
+                    .error = readFloat(input)
+                };
+
+                if (lod.firstIndex != nextLodIndex || lod.indexCount > I - nextLodIndex) {
+                    throw vkutils::Error("loadBakedModelFromFile(): %s: mesh '%s' has invalid level of detail %u",
+                                         inputName, data.name.c_str(), l);
+                }
+
+                nextLodIndex += lod.indexCount;
+                data.lods.emplace_back(lod);
+            }
+
+            if (data.lods.empty() || nextLodIndex != I) {
+                throw vkutils::Error("loadBakedModelFromFile(): %s: levels of detail of mesh '%s' cover %u of %u indices",
+                                     inputName, data.name.c_str(), nextLodIndex, I);
+            }
+
+            data.vertexCount = V;
+            data.indexCount = I;
+
+            if (compressedMeshes) {
+                // Streams are decoded from the compressed blocks once every mesh is read
+                data.positionOrigin = readVec<3>(input);
+                data.positionExtent = readVec<3>(input);
+                allocateDecodedStreams(data, true);
+                readCompressedBlocks(input, data, i, compressedBlocks, inputName);
+            } else if (meshBlob) {
+                // Streams point into the blob after the last mesh
+                data.positionOrigin = readVec<3>(input);
+                data.positionExtent = readVec<3>(input);
+                blobStreams.emplace_back(readBlobStreams(input));
+            } else {
+                if (packedVertices) {
+                    readPackedVertices(input, data);
+                } else {
+                    readFloatVertices(input, data);
+                }
+
+                data.indices = readBytes(input, std::size_t(I) * data.indexSize);
+            }
+
+            readMeshlets(input, data, inputName);
 
-            data.normals.resize(V);
-            checkedRead(input, V * sizeof(glm::vec3), data.normals.data());
+            bakedModel.meshes.emplace_back(std::move(data));
+        }
+
+        if (compressedMeshes) {
+            decodeCompressedMeshes(compressedBlocks, bakedModel, inputName);
+        } else if (meshBlob) {
+            readMeshBlob(input, blobStreams, bakedModel, inputName);
+        }
 
-            data.uvs.resize(V);
-            checkedRead(input, V * sizeof(glm::vec2), data.uvs.data());
+        // Read instances
+        for (auto& data : bakedModel.meshes) {
+            const auto N = readUint32(input);
+            if (0 == N) {
+                throw vkutils::Error("loadBakedModelFromFile(): %s: mesh '%s' has no instances",
+                                     inputName, data.name.c_str());
+            }
 
-            data.tangents.resize(V);
-            checkedRead(input, V * sizeof(glm::vec4), data.tangents.data());
+            data.instances.resize(N);
+            checkedRead(input, sizeof(glm::mat4x3) * N, data.instances.data());
+        }
 
-            data.indices.resize(I);
-            checkedRead(input, I * sizeof(std::uint32_t), data.indices.data());
+        // Read scene BVH
+        const auto B = readUint32(input);
+        bakedModel.bvh.nodes.resize(B);
+        checkedRead(input, B * sizeof(BakedBvhNode), bakedModel.bvh.nodes.data());
+
+        const auto P = readUint32(input);
+        bakedModel.bvh.primitives.resize(P);
+        checkedRead(input, P * sizeof(BakedBvhPrimitive), bakedModel.bvh.primitives.data());
+
+        for (std::uint32_t i = 0; i < B; ++i) {
+            const auto& node = bakedModel.bvh.nodes[i];
+            // Children follow their parent, so that traversal always terminates
+            const bool valid = node.is_leaf()
+                                   ? node.offset <= P && node.count <= P - node.offset
+                                   : node.offset > i + 1 && node.offset < B;
+            if (!valid) {
+                throw vkutils::Error("loadBakedModelFromFile(): %s: invalid BVH node %u", inputName, i);
+            }
+        }
 
-            bakedModel.meshes.emplace_back(std::move(data));
+        for (const auto& primitive : bakedModel.bvh.primitives) {
+            if (primitive.mesh >= bakedModel.meshes.size() ||
+                primitive.instance >= bakedModel.meshes[primitive.mesh].instances.size()) {
+                throw vkutils::Error("loadBakedModelFromFile(): %s: BVH references unknown mesh instance %u/%u",
+                                     inputName, primitive.mesh, primitive.instance);
+            }
         }
 
         // Check trailing bytes
-        char byte;
-        if (const auto check = std::fread(&byte, 1, 1, input); 0 != check) {
+        if (input.offset != input.bytes.size()) {
             std::fprintf(stderr, "Note: '%s' contains trailing bytes\n", inputName);
         }
 
+        // Streams that were not decoded point into the mapping
+        bakedModel.file = std::move(file);
+
         return bakedModel;
     }
 
     BakedModel loadBakedModel(char const* modelPath) {
         std::printf("Loading scene: %s\n", modelPath);
-        FILE* modelFile = std::fopen(modelPath, "rb");
-        if (!modelFile) {
-            throw vkutils::Error("loadBakedModel(): unable to open '%s' for reading", modelPath);
+        return loadBakedModelFromFile(vkutils::map_file(modelPath), modelPath);
+    }
+
+    BakedTextureData loadBakedTextureFromFile(FILE* input, char const* inputName) {
+        char magic[16];
+        checkedRead(input, 16, magic);
+
+        if (0 != std::memcmp(magic, kTextureFileMagic, 16)) {
+            throw vkutils::Error("loadBakedTextureFromFile(): %s: invalid file signature!", inputName);
+        }
+
+        BakedTextureData texture;
+        checkedRead(input, sizeof(TextureEncoding), &texture.encoding);
+
+        std::size_t blockSize;
+        switch (texture.encoding) {
+            case TextureEncoding::bc7Srgb:
+            case TextureEncoding::bc7Unorm:
+            case TextureEncoding::bc5Unorm:
+                blockSize = 16;
+                break;
+            case TextureEncoding::bc4Unorm:
+                blockSize = 8;
+                break;
+            default:
+                throw vkutils::Error("loadBakedTextureFromFile(): %s: unknown encoding %u",
+                                     inputName, static_cast<unsigned>(texture.encoding));
+        }
+
+        texture.width = readUint32(input);
+        texture.height = readUint32(input);
+
+        const auto levelCount = readUint32(input);
+        if (0 == levelCount || levelCount > kMaxMipLevels) {
+            throw vkutils::Error("loadBakedTextureFromFile(): %s: invalid number of mip levels (%u)",
+                                 inputName, levelCount);
+        }
+
+        std::size_t offset = 0;
+        for (std::uint32_t level = 0; level < levelCount; ++level) {
+            const std::uint32_t width = std::max(texture.width >> level, 1u);
+            const std::uint32_t height = std::max(texture.height >> level, 1u);
+            const std::size_t size = readUint32(input);
+
+            if (const std::size_t expected = std::size_t((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+                expected != size) {
+                throw vkutils::Error("loadBakedTextureFromFile(): %s: mip level %u is %zu bytes, expected %zu",
+                                     inputName, level, size, expected);
+            }
+
+            texture.mipLevels.emplace_back(BakedTextureMipLevel{
+                .width = width,
+                .height = height,
+                .offset = offset,
+                .size = size
+            });
+            offset += size;
+        }
+
+        texture.data.resize(offset);
+        checkedRead(input, texture.data.size(), texture.data.data());
+
+        return texture;
+    }
+
+    BakedTextureData loadBakedTexture(char const* texturePath) {
+        FILE* textureFile = std::fopen(texturePath, "rb");
+        if (!textureFile) {
+            throw vkutils::Error("loadBakedTexture(): unable to open '%s' for reading", texturePath);
         }
 
         try {
-            auto ret = loadBakedModelFromFile(modelFile, modelPath);
-            std::fclose(modelFile);
+            auto ret = loadBakedTextureFromFile(textureFile, texturePath);
+            std::fclose(textureFile);
             return ret;
         } catch (...) {
-            std::fclose(modelFile);
+            std::fclose(textureFile);
             throw;
         }
     }
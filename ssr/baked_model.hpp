@@ -1,5 +1,6 @@
 #pragma once
 
+#include <span>
 #include <string>
 #include <vector>
 
@@ -8,18 +9,22 @@
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include <glm/mat4x3.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "../vkutils/mapped_file.hpp"
 
 /*
  * Baked file format:
  *
  *  1. Header:
  *    - 16*char: file magic = "\0\0SPICYMESH"
- *    - 16*char: variant = "default" (changes later)
+ *    - 16*char: variant = "spicy", "spicy-packed", "spicy-zstd" or "spicy-blob", see 4.
  *
  *  2. Textures
  *    - uint32_t: U = number of (unique) textures
  *    - repeat U times:
- *      - string: path to texture
+ *      - string: path to baked texture, see 8.
  *      - 1*uint8_t: number of channels in texture
  *
  *  3. Material information
@@ -32,28 +37,107 @@
  *      - float: metalness factor
  *      - uint32_t: base color texture index
  *      - uint32_t: emissive texture index
- *      - uint32_t: roughness texture index
- *      - uint32_t: metalness texture index
+ *      - uint32_t: surface texture index, roughness (R) and metalness (G)
  *      - uint32_t: normal map texture index
- *      - uint32_t: alphaMask texture index, or 0xFFFFFFF if none
+ *      - uint32_t: alpha mask texture index, or 0xFFFFFFFF if none
  *
- *  4. Mesh data
+ *  4. Mesh data, written as every mesh is baked
  *    - uint32_t: M = number of meshes
  *    - repeat M times:
+ *      - string: name
  *      - uint32_t: material index
  *      - uint32_t: V = number of vertices
- *      - uint32_t: I = number of indices
- *		- repeat V times: vec3 position
- *      - repeat V times: vec3 normal
- *      - repeat V times: vec2 texture coordinate
- *      - repeat V times: vec4 tangent
- *      - repeat I times: uint32_t index
+ *      - uint32_t: I = number of indices, of all levels of detail
+ *      - uint8_t: S = index size in bytes, 2 if V <= 65536, else 4
+ *      - vec3: bounding box min
+ *      - vec3: bounding box max
+ *      - vec3: bounding sphere centre
+ *      - float: bounding sphere radius
+ *      - uint32_t: L = number of levels of detail, at least 1
+ *      - repeat L times, from full resolution to coarsest:
+ *        - uint32_t: first index
+ *        - uint32_t: number of indices
+ *        - float: simplification error, see BakedMeshLod
+ *      - "spicy" variant:
+ *        - repeat V times: vec3 position
+ *        - repeat V times: vec3 normal
+ *        - repeat V times: vec2 texture coordinate
+ *        - repeat V times: vec4 tangent
+ *      - "spicy-packed", "spicy-zstd" and "spicy-blob" variants:
+ *        - vec3: position origin
+ *        - vec3: position extent
+ *        - repeat V times: u16vec4 position, UNORM16 relative to origin and
+ *                          extent, w = tangent handedness (0 => -1, 1 => +1)
+ *        - repeat V times: i16vec2 octahedral normal, SNORM16
+ *        - repeat V times: u16vec2 texture coordinate, half floats
+ *        - repeat V times: i16vec2 octahedral tangent, SNORM16
+ *      - repeat I times: uint16_t or uint32_t index, depending on S
+ *      The "spicy-zstd" and "spicy-blob" variants store only the position
+ *      origin and extent of the vertices. "spicy-zstd" replaces the streams
+ *      and indices by blocks that are decoded independently:
+ *        - uint32_t: K = number of blocks
+ *        - repeat K times, ordered by stream and first element:
+ *          - uint32_t: stream, see MeshStream
+ *          - uint32_t: first element
+ *          - uint32_t: number of elements
+ *          - uint32_t: Z = compressed size in bytes
+ *        - repeat K times: Z bytes, a zstd frame of the block's elements in
+ *                          the layout above, byte shuffled (see
+ *                          vkutils::shuffle_bytes()). Indices are delta coded
+ *                          within the block, see vkutils::encode_index_deltas().
+ *      "spicy-blob" replaces them by the offsets of the mesh's streams in the
+ *      blob, each a multiple of 256 bytes, see 5.:
+ *        - 5*uint64_t: positions, normals, uvs, tangents and indices offsets
+ *      - uint32_t: C = number of meshlets, consecutive runs of at most 124
+ *                  triangles and 64 vertices, never spanning two levels of
+ *                  detail
+ *      - repeat C times:
+ *        - uint32_t: first index
+ *        - uint32_t: number of indices
+ *        - vec3: bounding sphere centre
+ *        - float: bounding sphere radius
+ *        - vec3: normal cone axis
+ *        - float: normal cone cutoff, see BakedMeshlet
+ *
+ *  5. "spicy-blob" variant only, the streams of every mesh:
+ *    - uint64_t: B = size of the blob in bytes
+ *    - zero padding up to the next multiple of 256 bytes in the file
+ *    - B bytes: the streams of every mesh at their offsets, in the layout
+ *               above, zero in between
+ *
+ *  6. Instances, only known once every mesh is baked
+ *    - repeat M times, once per mesh in the order of 4.:
+ *      - uint32_t: N = number of instances, at least 1
+ *      - repeat N times: mat4x3 model to world transform, column-major,
+ *                        rotation and translation only
+ *
+ *  7. Scene BVH over the world space bounds of every mesh instance
+ *    - uint32_t: B = number of nodes, 0 if there are no meshes
+ *    - repeat B times, depth-first, see BakedBvhNode:
+ *      - vec3: bounding box min
+ *      - uint32_t: right child of inner nodes, first primitive of leaves
+ *      - vec3: bounding box max
+ *      - uint32_t: number of primitives, 0 for inner nodes
+ *    - uint32_t: P = number of primitives, one per instance of every mesh
+ *    - repeat P times:
+ *      - uint32_t: mesh index
+ *      - uint32_t: instance index
+ *
+ *  8. Baked textures are stored in separate files:
+ *    - 16*char: file magic = "\0\0SPICYTEX"
+ *    - uint8_t: encoding, see TextureEncoding
+ *    - uint32_t: width
+ *    - uint32_t: height
+ *    - uint32_t: L = number of mip levels, the full chain down to 1x1
+ *    - repeat L times: uint32_t size of the mip level in bytes
+ *    - repeat L times: mip level data, 4x4 texel blocks in row-major order,
+ *                      starting with the bottom-most row of blocks
  *
  * Strings are stored as
  *   - uint32_t: N = length of string in chars, including terminating \0
  *   - repeat N times: char in string
  *
- * See assets-bake/main.cpp (specifically write_model_data_()) for additional
+ * See assets-bake/main.cpp (specifically write_mesh() and write_model_trailer()) for additional
  * information.
  */
 namespace baked {
@@ -74,8 +158,7 @@ namespace baked {
 
         std::uint32_t baseColourTextureId;
         std::uint32_t emissiveTextureId;
-        std::uint32_t roughnessTextureId;
-        std::uint32_t metalnessTextureId;
+        std::uint32_t surfaceTextureId;
         std::uint32_t normalMapTextureId;
         std::uint32_t alphaMaskTextureId = NO_ID;
 
@@ -84,24 +167,173 @@ namespace baked {
         }
     };
 
+    /*
+     * Range of a mesh's indices that is culled as a whole, in model space
+     */
+    struct BakedMeshlet {
+        std::uint32_t firstIndex;
+        std::uint32_t indexCount;
+
+        glm::vec3 sphereCentre;
+        float sphereRadius;
+
+        // Every triangle faces away from a camera at position p if
+        //   dot(sphereCentre - p, coneAxis) >= coneCutoff * length(sphereCentre - p) + sphereRadius
+        // A cutoff of 1 never culls anything.
+        glm::vec3 coneAxis;
+        float coneCutoff;
+    };
+
+    /*
+     * Simplified version of a mesh. Levels of detail share the mesh's vertices
+     * and cover consecutive ranges of its indices and meshlets.
+     */
+    struct BakedMeshLod {
+        std::uint32_t firstIndex;
+        std::uint32_t indexCount;
+
+        // Estimated distance between this level and the full resolution
+        // surface, in model space. 0 for level 0, increases with the level.
+        float error;
+
+        // Range in BakedMeshData::meshlets, derived while loading
+        std::uint32_t firstMeshlet = 0;
+        std::uint32_t meshletCount = 0;
+    };
+
+    /*
+     * Vertex streams are always packed as in the "spicy-packed" variant. Float
+     * vertices of the "spicy" variant are packed while loading.
+     *
+     * Streams are raw bytes that point straight into the mapped file where
+     * possible, see BakedModel::file, and stay valid as long as the model. They
+     * are not aligned to their elements, copy them instead of reading them in
+     * place.
+     *
+     * Bounds, vertices and meshlets are in model space. Every instance places
+     * a copy of the mesh in the world.
+     */
     struct BakedMeshData {
         std::string name;
 
         std::uint32_t materialId;
 
-        std::vector<glm::vec3> positions;
-        std::vector<glm::vec2> uvs;
-        std::vector<glm::vec3> normals;
-        std::vector<glm::vec4> tangents;
+        // Model to world transforms, rigid
+        std::vector<glm::mat4x3> instances;
+
+        // Bounds of the (unpacked) positions, in model space
+        glm::vec3 aabbMin;
+        glm::vec3 aabbMax;
+        glm::vec3 sphereCentre;
+        float sphereRadius;
+
+        // position = positionOrigin + positions.xyz * positionExtent
+        glm::vec3 positionOrigin;
+        glm::vec3 positionExtent;
+
+        // vertexCount elements each
+        std::uint32_t vertexCount;
+        std::span<const std::uint8_t> positions; // glm::u16vec4
+        std::span<const std::uint8_t> uvs; // glm::u16vec2
+        std::span<const std::uint8_t> normals; // glm::i16vec2
+        std::span<const std::uint8_t> tangents; // glm::i16vec2
+
+        // Raw index data, indexCount indices of indexSize bytes each
+        std::uint32_t indexCount;
+        std::uint8_t indexSize;
+        std::span<const std::uint8_t> indices;
+
+        // Backs the streams that are decoded while loading, i.e. the vertices
+        // of the "spicy" variant and everything of the "spicy-zstd" variant
+        std::vector<std::uint8_t> decoded;
+
+        // Cover all indices, in order
+        std::vector<BakedMeshLod> lods;
+        std::vector<BakedMeshlet> meshlets;
+    };
+
+    /*
+     * Node of the scene's bounding volume hierarchy, in world space. The left
+     * child of an inner node directly follows it.
+     */
+    struct BakedBvhNode {
+        glm::vec3 aabbMin;
+        // Index of the right child of inner nodes, of the first primitive of leaves
+        std::uint32_t offset;
+        glm::vec3 aabbMax;
+        // 0 for inner nodes
+        std::uint32_t count;
+
+        bool is_leaf() const {
+            return count > 0;
+        }
+    };
+
+    struct BakedBvhPrimitive {
+        std::uint32_t mesh;
+        std::uint32_t instance;
+    };
+
+    // Read as they are from the baked file
+    static_assert(sizeof(BakedBvhNode) == 32, "BakedBvhNode must match the baked node layout");
+    static_assert(sizeof(BakedBvhPrimitive) == 8, "BakedBvhPrimitive must match the baked primitive layout");
+
+    struct BakedBvh {
+        // Root first, empty if the model has no meshes
+        std::vector<BakedBvhNode> nodes;
+        std::vector<BakedBvhPrimitive> primitives;
+    };
+
+    // Streams of the "spicy-zstd" variant's compressed blocks
+    enum class MeshStream : std::uint32_t {
+        positions = 0,
+        normals = 1,
+        uvs = 2,
+        tangents = 3,
+        indices = 4
+    };
 
-        std::vector<std::uint32_t> indices;
+    enum class TextureEncoding : std::uint8_t {
+        bc7Srgb = 1, // base colour
+        bc7Unorm = 2, // emissive
+        bc5Unorm = 3, // normal map XY, or surface roughness and metalness
+        bc4Unorm = 4 // alpha mask transparency
+    };
+
+    struct BakedTextureMipLevel {
+        std::uint32_t width;
+        std::uint32_t height;
+
+        // Location of the level in BakedTextureData::data
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    struct BakedTextureData {
+        TextureEncoding encoding;
+
+        std::uint32_t width;
+        std::uint32_t height;
+
+        std::vector<BakedTextureMipLevel> mipLevels;
+        std::vector<std::uint8_t> data;
     };
 
     struct BakedModel {
+        // Backs the mesh streams that are used as they are, see BakedMeshData
+        vkutils::MappedFile file;
+
+        // "spicy-blob" variant: the streams of every mesh, in one block that
+        // is uploaded as it is, see mesh::MeshStore. Empty for other variants.
+        std::span<const std::uint8_t> meshBlob;
+
         std::vector<BakedTextureInfo> textures;
         std::vector<BakedMaterialInfo> materials;
         std::vector<BakedMeshData> meshes;
+        BakedBvh bvh;
     };
 
     BakedModel loadBakedModel(char const* modelPath);
+
+    BakedTextureData loadBakedTexture(char const* texturePath);
 }
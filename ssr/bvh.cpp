@@ -0,0 +1,83 @@
+#include "bvh.hpp"
+
+#include <glm/gtc/matrix_access.hpp>
+
+namespace {
+    // Conservative: boxes crossing a corner of the frustum outside of all planes are still reported
+    bool intersects_frustum(const bvh::Frustum& frustum, const baked::BakedBvhNode& node);
+}
+
+namespace bvh {
+    Frustum extract_frustum(const glm::mat4& viewProjection) {
+        // Gribb & Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix",
+        // adapted to a [0, 1] depth range
+        const glm::vec4 r0 = glm::row(viewProjection, 0);
+        const glm::vec4 r1 = glm::row(viewProjection, 1);
+        const glm::vec4 r2 = glm::row(viewProjection, 2);
+        const glm::vec4 r3 = glm::row(viewProjection, 3);
+
+        Frustum frustum{
+            r3 + r0, // left
+            r3 - r0, // right
+            r3 + r1, // bottom
+            r3 - r1, // top
+            r2, // near
+            r3 - r2 // far
+        };
+
+        // Normalise, so that the plane equations give distances
+        for (auto& plane : frustum) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+
+        return frustum;
+    }
+
+    void query_frustum(const baked::BakedModel& model, const Frustum& frustum, MeshVisibility& visibility) {
+        visibility.assign(model.meshes.size(), 0);
+
+        const auto& nodes = model.bvh.nodes;
+        if (nodes.empty()) {
+            return;
+        }
+
+        std::vector<std::uint32_t> stack{0};
+        while (!stack.empty()) {
+            const std::uint32_t nodeIndex = stack.back();
+            const auto& node = nodes[nodeIndex];
+            stack.pop_back();
+
+            if (!intersects_frustum(frustum, node)) {
+                continue;
+            }
+
+            if (node.is_leaf()) {
+                for (std::uint32_t p = node.offset; p < node.offset + node.count; ++p) {
+                    visibility[model.bvh.primitives[p].mesh] = 1;
+                }
+            } else {
+                // Left child directly follows its parent, visit it first
+                stack.push_back(node.offset);
+                stack.push_back(nodeIndex + 1);
+            }
+        }
+    }
+
+    void mark_all_visible(const baked::BakedModel& model, MeshVisibility& visibility) {
+        visibility.assign(model.meshes.size(), 1);
+    }
+}
+
+namespace {
+    bool intersects_frustum(const bvh::Frustum& frustum, const baked::BakedBvhNode& node) {
+        for (const auto& plane : frustum) {
+            // Corner of the box furthest along the plane's normal
+            const glm::vec3 corner = glm::mix(node.aabbMin, node.aabbMax,
+                                              glm::greaterThanEqual(glm::vec3(plane), glm::vec3(0.0f)));
+            if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "baked_model.hpp"
+
+/*
+ * Visibility queries against the scene's bounding volume hierarchy, baked
+ * over the world space bounds of every mesh instance (see baked::BakedBvh).
+ * Subtrees outside of the queried volume are skipped as a whole, so the cost
+ * grows with the number of visible meshes rather than the size of the scene.
+ */
+namespace bvh {
+    // World space, inside if dot(plane.xyz, p) + plane.w >= 0, normalised
+    using Frustum = std::array<glm::vec4, 6>;
+
+    // Left, right, bottom, top, near and far planes of a [0, 1] depth range projection
+    Frustum extract_frustum(const glm::mat4& viewProjection);
+
+    // One flag per mesh of the baked model, indexed by mesh::Mesh::modelIndex
+    using MeshVisibility = std::vector<std::uint8_t>;
+
+    // Flags the meshes with at least one instance whose bounds intersect the frustum
+    void query_frustum(const baked::BakedModel& model, const Frustum& frustum, MeshVisibility& visibility);
+
+    // Flags all meshes, for when culling is disabled
+    void mark_all_visible(const baked::BakedModel& model, MeshVisibility& visibility);
+}
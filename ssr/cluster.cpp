@@ -0,0 +1,271 @@
+#include "cluster.hpp"
+
+#include <algorithm>
+#include <array>
+
+#include "../vkutils/error.hpp"
+#include "../vkutils/to_string.hpp"
+#include "../vkutils/vkutil.hpp"
+
+#include "bvh.hpp"
+#include "config.hpp"
+
+namespace {
+    // Must match local_size_x in cluster_cull.comp
+    constexpr std::uint32_t kWorkgroupSize = 64;
+
+    // Minimum maxDrawIndirectCount guaranteed with multiDrawIndirect
+    constexpr std::uint32_t kMaxDrawsPerCall = 65535;
+
+    constexpr std::uint32_t kDrawStride = sizeof(VkDrawIndexedIndirectCommand);
+}
+
+namespace cluster {
+    ClusterBuffers create_cluster_buffers(const vkutils::Allocator& allocator,
+                                          const baked::BakedModel& model,
+                                          const std::vector<material::Material>& materials) {
+        // Same order as the meshes, see mesh::extract_meshes()
+        std::vector<glsl::Meshlet> meshlets;
+        for (const auto& mesh : model.meshes) {
+            // Alpha masked meshes are drawn without backface culling
+            const bool twoSided = materials[mesh.materialId].has_alpha_mask();
+
+            // Rigid transforms keep radii and cone angles, see mesh::MeshLod::firstMeshlet for the order
+            for (const auto& lod : mesh.lods) {
+                for (std::uint32_t instance = 0; instance < mesh.instances.size(); ++instance) {
+                    const auto& transform = mesh.instances[instance];
+                    const glm::mat3 rotation(transform);
+
+                    for (std::uint32_t m = lod.firstMeshlet; m < lod.firstMeshlet + lod.meshletCount; ++m) {
+                        const auto& meshlet = mesh.meshlets[m];
+                        meshlets.emplace_back(glsl::Meshlet{
+                            .sphere = glm::vec4(transform * glm::vec4(meshlet.sphereCentre, 1.0f),
+                                                meshlet.sphereRadius),
+                            .cone = glm::vec4(rotation * meshlet.coneAxis, twoSided ? 1.0f : meshlet.coneCutoff),
+                            .firstIndex = meshlet.firstIndex,
+                            .indexCount = meshlet.indexCount,
+                            .instance = instance
+                        });
+                    }
+                }
+            }
+        }
+
+        const auto meshletCount = static_cast<std::uint32_t>(meshlets.size());
+
+        // Vulkan buffers can't be empty
+        const std::size_t bufferCount = std::max<std::size_t>(meshlets.size(), 1);
+
+        // Written once and read by a single dispatch per frame, skip the staging copy
+        vkutils::Buffer meshletBuffer = vkutils::create_buffer(
+            allocator,
+            sizeof(glsl::Meshlet) * bufferCount,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
+        );
+
+        if (const auto res = meshlets.empty() ? VK_SUCCESS : vmaCopyMemoryToAllocation(
+                allocator.allocator, meshlets.data(), meshletBuffer.allocation, 0,
+                sizeof(glsl::Meshlet) * meshlets.size());
+            VK_SUCCESS != res) {
+            throw vkutils::Error("Writing meshlets\n"
+                                 "vmaCopyMemoryToAllocation() returned %s", vkutils::to_string(res).c_str()
+            );
+        }
+
+        vkutils::Buffer drawBuffer = vkutils::create_buffer(
+            allocator,
+            kDrawStride * bufferCount,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+            0,
+            VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
+        );
+
+        return ClusterBuffers{
+            .meshlets = std::move(meshletBuffer),
+            .draws = std::move(drawBuffer),
+            .meshletCount = meshletCount
+        };
+    }
+
+    vkutils::DescriptorSetLayout create_descriptor_layout(const vkutils::VulkanContext& context) {
+        constexpr std::array bindings{
+            VkDescriptorSetLayoutBinding{
+                .binding = 0, // layout(set = ..., binding = 0), meshlets
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            },
+            VkDescriptorSetLayoutBinding{
+                .binding = 1, // layout(set = ..., binding = 1), draw commands
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .descriptorCount = 1,
+                .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+            }
+        };
+
+        const VkDescriptorSetLayoutCreateInfo layoutInfo{
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .bindingCount = bindings.size(),
+            .pBindings = bindings.data()
+        };
+
+        VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+        if (const auto res = vkCreateDescriptorSetLayout(context.device, &layoutInfo, nullptr, &layout);
+            VK_SUCCESS != res) {
+            throw vkutils::Error("Unable to create descriptor set layout\n"
+                                 "vkCreateDescriptorSetLayout() returned %s", vkutils::to_string(res).c_str()
+            );
+        }
+
+        return vkutils::DescriptorSetLayout(context.device, layout);
+    }
+
+    void update_descriptor_set(const vkutils::VulkanContext& context,
+                               const ClusterBuffers& buffers,
+                               const VkDescriptorSet clusterDescriptorSet) {
+        const VkDescriptorBufferInfo meshletsInfo{
+            .buffer = buffers.meshlets.buffer,
+            .range = VK_WHOLE_SIZE
+        };
+
+        const VkDescriptorBufferInfo drawsInfo{
+            .buffer = buffers.draws.buffer,
+            .range = VK_WHOLE_SIZE
+        };
+
+        const std::array writeDescriptor{
+            VkWriteDescriptorSet{
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = clusterDescriptorSet,
+                .dstBinding = 0,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &meshletsInfo
+            },
+            VkWriteDescriptorSet{
+                .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+                .dstSet = clusterDescriptorSet,
+                .dstBinding = 1,
+                .descriptorCount = 1,
+                .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                .pBufferInfo = &drawsInfo
+            }
+        };
+
+        vkUpdateDescriptorSets(context.device, writeDescriptor.size(), writeDescriptor.data(), 0, nullptr);
+    }
+
+    vkutils::PipelineLayout create_pipeline_layout(const vkutils::VulkanContext& context,
+                                                   const vkutils::DescriptorSetLayout& clusterLayout) {
+        constexpr VkPushConstantRange pushConstantRange{
+            .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+            .offset = 0,
+            .size = sizeof(glsl::ClusterCullPushConstants)
+        };
+
+        const VkPipelineLayoutCreateInfo layoutInfo{
+            .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+            .setLayoutCount = 1,
+            .pSetLayouts = &clusterLayout.handle,
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &pushConstantRange
+        };
+
+        VkPipelineLayout layout = VK_NULL_HANDLE;
+        if (const auto res = vkCreatePipelineLayout(context.device, &layoutInfo, nullptr, &layout);
+            VK_SUCCESS != res) {
+            throw vkutils::Error("Unable to create cluster culling pipeline layout\n"
+                                 "vkCreatePipelineLayout() returned %s", vkutils::to_string(res).c_str());
+        }
+
+        return vkutils::PipelineLayout(context.device, layout);
+    }
+
+    vkutils::Pipeline create_pipeline(const vkutils::VulkanContext& context, const VkPipelineLayout pipelineLayout) {
+        const vkutils::ShaderModule comp = vkutils::load_shader_module(context, cfg::clusterCullCompPath);
+
+        const VkComputePipelineCreateInfo pipelineInfo{
+            .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+            .stage = VkPipelineShaderStageCreateInfo{
+                .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+                .module = comp.handle,
+                .pName = "main"
+            },
+            .layout = pipelineLayout
+        };
+
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        if (const auto res = vkCreateComputePipelines(context.device, VK_NULL_HANDLE,
+                                                      1, &pipelineInfo, nullptr, &pipeline);
+            VK_SUCCESS != res) {
+            throw vkutils::Error("Unable to create cluster culling pipeline\n"
+                                 "vkCreateComputePipelines() returned %s", vkutils::to_string(res).c_str());
+        }
+
+        return vkutils::Pipeline(context.device, pipeline);
+    }
+
+    glsl::ClusterCullPushConstants create_push_constants(const glsl::SceneUniform& sceneUniform,
+                                                         const state::State& state,
+                                                         const std::uint32_t meshletCount) {
+        const bvh::Frustum frustum = bvh::extract_frustum(sceneUniform.VP);
+
+        glsl::ClusterCullPushConstants pushConstants{
+            .cameraPosition = glm::vec4(glm::vec3(sceneUniform.C[3]), 1.0f),
+            .meshletCount = meshletCount,
+            .cullingEnabled = state.clusterCulling ? 1u : 0u
+        };
+        std::copy(frustum.begin(), frustum.end(), pushConstants.frustumPlanes);
+
+        return pushConstants;
+    }
+
+    void record_commands(const VkCommandBuffer commandBuffer,
+                         const VkPipelineLayout pipelineLayout,
+                         const VkPipeline pipeline,
+                         const VkDescriptorSet clusterDescriptorSet,
+                         const ClusterBuffers& buffers,
+                         const glsl::ClusterCullPushConstants& pushConstants) {
+        // The previous frame's draws must be done reading the commands
+        vkutils::buffer_barrier(commandBuffer,
+                                buffers.draws.buffer,
+                                VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                                VK_ACCESS_SHADER_WRITE_BIT,
+                                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+        );
+
+        vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                pipelineLayout, 0, 1,
+                                &clusterDescriptorSet, 0, nullptr);
+        vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                           sizeof(glsl::ClusterCullPushConstants), &pushConstants);
+
+        vkCmdDispatch(commandBuffer, (buffers.meshletCount + kWorkgroupSize - 1) / kWorkgroupSize, 1, 1);
+
+        vkutils::buffer_barrier(commandBuffer,
+                                buffers.draws.buffer,
+                                VK_ACCESS_SHADER_WRITE_BIT,
+                                VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+                                VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT
+        );
+    }
+
+    void draw_mesh(const VkCommandBuffer commandBuffer,
+                   const VkBuffer draws,
+                   const mesh::Mesh& mesh,
+                   const mesh::MeshLod& lod) {
+        // Culled meshlets have an instance count of 0
+        const std::uint32_t drawCount = lod.meshletCount * mesh.instanceCount;
+        for (std::uint32_t first = 0; first < drawCount; first += kMaxDrawsPerCall) {
+            vkCmdDrawIndexedIndirect(commandBuffer, draws,
+                                     VkDeviceSize(lod.firstMeshlet + first) * kDrawStride,
+                                     std::min(drawCount - first, kMaxDrawsPerCall),
+                                     kDrawStride);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../vkutils/allocator.hpp"
+#include "../vkutils/vkbuffer.hpp"
+#include "../vkutils/vkobject.hpp"
+#include "../vkutils/vulkan_context.hpp"
+
+#include "baked_model.hpp"
+#include "material.hpp"
+#include "mesh.hpp"
+#include "scene.hpp"
+#include "state.hpp"
+
+namespace glsl {
+    // See baked::BakedMeshlet, std430
+    struct Meshlet {
+        glm::vec4 sphere; // xyz = centre, w = radius
+        glm::vec4 cone; // xyz = axis, w = cutoff
+        std::uint32_t firstIndex;
+        std::uint32_t indexCount;
+        // Index of the mesh instance, the draw's firstInstance
+        std::uint32_t instance;
+        std::uint32_t padding;
+    };
+
+    static_assert(sizeof(Meshlet) == 48, "Meshlet must match the std430 layout in cluster_cull.comp");
+
+    struct ClusterCullPushConstants {
+        // World space, inside if dot(plane.xyz, p) + plane.w >= 0
+        glm::vec4 frustumPlanes[6];
+        glm::vec4 cameraPosition;
+        std::uint32_t meshletCount;
+        std::uint32_t cullingEnabled;
+    };
+
+    // 128 bytes is the minimum maxPushConstantsSize guaranteed by Vulkan
+    static_assert(sizeof(ClusterCullPushConstants) <= 128, "ClusterCullPushConstants must fit in 128 bytes");
+    static_assert(offsetof(ClusterCullPushConstants, frustumPlanes) % 16 == 0, "frustumPlanes must be aligned to 16 bytes");
+    static_assert(offsetof(ClusterCullPushConstants, cameraPosition) % 16 == 0, "cameraPosition must be aligned to 16 bytes");
+}
+
+/*
+ * Cluster culling. Every mesh is drawn as the meshlets of its selected level of
+ * detail (see baked::BakedMeshlet) with one indirect draw command per meshlet
+ * and mesh instance. Before the offscreen pass, a compute shader tests every
+ * meshlet against the camera frustum and its normal cone, and sets the
+ * instance count of its draw command to 0 or 1.
+ *
+ * All meshlets of the scene live in one buffer, in the order of the meshes in
+ * the baked model, of their levels of detail and of their instances, with
+ * bounds already in world space. mesh::MeshLod::firstMeshlet indexes both this
+ * buffer and the draw commands. Meshlets of every level are culled, whichever
+ * level ends up drawn; coarse levels only add a fraction of the full
+ * resolution meshlets.
+ */
+namespace cluster {
+    struct ClusterBuffers {
+        vkutils::Buffer meshlets;
+        // One VkDrawIndexedIndirectCommand per meshlet, written by the culling pass
+        vkutils::Buffer draws;
+        std::uint32_t meshletCount;
+    };
+
+    ClusterBuffers create_cluster_buffers(const vkutils::Allocator& allocator,
+                                          const baked::BakedModel& model,
+                                          const std::vector<material::Material>& materials);
+
+    vkutils::DescriptorSetLayout create_descriptor_layout(const vkutils::VulkanContext& context);
+
+    void update_descriptor_set(const vkutils::VulkanContext& context,
+                               const ClusterBuffers& buffers,
+                               VkDescriptorSet clusterDescriptorSet);
+
+    vkutils::PipelineLayout create_pipeline_layout(const vkutils::VulkanContext& context,
+                                                   const vkutils::DescriptorSetLayout& clusterLayout);
+
+    vkutils::Pipeline create_pipeline(const vkutils::VulkanContext& context, VkPipelineLayout pipelineLayout);
+
+    glsl::ClusterCullPushConstants create_push_constants(const glsl::SceneUniform& sceneUniform,
+                                                         const state::State& state,
+                                                         std::uint32_t meshletCount);
+
+    // Records the culling dispatch, must be outside of a render pass
+    void record_commands(VkCommandBuffer commandBuffer,
+                         VkPipelineLayout pipelineLayout,
+                         VkPipeline pipeline,
+                         VkDescriptorSet clusterDescriptorSet,
+                         const ClusterBuffers& buffers,
+                         const glsl::ClusterCullPushConstants& pushConstants);
+
+    // Draws the visible meshlets of a mesh's level of detail for all of its instances, with the mesh's buffers
+    // already bound
+    void draw_mesh(VkCommandBuffer commandBuffer, VkBuffer draws, const mesh::Mesh& mesh, const mesh::MeshLod& lod);
+}
@@ -24,6 +24,7 @@ namespace cfg {
     constexpr const char* offscreenAlphaFragPath = ASSETS_PATH_ "/shaders/offscreen_alpha.frag.spv";
     constexpr const char* fullscreenVertPath = ASSETS_PATH_ "/shaders/fullscreen.vert.spv";
     constexpr const char* fullscreenFragPath = ASSETS_PATH_ "/shaders/fullscreen.frag.spv";
+    constexpr const char* clusterCullCompPath = ASSETS_PATH_ "/shaders/cluster_cull.comp.spv";
 
     // Low resolution setting
     constexpr VkExtent2D resolutionLow{1280, 800};
@@ -65,4 +66,9 @@ namespace cfg {
     constexpr float lightNear = 1.0f;
     constexpr float lightFar = 100.0f;
     constexpr auto lightFov = 90.0_degf;
+
+    // Largest projected simplification error of a mesh's level of detail, in pixels. The shadow map tolerates
+    // coarser levels: its texels are filtered and only seen through the shading of the offscreen pass.
+    constexpr float lodPixelError = 1.0f;
+    constexpr float shadowLodPixelError = 4.0f;
 }
@@ -2,12 +2,13 @@
 
 #include <array>
 #include <cstring>
+#include <exception>
 #include <filesystem>
+#include <optional>
 #include <stb_image.h>
 #include <utility>
 
 #include "../vkutils/error.hpp"
-#include "../vkutils/vkbuffer.hpp"
 #include "../vkutils/to_string.hpp"
 #include "../vkutils/vkutil.hpp"
 
@@ -16,35 +17,12 @@
 namespace environment {
     constexpr std::uint32_t CUBE_FACES_AMOUNT = 6;
 
-    vkutils::Image cube_map_image(const vkutils::VulkanContext& context,
-                                  const VkFormat format,
+    vkutils::Image cube_map_image(const VkFormat format,
                                   const std::array<texture::Texture, CUBE_FACES_AMOUNT>& faceTextures,
                                   const vkutils::Allocator& allocator,
-                                  const vkutils::CommandPool& loadCommandPool) {
-        // Create staging buffer and copy faces data to it
-        // Assume all the faces share width, height & channels
-        const auto cubeSizeInBytes = faceTextures.size() * faceTextures.begin()->sizeInBytes();
-
-        const auto staging = vkutils::create_buffer(allocator, cubeSizeInBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                                    VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
-        uint8_t* sptr = nullptr;
-        if (const auto res = vmaMapMemory(allocator.allocator, staging.allocation, reinterpret_cast<void**>(&sptr));
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Mapping memory for writing\n"
-                                 "vmaMapMemory() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-
-        // Map all face textures into a single buffer
-        const auto textureSizeInBytes = faceTextures.begin()->sizeInBytes();
-        for (auto i = 0; i < faceTextures.size(); ++i) {
-            uint32_t faceTextureSize = faceTextures[i].sizeInBytes();
-            const auto faceTextureOffset = i * faceTextureSize;
-            std::memcpy(sptr + faceTextureOffset, faceTextures[i].data, faceTextureSize);
-        }
-        vmaUnmapMemory(allocator.allocator, staging.allocation);
-
+                                  vkutils::UploadBatcher& uploader) {
         // Create cube map image
+        // Assume all the faces share width, height & channels
         const uint32_t faceWidth = faceTextures.begin()->width,
                        faceHeight = faceTextures.begin()->height;
         const auto mipLevels = vkutils::compute_mip_level_count(faceWidth, faceHeight);
@@ -56,196 +34,24 @@ namespace environment {
                                                VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE,
                                                0, VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT);
 
-        // Create command buffer for data upload and begin recording
-        VkCommandBuffer commandBuffer = vkutils::alloc_command_buffer(context, loadCommandPool.handle);
-
-        constexpr VkCommandBufferBeginInfo beginInfo{
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .flags = 0,
-            .pInheritanceInfo = nullptr
-        };
-
-        if (const auto res = vkBeginCommandBuffer(commandBuffer, &beginInfo);
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Beginning command buffer recording\n"
-                                 "vkBeginCommandBuffer() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-
-        // Transition whole image layout
-        // When copying data to the image, the image’s layout must be TRANSFER DST OPTIMAL. The current
-        // image layout is UNDEFINED (which is the initial layout the image was created in).
-        vkutils::image_barrier(commandBuffer, cubeImage.image,
-                               0,
-                               VK_ACCESS_TRANSFER_WRITE_BIT,
-                               VK_IMAGE_LAYOUT_UNDEFINED,
-                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                               VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-                               VK_PIPELINE_STAGE_TRANSFER_BIT,
-                               VkImageSubresourceRange{
-                                   VK_IMAGE_ASPECT_COLOR_BIT,
-                                   0, mipLevels,
-                                   0, static_cast<std::uint32_t>(faceTextures.size())
-                               }
-        );
+        // Record the upload of every face's base level and the generation of the others
+        const auto faceSizeInBytes = faceTextures.begin()->sizeInBytes();
+        const auto staging = uploader.stage_image_generating_mips(cubeImage.image, faceWidth, faceHeight, mipLevels,
+                                                                  static_cast<std::uint32_t>(faceTextures.size()),
+                                                                  faceSizeInBytes);
 
-        std::array<VkBufferImageCopy, CUBE_FACES_AMOUNT> copyRegions;
-        for (std::uint32_t i = 0; i < faceTextures.size(); ++i) {
-            copyRegions[i] = {
-                .bufferOffset = i * textureSizeInBytes,
-                .bufferRowLength = 0,
-                .bufferImageHeight = 0,
-                .imageSubresource = VkImageSubresourceLayers{
-                    VK_IMAGE_ASPECT_COLOR_BIT,
-                    0, i, 1
-                },
-                .imageOffset = VkOffset3D{0, 0, 0},
-                .imageExtent = VkExtent3D{
-                    .width = faceWidth,
-                    .height = faceHeight,
-                    .depth = 1
-                }
-            };
+        // Map all face textures into the staging memory, one after the other
+        for (std::size_t i = 0; i < faceTextures.size(); ++i) {
+            std::memcpy(staging.data() + i * faceSizeInBytes, faceTextures[i].data, faceSizeInBytes);
         }
 
-        vkCmdCopyBufferToImage(commandBuffer, staging.buffer, cubeImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                               copyRegions.size(), copyRegions.data());
-
-        // Transition base level to TRANSFER SRC OPTIMAL
-        vkutils::image_barrier(commandBuffer, cubeImage.image,
-                               VK_ACCESS_TRANSFER_WRITE_BIT,
-                               VK_ACCESS_TRANSFER_READ_BIT,
-                               VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                               VK_PIPELINE_STAGE_TRANSFER_BIT,
-                               VK_PIPELINE_STAGE_TRANSFER_BIT,
-                               VkImageSubresourceRange{
-                                   VK_IMAGE_ASPECT_COLOR_BIT,
-                                   0, 1,
-                                   0, static_cast<std::uint32_t>(faceTextures.size())
-                               }
-        );
-
-        // Process all layers (i.e.: faces)
-        for (std::uint32_t layer = 0; layer < faceTextures.size(); ++layer) {
-            // Process all mip levels of layer
-            std::uint32_t mipWidth = faceWidth, mipHeight = faceHeight;
-            for (std::uint32_t level = 1; level < mipLevels; ++level) {
-                // Blit previous mipmap level (=level-1) to the current level. Note that the loop starts at level = 1.
-                // Level = 0 is the base level that we initialied before the loop.
-                VkImageBlit blit{};
-                blit.srcSubresource = VkImageSubresourceLayers{
-                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .mipLevel = level - 1,
-                    .baseArrayLayer = layer,
-                    .layerCount = 1
-                };
-                blit.srcOffsets[0] = {0, 0, 0};
-                blit.srcOffsets[1] = {static_cast<std::int32_t>(mipWidth), static_cast<std::int32_t>(mipHeight), 1};
-
-                // Next mip level
-                mipWidth >>= 1;
-                if (mipWidth == 0) {
-                    mipWidth = 1;
-                }
-                mipHeight >>= 1;
-                if (mipHeight == 0) {
-                    mipHeight = 1;
-                }
-
-                blit.dstSubresource = VkImageSubresourceLayers{
-                    .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                    .mipLevel = level,
-                    .baseArrayLayer = layer,
-                    .layerCount = 1
-                };
-                blit.dstOffsets[0] = {0, 0, 0};
-                blit.dstOffsets[1] = {static_cast<std::int32_t>(mipWidth), static_cast<std::int32_t>(mipHeight), 1};
-
-                vkCmdBlitImage(commandBuffer,
-                               cubeImage.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                               cubeImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                               1, &blit,
-                               VK_FILTER_LINEAR
-                );
-
-                // Transition mip level to TRANSFER SRC OPTIMAL for the next iteration. (Technically this is
-                // unnecessary for the last mip level, but transitioning it as well simplifes the final barrier following the
-                // loop).
-                vkutils::image_barrier(commandBuffer, cubeImage.image,
-                                       VK_ACCESS_TRANSFER_WRITE_BIT,
-                                       VK_ACCESS_TRANSFER_READ_BIT,
-                                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                       VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                                       VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                       VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                       VkImageSubresourceRange{
-                                           VK_IMAGE_ASPECT_COLOR_BIT,
-                                           level, 1,
-                                           layer, 1
-                                       }
-                );
-            }
-        }
-
-        // Whole image is currently in the TRANSFER SRC OPTIMAL layout. To use the image as a texture from
-        // which we sample, it must be in the SHADER READ ONLY OPTIMAL layout.
-        vkutils::image_barrier(commandBuffer, cubeImage.image,
-                               VK_ACCESS_TRANSFER_READ_BIT,
-                               VK_ACCESS_SHADER_READ_BIT,
-                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                               VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                               VK_PIPELINE_STAGE_TRANSFER_BIT,
-                               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-                               VkImageSubresourceRange{
-                                   VK_IMAGE_ASPECT_COLOR_BIT,
-                                   0, mipLevels,
-                                   0, static_cast<std::uint32_t>(faceTextures.size())
-                               }
-        );
-
-        // End command recording
-        if (const auto res = vkEndCommandBuffer(commandBuffer); VK_SUCCESS != res) {
-            throw vkutils::Error("Ending command buffer recording\n"
-                                 "vkEndCommandBuffer() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-
-        // Submit command buffer and wait for commands to complete. Commands must have completed before we can
-        // destroy the temporary resources, such as the staging buffers.
-        const vkutils::Fence uploadComplete = create_fence(context);
-
-        const VkSubmitInfo submitInfo{
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &commandBuffer
-        };
-
-        if (const auto res = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, uploadComplete.handle);
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Submitting commands\n"
-                                 "vkQueueSubmit() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-
-        if (const auto res = vkWaitForFences(context.device, 1, &uploadComplete.handle, VK_TRUE,
-                                             std::numeric_limits<std::uint64_t>::max()); VK_SUCCESS != res) {
-            throw vkutils::Error("Waiting for upload to complete\n"
-                                 "vkWaitForFences() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-
-        // Return resulting image
-        // Most temporary resources are destroyed automatically through their destructors. However, the command
-        // buffer we must free manually.
-        vkFreeCommandBuffers(context.device, loadCommandPool.handle, 1, &commandBuffer);
-
         return cubeImage;
     }
 
     std::pair<vkutils::Image, vkutils::ImageView> load_cube_map(const vkutils::VulkanContext& context,
                                                                 const vkutils::Allocator& allocator,
-                                                                const vkutils::CommandPool& loadCommandPool) {
+                                                                vkutils::UploadBatcher& uploader,
+                                                                vkutils::ThreadPool& loaders) {
         // Validate skybox path
         const std::filesystem::path skyboxPath(ASSETS_SRC_PATH_"/environment/skybox/");
 
@@ -255,18 +61,40 @@ namespace environment {
             throw vkutils::Error("Could not find the skybox directory");
         }
 
-        // Load textures, fails if not found
+        // Decode the faces on the loaders, fails if not found. Each job fills its own face.
+        constexpr std::array faceNames{"right.jpg", "left.jpg", "bottom.jpg", "top.jpg", "front.jpg", "back.jpg"};
+        std::array<std::optional<texture::Texture>, CUBE_FACES_AMOUNT> faces;
+        vkutils::ResultQueue<std::exception_ptr> decoded;
+        for (std::size_t i = 0; i < faceNames.size(); ++i) {
+            loaders.submit([&skyboxPath, &faceNames, &faces, &decoded, i] {
+                try {
+                    faces[i].emplace(skyboxPath / faceNames[i]);
+                    decoded.push(nullptr);
+                } catch (...) {
+                    decoded.push(std::current_exception());
+                }
+            });
+        }
+
+        // Every job is waited for, even after an error, since they refer to the faces
+        std::exception_ptr error;
+        for (std::size_t i = 0; i < faceNames.size(); ++i) {
+            if (auto faceError = decoded.pop(); faceError && !error) {
+                error = faceError;
+            }
+        }
+
+        if (error) {
+            std::rethrow_exception(error);
+        }
+
         const std::array faceTextures{
-            texture::Texture(skyboxPath / "right.jpg"),
-            texture::Texture(skyboxPath / "left.jpg"),
-            texture::Texture(skyboxPath / "bottom.jpg"),
-            texture::Texture(skyboxPath / "top.jpg"),
-            texture::Texture(skyboxPath / "front.jpg"),
-            texture::Texture(skyboxPath / "back.jpg")
+            std::move(*faces[0]), std::move(*faces[1]), std::move(*faces[2]),
+            std::move(*faces[3]), std::move(*faces[4]), std::move(*faces[5])
         };
 
         // Return cube map image & view
-        auto cubeImage = cube_map_image(context, VK_FORMAT_R8G8B8A8_UNORM, faceTextures, allocator, loadCommandPool);
+        auto cubeImage = cube_map_image(VK_FORMAT_R8G8B8A8_UNORM, faceTextures, allocator, uploader);
         auto cubeView = vkutils::image_to_view(context, cubeImage.image, VK_IMAGE_VIEW_TYPE_CUBE,
                                                VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
 
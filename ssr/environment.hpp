@@ -1,12 +1,16 @@
 #pragma once
 
+#include "../vkutils/thread_pool.hpp"
+#include "../vkutils/upload_batcher.hpp"
 #include "../vkutils/vkimage.hpp"
 #include "../vkutils/vkobject.hpp"
 
 namespace environment {
+    // The faces are decoded on the loaders, the cube map is ready once the uploader is finished
     std::pair<vkutils::Image, vkutils::ImageView> load_cube_map(const vkutils::VulkanContext& context,
                                                                 const vkutils::Allocator& allocator,
-                                                                const vkutils::CommandPool& loadCommandPool);
+                                                                vkutils::UploadBatcher& uploader,
+                                                                vkutils::ThreadPool& loaders);
 
     vkutils::DescriptorSetLayout create_descriptor_layout(const vkutils::VulkanContext& context);
 
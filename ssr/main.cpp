@@ -8,12 +8,16 @@
 #include <volk/volk.h>
 
 #include "../vkutils/vkbuffer.hpp"
+#include "../vkutils/thread_pool.hpp"
+#include "../vkutils/upload_batcher.hpp"
 #include "../vkutils/vkimage.hpp"
 #include "../vkutils/vulkan_window.hpp"
 
 #include "baked_model.hpp"
 #include "benchmark.hpp"
 #include "bloom.hpp"
+#include "bvh.hpp"
+#include "cluster.hpp"
 #include "config.hpp"
 #include "environment.hpp"
 #include "fullscreen.hpp"
@@ -176,9 +180,14 @@ int main(int argc, char* argv[]) try {
     const baked::BakedModel sceneModel = baked::loadBakedModel(scenePath.generic_string().c_str());
     // TODO: Light cube model with ImGui controls
 
-    // Load materials
+    // Scene data is uploaded in batches, which complete before the render loop
+    vkutils::UploadBatcher uploader(vulkanWindow, allocator);
+    // Textures are read and decoded in parallel, the material textures while rendering
+    vkutils::ThreadPool loaders;
+
+    // Load materials, bound to placeholder textures until the real ones have streamed in
     // Keeps all Images and ImageViews alive for the duration of the render loop
-    const material::MaterialStore materialStore = material::extract_materials(sceneModel, vulkanWindow, allocator);
+    material::MaterialStore materialStore = material::extract_materials(sceneModel, vulkanWindow, allocator, uploader);
 
     // Load 1 DescriptorSet per material
     const std::vector<VkDescriptorSet> materialDescriptorSets = vkutils::allocate_descriptor_sets(
@@ -193,13 +202,31 @@ int main(int argc, char* argv[]) try {
     }
 
     // Extract meshes
-    const auto [opaqueMeshes, alphaMeshes] =
-            mesh::extract_meshes(vulkanWindow, allocator, sceneModel, materialStore.materials);
+    const mesh::MeshStore meshStore =
+            mesh::extract_meshes(allocator, uploader, sceneModel, materialStore.materials);
+    const auto& opaqueMeshes = meshStore.opaqueMeshes;
+    const auto& alphaMeshes = meshStore.alphaMaskedMeshes;
+
+    // Initialise Cluster Culling
+    const cluster::ClusterBuffers clusterBuffers =
+            cluster::create_cluster_buffers(allocator, sceneModel, materialStore.materials);
+    const vkutils::DescriptorSetLayout clusterLayout = cluster::create_descriptor_layout(vulkanWindow);
+    const VkDescriptorSet clusterDescriptorSet = vkutils::allocate_descriptor_set(
+        vulkanWindow, descriptorPool.handle, clusterLayout.handle);
+    cluster::update_descriptor_set(vulkanWindow, clusterBuffers, clusterDescriptorSet);
+    const vkutils::PipelineLayout clusterPipelineLayout = cluster::create_pipeline_layout(vulkanWindow, clusterLayout);
+    const vkutils::Pipeline clusterPipeline = cluster::create_pipeline(vulkanWindow, clusterPipelineLayout.handle);
 
     // Load environment
-    const auto cubeMap = environment::load_cube_map(vulkanWindow, allocator, commandPool);
+    const auto cubeMap = environment::load_cube_map(vulkanWindow, allocator, uploader, loaders);
     environment::update_descriptor_set(vulkanWindow, environmentDescriptorSet, cubeMap.second, anisotropySampler);
 
+    // Wait for all uploads to complete
+    uploader.finish();
+
+    // Stream the material textures in while rendering
+    material::TextureStream textureStream = material::stream_textures(sceneModel, loaders);
+
 #ifdef ENABLE_DIAGNOSTICS
     // Screenshot resources
     const vkutils::Event screenshotReady = vkutils::create_event(vulkanWindow);
@@ -212,6 +239,10 @@ int main(int argc, char* argv[]) try {
     const auto timestampPeriod = benchmark::timestamp_period(vulkanWindow);
     std::size_t frameInFlightIndex = 0;
 
+    // Meshes in view of the camera and the light, refilled every frame
+    bvh::MeshVisibility cameraVisibility;
+    bvh::MeshVisibility shadowVisibility;
+
     // Render loop
     bool recreateSwapchain = false;
 
@@ -296,10 +327,33 @@ int main(int argc, char* argv[]) try {
             vulkanWindow.swapchainExtent.width, vulkanWindow.swapchainExtent.height, state);
         const glsl::ShadeUniform shadeUniform = shade::create_uniform(state);
         const glsl::SSRUniform ssrUniform = ssr::create_uniform(state);
+        const glsl::ClusterCullPushConstants clusterPushConstants = cluster::create_push_constants(
+            sceneUniform, state, clusterBuffers.meshletCount);
+
+        // Select levels of detail by their error projected into the swapchain and the shadow map respectively
+        const mesh::LodSelector cameraLodSelector = mesh::create_lod_selector(
+            glm::vec3(state.camera[3]), vkutils::Radians(cfg::cameraFov).value(),
+            vulkanWindow.swapchainExtent.height, state.lodPixelError);
+        const mesh::LodSelector shadowLodSelector = mesh::create_lod_selector(
+            state.lightPosition, vkutils::Radians(cfg::lightFov).value(),
+            shadow::shadowMapExtent.height, state.shadowLodPixelError);
+
+        // Find the meshes in the camera frustum and the light's shadow frustum respectively
+        if (state.meshCulling) {
+            bvh::query_frustum(sceneModel, bvh::extract_frustum(sceneUniform.VP), cameraVisibility);
+            bvh::query_frustum(sceneModel, bvh::extract_frustum(sceneUniform.LVP), shadowVisibility);
+        } else {
+            bvh::mark_all_visible(sceneModel, cameraVisibility);
+            bvh::mark_all_visible(sceneModel, shadowVisibility);
+        }
 
         // Prepare Offscreen command buffer
         offscreen::prepare_offscreen_command_buffer(vulkanWindow, offscreenFence, offscreenCommandBuffer);
 
+        // Swap in the textures streamed since the last frame, whose offscreen commands have completed
+        material::update_streamed_textures(sceneModel, vulkanWindow, allocator, uploader, textureStream, materialStore,
+                                           materialDescriptorSets, anisotropySampler, pointSampler);
+
         // Record frame start timestamp command
         benchmark::record_pipeline_top_timestamp(offscreenCommandBuffer, timestampPools[frameInFlightIndex],
                                                  benchmark::TimestampQuery::frameStart);
@@ -318,7 +372,9 @@ int main(int argc, char* argv[]) try {
             sceneDescriptorSet,
             opaqueMeshes,
             alphaMeshes,
-            materialDescriptorSets
+            materialDescriptorSets,
+            shadowLodSelector,
+            shadowVisibility
         );
 
         // Record shadow end timestamp command
@@ -332,6 +388,16 @@ int main(int argc, char* argv[]) try {
         benchmark::record_pipeline_top_timestamp(offscreenCommandBuffer, timestampPools[frameInFlightIndex],
                                                  benchmark::TimestampQuery::offscreenStart);
 
+        // Record Cluster Culling commands, outside of the offscreen render pass
+        cluster::record_commands(
+            offscreenCommandBuffer,
+            clusterPipelineLayout.handle,
+            clusterPipeline.handle,
+            clusterDescriptorSet,
+            clusterBuffers,
+            clusterPushConstants
+        );
+
         // Record Offscreen commands
         offscreen::record_commands(
             offscreenCommandBuffer,
@@ -348,7 +414,10 @@ int main(int argc, char* argv[]) try {
             shadeUniform,
             shadeDescriptorSet,
             opaqueMeshes,
-            alphaMeshes, materialStore.materials, materialDescriptorSets
+            alphaMeshes, materialStore.materials, materialDescriptorSets,
+            clusterBuffers.draws.buffer,
+            cameraLodSelector,
+            cameraVisibility
         );
 
         // Record GBuffer end timestamp command
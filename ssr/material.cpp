@@ -1,69 +1,93 @@
 #include "material.hpp"
 
 #include <array>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <span>
 
 #include "config.hpp"
 #include "texture.hpp"
 #include "../vkutils/error.hpp"
 #include "../vkutils/to_string.hpp"
 
-namespace material {
-    void load_material_texture(const baked::BakedModel& model,
-                               const std::uint32_t textureId,
-                               const VkFormat format,
-                               const vkutils::VulkanContext& context,
-                               const vkutils::Allocator& allocator,
-                               const vkutils::CommandPool& loadCommandPool,
-                               std::vector<vkutils::Image>& textures) {
-        if (textures[textureId].image != VK_NULL_HANDLE) {
-            return;
+namespace {
+    // Caps the staging work of a frame, so that streaming does not stall the render loop
+    constexpr std::size_t kStreamedBytesPerFrame = 16 * 1024 * 1024;
+
+    // Textures referenced by the materials, in order of first reference
+    std::vector<std::uint32_t> used_texture_ids(const baked::BakedModel& model) {
+        std::vector<bool> used(model.textures.size(), false);
+        std::vector<std::uint32_t> textureIds;
+        for (const auto& modelMaterial : model.materials) {
+            for (const auto textureId : {modelMaterial.baseColourTextureId, modelMaterial.emissiveTextureId,
+                                         modelMaterial.surfaceTextureId, modelMaterial.normalMapTextureId,
+                                         modelMaterial.alphaMaskTextureId}) {
+                if (baked::NO_ID != textureId && !used[textureId]) {
+                    used[textureId] = true;
+                    textureIds.emplace_back(textureId);
+                }
+            }
         }
+        return textureIds;
+    }
+
+    vkutils::Image create_placeholder(const vkutils::Allocator& allocator,
+                                      vkutils::UploadBatcher& uploader,
+                                      const std::array<std::uint8_t, 4>& rgba) {
+        vkutils::Image image = vkutils::create_texture_image(allocator, 1, 1, VK_FORMAT_R8G8B8A8_UNORM);
+
+        const VkBufferImageCopy copy{
+            .bufferOffset = 0,
+            .bufferRowLength = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource = VkImageSubresourceLayers{
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                0,
+                0, 1
+            },
+            .imageOffset = VkOffset3D{0, 0, 0},
+            .imageExtent = VkExtent3D{
+                .width = 1,
+                .height = 1,
+                .depth = 1
+            }
+        };
+
+        const auto staging = uploader.stage_image(image.image, rgba.size(), std::span(&copy, 1),
+                                                  VkImageSubresourceRange{
+                                                      VK_IMAGE_ASPECT_COLOR_BIT,
+                                                      0, 1,
+                                                      0, 1
+                                                  });
+        std::memcpy(staging.data(), rgba.data(), rgba.size());
+
+        return image;
+    }
 
-        const auto bakedTexture = model.textures[textureId];
-        textures[textureId] = texture_to_image(
-            context, texture::Texture(bakedTexture.path), format, allocator, loadCommandPool);
+    vkutils::ImageView placeholder_view(const vkutils::VulkanContext& context, const vkutils::Image& placeholder) {
+        return vkutils::image_to_view(context, placeholder.image, VK_IMAGE_VIEW_TYPE_2D, VK_FORMAT_R8G8B8A8_UNORM,
+                                      VK_IMAGE_ASPECT_COLOR_BIT);
     }
+}
 
+namespace material {
     MaterialStore extract_materials(const baked::BakedModel& model,
                                     const vkutils::VulkanContext& context,
-                                    const vkutils::Allocator& allocator) {
-        std::vector<vkutils::Image> textures;
-        // Need to explicitly resize here to allow for random-access in load_material_texture
-        textures.resize(model.textures.size());
-        std::vector<Material> materials;
-        materials.reserve(model.materials.size());
-        const vkutils::CommandPool loadCommandPool = vkutils::create_command_pool(
-            context, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+                                    const vkutils::Allocator& allocator,
+                                    vkutils::UploadBatcher& uploader) {
+        // Same values as the fallback textures of assets-bake: rgba1111.png and r1.png (white) stand in for the
+        // base colour, emissive, surface and alpha mask textures, rrggb05051.png (flat) for the normal map
+        MaterialStore store{
+            .placeholder = create_placeholder(allocator, uploader, {255, 255, 255, 255}),
+            .flatNormalPlaceholder = create_placeholder(allocator, uploader, {128, 128, 255, 255}),
+            // Need to explicitly resize here to allow for random-access by texture id
+            .textures = std::vector<vkutils::Image>(model.textures.size())
+        };
+        store.materials.reserve(model.materials.size());
 
         for (const auto& modelMaterial : model.materials) {
-            load_material_texture(model, modelMaterial.baseColourTextureId, Material::COLOUR_FORMAT,
-                                  context, allocator, loadCommandPool, textures);
-            load_material_texture(model, modelMaterial.emissiveTextureId, Material::LINEAR_FORMAT,
-                                  context, allocator, loadCommandPool, textures);
-            load_material_texture(model, modelMaterial.roughnessTextureId, Material::LINEAR_FORMAT,
-                                  context, allocator, loadCommandPool, textures);
-            load_material_texture(model, modelMaterial.metalnessTextureId, Material::LINEAR_FORMAT,
-                                  context, allocator, loadCommandPool, textures);
-            load_material_texture(model, modelMaterial.normalMapTextureId, Material::LINEAR_FORMAT,
-                                  context, allocator, loadCommandPool, textures);
-            if (modelMaterial.has_alpha_mask()) {
-                // Load with COLOUR_FORMAT in case texture matches base color one
-                load_material_texture(model, modelMaterial.alphaMaskTextureId, Material::COLOUR_FORMAT,
-                                      context, allocator, loadCommandPool, textures);
-            }
-
-            assert(textures[modelMaterial.baseColourTextureId].image != VK_NULL_HANDLE);
-            assert(textures[modelMaterial.emissiveTextureId].image != VK_NULL_HANDLE);
-            assert(textures[modelMaterial.roughnessTextureId].image != VK_NULL_HANDLE);
-            assert(textures[modelMaterial.metalnessTextureId].image != VK_NULL_HANDLE);
-            assert(textures[modelMaterial.normalMapTextureId].image != VK_NULL_HANDLE);
-            if (modelMaterial.has_alpha_mask()) {
-                assert(textures[modelMaterial.alphaMaskTextureId].image != VK_NULL_HANDLE);
-            }
-
-            // Marked as [[maybe_unused]] to avoid generating warnings in release mode
-            // Variable is only accessed by assert(...) calls, only relevant in debug mode
-            [[maybe_unused]] const auto& material = materials.emplace_back(
+            store.materials.emplace_back(
                 modelMaterial.name,
                 glsl::MaterialPushConstants{
                     .baseColour = modelMaterial.baseColour,
@@ -71,41 +95,127 @@ namespace material {
                     .emission = modelMaterial.emission,
                     .metalness = modelMaterial.metalness
                 },
-                vkutils::image_to_view(context, textures[modelMaterial.baseColourTextureId].image,
-                                       VK_IMAGE_VIEW_TYPE_2D, Material::COLOUR_FORMAT,
-                                       VK_IMAGE_ASPECT_COLOR_BIT),
-                vkutils::image_to_view(context, textures[modelMaterial.emissiveTextureId].image,
-                                       VK_IMAGE_VIEW_TYPE_2D, Material::LINEAR_FORMAT,
-                                       VK_IMAGE_ASPECT_COLOR_BIT),
-                vkutils::image_to_view(context, textures[modelMaterial.roughnessTextureId].image,
-                                       VK_IMAGE_VIEW_TYPE_2D, Material::LINEAR_FORMAT,
-                                       VK_IMAGE_ASPECT_COLOR_BIT),
-                vkutils::image_to_view(context, textures[modelMaterial.metalnessTextureId].image,
-                                       VK_IMAGE_VIEW_TYPE_2D, Material::LINEAR_FORMAT,
-                                       VK_IMAGE_ASPECT_COLOR_BIT),
-                vkutils::image_to_view(context, textures[modelMaterial.normalMapTextureId].image,
-                                       VK_IMAGE_VIEW_TYPE_2D, Material::LINEAR_FORMAT,
-                                       VK_IMAGE_ASPECT_COLOR_BIT),
-                !modelMaterial.has_alpha_mask()
-                    ? std::nullopt
-                    : std::make_optional(vkutils::image_to_view(
-                        context, textures[modelMaterial.alphaMaskTextureId].image,
-                        VK_IMAGE_VIEW_TYPE_2D, Material::COLOUR_FORMAT,
-                        VK_IMAGE_ASPECT_COLOR_BIT))
+                placeholder_view(context, store.placeholder),
+                placeholder_view(context, store.placeholder),
+                placeholder_view(context, store.placeholder),
+                placeholder_view(context, store.flatNormalPlaceholder),
+                modelMaterial.has_alpha_mask()
+                    ? std::make_optional(placeholder_view(context, store.placeholder))
+                    : std::nullopt
             );
+        }
+
+        return store;
+    }
+
+    TextureStream stream_textures(const baked::BakedModel& model, vkutils::ThreadPool& loaders) {
+        const auto textureIds = used_texture_ids(model);
+
+        TextureStream stream{
+            .loaded = std::make_shared<vkutils::ResultQueue<StreamedTexture>>(),
+            .remaining = textureIds.size()
+        };
 
-            assert(material.baseColour.handle != VK_NULL_HANDLE);
-            assert(material.emissive.handle != VK_NULL_HANDLE);
-            assert(material.roughness.handle != VK_NULL_HANDLE);
-            assert(material.metalness.handle != VK_NULL_HANDLE);
-            assert(material.normalMap.handle != VK_NULL_HANDLE);
-            assert(material.alphaMask.has_value() == modelMaterial.has_alpha_mask());
+        // Jobs own what they use, the stream may be destroyed while they run
+        for (const auto textureId : textureIds) {
+            loaders.submit([loaded = stream.loaded, path = model.textures[textureId].path, textureId] {
+                StreamedTexture texture{.textureId = textureId};
+                try {
+                    texture.data = baked::loadBakedTexture(path.c_str());
+                } catch (...) {
+                    texture.error = std::current_exception();
+                }
+                loaded->push(std::move(texture));
+            });
+        }
+
+        return stream;
+    }
+
+    void update_streamed_textures(const baked::BakedModel& model,
+                                  const vkutils::VulkanContext& context,
+                                  const vkutils::Allocator& allocator,
+                                  vkutils::UploadBatcher& uploader,
+                                  TextureStream& stream,
+                                  MaterialStore& store,
+                                  const std::vector<VkDescriptorSet>& materialDescriptorSets,
+                                  const vkutils::Sampler& anisotropySampler,
+                                  const vkutils::Sampler& pointSampler) {
+        if (0 == stream.remaining) {
+            return;
+        }
+
+        // Upload the textures read since the last frame. Textures are block compressed and carry their mip chain,
+        // the format depends on the texture's usage.
+        std::vector<VkFormat> formats(model.textures.size(), VK_FORMAT_UNDEFINED);
+        std::size_t stagedBytes = 0;
+        while (stagedBytes < kStreamedBytesPerFrame) {
+            auto texture = stream.loaded->try_pop();
+            if (!texture) {
+                break;
+            }
+
+            if (texture->error) {
+                std::rethrow_exception(texture->error);
+            }
+
+            formats[texture->textureId] = texture::baked_texture_format(texture->data.encoding);
+            store.textures[texture->textureId] = texture::baked_texture_to_image(texture->data, allocator, uploader);
+            stagedBytes += texture->data.data.size();
+            --stream.remaining;
+        }
+
+        if (0 == stagedBytes) {
+            return;
         }
 
-        return MaterialStore{
-            .textures = std::move(textures),
-            .materials = std::move(materials)
+        // Submitted ahead of the frame on the same queue, whose commands then wait for the uploads' barriers
+        uploader.flush();
+
+        const auto streamed = [&formats](const std::uint32_t textureId) {
+            return baked::NO_ID != textureId && VK_FORMAT_UNDEFINED != formats[textureId];
         };
+        const auto view = [&](const std::uint32_t textureId) {
+            return vkutils::image_to_view(context, store.textures[textureId].image, VK_IMAGE_VIEW_TYPE_2D,
+                                          formats[textureId], VK_IMAGE_ASPECT_COLOR_BIT);
+        };
+
+        // Swap the placeholders out. The previous frame's commands have completed, nothing uses the replaced views
+        // or the descriptor sets.
+        for (std::size_t m = 0; m < model.materials.size(); ++m) {
+            const auto& modelMaterial = model.materials[m];
+            auto& material = store.materials[m];
+
+            bool swapped = false;
+            if (streamed(modelMaterial.baseColourTextureId)) {
+                material.baseColour = view(modelMaterial.baseColourTextureId);
+                swapped = true;
+            }
+            if (streamed(modelMaterial.emissiveTextureId)) {
+                material.emissive = view(modelMaterial.emissiveTextureId);
+                swapped = true;
+            }
+            if (streamed(modelMaterial.surfaceTextureId)) {
+                material.surface = view(modelMaterial.surfaceTextureId);
+                swapped = true;
+            }
+            if (streamed(modelMaterial.normalMapTextureId)) {
+                material.normalMap = view(modelMaterial.normalMapTextureId);
+                swapped = true;
+            }
+            if (streamed(modelMaterial.alphaMaskTextureId)) {
+                material.alphaMask = view(modelMaterial.alphaMaskTextureId);
+                swapped = true;
+            }
+
+            if (swapped) {
+                update_descriptor_set(context, materialDescriptorSets[m], material, anisotropySampler, pointSampler);
+            }
+        }
+
+        if (0 == stream.remaining) {
+            std::printf("All textures streamed in\n");
+        }
     }
 
     vkutils::DescriptorSetLayout create_descriptor_layout(const vkutils::VulkanContext& context) {
@@ -124,30 +234,23 @@ namespace material {
                 .descriptorCount = 1,
                 .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
             },
-            // Roughness
+            // Surface - Roughness and metalness
             VkDescriptorSetLayoutBinding{
                 .binding = 2, // layout(set = ..., binding = 2)
                 .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                 .descriptorCount = 1,
                 .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
             },
-            // Metalness
-            VkDescriptorSetLayoutBinding{
-                .binding = 3, // layout(set = ..., binding = 3)
-                .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-                .descriptorCount = 1,
-                .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT
-            },
             // Normal Map
             VkDescriptorSetLayoutBinding{
-                .binding = 4, // layout(set = ..., binding = 4)
+                .binding = 3, // layout(set = ..., binding = 3)
                 .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                 .descriptorCount = 1,
                 .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
             },
             // Alpha Mask - Only for alpha masked pipelines
             VkDescriptorSetLayoutBinding{
-                .binding = 5, // layout(set = ..., binding = 5)
+                .binding = 4, // layout(set = ..., binding = 4)
                 .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
                 .descriptorCount = 1,
                 .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
@@ -174,13 +277,14 @@ namespace material {
     template<size_t N>
     void update_material_descriptor_set(const vkutils::VulkanContext& context,
                                         const VkDescriptorSet materialDescriptorSet,
-                                        const std::array<const VkDescriptorImageInfo, N>& textureDescriptors) {
+                                        const std::array<const VkDescriptorImageInfo, N>& textureDescriptors,
+                                        const std::uint32_t firstBinding = 0) {
         std::array<VkWriteDescriptorSet, N> writeDescriptor{};
 
         for (unsigned int i = 0; i < writeDescriptor.size(); ++i) {
             writeDescriptor[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
             writeDescriptor[i].dstSet = materialDescriptorSet;
-            writeDescriptor[i].dstBinding = i;
+            writeDescriptor[i].dstBinding = firstBinding + i;
             writeDescriptor[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
             writeDescriptor[i].descriptorCount = 1;
             writeDescriptor[i].pImageInfo = &textureDescriptors[i];
@@ -194,71 +298,42 @@ namespace material {
                                const material::Material& material,
                                const vkutils::Sampler& anisotropySampler,
                                const vkutils::Sampler& pointSampler) {
+        const std::array<const VkDescriptorImageInfo, 4> textureDescriptors{
+            VkDescriptorImageInfo{
+                .sampler = anisotropySampler.handle,
+                .imageView = material.baseColour.handle,
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+            },
+            VkDescriptorImageInfo{
+                .sampler = pointSampler.handle,
+                .imageView = material.emissive.handle,
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+            },
+            VkDescriptorImageInfo{
+                .sampler = pointSampler.handle,
+                .imageView = material.surface.handle,
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+            },
+            VkDescriptorImageInfo{
+                .sampler = anisotropySampler.handle,
+                .imageView = material.normalMap.handle,
+                .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+            }
+        };
+
+        update_material_descriptor_set(context, materialDescriptorSet, textureDescriptors);
+
+        // Only the alpha masked pipelines read binding 4, it stays unwritten for the others
         if (material.has_alpha_mask()) {
-            const std::array<const VkDescriptorImageInfo, 6> textureDescriptors{
-                VkDescriptorImageInfo{
-                    .sampler = anisotropySampler.handle,
-                    .imageView = material.baseColour.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                VkDescriptorImageInfo{
-                    .sampler = pointSampler.handle,
-                    .imageView = material.emissive.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                VkDescriptorImageInfo{
-                    .sampler = pointSampler.handle,
-                    .imageView = material.roughness.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                VkDescriptorImageInfo{
-                    .sampler = pointSampler.handle,
-                    .imageView = material.metalness.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                VkDescriptorImageInfo{
-                    .sampler = anisotropySampler.handle,
-                    .imageView = material.normalMap.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
+            const std::array<const VkDescriptorImageInfo, 1> alphaMaskDescriptor{
                 VkDescriptorImageInfo{
                     .sampler = pointSampler.handle,
                     .imageView = material.alphaMask->handle,
                     .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-            };
-
-            update_material_descriptor_set(context, materialDescriptorSet, textureDescriptors);
-        } else {
-            const std::array<const VkDescriptorImageInfo, 5> textureDescriptors{
-                VkDescriptorImageInfo{
-                    .sampler = anisotropySampler.handle,
-                    .imageView = material.baseColour.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                VkDescriptorImageInfo{
-                    .sampler = pointSampler.handle,
-                    .imageView = material.emissive.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                VkDescriptorImageInfo{
-                    .sampler = pointSampler.handle,
-                    .imageView = material.roughness.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                VkDescriptorImageInfo{
-                    .sampler = pointSampler.handle,
-                    .imageView = material.metalness.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-                },
-                VkDescriptorImageInfo{
-                    .sampler = anisotropySampler.handle,
-                    .imageView = material.normalMap.handle,
-                    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
                 }
             };
 
-            update_material_descriptor_set(context, materialDescriptorSet, textureDescriptors);
+            update_material_descriptor_set(context, materialDescriptorSet, alphaMaskDescriptor, 4);
         }
     }
 }
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <exception>
+#include <memory>
 #include <optional>
 
+#include "../vkutils/thread_pool.hpp"
+#include "../vkutils/upload_batcher.hpp"
 #include "../vkutils/vkimage.hpp"
 #include "../vkutils/vkutil.hpp"
 #include "../vkutils/vulkan_context.hpp"
@@ -34,27 +38,63 @@ namespace material {
 
         vkutils::ImageView baseColour;
         vkutils::ImageView emissive;
-        vkutils::ImageView roughness;
-        vkutils::ImageView metalness;
+        // Roughness (R) and metalness (G)
+        vkutils::ImageView surface;
         vkutils::ImageView normalMap;
         std::optional<vkutils::ImageView> alphaMask;
 
         bool has_alpha_mask() const {
             return alphaMask.has_value();
         }
-
-        static constexpr VkFormat COLOUR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
-        static constexpr VkFormat LINEAR_FORMAT = VK_FORMAT_R8G8B8A8_UNORM;
     };
 
     struct MaterialStore {
+        // Built-in 1x1 textures bound until the real ones have streamed in, see stream_textures()
+        vkutils::Image placeholder;
+        vkutils::Image flatNormalPlaceholder;
+        // By texture id, empty until streamed in
         std::vector<vkutils::Image> textures;
         std::vector<Material> materials;
     };
 
+    // A texture read on a loader thread
+    struct StreamedTexture {
+        std::uint32_t textureId;
+        baked::BakedTextureData data;
+        std::exception_ptr error;
+    };
+
+    struct TextureStream {
+        // Shared with the loader jobs
+        std::shared_ptr<vkutils::ResultQueue<StreamedTexture>> loaded;
+        // Textures not uploaded yet
+        std::size_t remaining;
+    };
+
+    // Materials start out with placeholder textures, uploaded through the uploader
     MaterialStore extract_materials(const baked::BakedModel& model,
                                     const vkutils::VulkanContext& context,
-                                    const vkutils::Allocator& allocator);
+                                    const vkutils::Allocator& allocator,
+                                    vkutils::UploadBatcher& uploader);
+
+    // Starts reading the textures referenced by the materials on the loaders
+    TextureStream stream_textures(const baked::BakedModel& model, vkutils::ThreadPool& loaders);
+
+    /*
+     * Uploads the textures read since the last call, up to a budget, and
+     * points the materials' views and descriptor sets at them. Call between
+     * frames, once the commands of the previous frame that use the material
+     * descriptor sets have completed.
+     */
+    void update_streamed_textures(const baked::BakedModel& model,
+                                  const vkutils::VulkanContext& context,
+                                  const vkutils::Allocator& allocator,
+                                  vkutils::UploadBatcher& uploader,
+                                  TextureStream& stream,
+                                  MaterialStore& store,
+                                  const std::vector<VkDescriptorSet>& materialDescriptorSets,
+                                  const vkutils::Sampler& anisotropySampler,
+                                  const vkutils::Sampler& pointSampler);
 
     vkutils::DescriptorSetLayout create_descriptor_layout(const vkutils::VulkanContext&);
 
@@ -1,296 +1,272 @@
 #include "mesh.hpp"
 
+#include <algorithm>
+#include <cmath>
 #include <cstring> // for std::memcpy()
 #include <limits>
 
 #include "config.hpp"
-#include "../vkutils/error.hpp"
-#include "../vkutils/to_string.hpp"
-#include "../vkutils/vkutil.hpp"
 
 namespace {
-    // Map positions from Host -> Staging -> Device memory
-    void map_vertices_to_gpu_memory(const vkutils::VulkanContext& context,
-                                    const vkutils::Allocator& allocator,
-                                    const vkutils::CommandPool& uploadPool,
-                                    const baked::BakedMeshData& mesh,
-                                    const vkutils::Buffer& positionsStaging, const vkutils::Buffer& positionsGPU,
-                                    const vkutils::Buffer& uvsStaging, const vkutils::Buffer& uvsGPU,
-                                    const vkutils::Buffer& normalsStaging, const vkutils::Buffer& normalsGPU,
-                                    const vkutils::Buffer& tangentsStaging, const vkutils::Buffer& tangentsGPU,
-                                    const vkutils::Buffer& indicesStaging, const vkutils::Buffer& indicesGPU) {
-        // Copy positions Host -> Staging
-        const auto positionsSizeInBytes = sizeof(glm::vec3) * mesh.positions.size();
-        void* positionsPointer = nullptr;
-        if (const auto res = vmaMapMemory(allocator.allocator, positionsStaging.allocation, &positionsPointer);
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Mapping memory for writing positions\n"
-                                 "vmaMapMemory() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-        std::memcpy(positionsPointer, mesh.positions.data(), positionsSizeInBytes);
-        vmaUnmapMemory(allocator.allocator, positionsStaging.allocation);
-
-        // Copy normals Host -> Staging
-        const auto normalsSizeInBytes = sizeof(glm::vec3) * mesh.normals.size();
-        void* normalsPointer = nullptr;
-        if (const auto res = vmaMapMemory(allocator.allocator, normalsStaging.allocation, &normalsPointer);
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Mapping memory for writing normals\n"
-                                 "vmaMapMemory() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-        std::memcpy(normalsPointer, mesh.normals.data(), normalsSizeInBytes);
-        vmaUnmapMemory(allocator.allocator, normalsStaging.allocation);
-
-        // Copy normals Host -> Staging
-        const auto tangentsSizeInBytes = sizeof(glm::vec4) * mesh.tangents.size();
-        void* tangentsPointer = nullptr;
-        if (const auto res = vmaMapMemory(allocator.allocator, tangentsStaging.allocation, &tangentsPointer);
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Mapping memory for writing tangents\n"
-                                 "vmaMapMemory() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-        std::memcpy(tangentsPointer, mesh.tangents.data(), tangentsSizeInBytes);
-        vmaUnmapMemory(allocator.allocator, tangentsStaging.allocation);
-
-        // Copy uvs Host -> Staging
-        const auto uvsSizeInBytes = sizeof(glm::vec2) * mesh.uvs.size();
-        void* uvsPointer = nullptr;
-        if (const auto res = vmaMapMemory(allocator.allocator, uvsStaging.allocation, &uvsPointer);
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Mapping memory for writing uvs\n"
-                                 "vmaMapMemory() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-        std::memcpy(uvsPointer, mesh.uvs.data(), uvsSizeInBytes);
-        vmaUnmapMemory(allocator.allocator, uvsStaging.allocation);
-
-        // Copy indices Host -> Staging
-        const auto indicesSizeInBytes = sizeof(std::uint32_t) * mesh.indices.size();
-        void* indicesPointer = nullptr;
-        if (const auto res = vmaMapMemory(allocator.allocator, indicesStaging.allocation, &indicesPointer);
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Mapping memory for writing indices\n"
-                                 "vmaMapMemory() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-        std::memcpy(indicesPointer, mesh.indices.data(), indicesSizeInBytes);
-        vmaUnmapMemory(allocator.allocator, indicesStaging.allocation);
-
-        // We need to ensure that the Vulkan resources are alive until all the transfers have completed. For simplicity,
-        // we will just wait for the operations to complete with a fence. A more complex solution might want to queue
-        // transfers, let these take place in the background while performing other tasks.
-        vkutils::Fence uploadComplete = vkutils::create_fence(context);
-
-        // Queue data uploads from staging buffers to the final buffers.
-        VkCommandBuffer uploadCommand = vkutils::alloc_command_buffer(context, uploadPool.handle);
-
-        constexpr VkCommandBufferBeginInfo beginInfo{
-            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .flags = 0,
-            .pInheritanceInfo = nullptr
-        };
-        if (const auto res = vkBeginCommandBuffer(uploadCommand, &beginInfo);
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Beginning command buffer recording\n"
-                                 "vkBeginCommandBuffer() returned %s", vkutils::to_string(res).c_str()
-            );
-        }
-
-        // Copy positions Staging -> GPU
-        const VkBufferCopy positionsCopy{
-            .size = positionsSizeInBytes
-        };
-
-        vkCmdCopyBuffer(uploadCommand, positionsStaging.buffer, positionsGPU.buffer, 1, &positionsCopy);
-
-        vkutils::buffer_barrier(uploadCommand,
-                                positionsGPU.buffer,
-                                VK_ACCESS_TRANSFER_WRITE_BIT,
-                                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-                                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-        );
+    // Streams start at multiples of this in the arena, as they do in a baked mesh blob, see
+    // baked::BakedModel::meshBlob. Covers every VkBuffer offset alignment.
+    constexpr VkDeviceSize kArenaAlignment = 256;
+
+    // Offsets of a mesh's data in the arena
+    struct ArenaStreams {
+        VkDeviceSize positions;
+        VkDeviceSize uvs;
+        VkDeviceSize normals;
+        VkDeviceSize tangents;
+        VkDeviceSize indices;
+        VkDeviceSize instances;
+    };
+
+    struct ArenaLayout {
+        std::vector<ArenaStreams> meshes;
+        VkDeviceSize size;
+    };
+
+    VkDeviceSize align_up(const VkDeviceSize offset) {
+        return (offset + kArenaAlignment - 1) / kArenaAlignment * kArenaAlignment;
+    }
 
-        // Copy normals Staging -> GPU
-        const VkBufferCopy normalsCopy{
-            .size = normalsSizeInBytes
+    // The streams of every mesh followed by their instance transforms. A baked mesh blob is used as it is.
+    ArenaLayout layout_arena(const baked::BakedModel& model,
+                             const std::vector<std::vector<glsl::InstanceTransform>>& instances) {
+        ArenaLayout layout{
+            .meshes = std::vector<ArenaStreams>(model.meshes.size()),
+            .size = 0
         };
 
-        vkCmdCopyBuffer(uploadCommand, normalsStaging.buffer, normalsGPU.buffer, 1, &normalsCopy);
-
-        vkutils::buffer_barrier(uploadCommand,
-                                normalsGPU.buffer,
-                                VK_ACCESS_TRANSFER_WRITE_BIT,
-                                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-                                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-        );
+        if (!model.meshBlob.empty()) {
+            const auto offset = [&model](const std::span<const std::uint8_t> stream) {
+                return static_cast<VkDeviceSize>(stream.data() - model.meshBlob.data());
+            };
+
+            for (std::size_t m = 0; m < model.meshes.size(); ++m) {
+                const auto& mesh = model.meshes[m];
+                auto& streams = layout.meshes[m];
+                streams.positions = offset(mesh.positions);
+                streams.uvs = offset(mesh.uvs);
+                streams.normals = offset(mesh.normals);
+                streams.tangents = offset(mesh.tangents);
+                streams.indices = offset(mesh.indices);
+            }
 
-        // Copy uvs Staging -> GPU
-        const VkBufferCopy uvsCopy{
-            .size = uvsSizeInBytes
-        };
+            layout.size = model.meshBlob.size();
+        } else {
+            const auto place = [&layout](const std::size_t bytes) {
+                const VkDeviceSize offset = align_up(layout.size);
+                layout.size = offset + bytes;
+                return offset;
+            };
+
+            for (std::size_t m = 0; m < model.meshes.size(); ++m) {
+                const auto& mesh = model.meshes[m];
+                auto& streams = layout.meshes[m];
+                streams.positions = place(mesh.positions.size());
+                streams.uvs = place(mesh.uvs.size());
+                streams.normals = place(mesh.normals.size());
+                streams.tangents = place(mesh.tangents.size());
+                streams.indices = place(mesh.indices.size());
+            }
+        }
 
-        vkCmdCopyBuffer(uploadCommand, uvsStaging.buffer, uvsGPU.buffer, 1, &uvsCopy);
+        for (std::size_t m = 0; m < model.meshes.size(); ++m) {
+            layout.meshes[m].instances = align_up(layout.size);
+            layout.size = layout.meshes[m].instances + sizeof(glsl::InstanceTransform) * instances[m].size();
+        }
 
-        vkutils::buffer_barrier(uploadCommand,
-                                uvsGPU.buffer,
-                                VK_ACCESS_TRANSFER_WRITE_BIT,
-                                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-                                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-        );
+        return layout;
+    }
 
-        // Copy tangents Staging -> GPU
-        const VkBufferCopy tangentsCopy{
-            .size = tangentsSizeInBytes
+    // Copies every mesh's data Host -> Staging, straight from the mapped scene file
+    void fill_staging(const std::span<std::uint8_t> staging,
+                      const baked::BakedModel& model,
+                      const ArenaLayout& layout,
+                      const std::vector<std::vector<glsl::InstanceTransform>>& instances) {
+        const auto copy = [arena = staging.data()](const VkDeviceSize offset, const void* data,
+                                                   const std::size_t bytes) {
+            if (bytes > 0) {
+                std::memcpy(arena + offset, data, bytes);
+            }
         };
 
-        vkCmdCopyBuffer(uploadCommand, tangentsStaging.buffer, tangentsGPU.buffer, 1, &tangentsCopy);
-
-        vkutils::buffer_barrier(uploadCommand,
-                                tangentsGPU.buffer,
-                                VK_ACCESS_TRANSFER_WRITE_BIT,
-                                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-                                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-        );
-
-        // Copy indices Staging -> GPU
-        VkBufferCopy indicesCopy{};
-        indicesCopy.size = indicesSizeInBytes;
-
-        vkCmdCopyBuffer(uploadCommand, indicesStaging.buffer, indicesGPU.buffer, 1, &indicesCopy);
-
-        vkutils::buffer_barrier(uploadCommand,
-                                indicesGPU.buffer,
-                                VK_ACCESS_TRANSFER_WRITE_BIT,
-                                VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
-                                VK_PIPELINE_STAGE_TRANSFER_BIT,
-                                VK_PIPELINE_STAGE_VERTEX_INPUT_BIT
-        );
-
-        if (const auto res = vkEndCommandBuffer(uploadCommand); VK_SUCCESS != res) {
-            throw vkutils::Error("Ending command buffer recording\n"
-                                 "vkEndCommandBuffer() returned %s", vkutils::to_string(res).c_str()
-            );
+        if (!model.meshBlob.empty()) {
+            // Already laid out as in the arena
+            copy(0, model.meshBlob.data(), model.meshBlob.size());
+        } else {
+            for (std::size_t m = 0; m < model.meshes.size(); ++m) {
+                const auto& mesh = model.meshes[m];
+                const auto& streams = layout.meshes[m];
+                copy(streams.positions, mesh.positions.data(), mesh.positions.size());
+                copy(streams.uvs, mesh.uvs.data(), mesh.uvs.size());
+                copy(streams.normals, mesh.normals.data(), mesh.normals.size());
+                copy(streams.tangents, mesh.tangents.data(), mesh.tangents.size());
+                copy(streams.indices, mesh.indices.data(), mesh.indices.size());
+            }
         }
 
-        // Submit transfer commands
-        const VkSubmitInfo submitInfo{
-            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &uploadCommand
-        };
-
-        if (const auto res = vkQueueSubmit(context.graphicsQueue, 1, &submitInfo, uploadComplete.handle);
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Submitting commands\n"
-                                 "vkQueueSubmit() returned %s", vkutils::to_string(res).c_str()
-            );
+        for (std::size_t m = 0; m < model.meshes.size(); ++m) {
+            copy(layout.meshes[m].instances, instances[m].data(),
+                 sizeof(glsl::InstanceTransform) * instances[m].size());
         }
+    }
 
-        // Wait for commands to finish before we destroy the temporary resources required for the transfers (staging
-        // buffers, command pool, ...)
-        //
-        // The code doesn’t destory the resources implicitly – the resources are destroyed by the destructors of the
-        // vkutils wrappers for the various objects once we leave the function’s scope.
-        if (const auto res = vkWaitForFences(context.device, 1, &uploadComplete.handle, VK_TRUE,
-                                             std::numeric_limits<std::uint64_t>::max());
-            VK_SUCCESS != res) {
-            throw vkutils::Error("Waiting for upload to complete\n"
-                                 "vkWaitForFences() returned %s", vkutils::to_string(res).c_str()
-            );
+    std::vector<mesh::MeshLod> allocate_lods(const baked::BakedMeshData& mesh, const std::uint32_t firstMeshlet) {
+        std::vector<mesh::MeshLod> lods;
+        lods.reserve(mesh.lods.size());
+
+        // Every level's meshlets are repeated for every instance, see cluster::create_cluster_buffers()
+        const auto instanceCount = static_cast<std::uint32_t>(mesh.instances.size());
+        for (const auto& lod : mesh.lods) {
+            lods.emplace_back(mesh::MeshLod{
+                .firstIndex = lod.firstIndex,
+                .indexCount = lod.indexCount,
+                .error = lod.error,
+                .firstMeshlet = firstMeshlet + lod.firstMeshlet * instanceCount,
+                .meshletCount = lod.meshletCount
+            });
         }
-    }
 
-    std::pair<vkutils::Buffer, vkutils::Buffer> stage_to_gpu_buffers(const vkutils::Allocator& allocator,
-                                                                     const std::size_t size,
-                                                                     const VkBufferUsageFlagBits bufferUsage) {
-        return {
-            vkutils::create_buffer(
-                allocator,
-                size,
-                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT
-            ),
-            vkutils::create_buffer(
-                allocator,
-                size,
-                bufferUsage | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                0, // no additional VmaAllocationCreateFlags
-                VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE // or just VMA MEMORY USAGE AUTO
-            )
-        };
+        return lods;
     }
 
-    mesh::Mesh allocate(const vkutils::VulkanContext& context,
-                        const baked::BakedMeshData& mesh,
-                        const vkutils::Allocator& allocator,
-                        const vkutils::CommandPool& uploadPool) {
-        auto [positionsStaging, positionsGPU] = stage_to_gpu_buffers(
-            allocator, sizeof(glm::vec3) * mesh.positions.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    std::vector<glsl::InstanceTransform> pack_instances(const baked::BakedMeshData& mesh) {
+        std::vector<glsl::InstanceTransform> instances;
+        instances.reserve(mesh.instances.size());
 
-        auto [normalsStaging, normalsGPU] = stage_to_gpu_buffers(
-            allocator, sizeof(glm::vec3) * mesh.normals.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        for (const auto& transform : mesh.instances) {
+            const glm::mat3x4 rows = glm::transpose(transform);
+            instances.emplace_back(glsl::InstanceTransform{
+                .rows = {rows[0], rows[1], rows[2]}
+            });
+        }
 
-        auto [uvsStaging, uvsGPU] = stage_to_gpu_buffers(
-            allocator, sizeof(glm::vec2) * mesh.uvs.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+        return instances;
+    }
 
-        auto [tangentsStaging, tangentsGPU] = stage_to_gpu_buffers(
-            allocator, sizeof(glm::vec4) * mesh.tangents.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+    std::vector<glm::vec3> instance_centres(const baked::BakedMeshData& mesh) {
+        std::vector<glm::vec3> centres;
+        centres.reserve(mesh.instances.size());
 
-        auto [indicesStaging, indicesGPU] = stage_to_gpu_buffers(
-            allocator, sizeof(std::uint32_t) * mesh.indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+        for (const auto& transform : mesh.instances) {
+            centres.emplace_back(transform * glm::vec4(mesh.sphereCentre, 1.0f));
+        }
 
-        map_vertices_to_gpu_memory(context,
-                                   allocator,
-                                   uploadPool,
-                                   mesh,
-                                   positionsStaging, positionsGPU,
-                                   uvsStaging, uvsGPU,
-                                   normalsStaging, normalsGPU,
-                                   tangentsStaging, tangentsGPU,
-                                   indicesStaging, indicesGPU);
+        return centres;
+    }
 
+    mesh::Mesh make_mesh(const baked::BakedMeshData& mesh,
+                         const std::uint32_t modelIndex,
+                         const std::uint32_t firstMeshlet,
+                         const vkutils::Buffer& arena,
+                         const ArenaStreams& streams) {
         return mesh::Mesh{
             .name = mesh.name,
-            .positions = std::move(positionsGPU),
-            .uvs = std::move(uvsGPU),
-            .normals = std::move(normalsGPU),
-            .tangents = std::move(tangentsGPU),
-            .indices = std::move(indicesGPU),
+            .modelIndex = modelIndex,
+            .arena = arena.buffer,
+            .positionsOffset = streams.positions,
+            .uvsOffset = streams.uvs,
+            .normalsOffset = streams.normals,
+            .tangentsOffset = streams.tangents,
+            .indicesOffset = streams.indices,
+            .instancesOffset = streams.instances,
             .materialId = mesh.materialId,
-            .indexCount = static_cast<std::uint32_t>(mesh.indices.size())
+            .aabbMin = mesh.aabbMin,
+            .aabbMax = mesh.aabbMax,
+            .sphereCentre = mesh.sphereCentre,
+            .sphereRadius = mesh.sphereRadius,
+            .indexCount = mesh.indexCount,
+            .indexType = sizeof(std::uint16_t) == mesh.indexSize ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32,
+            .instanceCount = static_cast<std::uint32_t>(mesh.instances.size()),
+            .instanceCentres = instance_centres(mesh),
+            .lods = allocate_lods(mesh, firstMeshlet),
+            .pushConstants = glsl::MeshPushConstants{
+                .positionOrigin = glm::vec4(mesh.positionOrigin, 0.0f),
+                .positionExtent = glm::vec4(mesh.positionExtent, 0.0f)
+            }
         };
     }
 }
 
 namespace mesh {
-    std::pair<std::vector<Mesh>, std::vector<Mesh>> extract_meshes(const vkutils::VulkanContext& context,
-                                                                   const vkutils::Allocator& allocator,
-                                                                   const baked::BakedModel& model,
-                                                                   const std::vector<material::Material>& materials) {
-        std::vector<Mesh> opaqueMeshes;
-        std::vector<Mesh> alphaMaskedMeshes;
+    LodSelector create_lod_selector(const glm::vec3& viewPosition,
+                                    const float verticalFov,
+                                    const std::uint32_t viewportHeight,
+                                    const float maxPixelError) {
+        return LodSelector{
+            .viewPosition = viewPosition,
+            .pixelsPerUnit = static_cast<float>(viewportHeight) / (2.0f * std::tan(0.5f * verticalFov)),
+            .maxPixelError = maxPixelError
+        };
+    }
+
+    const MeshLod& select_lod(const Mesh& mesh, const LodSelector& selector) {
+        // Projected error = error * pixelsPerUnit / distance, compared without the division. Inside the bounding
+        // sphere only levels without any error are acceptable.
+        float centreDistance = std::numeric_limits<float>::max();
+        for (const auto& centre : mesh.instanceCentres) {
+            centreDistance = std::min(centreDistance, glm::distance(selector.viewPosition, centre));
+        }
+        const float distance = std::max(centreDistance - mesh.sphereRadius, 0.0f);
+
+        // Errors increase with the level
+        std::size_t lod = 0;
+        while (lod + 1 < mesh.lods.size() &&
+               mesh.lods[lod + 1].error * selector.pixelsPerUnit <= selector.maxPixelError * distance) {
+            ++lod;
+        }
 
-        // CommandPool created solely to allocate mesh data in GPU
-        const vkutils::CommandPool uploadPool = vkutils::create_command_pool(context);
+        return mesh.lods[lod];
+    }
 
+    MeshStore extract_meshes(const vkutils::Allocator& allocator,
+                             vkutils::UploadBatcher& uploader,
+                             const baked::BakedModel& model,
+                             const std::vector<material::Material>& materials) {
+        std::vector<std::vector<glsl::InstanceTransform>> instances;
+        instances.reserve(model.meshes.size());
         for (const auto& modelMesh : model.meshes) {
+            instances.emplace_back(pack_instances(modelMesh));
+        }
+
+        const ArenaLayout layout = layout_arena(model, instances);
+
+        MeshStore store;
+        if (layout.size > 0) {
+            store.arena = vkutils::create_buffer(
+                allocator,
+                layout.size,
+                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                0, // no additional VmaAllocationCreateFlags
+                VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE
+            );
+
+            // Copied Staging -> GPU with a single command
+            const auto staging = uploader.stage_buffer(store.arena.buffer, 0, layout.size,
+                                                       VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT,
+                                                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+            fill_staging(staging, model, layout, instances);
+        }
+
+        // Meshlets are numbered in the order of the model's meshes, see cluster::create_cluster_buffers()
+        std::uint32_t firstMeshlet = 0;
+        for (std::uint32_t i = 0; i < model.meshes.size(); ++i) {
+            const auto& modelMesh = model.meshes[i];
+            auto mesh = make_mesh(modelMesh, i, firstMeshlet, store.arena, layout.meshes[i]);
             if (materials[modelMesh.materialId].has_alpha_mask()) {
-                alphaMaskedMeshes.emplace_back(allocate(context, modelMesh, allocator, uploadPool));
+                store.alphaMaskedMeshes.emplace_back(std::move(mesh));
             } else {
-                opaqueMeshes.emplace_back(allocate(context, modelMesh, allocator, uploadPool));
+                store.opaqueMeshes.emplace_back(std::move(mesh));
             }
+            firstMeshlet += static_cast<std::uint32_t>(modelMesh.meshlets.size() * modelMesh.instances.size());
         }
 
-        opaqueMeshes.shrink_to_fit();
-        alphaMaskedMeshes.shrink_to_fit();
+        store.opaqueMeshes.shrink_to_fit();
+        store.alphaMaskedMeshes.shrink_to_fit();
 
-        return {std::move(opaqueMeshes), std::move(alphaMaskedMeshes)};
+        return store;
     }
 }
@@ -1,31 +1,120 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
 #include "../vkutils/allocator.hpp"
+#include "../vkutils/upload_batcher.hpp"
 #include "../vkutils/vkbuffer.hpp"
 #include "../vkutils/vulkan_context.hpp"
 
 #include "baked_model.hpp"
 #include "material.hpp"
 
+namespace glsl {
+    // Dequantization of the packed positions, see baked::BakedMeshData
+    struct MeshPushConstants {
+        glm::vec4 positionOrigin;
+        glm::vec4 positionExtent;
+    };
+
+    static_assert(sizeof(MeshPushConstants) % 4 == 0, "MeshPushConstants size must be a multiple of 4 bytes");
+    static_assert(offsetof(MeshPushConstants, positionOrigin) % 16 == 0, "positionOrigin must be aligned to 16 bytes");
+    static_assert(offsetof(MeshPushConstants, positionExtent) % 16 == 0, "positionExtent must be aligned to 16 bytes");
+
+    // Per-instance vertex attribute, the rows of the model to world transform. Read as a mat3x4 with
+    // world = vec4(position, 1.0f) * transform, see vertex.glsl.
+    struct InstanceTransform {
+        glm::vec4 rows[3];
+    };
+
+    static_assert(sizeof(InstanceTransform) == 48, "InstanceTransform must be three tightly packed vec4");
+}
+
 namespace mesh {
+    // See baked::BakedMeshLod
+    struct MeshLod {
+        std::uint32_t firstIndex;
+        std::uint32_t indexCount;
+        float error;
+
+        // Range of the level's meshlets in the scene, see cluster::ClusterBuffers. The meshlets of every instance
+        // follow each other, meshletCount * Mesh::instanceCount in total.
+        std::uint32_t firstMeshlet;
+        std::uint32_t meshletCount;
+    };
+
     struct Mesh {
         std::string name;
+        // Index in baked::BakedModel::meshes, see bvh::MeshVisibility
+        std::uint32_t modelIndex;
 
-        vkutils::Buffer positions;
-        vkutils::Buffer uvs;
-        vkutils::Buffer normals;
-        vkutils::Buffer tangents;
-        vkutils::Buffer indices;
+        // Offsets of the mesh's streams in MeshStore::arena. The instance transforms are one
+        // glsl::InstanceTransform per instance.
+        VkBuffer arena;
+        VkDeviceSize positionsOffset;
+        VkDeviceSize uvsOffset;
+        VkDeviceSize normalsOffset;
+        VkDeviceSize tangentsOffset;
+        VkDeviceSize indicesOffset;
+        VkDeviceSize instancesOffset;
         std::uint32_t materialId;
 
+        // Model space bounds, see baked::BakedMeshData
+        glm::vec3 aabbMin;
+        glm::vec3 aabbMax;
+        glm::vec3 sphereCentre;
+        float sphereRadius;
+
         std::uint32_t indexCount;
+        VkIndexType indexType;
+
+        std::uint32_t instanceCount;
+        // World space bounding sphere centre of every instance
+        std::vector<glm::vec3> instanceCentres;
+
+        // From full resolution to coarsest
+        std::vector<MeshLod> lods;
+
+        glsl::MeshPushConstants pushConstants;
+    };
+
+    /*
+     * Level of detail selection by projected error: the coarsest level whose
+     * simplification error, seen from the viewer at the closest point of the
+     * mesh's bounding sphere, covers at most maxPixelError pixels. All instances
+     * of a mesh share a level, selected for the closest one.
+     */
+    struct LodSelector {
+        glm::vec3 viewPosition;
+        // Pixels covered by a unit length facing the viewer at unit distance
+        float pixelsPerUnit;
+        float maxPixelError;
+    };
+
+    struct MeshStore {
+        // Device-local buffer with the vertex streams, indices and instance transforms of every mesh
+        vkutils::Buffer arena;
+        std::vector<Mesh> opaqueMeshes;
+        std::vector<Mesh> alphaMaskedMeshes;
     };
 
-    std::pair<std::vector<Mesh>, std::vector<Mesh>> extract_meshes(const vkutils::VulkanContext&,
-                                                                   const vkutils::Allocator&,
-                                                                   const baked::BakedModel& model,
-                                                                   const std::vector<material::Material>& materials);
+    LodSelector create_lod_selector(const glm::vec3& viewPosition,
+                                    float verticalFov,
+                                    std::uint32_t viewportHeight,
+                                    float maxPixelError);
+
+    const MeshLod& select_lod(const Mesh& mesh, const LodSelector& selector);
+
+    /*
+     * Uploads every mesh into a single arena with one copy. The streams of a
+     * "spicy-blob" model are laid out for it in the baked file and are copied
+     * into the staging memory as a whole, see baked::BakedModel::meshBlob.
+     * The arena is ready once the uploader is finished.
+     */
+    MeshStore extract_meshes(const vkutils::Allocator&,
+                             vkutils::UploadBatcher&,
+                             const baked::BakedModel& model,
+                             const std::vector<material::Material>& materials);
 }
@@ -6,6 +6,7 @@
 #include "../vkutils/error.hpp"
 #include "../vkutils/to_string.hpp"
 
+#include "cluster.hpp"
 #include "config.hpp"
 #include "shade.hpp"
 
@@ -147,11 +148,18 @@ namespace offscreen {
             materialLayout.handle // set 2
         };
 
-        // Create a pipeline layout that includes a push constant range
-        constexpr VkPushConstantRange pushConstantRange{
-            .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
-            .offset = 0,
-            .size = sizeof(glsl::MaterialPushConstants)
+        // Create a pipeline layout that includes the mesh and material push constant ranges
+        constexpr std::array pushConstantRanges{
+            VkPushConstantRange{
+                .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+                .offset = 0,
+                .size = sizeof(glsl::MeshPushConstants)
+            },
+            VkPushConstantRange{
+                .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT,
+                .offset = sizeof(glsl::MeshPushConstants), // must match layout(offset = N) in the shaders
+                .size = sizeof(glsl::MaterialPushConstants)
+            }
         };
 
         const VkPipelineLayoutCreateInfo layoutInfo{
@@ -159,8 +167,8 @@ namespace offscreen {
             // Initialise with layouts information
             .setLayoutCount = layouts.size(),
             .pSetLayouts = layouts.data(),
-            .pushConstantRangeCount = 1,
-            .pPushConstantRanges = &pushConstantRange
+            .pushConstantRangeCount = pushConstantRanges.size(),
+            .pPushConstantRanges = pushConstantRanges.data()
         };
 
         VkPipelineLayout layout = VK_NULL_HANDLE;
@@ -203,26 +211,32 @@ namespace offscreen {
             // Positions Binding
             VkVertexInputBindingDescription{
                 .binding = 0,
-                .stride = sizeof(glm::vec3),
+                .stride = sizeof(glm::u16vec4),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
             },
             // UVs Binding
             VkVertexInputBindingDescription{
                 .binding = 1,
-                .stride = sizeof(glm::vec2),
+                .stride = sizeof(glm::u16vec2),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
             },
             // Normals Binding
             VkVertexInputBindingDescription{
                 .binding = 2,
-                .stride = sizeof(glm::vec3),
+                .stride = sizeof(glm::i16vec2),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
             },
             // Tangents Binding
             VkVertexInputBindingDescription{
                 .binding = 3,
-                .stride = sizeof(glm::vec4),
+                .stride = sizeof(glm::i16vec2),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+            },
+            // Instance transforms Binding
+            VkVertexInputBindingDescription{
+                .binding = 4,
+                .stride = sizeof(glsl::InstanceTransform),
+                .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE
             }
         };
 
@@ -232,21 +246,21 @@ namespace offscreen {
             VkVertexInputAttributeDescription{
                 .location = 0, // must match shader
                 .binding = vertexBindings[0].binding,
-                .format = VK_FORMAT_R32G32B32_SFLOAT, // (x, y, z)
+                .format = VK_FORMAT_R16G16B16A16_UNORM, // (x, y, z, handedness)
                 .offset = 0
             },
             // UVs attribute
             VkVertexInputAttributeDescription{
                 .location = 1, // must match shader
                 .binding = vertexBindings[1].binding,
-                .format = VK_FORMAT_R32G32_SFLOAT, // (u, v)
+                .format = VK_FORMAT_R16G16_SFLOAT, // (u, v)
                 .offset = 0
             },
             // Normals attribute
             VkVertexInputAttributeDescription{
                 .location = 2, // must match shader
                 .binding = vertexBindings[2].binding,
-                .format = VK_FORMAT_R32G32B32_SFLOAT, // (i, j, k)
+                .format = VK_FORMAT_R16G16_SNORM, // octahedral (i, j, k)
                 .offset = 0
 
             },
@@ -254,8 +268,27 @@ namespace offscreen {
             VkVertexInputAttributeDescription{
                 .location = 3, // must match shader
                 .binding = vertexBindings[3].binding,
-                .format = VK_FORMAT_R32G32B32A32_SFLOAT, // (x, y, z, w)
+                .format = VK_FORMAT_R16G16_SNORM, // octahedral (x, y, z)
+                .offset = 0
+            },
+            // Instance transform attributes, one per row of the mat3x4
+            VkVertexInputAttributeDescription{
+                .location = 4, // must match shader
+                .binding = vertexBindings[4].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
                 .offset = 0
+            },
+            VkVertexInputAttributeDescription{
+                .location = 5, // must match shader
+                .binding = vertexBindings[4].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 16
+            },
+            VkVertexInputAttributeDescription{
+                .location = 6, // must match shader
+                .binding = vertexBindings[4].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 32
             }
         };
 
@@ -417,26 +450,32 @@ namespace offscreen {
             // Positions Binding
             VkVertexInputBindingDescription{
                 .binding = 0,
-                .stride = sizeof(glm::vec3),
+                .stride = sizeof(glm::u16vec4),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
             },
             // UVs Binding
             VkVertexInputBindingDescription{
                 .binding = 1,
-                .stride = sizeof(glm::vec2),
+                .stride = sizeof(glm::u16vec2),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
             },
             // Normals Binding
             VkVertexInputBindingDescription{
                 .binding = 2,
-                .stride = sizeof(glm::vec3),
+                .stride = sizeof(glm::i16vec2),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
             },
             // Tangents Binding
             VkVertexInputBindingDescription{
                 .binding = 3,
-                .stride = sizeof(glm::vec4),
+                .stride = sizeof(glm::i16vec2),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+            },
+            // Instance transforms Binding
+            VkVertexInputBindingDescription{
+                .binding = 4,
+                .stride = sizeof(glsl::InstanceTransform),
+                .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE
             }
         };
 
@@ -446,29 +485,48 @@ namespace offscreen {
             VkVertexInputAttributeDescription{
                 .location = 0, // must match shader
                 .binding = vertexBindings[0].binding,
-                .format = VK_FORMAT_R32G32B32_SFLOAT, // (x, y, z)
+                .format = VK_FORMAT_R16G16B16A16_UNORM, // (x, y, z, handedness)
                 .offset = 0
             },
             // UVs attribute
             VkVertexInputAttributeDescription{
                 .location = 1, // must match shader
                 .binding = vertexBindings[1].binding,
-                .format = VK_FORMAT_R32G32_SFLOAT, // (u, v)
+                .format = VK_FORMAT_R16G16_SFLOAT, // (u, v)
                 .offset = 0
             },
             // Normals attribute
             VkVertexInputAttributeDescription{
                 .location = 2, // must match shader
                 .binding = vertexBindings[2].binding,
-                .format = VK_FORMAT_R32G32B32_SFLOAT, // (i, j, k)
+                .format = VK_FORMAT_R16G16_SNORM, // octahedral (i, j, k)
                 .offset = 0
             },
             // Tangents attribute
             VkVertexInputAttributeDescription{
                 .location = 3, // must match shader
                 .binding = vertexBindings[3].binding,
-                .format = VK_FORMAT_R32G32B32A32_SFLOAT, // (x, y, z, w)
+                .format = VK_FORMAT_R16G16_SNORM, // octahedral (x, y, z)
+                .offset = 0
+            },
+            // Instance transform attributes, one per row of the mat3x4
+            VkVertexInputAttributeDescription{
+                .location = 4, // must match shader
+                .binding = vertexBindings[4].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
                 .offset = 0
+            },
+            VkVertexInputAttributeDescription{
+                .location = 5, // must match shader
+                .binding = vertexBindings[4].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 16
+            },
+            VkVertexInputAttributeDescription{
+                .location = 6, // must match shader
+                .binding = vertexBindings[4].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 32
             }
         };
 
@@ -680,7 +738,10 @@ namespace offscreen {
                          const std::vector<mesh::Mesh>& opaqueMeshes,
                          const std::vector<mesh::Mesh>& alphaMeshes,
                          const std::vector<material::Material>& materials,
-                         const std::vector<VkDescriptorSet>& materialDescriptorSets) {
+                         const std::vector<VkDescriptorSet>& materialDescriptorSets,
+                         VkBuffer meshletDraws,
+                         const mesh::LodSelector& lodSelector,
+                         const bvh::MeshVisibility& visibility) {
         // Begin render pass
         // Clear in order: depth, normal, baseColour, surface
         constexpr std::array clearValues{
@@ -739,8 +800,16 @@ namespace offscreen {
 
         // Draw opaque meshes
         for (const auto& mesh : opaqueMeshes) {
+            // Skip meshes without an instance in view, see bvh::query_frustum()
+            if (!visibility[mesh.modelIndex]) {
+                continue;
+            }
+
             // Push the constants to the command buffer
-            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                               sizeof(glsl::MeshPushConstants), &mesh.pushConstants);
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT,
+                               sizeof(glsl::MeshPushConstants),
                                sizeof(glsl::MaterialPushConstants), &materials[mesh.materialId].pushConstants);
 
             // Bind mesh descriptor set into layout(set = 2, ...)
@@ -748,18 +817,19 @@ namespace offscreen {
                                     pipelineLayout, 2, 1,
                                     &materialDescriptorSets[mesh.materialId], 0, nullptr);
 
-            // Bind mesh vertex buffers into layout(location = {1, 2, 3, 4})
-            const std::array vertexBuffers{
-                mesh.positions.buffer, mesh.uvs.buffer, mesh.normals.buffer, mesh.tangents.buffer
+            // Bind mesh vertex buffers into layout(location = {1, 2, 3, 4}) and the instance transforms
+            const std::array vertexBuffers{mesh.arena, mesh.arena, mesh.arena, mesh.arena, mesh.arena};
+            const std::array offsets{
+                mesh.positionsOffset, mesh.uvsOffset, mesh.normalsOffset, mesh.tangentsOffset,
+                mesh.instancesOffset
             };
-            constexpr std::array<VkDeviceSize, vertexBuffers.size()> offsets{};
             vkCmdBindVertexBuffers(commandBuffer, 0, vertexBuffers.size(), vertexBuffers.data(), offsets.data());
 
             // Bind mesh vertex indices
-            vkCmdBindIndexBuffer(commandBuffer, mesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdBindIndexBuffer(commandBuffer, mesh.arena, mesh.indicesOffset, mesh.indexType);
 
-            // Draw mesh vertices
-            vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, 0);
+            // Draw the meshlets of the selected level of detail that survived cluster culling
+            cluster::draw_mesh(commandBuffer, meshletDraws, mesh, mesh::select_lod(mesh, lodSelector));
         }
 
         // Then alpha pipeline
@@ -767,8 +837,16 @@ namespace offscreen {
 
         // Draw alpha meshes
         for (const auto& mesh : alphaMeshes) {
+            // Skip meshes without an instance in view, see bvh::query_frustum()
+            if (!visibility[mesh.modelIndex]) {
+                continue;
+            }
+
             // Push the constants to the command buffer
-            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                               sizeof(glsl::MeshPushConstants), &mesh.pushConstants);
+            vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT,
+                               sizeof(glsl::MeshPushConstants),
                                sizeof(glsl::MaterialPushConstants), &materials[mesh.materialId].pushConstants);
 
             // Bind mesh descriptor set into layout(set = 2, ...)
@@ -776,18 +854,19 @@ namespace offscreen {
                                     pipelineLayout, 2, 1,
                                     &materialDescriptorSets[mesh.materialId], 0, nullptr);
 
-            // Bind mesh vertex buffers into layout(location = {1, 2, 3, 4})
-            const std::array vertexBuffers{
-                mesh.positions.buffer, mesh.uvs.buffer, mesh.normals.buffer, mesh.tangents.buffer
+            // Bind mesh vertex buffers into layout(location = {1, 2, 3, 4}) and the instance transforms
+            const std::array vertexBuffers{mesh.arena, mesh.arena, mesh.arena, mesh.arena, mesh.arena};
+            const std::array offsets{
+                mesh.positionsOffset, mesh.uvsOffset, mesh.normalsOffset, mesh.tangentsOffset,
+                mesh.instancesOffset
             };
-            constexpr std::array<VkDeviceSize, vertexBuffers.size()> offsets{};
             vkCmdBindVertexBuffers(commandBuffer, 0, vertexBuffers.size(), vertexBuffers.data(), offsets.data());
 
             // Bind mesh vertex indices
-            vkCmdBindIndexBuffer(commandBuffer, mesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdBindIndexBuffer(commandBuffer, mesh.arena, mesh.indicesOffset, mesh.indexType);
 
-            // Draw mesh vertices
-            vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, 0);
+            // Draw the meshlets of the selected level of detail that survived cluster culling
+            cluster::draw_mesh(commandBuffer, meshletDraws, mesh, mesh::select_lod(mesh, lodSelector));
         }
 
         // End render pass
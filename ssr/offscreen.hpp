@@ -3,6 +3,7 @@
 #include "../vkutils/vkobject.hpp"
 #include "../vkutils/vulkan_window.hpp"
 
+#include "bvh.hpp"
 #include "gbuffer.hpp"
 #include "material.hpp"
 #include "mesh.hpp"
@@ -49,7 +50,10 @@ namespace offscreen {
                          const std::vector<mesh::Mesh>& opaqueMeshes,
                          const std::vector<mesh::Mesh>& alphaMeshes,
                          const std::vector<material::Material>& materials,
-                         const std::vector<VkDescriptorSet>& materialDescriptorSets);
+                         const std::vector<VkDescriptorSet>& materialDescriptorSets,
+                         VkBuffer meshletDraws,
+                         const mesh::LodSelector& lodSelector,
+                         const bvh::MeshVisibility& visibility);
 
     void submit_commands(const vkutils::VulkanContext& context,
                          VkCommandBuffer offscreenCommandBuffer,
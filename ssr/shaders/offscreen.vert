@@ -1,5 +1,7 @@
 #version 460
 
+#include "vertex.glsl"
+
 // See glsl::SceneUniform for definition
 layout(std140, set = 0, binding = 0) uniform Scene {
     mat4 V;
@@ -12,10 +14,11 @@ layout(std140, set = 0, binding = 0) uniform Scene {
     mat4 C;
 } scene;
 
-layout(location = 0) in vec3 vertexPosition_wcs;
+layout(location = 0) in vec4 packedPosition;
 layout(location = 1) in vec2 vertexUV;
-layout(location = 2) in vec3 vertexNormal_wcs;
-layout(location = 3) in vec4 vertexTangent;
+layout(location = 2) in vec2 packedNormal;
+layout(location = 3) in vec2 packedTangent;
+layout(location = 4) in mat3x4 instanceTransform;
 
 layout(location = 0) out vec3 position_vcs;
 layout(location = 1) out vec2 uv;
@@ -24,6 +27,11 @@ layout(location = 3) out mat3 VTBN;
 layout(location = 6) out vec4 position_lcs;
 
 void main() {
+    vec3 vertexPosition_wcs = transform_point(instanceTransform, decode_position(packedPosition));
+    vec3 vertexNormal_wcs = transform_direction(instanceTransform, decode_octahedral(packedNormal));
+    vec4 vertexTangent = vec4(transform_direction(instanceTransform, decode_octahedral(packedTangent)),
+                              decode_handedness(packedPosition));
+
     gl_Position = scene.VP * vec4(vertexPosition_wcs, 1.0f);
     position_vcs = (scene.V * vec4(vertexPosition_wcs, 1.0f)).xyz;
     uv = vertexUV;
@@ -16,12 +16,13 @@ layout(set = 1, binding = 1) uniform sampler2DShadow shadow;
 
 layout(set = 2, binding = 0) uniform sampler2D baseColour;
 layout(set = 2, binding = 1) uniform sampler2D emissive;
-layout(set = 2, binding = 2) uniform sampler2D roughness;
-layout(set = 2, binding = 3) uniform sampler2D metalness;
-layout(set = 2, binding = 4) uniform sampler2D normalMap;
+// Roughness (R) and metalness (G), see assets-bake/texture_bake.hpp
+layout(set = 2, binding = 2) uniform sampler2D surface;
+layout(set = 2, binding = 3) uniform sampler2D normalMap;
 
+// Follows glsl::MeshPushConstants (see vertex.glsl) in the push constant range
 layout(std140, push_constant) uniform MaterialPushConstants {
-    vec3 baseColour;
+    layout(offset = 32) vec3 baseColour;
     float roughness;
     vec3 emission;
     float metalness;
@@ -39,8 +40,11 @@ layout(location = 1) out vec4 gBaseColour;
 layout(location = 2) out vec4 gSurface;
 layout(location = 3) out vec4 gEmissive;
 
-vec3 mapNormal(vec3 normal_tcs) {
-    return VTBN * (normal_tcs * 2.0f - 1.0f);
+// Normal maps are BC5 compressed and only store X and Y, Z is reconstructed
+vec3 mapNormal(vec2 normal_tcs_xy) {
+    vec2 xy = normal_tcs_xy * 2.0f - 1.0f;
+    float z = sqrt(max(1.0f - dot(xy, xy), 0.0f));
+    return VTBN * vec3(xy, z);
 }
 
 float shadowFactor() {
@@ -52,12 +56,13 @@ void main() {
     bool normalMappingEnabled = (shadeUniforms.shade.detailsBitfield & normalMappingMask) != 0;
     vec3 fragNormal_vcs = normal_vcs;
     if (normalMappingEnabled) {
-        fragNormal_vcs = mapNormal(texture(normalMap, uv).rgb);
+        fragNormal_vcs = mapNormal(texture(normalMap, uv).rg);
     }
 
     vec3 cMat = texture(baseColour, uv).rgb * materialPush.baseColour;
-    float r = texture(roughness, uv).r * materialPush.roughness;
-    float M = texture(metalness, uv).r * materialPush.metalness;
+    vec2 surfaceSample = texture(surface, uv).rg;
+    float r = surfaceSample.r * materialPush.roughness;
+    float M = surfaceSample.g * materialPush.metalness;
     float S = (shadeUniforms.shade.detailsBitfield & shadowsMask) != 0 ? shadowFactor() : noShadows;
     vec3 emissive = texture(emissive, uv).rgb * materialPush.emission;
 
@@ -8,10 +8,8 @@ layout(location = 0) in vec2 uv;
 
 void main() {
     // Discard fragments with alpha below a threshold
-    vec4 mask = texture(alphaMask, uv);
-    float transparency = (mask.a < 1.0f)
-        ? max(mask.a, dot(mask.rgb, vec3(0.333f)))  // RGBA - use the max of alpha and RGB brightness
-        : dot(mask.rgb, vec3(0.333));               // RGB - only use RGB brightness
+    // Transparency is derived from the RGBA mask when baking, see assets-bake/texture_bake.cpp
+    float transparency = texture(alphaMask, uv).r;
     if (transparency < alphaThreshold) {
         discard; // Don't write to depth buffer and terminate processing
     }
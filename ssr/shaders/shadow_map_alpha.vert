@@ -1,5 +1,7 @@
 #version 460
 
+#include "vertex.glsl"
+
 layout(std140, set = 0, binding = 0) uniform Scene {
     mat4 V;
     mat4 P;
@@ -11,12 +13,13 @@ layout(std140, set = 0, binding = 0) uniform Scene {
     mat4 C;
 } scene;
 
-layout(location = 0) in vec3 vertexPosition_wcs;
+layout(location = 0) in vec4 packedPosition;
 layout(location = 1) in vec2 vertexUV;
+layout(location = 2) in mat3x4 instanceTransform;
 
 layout(location = 0) out vec2 uv;
 
 void main() {
-    gl_Position = scene.LVP * vec4(vertexPosition_wcs, 1.0f);
+    gl_Position = scene.LVP * vec4(transform_point(instanceTransform, decode_position(packedPosition)), 1.0f);
     uv = vertexUV;
 }
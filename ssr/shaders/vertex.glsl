@@ -0,0 +1,34 @@
+// Decoding of the packed vertex streams, see baked::BakedMeshData
+
+// See glsl::MeshPushConstants
+layout(std140, push_constant) uniform MeshPushConstants {
+    vec4 positionOrigin;
+    vec4 positionExtent;
+} meshPush;
+
+// Positions are UNORM16 relative to the mesh bounds
+vec3 decode_position(vec4 packedPosition) {
+    return meshPush.positionOrigin.xyz + packedPosition.xyz * meshPush.positionExtent.xyz;
+}
+
+// Tangent handedness is stored in the w component of the position (0 => -1, 1 => +1)
+float decode_handedness(vec4 packedPosition) {
+    return packedPosition.w * 2.0f - 1.0f;
+}
+
+// Rigid model to world transform of the instance, see glsl::InstanceTransform
+vec3 transform_point(mat3x4 transform, vec3 point) {
+    return vec4(point, 1.0f) * transform;
+}
+
+vec3 transform_direction(mat3x4 transform, vec3 direction) {
+    return vec4(direction, 0.0f) * transform;
+}
+
+// Octahedral encoding, see vkutils::pack_octahedral()
+vec3 decode_octahedral(vec2 octahedral) {
+    vec3 direction = vec3(octahedral, 1.0f - abs(octahedral.x) - abs(octahedral.y));
+    float fold = max(-direction.z, 0.0f);
+    direction.xy += vec2(direction.x >= 0.0f ? -fold : fold, direction.y >= 0.0f ? -fold : fold);
+    return normalize(direction);
+}
@@ -8,6 +8,16 @@
 
 #include "config.hpp"
 
+namespace {
+    // Shared by both layouts: the scene descriptor set is bound once for both
+    // pipelines, which requires identical push constant ranges
+    constexpr VkPushConstantRange kMeshPushConstantRange{
+        .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+        .offset = 0,
+        .size = sizeof(glsl::MeshPushConstants)
+    };
+}
+
 namespace shadow {
     vkutils::RenderPass create_render_pass(const vkutils::VulkanWindow& window) {
         constexpr std::array attachments{
@@ -94,8 +104,8 @@ namespace shadow {
             // Initialise with layouts information
             .setLayoutCount = layouts.size(),
             .pSetLayouts = layouts.data(),
-            .pushConstantRangeCount = 0,
-            .pPushConstantRanges = nullptr
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &kMeshPushConstantRange
         };
 
         VkPipelineLayout layout = VK_NULL_HANDLE;
@@ -122,8 +132,8 @@ namespace shadow {
             // Initialise with layouts information
             .setLayoutCount = layouts.size(),
             .pSetLayouts = layouts.data(),
-            .pushConstantRangeCount = 0,
-            .pPushConstantRanges = nullptr
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges = &kMeshPushConstantRange
         };
 
         VkPipelineLayout layout = VK_NULL_HANDLE;
@@ -166,8 +176,14 @@ namespace shadow {
             // Positions Binding
             VkVertexInputBindingDescription{
                 .binding = 0,
-                .stride = sizeof(glm::vec3),
+                .stride = sizeof(glm::u16vec4),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+            },
+            // Instance transforms Binding
+            VkVertexInputBindingDescription{
+                .binding = 1,
+                .stride = sizeof(glsl::InstanceTransform),
+                .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE
             }
         };
 
@@ -177,8 +193,27 @@ namespace shadow {
             VkVertexInputAttributeDescription{
                 .location = 0, // must match shader
                 .binding = vertexBindings[0].binding,
-                .format = VK_FORMAT_R32G32B32_SFLOAT, // (x, y, z)
+                .format = VK_FORMAT_R16G16B16A16_UNORM, // (x, y, z, handedness)
+                .offset = 0
+            },
+            // Instance transform attributes, one per row of the mat3x4
+            VkVertexInputAttributeDescription{
+                .location = 1, // must match shader
+                .binding = vertexBindings[1].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
                 .offset = 0
+            },
+            VkVertexInputAttributeDescription{
+                .location = 2, // must match shader
+                .binding = vertexBindings[1].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 16
+            },
+            VkVertexInputAttributeDescription{
+                .location = 3, // must match shader
+                .binding = vertexBindings[1].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 32
             }
         };
 
@@ -312,14 +347,20 @@ namespace shadow {
             // Positions Binding
             VkVertexInputBindingDescription{
                 .binding = 0,
-                .stride = sizeof(glm::vec3),
+                .stride = sizeof(glm::u16vec4),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
             },
             // UVs Binding
             VkVertexInputBindingDescription{
                 .binding = 1,
-                .stride = sizeof(glm::vec2),
+                .stride = sizeof(glm::u16vec2),
                 .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+            },
+            // Instance transforms Binding
+            VkVertexInputBindingDescription{
+                .binding = 2,
+                .stride = sizeof(glsl::InstanceTransform),
+                .inputRate = VK_VERTEX_INPUT_RATE_INSTANCE
             }
         };
 
@@ -329,15 +370,34 @@ namespace shadow {
             VkVertexInputAttributeDescription{
                 .location = 0, // must match shader
                 .binding = vertexBindings[0].binding,
-                .format = VK_FORMAT_R32G32B32_SFLOAT, // (x, y, z)
+                .format = VK_FORMAT_R16G16B16A16_UNORM, // (x, y, z, handedness)
                 .offset = 0
             },
             // UVs attribute
             VkVertexInputAttributeDescription{
                 .location = 1, // must match shader
                 .binding = vertexBindings[1].binding,
-                .format = VK_FORMAT_R32G32_SFLOAT, // (u, v)
+                .format = VK_FORMAT_R16G16_SFLOAT, // (u, v)
+                .offset = 0
+            },
+            // Instance transform attributes, one per row of the mat3x4
+            VkVertexInputAttributeDescription{
+                .location = 2, // must match shader
+                .binding = vertexBindings[2].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
                 .offset = 0
+            },
+            VkVertexInputAttributeDescription{
+                .location = 3, // must match shader
+                .binding = vertexBindings[2].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 16
+            },
+            VkVertexInputAttributeDescription{
+                .location = 4, // must match shader
+                .binding = vertexBindings[2].binding,
+                .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+                .offset = 32
             }
         };
 
@@ -493,7 +553,9 @@ namespace shadow {
                          const glsl::SceneUniform& sceneUniform, VkDescriptorSet sceneDescriptorSet,
                          const std::vector<mesh::Mesh>& opaqueMeshes,
                          const std::vector<mesh::Mesh>& alphaMeshes,
-                         const std::vector<VkDescriptorSet>& materialDescriptors) {
+                         const std::vector<VkDescriptorSet>& materialDescriptors,
+                         const mesh::LodSelector& lodSelector,
+                         const bvh::MeshVisibility& visibility) {
         // Begin render pass
         constexpr std::array clearValues{
             // Clear depth value
@@ -533,16 +595,26 @@ namespace shadow {
 
         // Draw opaque meshes
         for (const auto& mesh : opaqueMeshes) {
-            // Bind mesh vertex buffers into layout(location = {1})
-            const std::array vertexBuffers = {mesh.positions.buffer};
-            constexpr std::array<VkDeviceSize, vertexBuffers.size()> offsets{};
+            // Skip meshes without an instance in view, see bvh::query_frustum()
+            if (!visibility[mesh.modelIndex]) {
+                continue;
+            }
+
+            // Push the position dequantization constants
+            vkCmdPushConstants(commandBuffer, opaqueLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                               sizeof(glsl::MeshPushConstants), &mesh.pushConstants);
+
+            // Bind mesh vertex buffers into layout(location = {1}) and the instance transforms
+            const std::array vertexBuffers = {mesh.arena, mesh.arena};
+            const std::array offsets = {mesh.positionsOffset, mesh.instancesOffset};
             vkCmdBindVertexBuffers(commandBuffer, 0, vertexBuffers.size(), vertexBuffers.data(), offsets.data());
 
             // Bind mesh vertex indices
-            vkCmdBindIndexBuffer(commandBuffer, mesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdBindIndexBuffer(commandBuffer, mesh.arena, mesh.indicesOffset, mesh.indexType);
 
-            // Draw mesh vertices
-            vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, 0);
+            // Draw the selected level of detail for every instance
+            const auto& lod = mesh::select_lod(mesh, lodSelector);
+            vkCmdDrawIndexed(commandBuffer, lod.indexCount, mesh.instanceCount, lod.firstIndex, 0, 0);
         }
 
         // Then draw alpha pipeline
@@ -550,21 +622,31 @@ namespace shadow {
 
         // Draw alpha meshes
         for (const auto& mesh : alphaMeshes) {
+            // Skip meshes without an instance in view, see bvh::query_frustum()
+            if (!visibility[mesh.modelIndex]) {
+                continue;
+            }
+
+            // Push the position dequantization constants
+            vkCmdPushConstants(commandBuffer, alphaLayout, VK_SHADER_STAGE_VERTEX_BIT, 0,
+                               sizeof(glsl::MeshPushConstants), &mesh.pushConstants);
+
             // Bind mesh descriptor set into layout(set = 1, ...)
             vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                                     alphaLayout, 1, 1,
                                     &materialDescriptors[mesh.materialId], 0, nullptr);
 
-            // Bind mesh vertex buffers into layout(location = {1, 2})
-            const std::array vertexBuffers = {mesh.positions.buffer, mesh.uvs.buffer};
-            constexpr std::array<VkDeviceSize, vertexBuffers.size()> offsets{};
+            // Bind mesh vertex buffers into layout(location = {1, 2}) and the instance transforms
+            const std::array vertexBuffers = {mesh.arena, mesh.arena, mesh.arena};
+            const std::array offsets = {mesh.positionsOffset, mesh.uvsOffset, mesh.instancesOffset};
             vkCmdBindVertexBuffers(commandBuffer, 0, vertexBuffers.size(), vertexBuffers.data(), offsets.data());
 
             // Bind mesh vertex indices
-            vkCmdBindIndexBuffer(commandBuffer, mesh.indices.buffer, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdBindIndexBuffer(commandBuffer, mesh.arena, mesh.indicesOffset, mesh.indexType);
 
-            // Draw mesh vertices
-            vkCmdDrawIndexed(commandBuffer, mesh.indexCount, 1, 0, 0, 0);
+            // Draw the selected level of detail for every instance
+            const auto& lod = mesh::select_lod(mesh, lodSelector);
+            vkCmdDrawIndexed(commandBuffer, lod.indexCount, mesh.instanceCount, lod.firstIndex, 0, 0);
         }
 
         // End the render pass
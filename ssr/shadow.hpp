@@ -6,6 +6,7 @@
 #include "../vkutils/vkimage.hpp"
 #include "../vkutils/vulkan_window.hpp"
 
+#include "bvh.hpp"
 #include "mesh.hpp"
 #include "scene.hpp"
 
@@ -59,5 +60,7 @@ namespace shadow {
                          VkDescriptorSet sceneDescriptors,
                          const std::vector<mesh::Mesh>& opaqueMeshes,
                          const std::vector<mesh::Mesh>& alphaMeshes,
-                         const std::vector<VkDescriptorSet>& materialDescriptors);
+                         const std::vector<VkDescriptorSet>& materialDescriptors,
+                         const mesh::LodSelector& lodSelector,
+                         const bvh::MeshVisibility& visibility);
 }
@@ -148,6 +148,16 @@ namespace state {
         std::uint32_t ssrBinaryRefinementSteps = 0;
         float ssrThickness = cfg::cameraFar;
 
+        // Skip meshes outside the camera or light frustum, see bvh::query_frustum()
+        bool meshCulling = true;
+
+        // Cull meshlets outside the frustum or facing away from the camera
+        bool clusterCulling = true;
+
+        // Level of detail selection, see mesh::LodSelector
+        float lodPixelError = cfg::lodPixelError;
+        float shadowLodPixelError = cfg::shadowLodPixelError;
+
         // Take screenshot of current frame, reset after frame ends
         bool takeFrameScreenshot = false;
 
@@ -5,8 +5,10 @@
 #include <stb_image.h>
 #include <string>
 
+#include "baked_model.hpp"
 #include "../vkutils/allocator.hpp"
 #include "../vkutils/vkimage.hpp"
+#include "../vkutils/upload_batcher.hpp"
 #include "../vkutils/vkobject.hpp"
 #include "../vkutils/vulkan_context.hpp"
 
@@ -36,9 +38,16 @@ namespace texture {
         ~Texture();
     };
 
-    vkutils::Image texture_to_image(const vkutils::VulkanContext& context,
-                                    const Texture& texture,
+    // Uploads the base level and generates the mip chain, recorded into the uploader
+    vkutils::Image texture_to_image(const Texture& texture,
                                     VkFormat format,
                                     const vkutils::Allocator& allocator,
-                                    const vkutils::CommandPool& loadCommandPool);
+                                    vkutils::UploadBatcher& uploader);
+
+    VkFormat baked_texture_format(baked::TextureEncoding encoding);
+
+    // Uploads all mip levels of a texture baked by assets-bake as they are
+    vkutils::Image baked_texture_to_image(const baked::BakedTextureData& texture,
+                                          const vkutils::Allocator& allocator,
+                                          vkutils::UploadBatcher& uploader);
 }
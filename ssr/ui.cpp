@@ -220,6 +220,18 @@ namespace ui {
         ImGui::Text("Total (ms): %.3f", frameTime.totalInMs);
         ImGui::Spacing();
 
+        ImGui::SeparatorText("Culling");
+        ImGui::Spacing();
+        ImGui::Checkbox("Mesh Culling", &state.meshCulling);
+        ImGui::Checkbox("Cluster Culling", &state.clusterCulling);
+        ImGui::Spacing();
+
+        ImGui::SeparatorText("Level of Detail");
+        ImGui::Spacing();
+        ImGui::SliderFloat("Max Error (px)", &state.lodPixelError, 0.0f, 16.0f);
+        ImGui::SliderFloat("Max Shadow Error (px)", &state.shadowLodPixelError, 0.0f, 16.0f);
+        ImGui::Spacing();
+
         ImGui::SeparatorText("Benchmarks");
         ImGui::Spacing();
         const bool loadPlaybackFile = ImGui::Button("Load Playback file");
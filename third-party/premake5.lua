@@ -174,6 +174,8 @@ project( "x-zstd" )
 	files( "zstd/src/decompress/*.c" )
 	files( "zstd/src/compress/*.c" )
 
+	defines( "ZSTD_MULTITHREAD=1" ) -- for ZSTD_c_nbWorkers, see assets-bake
+
 project( "x-imgui" )
 	kind "StaticLib"
 
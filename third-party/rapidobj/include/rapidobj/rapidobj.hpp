@@ -33,6 +33,7 @@ OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
 #include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <map>
 #include <optional>
@@ -338,6 +339,18 @@ inline Result ParseFile(
 
 inline Result ParseStream(std::istream& obj_stream, const MaterialLibrary& mtl_library = MaterialLibrary::Default());
 
+// In-memory .obj data, which may still be produced (e.g. decompressed) while it is parsed.
+struct ObjBuffer final {
+    const char* data{};
+    size_t      size{};
+
+    // Blocks until the first count bytes of data are valid, and returns false if they never
+    // will be. May be empty if data is complete.
+    std::function<bool(size_t count)> wait_until_available{};
+};
+
+inline Result ParseBuffer(const ObjBuffer& obj_buffer, const MaterialLibrary& mtl_library = MaterialLibrary::Default());
+
 inline bool Triangulate(Result& result);
 
 } // namespace rapidobj
@@ -5211,7 +5224,7 @@ struct FileReader : Reader {
 
 } // namespace sys
 
-using DataSource = std::variant<sys::File*, std::istream*>;
+using DataSource = std::variant<sys::File*, std::istream*, const ObjBuffer*>;
 
 struct StreamReader : Reader {
     StreamReader(std::istream* is) noexcept : m_stream(is)
@@ -5263,6 +5276,50 @@ struct StreamReader : Reader {
     char*         m_buffer{};
 };
 
+struct BufferReader : Reader {
+    BufferReader(const ObjBuffer* buffer) noexcept : m_source(buffer) { assert(buffer); }
+
+    std::error_code ReadBlock(size_t offset, size_t size, char* buffer) override
+    {
+        assert(buffer);
+
+        ++m_num_requests;
+
+        m_offset = std::min(offset, m_source->size);
+        m_size   = std::min(size, m_source->size - m_offset);
+        m_buffer = buffer;
+
+        return std::error_code();
+    }
+
+    ReadResult WaitForResult() override
+    {
+        auto t1 = std::chrono::steady_clock::now();
+
+        bool available = !m_source->wait_until_available || m_source->wait_until_available(m_offset + m_size);
+
+        auto t2 = std::chrono::steady_clock::now();
+
+        m_wait_time += t2 - t1;
+
+        if (!available) {
+            return { size_t{}, std::make_error_code(std::io_errc::stream) };
+        }
+
+        memcpy(m_buffer, m_source->data + m_offset, m_size);
+
+        m_bytes_read += m_size;
+
+        return { m_size, std::error_code() };
+    }
+
+  private:
+    const ObjBuffer* m_source{};
+    size_t        m_offset{};
+    size_t        m_size{};
+    char*         m_buffer{};
+};
+
 inline std::unique_ptr<Reader> CreateReader(sys::File* file)
 {
     return std::make_unique<sys::FileReader>(*file);
@@ -5271,6 +5328,10 @@ inline std::unique_ptr<Reader> CreateReader(std::istream* is)
 {
     return std::make_unique<StreamReader>(is);
 }
+inline std::unique_ptr<Reader> CreateReader(const ObjBuffer* buffer)
+{
+    return std::make_unique<BufferReader>(buffer);
+}
 inline std::unique_ptr<Reader> CreateReader(DataSource source)
 {
     return std::visit([](auto arg) { return CreateReader(arg); }, source);
@@ -7056,7 +7117,11 @@ inline void ProcessBlocks(
     context->debug.parse.time[thread_index]     = parse_time;
 }
 
-inline void ParseFileSequential(sys::File* file, std::vector<Chunk>* chunks, std::shared_ptr<SharedContext> context)
+inline void ParseFileSequential(
+    DataSource                     source,
+    size_t                         size,
+    std::vector<Chunk>*            chunks,
+    std::shared_ptr<SharedContext> context)
 {
     context->thread.concurrency   = 1;
     context->parsing.thread_count = 1;
@@ -7069,19 +7134,20 @@ inline void ParseFileSequential(sys::File* file, std::vector<Chunk>* chunks, std
     context->debug.io.wait_time.resize(1);
     context->debug.parse.time.resize(1);
 
-    auto source = DataSource(file);
-
-    auto num_blocks             = file->size() / kBlockSize + (file->size() % kBlockSize != 0);
+    auto num_blocks             = size / kBlockSize + (size % kBlockSize != 0);
     auto stop_parsing_after_eol = false;
     auto chunk                  = &chunks->front();
 
     ProcessBlocks(source, 0, 0, num_blocks, stop_parsing_after_eol, chunk, context);
 }
 
-inline void ParseFileParallel(sys::File* file, std::vector<Chunk>* chunks, std::shared_ptr<SharedContext> context)
+inline void ParseFileParallel(
+    DataSource                     source,
+    size_t                         size,
+    std::vector<Chunk>*            chunks,
+    std::shared_ptr<SharedContext> context)
 {
-    auto source                = DataSource(file);
-    auto num_blocks            = file->size() / kBlockSize + (file->size() % kBlockSize != 0);
+    auto num_blocks            = size / kBlockSize + (size % kBlockSize != 0);
     auto num_threads           = std::thread::hardware_concurrency();
     auto num_blocks_per_thread = num_blocks / num_threads;
     auto num_remainder_blocks  = num_blocks - (num_blocks_per_thread * num_threads);
@@ -7177,9 +7243,9 @@ inline Result ParseFile(const std::filesystem::path& filepath, const MaterialLib
     auto t1 = std::chrono::steady_clock::now();
 
     if (file.size() <= kSingleThreadCutoff) {
-        ParseFileSequential(&file, &chunks, context);
+        ParseFileSequential(&file, file.size(), &chunks, context);
     } else {
-        ParseFileParallel(&file, &chunks, context);
+        ParseFileParallel(&file, file.size(), &chunks, context);
     }
 
     auto t2 = std::chrono::steady_clock::now();
@@ -7293,6 +7359,84 @@ inline Result ParseStream(std::istream& is, const MaterialLibrary& material_libr
     return result;
 }
 
+inline Result ParseBuffer(const ObjBuffer& buffer, const MaterialLibrary& material_library)
+{
+    if (buffer.size == 0) {
+        return Result{};
+    }
+
+    auto context                  = std::make_shared<SharedContext>();
+    auto material_library_value   = &material_library.Value();
+    auto default_material_library = MaterialLibrary::SearchPaths({}, Load::Optional);
+
+    if (std::get_if<std::nullptr_t>(material_library_value) != nullptr) {
+        context->material.library = nullptr;
+    } else if (std::get_if<std::monostate>(material_library_value) != nullptr) {
+        if (material_library.Policy()) {
+            return Result{ Attributes{}, Shapes{}, Materials{}, Error{ rapidobj_errc::InvalidArgumentsError } };
+        }
+        context->material.library = &default_material_library;
+    } else if (auto* paths = std::get_if<std::vector<std::filesystem::path>>(material_library_value)) {
+        if (paths->empty()) {
+            return Result{ Attributes{}, Shapes{}, Materials{}, Error{ rapidobj_errc::InvalidArgumentsError } };
+        }
+        if (std::any_of(paths->begin(), paths->end(), [](auto& path) { return path.is_relative(); })) {
+            return Result{ Attributes{}, Shapes{}, Materials{}, Error{ rapidobj_errc::MaterialRelativePathError } };
+        }
+        context->material.library = &material_library;
+    } else if (std::get_if<std::string_view>(material_library_value) != nullptr) {
+        context->material.library = &material_library;
+    } else {
+        return Result{ Attributes{}, Shapes{}, Materials{}, Error{ rapidobj_errc::InternalError } };
+    }
+
+    auto chunks = std::vector<Chunk>();
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (buffer.size <= kSingleThreadCutoff) {
+        ParseFileSequential(&buffer, buffer.size, &chunks, context);
+    } else {
+        ParseFileParallel(&buffer, buffer.size, &chunks, context);
+    }
+
+    auto t2 = std::chrono::steady_clock::now();
+
+    context->debug.parse.total_time = t2 - t1;
+
+    // check if an error occured
+    size_t running_line_num = size_t{};
+    for (auto& chunk : chunks) {
+        if (chunk.error.code) {
+            chunk.error.line_num += running_line_num;
+            return Result{ Attributes{}, Shapes{}, Materials{}, chunk.error };
+        }
+        running_line_num += chunk.text.line_count;
+    }
+
+    t1 = std::chrono::steady_clock::now();
+
+    auto result = Merge(chunks, context);
+
+    t2 = std::chrono::steady_clock::now();
+
+    context->debug.merge.total_time = t2 - t1;
+
+    auto memory = size_t{ 0 };
+
+    for (const auto& chunk : chunks) {
+        memory += SizeInBytes(chunk);
+    }
+
+    // Free memory in a different thread
+    if (memory > kMemoryRecyclingSize) {
+        auto recycle = std::thread([](std::vector<Chunk>&&) {}, std::move(chunks));
+        recycle.detach();
+    }
+
+    return result;
+}
+
 struct TriangulateTask final {
     TriangulateTask(
         const Mesh* src_,
@@ -7699,6 +7843,19 @@ inline Result ParseStream(std::istream& obj_stream, const MaterialLibrary& mtl_l
     return detail::ParseStream(obj_stream, mtl_library);
 }
 
+/// <summary>
+/// Loads and parses Wavefront geometry definition data from memory. Like ParseFile(), larger
+/// buffers are parsed in parallel. Parsing may start while the buffer is still being filled,
+/// see ObjBuffer::wait_until_available.
+/// </summary>
+/// <param name="obj_buffer"> : buffer to parse.</param>
+/// <param name="mtl_library"> : optional material library.</param>
+/// <returns>Parsed data stored in Result class.</returns>
+inline Result ParseBuffer(const ObjBuffer& obj_buffer, const MaterialLibrary& mtl_library)
+{
+    return detail::ParseBuffer(obj_buffer, mtl_library);
+}
+
 inline bool Triangulate(Result& result)
 {
     return detail::Triangulate(result);
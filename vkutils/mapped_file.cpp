@@ -0,0 +1,120 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#if defined(_WIN32)
+#   define WIN32_LEAN_AND_MEAN
+#   define NOMINMAX
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+#include "error.hpp"
+
+namespace vkutils {
+    MappedFile::MappedFile() noexcept = default;
+
+    MappedFile::~MappedFile() {
+        if (!mData) {
+            return;
+        }
+
+#       if defined(_WIN32)
+        UnmapViewOfFile(mData);
+#       else
+        munmap(const_cast<std::uint8_t*>(mData), mSize);
+#       endif
+    }
+
+    MappedFile::MappedFile(MappedFile&& aOther) noexcept
+        : mData(std::exchange(aOther.mData, nullptr)),
+          mSize(std::exchange(aOther.mSize, 0)) {
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& aOther) noexcept {
+        std::swap(mData, aOther.mData);
+        std::swap(mSize, aOther.mSize);
+        return *this;
+    }
+
+    std::span<const std::uint8_t> MappedFile::bytes() const noexcept {
+        return {mData, mSize};
+    }
+}
+
+namespace vkutils {
+    MappedFile map_file(char const* path) {
+        MappedFile mapped;
+
+#       if defined(_WIN32)
+        const HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                        FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (INVALID_HANDLE_VALUE == file) {
+            throw Error("Unable to open '%s' for reading", path);
+        }
+
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(file, &size)) {
+            CloseHandle(file);
+            throw Error("Unable to query the size of '%s'", path);
+        }
+
+        if (0 == size.QuadPart) {
+            CloseHandle(file);
+            return mapped;
+        }
+
+        // The view keeps the mapping alive, both handles can be closed right away
+        const HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (!mapping) {
+            throw Error("Unable to map '%s'", path);
+        }
+
+        const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        if (!view) {
+            throw Error("Unable to map '%s'", path);
+        }
+
+        mapped.mData = static_cast<const std::uint8_t*>(view);
+        mapped.mSize = static_cast<std::size_t>(size.QuadPart);
+#       else
+        const int file = open(path, O_RDONLY);
+        if (-1 == file) {
+            throw Error("Unable to open '%s' for reading", path);
+        }
+
+        struct stat status{};
+        if (0 != fstat(file, &status)) {
+            close(file);
+            throw Error("Unable to query the size of '%s'", path);
+        }
+
+        if (0 == status.st_size) {
+            close(file);
+            return mapped;
+        }
+
+        // The mapping stays valid once the file is closed
+        const auto size = static_cast<std::size_t>(status.st_size);
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+        close(file);
+        if (MAP_FAILED == view) {
+            throw Error("Unable to map '%s'", path);
+        }
+
+        // The whole file is read while loading, start paging it in
+        madvise(view, size, MADV_WILLNEED);
+
+        mapped.mData = static_cast<const std::uint8_t*>(view);
+        mapped.mSize = size;
+#       endif
+
+        return mapped;
+    }
+}
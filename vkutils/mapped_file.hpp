@@ -0,0 +1,38 @@
+#pragma once
+
+#include <span>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vkutils {
+    /*
+     * Read-only memory mapping of a whole file. The mapped bytes stay valid
+     * until the MappedFile is destroyed, including across moves.
+     */
+    class MappedFile {
+    public:
+        MappedFile() noexcept;
+
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        MappedFile(MappedFile&&) noexcept;
+
+        MappedFile& operator =(MappedFile&&) noexcept;
+
+        std::span<const std::uint8_t> bytes() const noexcept;
+
+    private:
+        friend MappedFile map_file(char const*);
+
+        const std::uint8_t* mData = nullptr;
+        std::size_t mSize = 0;
+    };
+
+    // Throws vkutils::Error if the file can't be opened or mapped. Empty files map to no bytes.
+    MappedFile map_file(char const* path);
+}
@@ -0,0 +1,116 @@
+#include "mesh_codec.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#   define VKUTILS_CODEC_SSE2 1
+#endif
+
+namespace {
+#   if VKUTILS_CODEC_SSE2
+    __m128i load(const std::uint8_t* plane, const std::size_t e) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i*>(plane + e));
+    }
+
+    void store(std::uint8_t* output, const __m128i value) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(output), value);
+    }
+
+    // Bytes 0 and 1 of 8 elements each, from 16 elements of two planes
+    struct Interleaved2 {
+        __m128i lo, hi;
+    };
+
+    Interleaved2 interleave_2(const __m128i plane0, const __m128i plane1) {
+        return {_mm_unpacklo_epi8(plane0, plane1), _mm_unpackhi_epi8(plane0, plane1)};
+    }
+
+    // Bytes 0 to 3 of 4 elements each, from 16 elements of four planes
+    struct Interleaved4 {
+        __m128i e0, e4, e8, e12;
+    };
+
+    Interleaved4 interleave_4(const std::uint8_t* input, const std::size_t count, const std::size_t e) {
+        const auto [lo01, hi01] = interleave_2(load(input, e), load(input + count, e));
+        const auto [lo23, hi23] = interleave_2(load(input + 2 * count, e), load(input + 3 * count, e));
+
+        return {
+            _mm_unpacklo_epi16(lo01, lo23), _mm_unpackhi_epi16(lo01, lo23),
+            _mm_unpacklo_epi16(hi01, hi23), _mm_unpackhi_epi16(hi01, hi23)
+        };
+    }
+
+    // Each returns the first element left to the scalar loop
+    std::size_t unshuffle_2(const std::uint8_t* input, const std::size_t count, std::uint8_t* output) {
+        std::size_t e = 0;
+        for (; e + 16 <= count; e += 16) {
+            const auto [lo, hi] = interleave_2(load(input, e), load(input + count, e));
+            store(output + 2 * e, lo);
+            store(output + 2 * e + 16, hi);
+        }
+        return e;
+    }
+
+    std::size_t unshuffle_4(const std::uint8_t* input, const std::size_t count, std::uint8_t* output) {
+        std::size_t e = 0;
+        for (; e + 16 <= count; e += 16) {
+            const auto elements = interleave_4(input, count, e);
+            store(output + 4 * e, elements.e0);
+            store(output + 4 * e + 16, elements.e4);
+            store(output + 4 * e + 32, elements.e8);
+            store(output + 4 * e + 48, elements.e12);
+        }
+        return e;
+    }
+
+    std::size_t unshuffle_8(const std::uint8_t* input, const std::size_t count, std::uint8_t* output) {
+        std::size_t e = 0;
+        for (; e + 16 <= count; e += 16) {
+            // Low and high halves of the elements, then pairs of elements
+            const auto low = interleave_4(input, count, e);
+            const auto high = interleave_4(input + 4 * count, count, e);
+
+            std::uint8_t* out = output + 8 * e;
+            store(out, _mm_unpacklo_epi32(low.e0, high.e0));
+            store(out + 16, _mm_unpackhi_epi32(low.e0, high.e0));
+            store(out + 32, _mm_unpacklo_epi32(low.e4, high.e4));
+            store(out + 48, _mm_unpackhi_epi32(low.e4, high.e4));
+            store(out + 64, _mm_unpacklo_epi32(low.e8, high.e8));
+            store(out + 80, _mm_unpackhi_epi32(low.e8, high.e8));
+            store(out + 96, _mm_unpacklo_epi32(low.e12, high.e12));
+            store(out + 112, _mm_unpackhi_epi32(low.e12, high.e12));
+        }
+        return e;
+    }
+#   endif
+}
+
+namespace vkutils {
+    void unshuffle_bytes(const std::uint8_t* input,
+                         const std::size_t count,
+                         const std::size_t elementSize,
+                         std::uint8_t* output) {
+        std::size_t first = 0;
+#       if VKUTILS_CODEC_SSE2
+        switch (elementSize) {
+            case 2:
+                first = unshuffle_2(input, count, output);
+                break;
+            case 4:
+                first = unshuffle_4(input, count, output);
+                break;
+            case 8:
+                first = unshuffle_8(input, count, output);
+                break;
+            default:
+                break;
+        }
+#       endif
+
+        for (std::size_t b = 0; b < elementSize; ++b) {
+            const std::uint8_t* plane = input + b * count;
+            for (std::size_t e = first; e < count; ++e) {
+                output[e * elementSize + b] = plane[e];
+            }
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/*
+ * Reversible transforms applied to vertex and index streams before they are
+ * compressed with zstd, shared by the baker and the runtime loader.
+ *
+ * Neither transform changes the size of a stream; both make it easier to
+ * compress. Byte shuffling groups the n-th byte of every element, so that
+ * slowly changing high bytes form long runs. Delta coding turns the indices
+ * of a vertex cache optimised mesh into small numbers, and zigzag coding maps
+ * small negative deltas to small unsigned numbers.
+ */
+namespace vkutils {
+    // Byte b of element e is written to output[b * count + e]
+    inline void shuffle_bytes(const std::uint8_t* input,
+                              const std::size_t count,
+                              const std::size_t elementSize,
+                              std::uint8_t* output) {
+        for (std::size_t e = 0; e < count; ++e) {
+            for (std::size_t b = 0; b < elementSize; ++b) {
+                output[b * count + e] = input[e * elementSize + b];
+            }
+        }
+    }
+
+    // Inverse of shuffle_bytes(). Interleaves 16 elements at a time for 2, 4 and 8 byte elements where SSE2 is
+    // available, as the byte at a time loop took half of the time spent loading compressed meshes.
+    void unshuffle_bytes(const std::uint8_t* input,
+                         std::size_t count,
+                         std::size_t elementSize,
+                         std::uint8_t* output);
+
+    // Replaces every index by the zigzag coded difference to the previous one, starting from 0. Differences wrap
+    // around at the width of tIndex, so that every index type codes into itself.
+    template<typename tIndex>
+    void encode_index_deltas(tIndex* indices, const std::size_t count) {
+        static_assert(std::is_unsigned_v<tIndex>, "Indices must be unsigned");
+        using Signed = std::make_signed_t<tIndex>;
+        constexpr int kSignShift = sizeof(tIndex) * 8 - 1;
+
+        tIndex previous = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto delta = static_cast<Signed>(static_cast<tIndex>(indices[i] - previous));
+            previous = indices[i];
+            indices[i] = static_cast<tIndex>(static_cast<tIndex>(delta) << 1) ^
+                         static_cast<tIndex>(delta >> kSignShift);
+        }
+    }
+
+    // Inverse of encode_index_deltas()
+    template<typename tIndex>
+    void decode_index_deltas(tIndex* indices, const std::size_t count) {
+        static_assert(std::is_unsigned_v<tIndex>, "Indices must be unsigned");
+
+        tIndex previous = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            const auto delta = static_cast<tIndex>((indices[i] >> 1) ^ static_cast<tIndex>(0 - (indices[i] & 1)));
+            previous = static_cast<tIndex>(previous + delta);
+            indices[i] = previous;
+        }
+    }
+}
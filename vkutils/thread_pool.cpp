@@ -0,0 +1,58 @@
+#include "thread_pool.hpp"
+
+namespace vkutils {
+    ThreadPool::ThreadPool(const std::size_t workerCount) {
+        mWorkers.reserve(workerCount);
+        for (std::size_t w = 0; w < workerCount; ++w) {
+            mWorkers.emplace_back([this] {
+                worker_loop();
+            });
+        }
+    }
+
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard lock(mMutex);
+            mStopping = true;
+            mJobs.clear();
+        }
+        mWake.notify_all();
+
+        for (auto& worker : mWorkers) {
+            worker.join();
+        }
+    }
+
+    std::size_t ThreadPool::worker_count() const {
+        return mWorkers.size();
+    }
+
+    void ThreadPool::submit(std::function<void()> job) {
+        {
+            std::lock_guard lock(mMutex);
+            mJobs.emplace_back(std::move(job));
+        }
+        mWake.notify_one();
+    }
+
+    void ThreadPool::worker_loop() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock lock(mMutex);
+                mWake.wait(lock, [this] {
+                    return mStopping || !mJobs.empty();
+                });
+
+                if (mStopping) {
+                    return;
+                }
+
+                job = std::move(mJobs.front());
+                mJobs.pop_front();
+            }
+
+            job();
+        }
+    }
+}
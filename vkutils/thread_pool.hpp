@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vkutils {
+    /*
+     * Fixed set of worker threads running jobs in submission order, for
+     * loading work that would otherwise stall the main thread. Jobs must not
+     * throw, they report back (and report errors) through a ResultQueue.
+     *
+     * Destroying the pool waits for the running jobs and drops the queued ones.
+     */
+    class ThreadPool {
+    public:
+        explicit ThreadPool(std::size_t workerCount = std::max(std::thread::hardware_concurrency(), 1u));
+
+        ~ThreadPool();
+
+        ThreadPool(const ThreadPool&) = delete;
+
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        std::size_t worker_count() const;
+
+        void submit(std::function<void()> job);
+
+    private:
+        void worker_loop();
+
+        std::vector<std::thread> mWorkers;
+
+        std::mutex mMutex;
+        std::condition_variable mWake;
+        std::deque<std::function<void()>> mJobs;
+        bool mStopping = false;
+    };
+
+    // Results pushed by jobs in the order they complete
+    template<typename tResult>
+    class ResultQueue {
+    public:
+        void push(tResult result) {
+            {
+                std::lock_guard lock(mMutex);
+                mResults.emplace_back(std::move(result));
+            }
+            mReady.notify_one();
+        }
+
+        // Blocks until a result is available
+        tResult pop() {
+            std::unique_lock lock(mMutex);
+            mReady.wait(lock, [this] {
+                return !mResults.empty();
+            });
+
+            tResult result = std::move(mResults.front());
+            mResults.pop_front();
+            return result;
+        }
+
+        std::optional<tResult> try_pop() {
+            std::lock_guard lock(mMutex);
+            if (mResults.empty()) {
+                return std::nullopt;
+            }
+
+            tResult result = std::move(mResults.front());
+            mResults.pop_front();
+            return result;
+        }
+
+    private:
+        std::mutex mMutex;
+        std::condition_variable mReady;
+        std::deque<tResult> mResults;
+    };
+}
@@ -0,0 +1,450 @@
+#include "upload_batcher.hpp"
+
+#include <limits>
+#include <utility>
+
+#include "error.hpp"
+#include "to_string.hpp"
+#include "vkutil.hpp"
+
+namespace {
+    // Staging offsets are multiples of this, which covers the texel block sizes of every format we upload and the
+    // multiple of 4 required by vkCmdCopyBufferToImage()
+    constexpr VkDeviceSize kStagingAlignment = 16;
+
+    VkDeviceSize align_up(const VkDeviceSize offset) {
+        return (offset + kStagingAlignment - 1) / kStagingAlignment * kStagingAlignment;
+    }
+
+    std::uint8_t* mapped_data(const vkutils::Allocator& allocator, const vkutils::Buffer& buffer) {
+        VmaAllocationInfo info{};
+        vmaGetAllocationInfo(allocator.allocator, buffer.allocation, &info);
+        return static_cast<std::uint8_t*>(info.pMappedData);
+    }
+}
+
+namespace vkutils {
+    UploadBatcher::UploadBatcher(const VulkanContext& context,
+                                 const Allocator& allocator,
+                                 const VkDeviceSize ringSize)
+        : mContext(context),
+          mAllocator(allocator),
+          mCommandPool(create_command_pool(context,
+                                           VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                                           VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT)),
+          mRing(create_buffer(allocator, ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                              VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                              VMA_ALLOCATION_CREATE_MAPPED_BIT)),
+          mRingData(mapped_data(allocator, mRing)),
+          mRingSize(ringSize) {
+    }
+
+    UploadBatcher::~UploadBatcher() {
+        // Staging memory must outlive the copies reading it. Errors can't be reported from here.
+        for (const auto& batch : mInFlight) {
+            vkWaitForFences(mContext.device, 1, &batch.fence.handle, VK_TRUE,
+                            std::numeric_limits<std::uint64_t>::max());
+        }
+    }
+
+    std::span<std::uint8_t> UploadBatcher::stage_buffer(const VkBuffer dstBuffer,
+                                                        const VkDeviceSize dstOffset,
+                                                        const VkDeviceSize size,
+                                                        const VkAccessFlags dstAccess,
+                                                        const VkPipelineStageFlags dstStage) {
+        if (0 == size) {
+            return {};
+        }
+
+        const Staging staging = allocate(size);
+        const VkCommandBuffer commandBuffer = recording().commandBuffer;
+
+        const VkBufferCopy copy{
+            .srcOffset = staging.offset,
+            .dstOffset = dstOffset,
+            .size = size
+        };
+        vkCmdCopyBuffer(commandBuffer, staging.buffer, dstBuffer, 1, &copy);
+
+        buffer_barrier(commandBuffer, dstBuffer,
+                       VK_ACCESS_TRANSFER_WRITE_BIT,
+                       dstAccess,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       dstStage,
+                       size,
+                       dstOffset
+        );
+
+        return staging.bytes;
+    }
+
+    std::span<std::uint8_t> UploadBatcher::stage_image(const VkImage image,
+                                                       const VkDeviceSize size,
+                                                       const std::span<const VkBufferImageCopy> regions,
+                                                       const VkImageSubresourceRange& range) {
+        const Staging staging = allocate(size);
+        const VkCommandBuffer commandBuffer = recording().commandBuffer;
+
+        image_barrier(commandBuffer, image,
+                      0,
+                      VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_IMAGE_LAYOUT_UNDEFINED,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      range
+        );
+
+        std::vector<VkBufferImageCopy> copies(regions.begin(), regions.end());
+        for (auto& copy : copies) {
+            copy.bufferOffset += staging.offset;
+        }
+
+        vkCmdCopyBufferToImage(commandBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               static_cast<std::uint32_t>(copies.size()), copies.data());
+
+        image_barrier(commandBuffer, image,
+                      VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_ACCESS_SHADER_READ_BIT,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                      range
+        );
+
+        return staging.bytes;
+    }
+
+    std::span<std::uint8_t> UploadBatcher::stage_image_generating_mips(const VkImage image,
+                                                                       const std::uint32_t width,
+                                                                       const std::uint32_t height,
+                                                                       const std::uint32_t mipLevels,
+                                                                       const std::uint32_t layers,
+                                                                       const VkDeviceSize layerSize) {
+        const Staging staging = allocate(layerSize * layers);
+        const VkCommandBuffer commandBuffer = recording().commandBuffer;
+
+        // Transition whole image layout
+        // When copying data to the image, the image’s layout must be TRANSFER DST OPTIMAL. The current
+        // image layout is UNDEFINED (which is the initial layout the image was created in).
+        image_barrier(commandBuffer, image,
+                      0,
+                      VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_IMAGE_LAYOUT_UNDEFINED,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VkImageSubresourceRange{
+                          VK_IMAGE_ASPECT_COLOR_BIT,
+                          0, mipLevels,
+                          0, layers
+                      }
+        );
+
+        // Upload the base level of every layer
+        std::vector<VkBufferImageCopy> copies;
+        copies.reserve(layers);
+        for (std::uint32_t layer = 0; layer < layers; ++layer) {
+            copies.emplace_back(VkBufferImageCopy{
+                .bufferOffset = staging.offset + layer * layerSize,
+                .bufferRowLength = 0,
+                .bufferImageHeight = 0,
+                .imageSubresource = VkImageSubresourceLayers{
+                    VK_IMAGE_ASPECT_COLOR_BIT,
+                    0, layer, 1
+                },
+                .imageOffset = VkOffset3D{0, 0, 0},
+                .imageExtent = VkExtent3D{
+                    .width = width,
+                    .height = height,
+                    .depth = 1
+                }
+            });
+        }
+
+        vkCmdCopyBufferToImage(commandBuffer, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               static_cast<std::uint32_t>(copies.size()), copies.data());
+
+        // Transition base level to TRANSFER SRC OPTIMAL
+        image_barrier(commandBuffer, image,
+                      VK_ACCESS_TRANSFER_WRITE_BIT,
+                      VK_ACCESS_TRANSFER_READ_BIT,
+                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VkImageSubresourceRange{
+                          VK_IMAGE_ASPECT_COLOR_BIT,
+                          0, 1,
+                          0, layers
+                      }
+        );
+
+        // Process all mipmap levels, for all layers at once
+        std::uint32_t mipWidth = width, mipHeight = height;
+        for (std::uint32_t level = 1; level < mipLevels; ++level) {
+            // Blit previous mipmap level (=level-1) to the current level. Note that the loop starts at level = 1.
+            // Level = 0 is the base level that we initialied before the loop.
+            VkImageBlit blit{};
+            blit.srcSubresource = VkImageSubresourceLayers{
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                level - 1,
+                0, layers
+            };
+            blit.srcOffsets[0] = {0, 0, 0};
+            blit.srcOffsets[1] = {static_cast<std::int32_t>(mipWidth), static_cast<std::int32_t>(mipHeight), 1};
+
+            // Next mip level
+            mipWidth = mipWidth > 1 ? mipWidth >> 1 : 1;
+            mipHeight = mipHeight > 1 ? mipHeight >> 1 : 1;
+
+            blit.dstSubresource = VkImageSubresourceLayers{
+                VK_IMAGE_ASPECT_COLOR_BIT,
+                level,
+                0, layers
+            };
+            blit.dstOffsets[0] = {0, 0, 0};
+            blit.dstOffsets[1] = {static_cast<std::int32_t>(mipWidth), static_cast<std::int32_t>(mipHeight), 1};
+
+            vkCmdBlitImage(commandBuffer,
+                           image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                           image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           1, &blit,
+                           VK_FILTER_LINEAR
+            );
+
+            // Transition mip level to TRANSFER SRC OPTIMAL for the next iteration. (Technically this is
+            // unnecessary for the last mip level, but transitioning it as well simplifes the final barrier following the
+            // loop).
+            image_barrier(commandBuffer, image,
+                          VK_ACCESS_TRANSFER_WRITE_BIT,
+                          VK_ACCESS_TRANSFER_READ_BIT,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT,
+                          VK_PIPELINE_STAGE_TRANSFER_BIT,
+                          VkImageSubresourceRange{
+                              VK_IMAGE_ASPECT_COLOR_BIT,
+                              level, 1,
+                              0, layers
+                          }
+            );
+        }
+
+        // Whole image is currently in the TRANSFER SRC OPTIMAL layout. To use the image as a texture from
+        // which we sample, it must be in the SHADER READ ONLY OPTIMAL layout.
+        image_barrier(commandBuffer, image,
+                      VK_ACCESS_TRANSFER_READ_BIT,
+                      VK_ACCESS_SHADER_READ_BIT,
+                      VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                      VK_PIPELINE_STAGE_TRANSFER_BIT,
+                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                      VkImageSubresourceRange{
+                          VK_IMAGE_ASPECT_COLOR_BIT,
+                          0, mipLevels,
+                          0, layers
+                      }
+        );
+
+        return staging.bytes;
+    }
+
+    void UploadBatcher::flush() {
+        submit();
+    }
+
+    void UploadBatcher::finish() {
+        submit();
+        while (!mInFlight.empty()) {
+            wait_oldest();
+        }
+    }
+
+    UploadBatcher::Staging UploadBatcher::allocate(const VkDeviceSize size) {
+        // Let the GPU start on large batches while the next one is recorded. The previous call's bytes are written.
+        if (mRecording && mRecording->stagedBytes >= mRingSize / 4) {
+            submit();
+        }
+
+        if (size > mRingSize) {
+            Buffer dedicated = create_buffer(mAllocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                             VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT |
+                                             VMA_ALLOCATION_CREATE_MAPPED_BIT);
+            const Staging staging{
+                .buffer = dedicated.buffer,
+                .offset = 0,
+                .bytes = {mapped_data(mAllocator, dedicated), static_cast<std::size_t>(size)}
+            };
+
+            Batch& batch = recording();
+            batch.dedicatedStaging.emplace_back(std::move(dedicated));
+            batch.stagedBytes += size;
+            return staging;
+        }
+
+        // Make room by submitting what is recorded, then by waiting for the oldest batches
+        std::optional<VkDeviceSize> offset = find_ring_space(size);
+        while (!offset) {
+            if (mRecording && mRecording->usesRing) {
+                submit();
+            } else {
+                wait_oldest();
+            }
+            offset = find_ring_space(size);
+        }
+
+        // Starting the batch may retire others, which only frees more of the ring
+        Batch& batch = recording();
+        if (!batch.usesRing) {
+            if (0 == mRingBatches) {
+                mTail = 0;
+            }
+            batch.usesRing = true;
+            ++mRingBatches;
+        }
+
+        mHead = *offset + size;
+        batch.ringEnd = mHead;
+        batch.stagedBytes += size;
+
+        return Staging{
+            .buffer = mRing.buffer,
+            .offset = *offset,
+            .bytes = {mRingData + *offset, static_cast<std::size_t>(size)}
+        };
+    }
+
+    std::optional<VkDeviceSize> UploadBatcher::find_ring_space(const VkDeviceSize size) const {
+        // Nothing staged is alive, the whole ring is free
+        if (0 == mRingBatches) {
+            return 0;
+        }
+
+        // Free are [mHead, mRingSize) and [0, mTail) when not wrapped around, otherwise [mHead, mTail). mHead never
+        // catches up with mTail, so that mHead == mTail only when the ring is empty.
+        const VkDeviceSize offset = align_up(mHead);
+        if (mHead >= mTail) {
+            if (offset + size <= mRingSize) {
+                return offset;
+            }
+            if (size < mTail) {
+                return 0;
+            }
+        } else if (offset + size < mTail) {
+            return offset;
+        }
+
+        return std::nullopt;
+    }
+
+    UploadBatcher::Batch& UploadBatcher::recording() {
+        if (mRecording) {
+            return *mRecording;
+        }
+
+        // Fences are only checked here, completed batches are recycled
+        retire_completed();
+
+        if (mIdle.empty()) {
+            mRecording.emplace();
+            mRecording->commandBuffer = alloc_command_buffer(mContext, mCommandPool.handle);
+            mRecording->fence = create_fence(mContext);
+        } else {
+            mRecording.emplace(std::move(mIdle.back()));
+            mIdle.pop_back();
+        }
+
+        constexpr VkCommandBufferBeginInfo beginInfo{
+            .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+            .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+            .pInheritanceInfo = nullptr
+        };
+
+        if (const auto res = vkBeginCommandBuffer(mRecording->commandBuffer, &beginInfo);
+            VK_SUCCESS != res) {
+            throw Error("Beginning command buffer recording\n"
+                        "vkBeginCommandBuffer() returned %s", to_string(res).c_str()
+            );
+        }
+
+        return *mRecording;
+    }
+
+    void UploadBatcher::submit() {
+        if (!mRecording) {
+            return;
+        }
+
+        if (const auto res = vkEndCommandBuffer(mRecording->commandBuffer); VK_SUCCESS != res) {
+            throw Error("Ending command buffer recording\n"
+                        "vkEndCommandBuffer() returned %s", to_string(res).c_str()
+            );
+        }
+
+        // Staging memory isn't necessarily host coherent
+        if (mRecording->usesRing) {
+            vmaFlushAllocation(mAllocator.allocator, mRing.allocation, 0, VK_WHOLE_SIZE);
+        }
+        for (const auto& staging : mRecording->dedicatedStaging) {
+            vmaFlushAllocation(mAllocator.allocator, staging.allocation, 0, VK_WHOLE_SIZE);
+        }
+
+        const VkSubmitInfo submitInfo{
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &mRecording->commandBuffer
+        };
+
+        if (const auto res = vkQueueSubmit(mContext.graphicsQueue, 1, &submitInfo, mRecording->fence.handle);
+            VK_SUCCESS != res) {
+            throw Error("Submitting commands\n"
+                        "vkQueueSubmit() returned %s", to_string(res).c_str()
+            );
+        }
+
+        mInFlight.emplace_back(std::move(*mRecording));
+        mRecording.reset();
+    }
+
+    void UploadBatcher::retire_completed() {
+        while (!mInFlight.empty() && VK_SUCCESS == vkGetFenceStatus(mContext.device, mInFlight.front().fence.handle)) {
+            retire(std::move(mInFlight.front()));
+            mInFlight.pop_front();
+        }
+    }
+
+    void UploadBatcher::wait_oldest() {
+        if (const auto res = vkWaitForFences(mContext.device, 1, &mInFlight.front().fence.handle, VK_TRUE,
+                                             std::numeric_limits<std::uint64_t>::max());
+            VK_SUCCESS != res) {
+            throw Error("Waiting for upload to complete\n"
+                        "vkWaitForFences() returned %s", to_string(res).c_str()
+            );
+        }
+
+        retire(std::move(mInFlight.front()));
+        mInFlight.pop_front();
+    }
+
+    void UploadBatcher::retire(Batch&& batch) {
+        // Batches complete in submission order, so the ring is free up to the end of this one
+        if (batch.usesRing) {
+            mTail = batch.ringEnd;
+            --mRingBatches;
+        }
+
+        if (const auto res = vkResetFences(mContext.device, 1, &batch.fence.handle); VK_SUCCESS != res) {
+            throw Error("Unable to reset fence\n"
+                        "vkResetFences() returned %s", to_string(res).c_str()
+            );
+        }
+
+        batch.dedicatedStaging.clear();
+        batch.stagedBytes = 0;
+        batch.ringEnd = 0;
+        batch.usesRing = false;
+        mIdle.emplace_back(std::move(batch));
+    }
+}
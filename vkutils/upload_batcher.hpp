@@ -0,0 +1,138 @@
+#pragma once
+
+#include <deque>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <volk/volk.h>
+
+#include "allocator.hpp"
+#include "vkbuffer.hpp"
+#include "vkobject.hpp"
+#include "vulkan_context.hpp"
+
+namespace vkutils {
+    /*
+     * Records uploads to buffers and images into a few large command buffers
+     * and submits them to the graphics queue without waiting on them.
+     *
+     * Uploads are staged in a persistently mapped ring buffer. A batch is
+     * submitted once it has staged a quarter of the ring, or when the ring
+     * runs out of space. Fences are only checked when a new batch starts or
+     * when space is needed. The CPU waits only when the ring is full, or in
+     * finish(). Uploads larger than the ring get their own staging buffer,
+     * which is released with its batch.
+     *
+     * Each stage_*() call records the copy and returns its staging bytes.
+     * Write them before the next call into the batcher, which may submit
+     * them. The destination buffers and images must stay alive until
+     * finish() returns.
+     */
+    class UploadBatcher {
+    public:
+        static constexpr VkDeviceSize kDefaultRingSize = 32 * 1024 * 1024;
+
+        UploadBatcher(const VulkanContext&, const Allocator&, VkDeviceSize ringSize = kDefaultRingSize);
+
+        // Waits for the submitted uploads, unsubmitted ones are dropped
+        ~UploadBatcher();
+
+        UploadBatcher(const UploadBatcher&) = delete;
+
+        UploadBatcher& operator=(const UploadBatcher&) = delete;
+
+        // Copies size bytes to dstBuffer at dstOffset, then makes them available to dstAccess in dstStage
+        std::span<std::uint8_t> stage_buffer(VkBuffer dstBuffer,
+                                             VkDeviceSize dstOffset,
+                                             VkDeviceSize size,
+                                             VkAccessFlags dstAccess,
+                                             VkPipelineStageFlags dstStage);
+
+        /*
+         * Copies size bytes into the image as described by regions, whose
+         * bufferOffset is relative to the returned bytes. Then transitions
+         * the whole range to SHADER_READ_ONLY_OPTIMAL for the fragment shader.
+         */
+        std::span<std::uint8_t> stage_image(VkImage image,
+                                            VkDeviceSize size,
+                                            std::span<const VkBufferImageCopy> regions,
+                                            const VkImageSubresourceRange& range);
+
+        /*
+         * Copies the base level of each layer, layerSize bytes each and one
+         * after the other. Then generates the other levels by blitting and
+         * transitions the image to SHADER_READ_ONLY_OPTIMAL for the fragment
+         * shader. The image needs TRANSFER_SRC usage.
+         */
+        std::span<std::uint8_t> stage_image_generating_mips(VkImage image,
+                                                            std::uint32_t width,
+                                                            std::uint32_t height,
+                                                            std::uint32_t mipLevels,
+                                                            std::uint32_t layers,
+                                                            VkDeviceSize layerSize);
+
+        // Submits the recorded uploads without waiting for them
+        void flush();
+
+        // Submits the recorded uploads and waits for all of them to complete
+        void finish();
+
+    private:
+        struct Staging {
+            VkBuffer buffer;
+            VkDeviceSize offset;
+            std::span<std::uint8_t> bytes;
+        };
+
+        struct Batch {
+            VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+            Fence fence;
+
+            // Bytes staged by the batch, and the end of its staging memory in the ring
+            VkDeviceSize stagedBytes = 0;
+            VkDeviceSize ringEnd = 0;
+            bool usesRing = false;
+
+            // Staging buffers of uploads that do not fit into the ring
+            std::vector<Buffer> dedicatedStaging;
+        };
+
+        Staging allocate(VkDeviceSize size);
+
+        std::optional<VkDeviceSize> find_ring_space(VkDeviceSize size) const;
+
+        Batch& recording();
+
+        void submit();
+
+        void retire_completed();
+
+        void wait_oldest();
+
+        void retire(Batch&& batch);
+
+        const VulkanContext& mContext;
+        const Allocator& mAllocator;
+
+        CommandPool mCommandPool;
+
+        Buffer mRing;
+        std::uint8_t* mRingData = nullptr;
+        VkDeviceSize mRingSize = 0;
+
+        // Staged bytes of live batches go from mTail to mHead, wrapping around the end of the ring
+        VkDeviceSize mHead = 0;
+        VkDeviceSize mTail = 0;
+        std::size_t mRingBatches = 0;
+
+        std::optional<Batch> mRecording;
+        // Oldest first
+        std::deque<Batch> mInFlight;
+        // Completed, to be reused
+        std::vector<Batch> mIdle;
+    };
+}
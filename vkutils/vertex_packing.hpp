@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+
+#include <cmath>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+/*
+ * Vertex attribute packing shared by the baker and the runtime loader. The
+ * packed values are decoded by the vertex input stage (UNORM, SNORM and SFLOAT
+ * formats) and ssr/shaders/vertex.glsl.
+ */
+namespace vkutils {
+    // Maps [0, 1] to VK_FORMAT_R16_UNORM
+    inline std::uint16_t pack_unorm16(const float value) {
+        return static_cast<std::uint16_t>(std::lround(std::clamp(value, 0.f, 1.f) * 65535.f));
+    }
+
+    // Maps [-1, 1] to VK_FORMAT_R16_SNORM
+    inline std::int16_t pack_snorm16(const float value) {
+        return static_cast<std::int16_t>(std::lround(std::clamp(value, -1.f, 1.f) * 32767.f));
+    }
+
+    // Maps a float to VK_FORMAT_R16_SFLOAT
+    inline std::uint16_t pack_half(const float value) {
+        return glm::packHalf1x16(value);
+    }
+
+    /*
+     * Octahedral encoding of a unit vector into two SNORM16 values: the vector
+     * is projected onto the octahedron |x| + |y| + |z| = 1, whose lower half is
+     * then folded over the upper one. See Cigolle et al. 2014, "A Survey of
+     * Efficient Representations for Independent Unit Vectors".
+     */
+    inline glm::i16vec2 pack_octahedral(const glm::vec3& direction) {
+        const float l1 = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+        if (l1 <= 0.f) {
+            // Degenerate vector, decodes to +Z
+            return {0, 0};
+        }
+
+        glm::vec2 octahedral = glm::vec2(direction) / l1;
+        if (direction.z < 0.f) {
+            const glm::vec2 sign(octahedral.x >= 0.f ? 1.f : -1.f, octahedral.y >= 0.f ? 1.f : -1.f);
+            octahedral = (1.f - glm::abs(glm::vec2(octahedral.y, octahedral.x))) * sign;
+        }
+
+        return {pack_snorm16(octahedral.x), pack_snorm16(octahedral.y)};
+    }
+}
@@ -25,6 +25,9 @@ static constexpr bool enableFramebufferReadback = true;
 #endif
 
 namespace {
+    // The graphics queue also records compute dispatches
+    constexpr VkQueueFlags kGraphicsQueueFlags = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT;
+
     // The device selection process has changed somewhat w.r.t. the one used
     // earlier (e.g., with VulkanContext).
     VkPhysicalDevice select_device(VkInstance, VkSurfaceKHR);
@@ -264,7 +267,7 @@ namespace vkutils {
         // We need a graphics queue and a queue that can present
         std::vector<std::uint32_t> queueFamilyIndices;
 
-        if (const auto index = find_queue_family(vulkanWindow.physicalDevice, VK_QUEUE_GRAPHICS_BIT,
+        if (const auto index = find_queue_family(vulkanWindow.physicalDevice, kGraphicsQueueFlags,
                                                  vulkanWindow.surface)) {
             // best case: one GRAPHICS queue that can present
             vulkanWindow.graphicsFamilyIndex = *index;
@@ -272,7 +275,7 @@ namespace vkutils {
             queueFamilyIndices.emplace_back(*index);
         } else {
             // otherwise: one GRAPHICS queue and any queue that can present
-            const auto graphics = find_queue_family(vulkanWindow.physicalDevice, VK_QUEUE_GRAPHICS_BIT);
+            const auto graphics = find_queue_family(vulkanWindow.physicalDevice, kGraphicsQueueFlags);
             const auto present = find_queue_family(vulkanWindow.physicalDevice, 0, vulkanWindow.surface);
 
             assert(graphics && present);
@@ -620,8 +623,13 @@ namespace {
             queueInfo.pQueuePriorities = queuePriorities;
         }
 
+        // Material textures are baked into BC4, BC5 and BC7 formats, meshes are drawn with one indirect draw per
+        // meshlet and instance
         constexpr VkPhysicalDeviceFeatures deviceFeatures{
-            .samplerAnisotropy = VK_TRUE
+            .multiDrawIndirect = VK_TRUE,
+            .drawIndirectFirstInstance = VK_TRUE,
+            .samplerAnisotropy = VK_TRUE,
+            .textureCompressionBC = VK_TRUE
         };
 
         VkPhysicalDeviceHostQueryResetFeatures hostQueryResetFeatures{
@@ -684,12 +692,32 @@ namespace {
             return -1.0f;
         }
 
-        // Also ensure there is a queue family that supports graphics commands
-        if (!find_queue_family(physicalDevice, VK_QUEUE_GRAPHICS_BIT)) {
+        // Also ensure there is a queue family that supports graphics (and compute) commands
+        if (!find_queue_family(physicalDevice, kGraphicsQueueFlags)) {
             std::fprintf(stderr, "Info: Discarding device ’%s’: no graphics queue family\n", props.deviceName);
             return -1.0f;
         }
 
+        // Baked material textures are block compressed
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physicalDevice, &features);
+        if (!features.textureCompressionBC) {
+            std::fprintf(stderr, "Info: Discarding device ’%s’: no BC texture compression\n", props.deviceName);
+            return -1.0f;
+        }
+
+        // Meshes are drawn with indirect draws, see cluster::draw_mesh()
+        if (!features.multiDrawIndirect) {
+            std::fprintf(stderr, "Info: Discarding device ’%s’: no multi draw indirect\n", props.deviceName);
+            return -1.0f;
+        }
+
+        // Indirect draws select their instance transform with firstInstance
+        if (!features.drawIndirectFirstInstance) {
+            std::fprintf(stderr, "Info: Discarding device ’%s’: no indirect first instance\n", props.deviceName);
+            return -1.0f;
+        }
+
         // Discrete GPU > Integrated GPU > others
         float score = 0.f;
 